@@ -262,6 +262,17 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to a SyncedMemory of at least
+   *        count() elements, which may also hold the data of other Blob%s
+   *        while this one is unused.
+   *
+   * Reshaping the Blob beyond its current capacity allocates its own memory
+   * again.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& memory);
+  /// @brief As ShareDataMemory, for the diff_.
+  void ShareDiffMemory(const shared_ptr<SyncedMemory>& memory);
 
   bool ShapeEquals(const BlobProto& other);
 
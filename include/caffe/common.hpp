@@ -97,6 +97,8 @@ using std::vector;
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
 
+class WorkerPool;
+
 // A singleton class to hold common caffe stuff, such as the handler that
 // caffe is going to use for cublas, curand, etc.
 class Caffe {
@@ -163,6 +165,17 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // Threads shared by the CPU layers that split their work, one pool per
+  // Caffe thread, created on first use with cpu_threads() workers (the calling
+  // thread being one of them). Creating it leaves the random stream untouched.
+  static WorkerPool& cpu_pool();
+  // The number of workers of cpu_pool(), for all threads; 1 by default, so
+  // the layers run on the calling thread only, and 0 for one per hardware
+  // thread. The pools of the threads follow a change at their next use.
+  static int cpu_threads();
+  // The value last given to set_cpu_threads(), 0 included.
+  static int cpu_threads_setting();
+  static void set_cpu_threads(int val);
 
  protected:
 #ifndef CPU_ONLY
@@ -170,6 +183,7 @@ class Caffe {
   curandGenerator_t curand_generator_;
 #endif
   shared_ptr<RNG> random_generator_;
+  shared_ptr<WorkerPool> cpu_pool_;
 
   Brew mode_;
   int solver_count_;
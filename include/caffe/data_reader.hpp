@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_READER_HPP_
 #define CAFFE_DATA_READER_HPP_
 
+#include <boost/thread/mutex.hpp>
 #include <map>
 #include <string>
 #include <vector>
@@ -8,6 +9,7 @@
 #include "caffe/common.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/data_profile.hpp"
 #include "caffe/util/db.hpp"
 
 namespace caffe {
@@ -19,6 +21,11 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ * With DataParameter.reader_threads > 1, the body reads the source through
+ * that many shards, each on its own thread and cursor over a contiguous range
+ * of the records, and takes them in turn.
+ * With DataParameter.shuffle, records are instead looked up by key in a new
+ * random order every epoch.
  */
 template <typename T>
 class DataReader {
@@ -46,6 +53,36 @@ class DataReader {
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
 
+  // Reads the count records from start_key over and over, into its own pool
+  // of messages.
+  class Shard : public InternalThread {
+   public:
+    Shard(const shared_ptr<db::Cursor>& cursor, const string& start_key,
+        int count, int pool_size, bool profile);
+    virtual ~Shard();
+
+    // Adds the time the shard spent in each stage since the last call to
+    // total, if it is profiled.
+    void TakeProfile(DataProfile* total);
+
+    BlockingQueue<T*> free_;
+    BlockingQueue<T*> full_;
+
+   protected:
+    void InternalThreadEntry();
+
+    shared_ptr<db::Cursor> cursor_;
+    const string start_key_;
+    const int count_;
+    // Filled by the shard thread, and moved to reported_ after each record
+    // for the body to take.
+    shared_ptr<DataProfile> profile_;
+    DataProfile reported_;
+    boost::mutex reported_mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(Shard);
+  };
+
   // A single body is created per source
   class Body : public InternalThread {
    public:
@@ -55,9 +92,24 @@ class DataReader {
    protected:
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Draws the order of the next epoch, and hints the first records.
+    void ShuffleEpoch();
+    // Logs the time spent reading and parsing, by the body and its shards.
+    void LogProfile();
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
+    // Empty unless reading with several threads.
+    vector<shared_ptr<Shard> > shards_;
+    int next_shard_;
+    // Only set when reading in shuffled order.
+    shared_ptr<db::RandomReader> random_reader_;
+    shared_ptr<Caffe::RNG> rng_;
+    vector<int> order_;
+    int order_pos_;
+    // Time spent reading and parsing, if DataParameter.prefetch_stats_interval
+    // is set.
+    shared_ptr<DataProfile> profile_;
 
     friend class DataReader;
 
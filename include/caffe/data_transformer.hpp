@@ -8,6 +8,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/data_profile.hpp"
 #ifdef USE_OPENCV
 #include <opencv2/opencv.hpp>
 #endif
@@ -15,6 +16,9 @@ using google::protobuf::RepeatedPtrField;
 
 namespace caffe {
 
+    class ImageCache;
+    struct AnnotationBox;
+
     /**
      * @brief Applies common transformations to the input data, such as
      * scaling, mirroring, substracting the image mean...
@@ -31,6 +35,25 @@ namespace caffe {
      */
     void InitRand();
 
+    /**
+     * @brief Looks the decoded images of source records up in cache, which
+     *    may be shared by several transformers. The transformer does not own
+     *    it. NULL disables caching.
+     */
+    void set_image_cache(ImageCache* cache) { image_cache_ = cache; }
+    /**
+     * @brief Marks datum as the record read from the source for the next
+     *    item, the only datum whose decoded image goes through the cache.
+     *    Intermediate datums (distorted, expanded...) are decoded as usual.
+     */
+    void set_source_datum(const Datum* datum) { source_datum_ = datum; }
+    /**
+     * @brief Charges the decode, distort and resize stages to profile, owned
+     *    by the caller and only touched from the thread using this
+     *    transformer. NULL disables profiling.
+     */
+    void set_profile(DataProfile* profile) { profile_ = profile; }
+
     /**
      * @brief Applies the transformation defined in the data layer's
      * transform_param block to the data.
@@ -82,6 +105,10 @@ namespace caffe {
     void Transform(const AnnotatedDatum& anno_datum,
                     Blob<Dtype>* transformed_blob,
                     vector<AnnotationGroup>* transformed_anno_vec);
+    // The same, with the annotations as AnnotationBox (see bbox_util.hpp).
+    void Transform(const AnnotatedDatum& anno_datum,
+                    Blob<Dtype>* transformed_blob,
+                    vector<AnnotationBox>* transformed_boxes);
     
     /**
      * @brief Transform the annotation according to the transformation applied
@@ -102,6 +129,10 @@ namespace caffe {
         const AnnotatedDatum& anno_datum, const bool do_resize,
         const NormalizedBBox& crop_bbox, const bool do_mirror,
         RepeatedPtrField<AnnotationGroup>* transformed_anno_group_all);
+    void TransformAnnotation(
+        const AnnotatedDatum& anno_datum, const bool do_resize,
+        const NormalizedBBox& crop_bbox, const bool do_mirror,
+        vector<AnnotationBox>* transformed_boxes);
 
     /**
      * @brief Crops the datum according to bbox.
@@ -293,6 +324,13 @@ namespace caffe {
      */
     virtual int Rand(int n);
 
+    // Appends the transformed annotations of one group of an image of
+    // img_height x img_width, see TransformAnnotation.
+    void TransformAnnotationGroup(const AnnotationGroup& anno_group,
+        const int img_height, const int img_width, const bool do_resize,
+        const NormalizedBBox& crop_bbox, const bool do_mirror,
+        vector<AnnotationBox>* transformed_boxes);
+
     // Transform and return the transformation information.
     void Transform(const Datum& datum, Dtype* transformed_data,
                     NormalizedBBox* crop_bbox, bool* do_mirror);
@@ -305,6 +343,18 @@ namespace caffe {
     void Transform(const Datum& datum, Blob<Dtype>* transformed_blob,
                     NormalizedBBox* crop_bbox, bool* do_mirror);
 
+    #ifdef USE_OPENCV
+    // Decodes an encoded datum, through the image cache if it is the source
+    // datum. With reduced_decode, a JPEG may be decoded reduced, but no
+    // smaller than the resize target.
+    cv::Mat DecodeImage(const Datum& datum);
+    // Gets the size a reduced decode of datum must not go below, which is
+    // the size its content is resized to under resize_param. Returns false
+    // when reduced_decode is off or the size cannot be computed.
+    bool ReducedDecodeSize(const Datum& datum, int* min_height,
+                           int* min_width) const;
+    #endif  // USE_OPENCV
+
     // Tranformation parameters
     TransformationParameter param_;
 
@@ -313,6 +363,9 @@ namespace caffe {
     Phase phase_;
     Blob<Dtype> data_mean_;
     vector<Dtype> mean_values_;
+    ImageCache* image_cache_;
+    const Datum* source_datum_;
+    DataProfile* profile_;
     };
 
 }  // namespace caffe
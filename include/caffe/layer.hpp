@@ -10,6 +10,7 @@
 #include "caffe/layer_factory.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/workspace.hpp"
 
 /**
  Forward declare boost::thread instead of including boost/thread.hpp
@@ -116,6 +117,21 @@ class Layer {
     is_shared_ = is_shared;
   }
 
+  /**
+   * @brief Returns the bytes of scratch memory the layer needs during its
+   *        Forward and Backward calls at its current shapes, which it takes
+   *        from the workspace given to set_workspace() if any.
+   */
+  virtual inline size_t WorkspaceSize() const { return 0; }
+
+  /**
+   * @brief Sets the scratch memory shared with the other layers of a Net.
+   *        The layer must not run at the same time as these other layers.
+   */
+  inline void set_workspace(const shared_ptr<Workspace>& workspace) {
+    workspace_ = workspace;
+  }
+
   /**
    * @brief Adjust the shapes of top blobs and internal buffers to accommodate
    *        the shapes of the bottom blobs.
@@ -294,6 +310,16 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Returns whether the layer may make its top blobs share the data or
+   *        diff memory of its bottom blobs, or the reverse, while it runs.
+   *
+   * Layers that pass blobs through by reference, like Split or Flatten,
+   * return true, so that Net plans the memory of their tops and bottoms to
+   * live as long as any of them is in use.
+   */
+  virtual inline bool SharesBottomMemory() const { return false; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -326,6 +352,8 @@ class Layer {
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   /** Vector indicating whether to compute the diff of each param blob. */
   vector<bool> param_propagate_down_;
+  /** The scratch memory shared with the other layers of the Net, if any. */
+  shared_ptr<Workspace> workspace_;
 
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
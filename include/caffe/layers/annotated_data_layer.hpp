@@ -30,9 +30,13 @@ public:
 
 protected:
     virtual void load_batch(Batch<Dtype>* batch);
-    void fill_label(Dtype* top_label, int batch_size, 
-                std::map<int, vector<AnnotationGroup> > all_anno, 
-                int num_bboxes, 
+    void transform_item(Batch<Dtype>* batch,
+                const vector<AnnotatedDatum*>* anno_datums, Dtype* top_data,
+                Dtype* top_label, vector<vector<AnnotationBox> >* transformed_annos,
+                int item_id, int worker_id);
+    void fill_label(Dtype* top_label, int batch_size,
+                const vector<vector<AnnotationBox> >& all_anno,
+                int num_bboxes,
                 int label_last_channels);
 
     DataReader<AnnotatedDatum> reader_;
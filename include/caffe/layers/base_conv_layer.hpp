@@ -1,6 +1,7 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -27,19 +28,34 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
+  // The column buffers of the cpu workers, one per item of the batch up to
+  // Caffe::cpu_threads(), or the one of the gpu passes.
+  virtual inline size_t WorkspaceSize() const {
+    return col_buffers_size(Caffe::mode() == Caffe::CPU ?
+        std::min(Caffe::cpu_threads(), num_) : 1);
+  }
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
-  // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // The skip_im2col argument in forward_cpu_gemm is so that we can skip the
+  // im2col if we just called weight_cpu_gemm with the same input. Each
+  // Forward_cpu or Backward_cpu must call set_cpu_workers() before the cpu
+  // helpers; up to that many threads may then call them at once, each passing
+  // its worker id to use its own column buffer.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false, int worker = 0);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, int worker = 0);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, int worker = 0);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  void set_cpu_workers(int num_workers);
+  // The bytes of the column buffers of num_workers, which 1x1 convolutions do
+  // without.
+  inline size_t col_buffers_size(int num_workers) const {
+    return is_1x1_ ? 0 : num_workers * col_buffer_.count() * sizeof(Dtype);
+  }
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -165,7 +181,16 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int col_offset_;
   int output_offset_;
 
+  inline Dtype* col_buffer_cpu(int worker) { return col_buffers_cpu_[worker]; }
+#ifndef CPU_ONLY
+  Dtype* col_buffer_gpu();
+#endif
+
+  // The column buffers are taken from the workspace of the net, if any, or
+  // else from col_buffer_ and worker_col_buffers_ (for workers 1 and up).
   Blob<Dtype> col_buffer_;
+  vector<shared_ptr<Blob<Dtype> > > worker_col_buffers_;
+  vector<Dtype*> col_buffers_cpu_;
   Blob<Dtype> bias_multiplier_;
 };
 
@@ -9,6 +9,9 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/data_profile.hpp"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
@@ -40,9 +43,41 @@ class BaseDataLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
 
  protected:
+  // Creates transform_pool_ and one DataTransformer per worker, according to
+  // transform_param_.num_threads(), sharing image_cache_ if enabled. Called by
+  // the prefetching layers.
+  void InitTransformPool();
+  // Logs the hit rate of image_cache_, if any.
+  void LogImageCacheStats() const;
+  // Logs where the time of the last num_batches batches went, stage by stage,
+  // and starts over. batch_ms: their total production time.
+  void LogProfile(int num_batches, double batch_ms);
+  inline DataTransformer<Dtype>* transformer(int worker_id) {
+    return transformers_[worker_id].get();
+  }
+  // The profile of a transform worker, NULL if profiling is disabled. Worker
+  // 0 is the prefetch thread, which also charges its own stages to it.
+  inline DataProfile* profile(int worker_id) {
+    return profiles_.empty() ? NULL : profiles_[worker_id].get();
+  }
+
   TransformationParameter transform_param_;
   shared_ptr<DataTransformer<Dtype> > data_transformer_;
   bool output_labels_;
+  // Transforms the items of a batch in parallel; transformers_[0] is
+  // data_transformer_, the others have their own random generator.
+  shared_ptr<WorkerPool> transform_pool_;
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  // One per transform worker, if DataParameter.prefetch_stats_interval is set.
+  vector<shared_ptr<DataProfile> > profiles_;
+  // Key the random stream of each item, see ItemRNGScope: the seed is drawn
+  // from the solver's generator at setup, and load_batch counts the batches.
+  uint64_t item_seed_;
+  uint64_t batch_id_;
+#ifdef USE_OPENCV
+  // Decoded images of the source records, see DataParameter.image_cache_mb.
+  shared_ptr<ImageCache> image_cache_;
+#endif  // USE_OPENCV
 };
 
 template <typename Dtype>
@@ -65,6 +100,32 @@ class pairBatch {
 };
 
 
+/**
+ * @brief Occupancy of a prefetch queue, sampled each time the net asks for a
+ * batch. Logged every DataParameter.prefetch_stats_interval forward passes so
+ * that the prefetch depth can be sized to absorb I/O jitter.
+ */
+class PrefetchStats {
+ public:
+  PrefetchStats();
+  void Init(const string& name, int capacity, int interval);
+  // occupancy: number of full batches before popping one.
+  // wait_ms: time spent waiting for the batch.
+  void Record(int occupancy, float wait_ms);
+
+ protected:
+  void Reset();
+
+  string name_;
+  int capacity_;
+  int interval_;
+  int count_;
+  int starved_;
+  int min_occupancy_;
+  double occupancy_sum_;
+  double wait_ms_;
+};
+
 template <typename Dtype>
 class BasePrefetchingDataLayer :
     public BaseDataLayer<Dtype>, public InternalThread {
@@ -81,16 +142,20 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Pops the next full batch and records the queue occupancy.
+  Batch<Dtype>* PopFullBatch();
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  // Prefetches batches (asynchronously if to GPU memory). The batches are
+  // allocated once, DataParameter.prefetch of them, and recycled through
+  // the free and full queues.
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  PrefetchStats prefetch_stats_;
 
   Blob<Dtype> transformed_data_;
 };
@@ -115,10 +180,14 @@ class ReidPrefetchingDataLayer :
   virtual void InternalThreadEntry();
   virtual void load_batch(ReidBatch<Dtype>* batch) = 0;
 
+  // Pops the next full batch and records the queue occupancy.
+  ReidBatch<Dtype>* PopFullBatch();
+
   vector<shared_ptr<ReidBatch<Dtype> > > prefetch_;
   BlockingQueue<ReidBatch<Dtype>*> prefetch_free_;
   BlockingQueue<ReidBatch<Dtype>*> prefetch_full_;
   ReidBatch<Dtype>* prefetch_current_;
+  PrefetchStats prefetch_stats_;
 
   Blob<Dtype> transformed_data_;
 };
@@ -143,17 +212,19 @@ class ImageDataPrefetchingDataLayer :
       const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(pairBatch<Dtype>* batch) = 0;
+  // Pops the next full batch and records the queue occupancy.
+  pairBatch<Dtype>* PopFullBatch();
 
-  pairBatch<Dtype> prefetch_[PREFETCH_COUNT];
-
+  // Prefetches batches (asynchronously if to GPU memory), see
+  // BasePrefetchingDataLayer.
+  vector<shared_ptr<pairBatch<Dtype> > > prefetch_;
   BlockingQueue<pairBatch<Dtype>*> prefetch_free_;
   BlockingQueue<pairBatch<Dtype>*> prefetch_full_;
+  PrefetchStats prefetch_stats_;
 
   Blob<Dtype> transformed_data_;
 };
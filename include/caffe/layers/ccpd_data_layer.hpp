@@ -29,6 +29,9 @@ class ccpdDataLayer: public BasePrefetchingDataLayer<Dtype>{
 
     protected:
         virtual void load_batch(Batch<Dtype>* batch);
+        void transform_item(Batch<Dtype>* batch,
+                const vector<AnnotatedCCpdDatum*>* anno_datums, Dtype* top_data,
+                vector<LicensePlate>* all_anno, int item_id, int worker_id);
 
         DataReader<AnnotatedCCpdDatum> reader_;
         bool has_anno_type_;
@@ -56,7 +56,10 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  output channels. Concretely 4 input channels, 8 output channels, and
    *  2 groups separate input channels 1-2 and output channels 1-4 into the
    *  first group and input channels 3-4 and output channels 5-8 into the second
-   *  group.
+   *  group. With one group per input channel (depthwise convolution) of a 2D
+   *  input, the CPU convolves each channel plane directly, without im2col,
+   *  splitting the planes over the threads of Caffe::cpu_pool(). Otherwise
+   *  the CPU splits the batch over these threads.
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
@@ -64,7 +67,15 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
 
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   virtual inline const char* type() const { return "Convolution"; }
+  // The depthwise cpu passes do without the column buffer.
+  virtual inline size_t WorkspaceSize() const {
+    return depthwise_ && Caffe::mode() == Caffe::CPU ? 0 :
+        BaseConvolutionLayer<Dtype>::WorkspaceSize();
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -77,6 +88,29 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // Forward and backward passes of batch item n, run by the given worker of
+  // Caffe::cpu_pool(). weight_diffs holds the weight gradient accumulator of
+  // each worker, or nothing when it is not needed.
+  void forward_cpu_item(const Dtype* input, const Dtype* weights,
+      const Dtype* bias, Dtype* output, int n, int worker);
+  void backward_cpu_item(const Dtype* top_diff, const Dtype* bottom_data,
+      const Dtype* weights, Dtype* bottom_diff,
+      const vector<Dtype*>& weight_diffs, int n, int worker);
+
+  // Depthwise convolution of one output plane (item n * num_output_ + c) of
+  // the batch, one input plane (item n * channels_ + c) for the data gradient
+  // and one filter (item c) for the weight gradient.
+  void forward_cpu_depthwise(const Dtype* input, const Dtype* weights,
+      const Dtype* bias, Dtype* output, int item);
+  void backward_cpu_depthwise(const Dtype* input, const Dtype* weights,
+      Dtype* output, int item);
+  void weight_cpu_depthwise(const Dtype* input, const Dtype* output,
+      Dtype* weights, int item);
+
+  bool depthwise_;
+  // The weight gradient accumulators of workers 1 and up.
+  vector<shared_ptr<Blob<Dtype> > > worker_weight_diffs_;
 };
 
 }  // namespace caffe
@@ -36,6 +36,8 @@ class CuDNNConvolutionLayer : public ConvolutionLayer<Dtype> {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual ~CuDNNConvolutionLayer();
+  // cuDNN allocates its own workspace.
+  virtual inline size_t WorkspaceSize() const { return 0; }
 
  protected:
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
@@ -30,6 +30,8 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  void transform_item(Batch<Dtype>* batch, const vector<Datum*>* datums,
+      Dtype* top_data, Dtype* top_label, int item_id, int worker_id);
 
   DataReader<Datum> reader_;
 };
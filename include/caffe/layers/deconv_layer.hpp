@@ -32,6 +32,10 @@ class DeconvolutionLayer : public BaseConvolutionLayer<Dtype> {
       : BaseConvolutionLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "Deconvolution"; }
+  // The cpu passes run on a single worker.
+  virtual inline size_t WorkspaceSize() const {
+    return this->col_buffers_size(1);
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -30,6 +30,7 @@ class FlattenLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Flatten"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool SharesBottomMemory() const { return true; }
 
  protected:
   /**
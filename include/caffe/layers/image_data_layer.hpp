@@ -11,13 +11,20 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/file_readahead.hpp"
+#include "caffe/util/line_index.hpp"
 
 namespace caffe {
 
 /**
  * @brief Provides data to the Net from image files.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * The source lists a directory of images and a label per line. Each batch
+ * takes up to sample_num images from each of random distinct directories.
+ * The source is memory-mapped rather than loaded, the directories are
+ * listed once, and the images of a batch are read by
+ * image_data_param.io_threads threads ahead of their decoding, which runs in
+ * parallel on the transform workers.
  */
 template <typename Dtype>
 class ImageDataLayer : public ImageDataPrefetchingDataLayer<Dtype> {
@@ -37,9 +44,24 @@ class ImageDataLayer : public ImageDataPrefetchingDataLayer<Dtype> {
   virtual void load_batch(pairBatch<Dtype>* batch);
   virtual void get_random_erasing_box(float sl, float sh, float min_rate, 
                                 float max_rate, cv::Mat img, float *mean_value);
+  // Reads, decodes and transforms an image of the batch, on the transform
+  // workers.
+  void transform_item(pairBatch<Dtype>* batch, int item_id, int worker_id);
+  // Decodes an image file to new_height x new_width, letting the decoder
+  // shrink it first if transform_param.reduced_decode is set.
+  cv::Mat DecodeImage(const string& data, int new_height, int new_width,
+      bool is_color) const;
+  // The directory and label of a line of the source.
+  std::pair<std::string, int> class_dir(int class_id) const;
+  // The images of a directory, listed on first use.
+  const std::vector<std::string>& class_files(int class_id);
 
   int lines_id_;
-  std::vector< std::pair<std::string, int> > fullImageSetDir_;
+  LineIndex source_;
+  std::vector<shared_ptr<std::vector<std::string> > > class_files_;
+  shared_ptr<FileReadahead> readahead_;
+  // The first image of the batch, decoded to shape the batch.
+  cv::Mat first_img_;
   std::vector< std::pair<std::string, int> > choosedImagefile_;
   int sample_num_;
   int label_num_;
@@ -13,6 +13,10 @@ namespace caffe {
  * @brief Also known as a "fully-connected" layer, computes an inner product
  *        with a set of learned weights, and (optionally) adds biases.
  *
+ * On the CPU, the products are split over the threads of Caffe::cpu_pool():
+ * by rows of the batch for the output and the bottom gradient, by rows of the
+ * weights for the weight gradient.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -39,6 +43,15 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // The part-th of num_parts slices of the products computed by the cpu
+  // passes.
+  void forward_cpu_part(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data, int num_parts, int part);
+  void backward_cpu_part(const Dtype* top_diff, const Dtype* weight,
+      Dtype* bottom_diff, int num_parts, int part);
+  void weight_cpu_part(const Dtype* top_diff, const Dtype* bottom_data,
+      Dtype* weight_diff, int num_parts, int part);
+
   int M_;
   int K_;
   int N_;
@@ -34,6 +34,7 @@ class PermuteLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Permute"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool SharesBottomMemory() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
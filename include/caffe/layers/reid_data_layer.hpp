@@ -35,6 +35,10 @@ class ReidDataLayer : public ReidPrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(ReidBatch<Dtype>* batch);
+  // Transforms the pair of images of a batch item, on the transform workers.
+  void transform_item(ReidBatch<Dtype>* batch, const vector<size_t>& batches,
+                      const vector<size_t>& batches_pair, int item_id,
+                      int worker_id);
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual unsigned int RandRng();
 
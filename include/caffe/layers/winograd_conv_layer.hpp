@@ -0,0 +1,59 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd F(2x2, 3x3) implementation of ConvolutionLayer on the CPU,
+ *        selected by engine: WINOGRAD.
+ *        Fallback to ConvolutionLayer for other convolutions, for the backward
+ *        pass and for GPU mode.
+ *
+ * The 2D 3x3 convolutions with stride 1 and no dilation of groups of more
+ * than one channel are computed on 2x2 output tiles: the input is transformed
+ * into 16 matrices of about 4x its size (instead of the 9x im2col buffer),
+ * multiplied by the transformed kernels with 16 GEMMs of 4x fewer columns,
+ * and transformed back. This takes 2.25x fewer multiplications than the CAFFE
+ * engine, at the cost of slightly larger rounding errors.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // The column buffer of the backward pass, or the transforms of the forward
+  // pass.
+  virtual inline size_t WorkspaceSize() const {
+    return std::max(ConvolutionLayer<Dtype>::WorkspaceSize(), sizeof(Dtype) *
+        (kernel_tr_.count() + input_tr_.count() + output_tr_.count()));
+  }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  bool winograd_;
+  // The transforms are taken from the workspace of the net, if any, or else
+  // from these blobs.
+  Blob<Dtype> kernel_tr_;
+  Blob<Dtype> input_tr_;
+  Blob<Dtype> output_tr_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
@@ -242,6 +242,15 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Give the layers one workspace for their scratch memory.
+  void ShareWorkspace();
+  /**
+   * @brief Let the blobs whose lifetimes in a pass do not overlap share
+   *        memory, for NetParameter plan_memory. The backward pass is planned
+   *        for in the TRAIN phase or if force_backward is set.
+   */
+  void PlanMemory(const bool force_backward);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -304,6 +313,8 @@ class Net {
   vector<bool> has_params_decay_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// The scratch memory shared by the layers
+  shared_ptr<Workspace> workspace_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
@@ -0,0 +1,80 @@
+#ifndef CAFFE_UTIL_ANNOTATION_TREE_HPP_
+#define CAFFE_UTIL_ANNOTATION_TREE_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A read-only tree of keys and string values, parsed from an XML or a
+ *    JSON annotation file, with the layout boost::property_tree gives them.
+ *
+ * XML elements become nodes keyed by their tag, whose value is their text;
+ * attributes, comments and processing instructions are dropped. JSON object
+ * members become nodes keyed by their name, array items nodes with an empty
+ * key, and scalars keep their literal text. Values convert like
+ * property_tree's: the whole value, but surrounding whitespace, has to be
+ * read as the requested type.
+ *
+ * All the nodes live in a single vector and most keys and values fit in the
+ * strings' inline buffer, so parsing a small annotation file costs a handful
+ * of allocations, where property_tree costs several per node.
+ */
+class AnnotationTree {
+ public:
+  AnnotationTree();
+
+  // Both return false, with a message in error, if data is malformed.
+  bool ParseXML(const char* data, size_t size, string* error);
+  bool ParseJSON(const char* data, size_t size, string* error);
+
+  // The node holding the whole document.
+  inline int root() const { return 0; }
+  inline const string& key(int node) const { return nodes_[node].key; }
+  inline const string& data(int node) const { return nodes_[node].data; }
+  // Children in document order, -1 past the last one.
+  inline int first_child(int node) const { return nodes_[node].first_child; }
+  inline int next_sibling(int node) const {
+    return nodes_[node].next_sibling;
+  }
+
+  // The first node at a dot separated path of keys below node, or -1.
+  int Find(int node, const string& path) const;
+  // Converts the value at path, returning false if there is none or it does
+  // not convert.
+  bool Get(int node, const string& path, int* value) const;
+  bool Get(int node, const string& path, float* value) const;
+  bool Get(int node, const string& path, string* value) const;
+  template <typename T>
+  T Get(int node, const string& path, const T& default_value) const {
+    T value;
+    return Get(node, path, &value) ? value : default_value;
+  }
+
+  // Conversion of a single value.
+  static bool ToInt(const string& text, int* value);
+  static bool ToFloat(const string& text, float* value);
+
+ protected:
+  struct Node {
+    string key;
+    string data;
+    int first_child;
+    int last_child;
+    int next_sibling;
+  };
+
+  void Clear();
+  int AddChild(int parent);
+
+  std::vector<Node> nodes_;
+  // Number of nodes_ in use; the others are kept for their buffers.
+  int size_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ANNOTATION_TREE_HPP_
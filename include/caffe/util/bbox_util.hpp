@@ -32,6 +32,36 @@ typedef MultiFaceAttriLossParameter_AttriLossType PoseAttriLossType;
 
 typedef map<int, vector<NormalizedBBox> > LabelBBox;
 
+// Number of points of AnnoFaceLandmarks: lefteye, righteye, nose, leftmouth
+// and rightmouth.
+const int kNumFaceLandmarks = 5;
+
+/**
+ * @brief A transformed box annotation as plain data, as the annotated data
+ * layer writes it to the label blob, so that going from the transformer to
+ * the label blob builds no Annotation message per box.
+ */
+struct AnnotationBox {
+  int group_label;
+  int instance_id;
+  float xmin, ymin, xmax, ymax;
+  // As set by ProjectBBox, so that the box converts back to the same
+  // NormalizedBBox.
+  float size;
+  bool difficult;
+  int has_lm;
+  // x, y of the kNumFaceLandmarks points, -1 if has_lm is 0.
+  float landmarks[2 * kNumFaceLandmarks];
+};
+
+// Copies the x, y of the points of marks to points, and back.
+void GetFaceLandmarks(const AnnoFaceLandmarks& marks, float* points);
+void SetFaceLandmarks(const float* points, AnnoFaceLandmarks* marks);
+
+// Converts the boxes of one AnnotationGroup back to messages.
+void AnnotationBoxesToGroup(const AnnotationBox* boxes, int num,
+                            AnnotationGroup* anno_group);
+
 // Function used to sort NormalizedBBox, stored in STL container (e.g. vector),
 // in ascend order based on the score value.
 bool SortBBoxAscend(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2);
@@ -94,6 +124,8 @@ bool ProjectBBox(const NormalizedBBox& src_bbox, const NormalizedBBox& bbox,
 
 bool ProjectfacemarksBBox(const NormalizedBBox& src_bbox,
                  AnnoFaceLandmarks* marks);
+// The same on the x, y of kNumFaceLandmarks points.
+bool ProjectLandmarks(const NormalizedBBox& src_bbox, float* points);
 
 // Extrapolate the transformed bbox if height_scale and width_scale is
 // explicitly provided, and it is only effective for FIT_SMALL_SIZE case.
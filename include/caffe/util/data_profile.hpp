@@ -0,0 +1,89 @@
+#ifndef CAFFE_UTIL_DATA_PROFILE_HPP_
+#define CAFFE_UTIL_DATA_PROFILE_HPP_
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Wall-clock time one thread spends in each stage of producing a batch,
+ * so that the data layers can tell which stage limits their throughput.
+ *
+ * Stages nest, and time is only charged to the innermost open one: a decode
+ * inside a transform counts as decode, not as both. Time outside any stage,
+ * such as waiting for a worker, is not counted. Not thread-safe: each thread
+ * fills its own profile, and they are merged once the threads are done.
+ */
+class DataProfile {
+ public:
+  enum Stage {
+    READ,        // reading records, or waiting for the reader to provide them
+    PARSE,       // deserializing records
+    DECODE,      // decoding images
+    DISTORT,     // photometric distortions
+    EXPAND,      // zoom-out expansion
+    SAMPLE,      // generating and cropping to batch samplers
+    RESIZE,      // resizing to the input size
+    TRANSFORM,   // crop, mirror, mean and scale into the batch
+    LABEL,       // filling the label blob
+    QUEUE_WAIT,  // waiting for a free batch, i.e. for the net
+    NUM_STAGES
+  };
+
+  DataProfile();
+
+  void Enter(Stage stage);
+  void Leave();
+  // Adds the times of other, which must have no open stage.
+  void Merge(const DataProfile& other);
+  void Reset();
+
+  inline double microseconds(Stage stage) const { return us_[stage]; }
+  inline uint64_t count(Stage stage) const { return count_[stage]; }
+  static const char* StageName(Stage stage);
+  // "name ms, name ms, ..." for the stages that ran, divided by num_batches.
+  string Summary(int num_batches) const;
+
+ protected:
+  void Charge();
+
+  std::vector<Stage> open_;
+  boost::posix_time::ptime last_;
+  double us_[NUM_STAGES];
+  uint64_t count_[NUM_STAGES];
+};
+
+/**
+ * @brief Charges the lifetime of a scope to a stage of profile. Does nothing
+ * if profile is NULL, i.e. if profiling is disabled.
+ */
+class StageTimer {
+ public:
+  StageTimer(DataProfile* profile, DataProfile::Stage stage)
+      : profile_(profile) {
+    if (profile_) {
+      profile_->Enter(stage);
+    }
+  }
+  ~StageTimer() {
+    Stop();
+  }
+  // Leaves the stage before the end of the scope.
+  void Stop() {
+    if (profile_) {
+      profile_->Leave();
+      profile_ = NULL;
+    }
+  }
+
+ private:
+  DataProfile* profile_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATA_PROFILE_HPP_
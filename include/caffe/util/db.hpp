@@ -15,14 +15,42 @@ class Cursor {
   Cursor() { }
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
+  // Moves to the first record whose key is not less than key, or for
+  // backends that keep the records in the order they were written, to the
+  // record of key.
+  virtual void Seek(const string& key) = 0;
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  // Point to the current value in the backend's own memory, without copying
+  // it. Only valid until the cursor moves, unless the backend says otherwise.
+  virtual const char* value_data() = 0;
+  virtual size_t value_size() = 0;
   virtual bool valid() = 0;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
 
+// Looks records up by key, for backends that support random access.
+class RandomReader {
+ public:
+  RandomReader() { }
+  virtual ~RandomReader() { }
+  // Keys of all the records, in the order of the database.
+  virtual const vector<string>& keys() = 0;
+  // Points data at the value of key, valid for the lifetime of the reader.
+  virtual bool Get(const string& key, const char** data, size_t* size) = 0;
+  // Hints that the given value will be read soon.
+  virtual void WillNeed(const char* data, size_t size) { }
+
+  DISABLE_COPY_AND_ASSIGN(RandomReader);
+};
+
+// Records put are only sure to be in the database once Commit() returns, and
+// those not committed when the transaction is destroyed are dropped. Commit()
+// is atomic for LevelDB and RECORD, but not for LMDB, which may commit part of
+// the puts early to grow its map: a failure before Commit() can then leave
+// some of them written.
 class Transaction {
  public:
   Transaction() { }
@@ -41,6 +69,13 @@ class DB {
   virtual void Close() = 0;
   virtual Cursor* NewCursor() = 0;
   virtual Transaction* NewTransaction() = 0;
+  virtual RandomReader* NewRandomReader();
+  // Hints at the number of bytes of records about to be written, for
+  // backends that size their storage up front. Call it before
+  // NewTransaction().
+  virtual void SetSizeHint(uint64_t bytes) { }
+  // Number of records, or -1 if the backend cannot tell without a scan.
+  virtual int64_t Count() { return -1; }
 
   DISABLE_COPY_AND_ASSIGN(DB);
 };
@@ -48,6 +83,14 @@ class DB {
 DB* GetDB(DataParameter::DB backend);
 DB* GetDB(const string& backend);
 
+// Splits the records of db into at most num_ranges contiguous ranges of about
+// the same size: start_keys[k] is the first key of range k, and sizes[k] its
+// number of records. Only the start keys are copied, in a single pass of
+// cursor over the records if db can Count() them, and two otherwise. Leaves
+// cursor at the first record.
+void SplitRanges(DB* db, Cursor* cursor, int num_ranges,
+    vector<string>* start_keys, vector<int>* sizes);
+
 }  // namespace db
 }  // namespace caffe
 
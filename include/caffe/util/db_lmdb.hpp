@@ -3,10 +3,12 @@
 #define CAFFE_UTIL_DB_LMDB_HPP
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "lmdb.h"
 
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/db.hpp"
 
 namespace caffe { namespace db {
@@ -15,6 +17,9 @@ inline void MDB_CHECK(int mdb_status) {
   CHECK_EQ(mdb_status, MDB_SUCCESS) << mdb_strerror(mdb_status);
 }
 
+// The cursor pins its read-only transaction until it is destroyed, so the
+// memory-mapped values returned by value_data() stay valid across Next() and
+// SeekToFirst() for the lifetime of the cursor.
 class LMDBCursor : public Cursor {
  public:
   explicit LMDBCursor(MDB_txn* mdb_txn, MDB_cursor* mdb_cursor)
@@ -26,6 +31,11 @@ class LMDBCursor : public Cursor {
     mdb_txn_abort(mdb_txn_);
   }
   virtual void SeekToFirst() { Seek(MDB_FIRST); }
+  virtual void Seek(const string& key) {
+    mdb_key_.mv_size = key.size();
+    mdb_key_.mv_data = const_cast<char*>(key.data());
+    Seek(MDB_SET_RANGE);
+  }
   virtual void Next() { Seek(MDB_NEXT); }
   virtual string key() {
     return string(static_cast<const char*>(mdb_key_.mv_data), mdb_key_.mv_size);
@@ -34,6 +44,10 @@ class LMDBCursor : public Cursor {
     return string(static_cast<const char*>(mdb_value_.mv_data),
         mdb_value_.mv_size);
   }
+  virtual const char* value_data() {
+    return static_cast<const char*>(mdb_value_.mv_data);
+  }
+  virtual size_t value_size() { return mdb_value_.mv_size; }
   virtual bool valid() { return valid_; }
 
  private:
@@ -53,18 +67,86 @@ class LMDBCursor : public Cursor {
   bool valid_;
 };
 
+// Looks values up with mdb_get on a read-only transaction pinned for the
+// lifetime of the reader. Kernel readahead is turned off for the map, as it
+// only wastes I/O on random reads; WillNeed() prefetches a value instead.
+class LMDBRandomReader : public RandomReader {
+ public:
+  LMDBRandomReader(MDB_env* mdb_env, MDB_txn* mdb_txn, MDB_dbi mdb_dbi,
+      const string& source);
+  virtual ~LMDBRandomReader() { mdb_txn_abort(mdb_txn_); }
+  virtual const vector<string>& keys() { return keys_; }
+  virtual bool Get(const string& key, const char** data, size_t* size);
+  virtual void WillNeed(const char* data, size_t size);
+
+ private:
+  // The key index is cached in <source>.keys, and rebuilt whenever the
+  // number of entries or the last committed transaction changes.
+  bool LoadKeys(const string& filename, uint64_t entries, uint64_t txnid);
+  void SaveKeys(const string& filename, uint64_t entries, uint64_t txnid);
+
+  MDB_env* mdb_env_;
+  MDB_txn* mdb_txn_;
+  MDB_dbi mdb_dbi_;
+  vector<string> keys_;
+
+  DISABLE_COPY_AND_ASSIGN(LMDBRandomReader);
+};
+
+// What the transactions of an LMDB wrote, reported when it is closed.
+struct LMDBWriteStats {
+  LMDBWriteStats() : records(0), bytes(0), map_grows(0) { }
+  uint64_t records;
+  uint64_t bytes;
+  int map_grows;
+  // Started by the first write.
+  CPUTimer timer;
+};
+
+// Puts go straight into an open write transaction, with MDB_APPEND while the
+// keys come in increasing order, which fills the pages sequentially. The
+// transaction tracks a conservative estimate of the space its records take:
+// when the next one may not fit, it commits what it has, grows the map and
+// carries on in a new transaction, so Commit() is not atomic. Should the map
+// still fill up, the failed transaction is aborted and the puts since the
+// last commit are replayed into a larger map, from copies kept up to
+// kMaxPendingBytes; past that, the records are committed instead. Uncommitted
+// puts are dropped with the transaction.
 class LMDBTransaction : public Transaction {
  public:
-  explicit LMDBTransaction(MDB_env* mdb_env)
-    : mdb_env_(mdb_env) { }
+  static const size_t kMaxPendingBytes = 64 << 20;
+
+  LMDBTransaction(MDB_env* mdb_env, LMDBWriteStats* stats);
+  virtual ~LMDBTransaction();
   virtual void Put(const string& key, const string& value);
   virtual void Commit();
 
  private:
-  MDB_env* mdb_env_;
-  vector<string> keys, values;
+  void Begin();
+  // Bytes of the map that a record may use up.
+  size_t Footprint(const string& key, const string& value, bool append) const;
+  void GrowMap(size_t needed);
+  // Puts a record into the open transaction, and returns the mdb_put status.
+  int Write(const string& key, const string& value);
+  void ClearPending();
 
-  void DoubleMapSize();
+  MDB_env* mdb_env_;
+  MDB_txn* mdb_txn_;
+  MDB_dbi mdb_dbi_;
+  LMDBWriteStats* stats_;
+  size_t page_size_;
+  size_t map_size_;
+  // Bytes of the map in use, committed ones exact, the others estimated.
+  size_t used_;
+  // The largest key in the database, if has_last_key_.
+  string last_key_;
+  bool has_last_key_;
+  // Puts into the open transaction.
+  int puts_;
+  // Copies of the records put since the last commit, to replay them on
+  // MDB_MAP_FULL, and their total size.
+  vector<std::pair<string, string> > pending_;
+  size_t pending_bytes_;
 
   DISABLE_COPY_AND_ASSIGN(LMDBTransaction);
 };
@@ -74,19 +156,20 @@ class LMDB : public DB {
   LMDB() : mdb_env_(NULL) { }
   virtual ~LMDB() { Close(); }
   virtual void Open(const string& source, Mode mode);
-  virtual void Close() {
-    if (mdb_env_ != NULL) {
-      mdb_dbi_close(mdb_env_, mdb_dbi_);
-      mdb_env_close(mdb_env_);
-      mdb_env_ = NULL;
-    }
-  }
+  virtual void Close();
   virtual LMDBCursor* NewCursor();
   virtual LMDBTransaction* NewTransaction();
+  virtual LMDBRandomReader* NewRandomReader();
+  // Grows the map to fit the records written so far and bytes more.
+  virtual void SetSizeHint(uint64_t bytes);
+  // The entry count that LMDB keeps in the database header.
+  virtual int64_t Count();
 
  private:
   MDB_env* mdb_env_;
   MDB_dbi mdb_dbi_;
+  string source_;
+  LMDBWriteStats write_stats_;
 };
 
 }  // namespace db
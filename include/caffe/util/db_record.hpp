@@ -0,0 +1,176 @@
+#ifndef CAFFE_UTIL_DB_RECORD_HPP
+#define CAFFE_UTIL_DB_RECORD_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+class RecordDB;
+
+// Iterates over the records committed when it was created, in the order they
+// were written. The values point into the memory-mapped chunks, and stay
+// valid for the lifetime of the database. Reading ahead is requested from
+// the kernel in large windows, which suits network filesystems, but only
+// once a value is read: moving over records, or reading their keys, does not
+// bring in their values.
+class RecordCursor : public Cursor {
+ public:
+  explicit RecordCursor(RecordDB* db);
+  virtual void SeekToFirst() { Seek(0); }
+  virtual void Seek(const string& key);
+  virtual void Next() { ++index_; }
+  virtual string key();
+  virtual string value() { return string(value_data(), value_size()); }
+  virtual const char* value_data();
+  virtual size_t value_size();
+  virtual bool valid() { return index_ < size_; }
+
+ private:
+  // A jump, which starts a new readahead window at the next value read.
+  void Seek(int index) {
+    index_ = index;
+    readahead_chunk_ = -1;
+  }
+  // Asks for the chunk ahead of the current record to be read, if the last
+  // request does not cover most of it.
+  void ReadAhead();
+
+  RecordDB* db_;
+  const int size_;
+  int index_;
+  // End of the range of the current chunk asked to be read ahead.
+  int readahead_chunk_;
+  uint64_t readahead_end_;
+
+  DISABLE_COPY_AND_ASSIGN(RecordCursor);
+};
+
+class RecordRandomReader : public RandomReader {
+ public:
+  explicit RecordRandomReader(RecordDB* db);
+  virtual const vector<string>& keys();
+  virtual bool Get(const string& key, const char** data, size_t* size);
+  virtual void WillNeed(const char* data, size_t size);
+
+ private:
+  RecordDB* db_;
+
+  DISABLE_COPY_AND_ASSIGN(RecordRandomReader);
+};
+
+// Streams the values to the current chunk as they are put, and indexes them
+// at Commit. Puts that are not committed are rolled back.
+class RecordTransaction : public Transaction {
+ public:
+  explicit RecordTransaction(RecordDB* db) : db_(db) { }
+  virtual ~RecordTransaction();
+  virtual void Put(const string& key, const string& value);
+  virtual void Commit();
+
+ private:
+  RecordDB* db_;
+  // Index entries of the puts since the last commit.
+  string pending_;
+
+  DISABLE_COPY_AND_ASSIGN(RecordTransaction);
+};
+
+/**
+ * @brief An append-only database of records packed in large chunk files,
+ *    with an index of their offsets.
+ *
+ * The database is a directory holding the chunks, data_00000,
+ * data_00001..., which only hold the values back to back, and the index. The
+ * index starts with an 8 byte magic and a version, followed by an entry per
+ * record: the chunk, the size of the key, the offset and the size of the
+ * value, and the key. Values are appended to the last chunk until it would
+ * exceed kChunkSize, and the index is appended to at every commit, after the
+ * values it points at are written: an entry that is cut short, or points
+ * past the end of its chunk, ends the index when it is loaded.
+ *
+ * Records come out in the order they were written, rather than sorted by
+ * key. Putting a key again replaces its value, as in the other backends, but
+ * the record keeps the position of the first put. The chunks are
+ * memory-mapped for reading, so looking up the record of a key, or of a
+ * position, costs a hash lookup at most.
+ */
+class RecordDB : public DB {
+ public:
+  static const uint64_t kChunkSize = 1ULL << 30;
+
+  RecordDB() : data_file_(NULL), index_file_(NULL) { }
+  virtual ~RecordDB() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual RecordCursor* NewCursor();
+  virtual RecordTransaction* NewTransaction();
+  virtual RecordRandomReader* NewRandomReader();
+  virtual int64_t Count() { return records_.size(); }
+
+ protected:
+  struct Record {
+    int chunk;
+    uint64_t offset;
+    uint64_t size;
+  };
+  struct Chunk {
+    Chunk() : map(NULL), map_size(0) { }
+    char* map;
+    uint64_t map_size;
+  };
+
+  string ChunkName(int chunk) const;
+  // Loads the valid prefix of the index, and returns its size in bytes. Sets
+  // data_chunk_ and data_size_ to the end of the value of its last entry.
+  uint64_t LoadIndex();
+  // Adds a record to the end, or replaces that of its key if it has one.
+  void AddRecord(const string& key, const Record& record);
+  // Maps the chunks up to the end of their last committed record. A chunk
+  // that has grown is mapped again, and its old map is only unmapped at
+  // Close, so values already handed out stay valid.
+  void MapChunks();
+  void UnmapChunks();
+  inline const char* data(int index) const {
+    const Record& record = records_[index];
+    return chunks_[record.chunk].map + record.offset;
+  }
+
+  // For RecordTransaction: appends the value of a record to the chunks, and
+  // its entry to pending.
+  void Append(const string& key, const string& value, string* pending);
+  // Flushes the values, and adds the pending entries to the index.
+  void Commit(const string& pending);
+  // Drops the values of the pending entries, if the database is still open.
+  void Rollback(const string& pending);
+  void OpenChunk(int chunk, uint64_t size);
+
+  string source_;
+  vector<string> keys_;
+  vector<Record> records_;
+  boost::unordered_map<string, int> key_index_;
+  vector<Chunk> chunks_;
+  // Maps replaced by MapChunks, see there.
+  vector<Chunk> retired_chunks_;
+  // Only used when writing: the last chunk and the index, open for appending.
+  FILE* data_file_;
+  FILE* index_file_;
+  int data_chunk_;
+  uint64_t data_size_;
+
+  friend class RecordCursor;
+  friend class RecordRandomReader;
+  friend class RecordTransaction;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_RECORD_HPP
@@ -0,0 +1,37 @@
+#ifndef _CAFFE_UTIL_DEPTHWISE_CONV_HPP_
+#define _CAFFE_UTIL_DEPTHWISE_CONV_HPP_
+
+namespace caffe {
+
+// Direct convolution of a single channel plane with its own kernel, as used by
+// convolutions with group == channels. The output plane has the size im2col
+// would give. 3x3 and 5x5 kernels with stride 1 or 2 (and no dilation) run
+// through specialized loops; any other shape takes the generic path.
+
+// data_out = data_im * kernel
+template <typename Dtype>
+void depthwise_conv_cpu(const Dtype* data_im, const int height,
+    const int width, const Dtype* kernel, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    Dtype* data_out);
+
+// im_diff += out_diff * kernel, transposed.
+template <typename Dtype>
+void depthwise_conv_backward_data_cpu(const Dtype* out_diff,
+    const int height, const int width, const Dtype* kernel,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, Dtype* im_diff);
+
+// kernel_diff += gradient of the kernel given data_im and out_diff.
+template <typename Dtype>
+void depthwise_conv_backward_kernel_cpu(const Dtype* data_im,
+    const Dtype* out_diff, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, Dtype* kernel_diff);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DEPTHWISE_CONV_HPP_
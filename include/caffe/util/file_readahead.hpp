@@ -0,0 +1,63 @@
+#ifndef CAFFE_UTIL_FILE_READAHEAD_HPP_
+#define CAFFE_UTIL_FILE_READAHEAD_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Reads the files of a list on a pool of threads, in order, at most
+ * window files ahead of the ones taken.
+ *
+ * Slow or networked storage is then read with several requests in flight,
+ * while the decoders only ever wait for the file they need, and the memory
+ * held by files read but not yet taken stays bounded, unless files are taken
+ * out of order: waiting for a file reads up to it. Get may be called from
+ * several threads; Start must not be called while they still take files.
+ */
+class FileReadahead {
+ public:
+  // With no threads, Get reads the files itself.
+  FileReadahead(int num_threads, int window);
+  ~FileReadahead();
+
+  // Starts reading files, after waiting for the reads of the previous list.
+  void Start(const vector<string>& files);
+  // Waits for file i of the list and moves its contents into data. Returns
+  // false if it could not be read.
+  bool Get(int i, string* data);
+
+  inline int num_threads() const { return num_threads_; }
+
+ protected:
+  // Moves the contents of filename into data.
+  static bool ReadFile(const string& filename, string* data);
+  void Entry();
+
+  // Holds the threads and their synchronization, see BlockingQueue.
+  class sync;
+
+  const int num_threads_;
+  const int window_;
+  vector<string> files_;
+  vector<string> data_;
+  // 0: not read yet, 1: read, -1: failed.
+  vector<int> state_;
+  // The next file to read, the number of files being read and taken, and
+  // the last file waited for.
+  int next_;
+  int in_flight_;
+  int taken_;
+  int wanted_;
+  bool stop_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(FileReadahead);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FILE_READAHEAD_HPP_
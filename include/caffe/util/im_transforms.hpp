@@ -24,6 +24,11 @@ void UpdateLandmarkFacePoseByResizePolicy(const ResizeParameter& param,
                               const int old_width, const int old_height,
                               AnnoFaceLandmarks* lface) ;
 
+// The same on the x, y of kNumFaceLandmarks points, see GetFaceLandmarks.
+void UpdateLandmarksByResizePolicy(const ResizeParameter& param,
+                              const int old_width, const int old_height,
+                              float* points);
+
 
 void InferNewSize(const ResizeParameter& resize_param,
                   const int old_width, const int old_height,
@@ -87,6 +92,9 @@ void AdjustHue(const cv::Mat& in_img, const float delta, cv::Mat* out_img);
 void RandomOrderChannels(const cv::Mat& in_img, cv::Mat* out_img,
                          const float random_order_prob);
 
+// Randomly distorts the photometry of an image. 8-bit color images go through
+// lookup tables and a single round trip to HSV in per-thread buffers; the
+// random draws are those of applying the Random*() functions above in turn.
 cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param);
 #endif  // USE_OPENCV
 
@@ -0,0 +1,81 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+#include <stdint.h>
+
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+#ifdef USE_OPENCV
+/**
+ * @brief A bounded, thread-safe cache of decoded images, keyed by a 128-bit
+ * digest of the encoded bytes they were decoded from, with
+ * least-recently-used eviction.
+ *
+ * Images are copied in and out, so callers may modify what they get back
+ * (the distortions do so in place).
+ */
+class ImageCache {
+ public:
+  // MurmurHash3 (x64, 128-bit) of encoded bytes: for a cache of millions of
+  // images, the odds that two of them collide are below 1e-26.
+  struct Key {
+    uint64_t h1, h2;
+    bool operator<(const Key& other) const {
+      return h1 < other.h1 || (h1 == other.h1 && h2 < other.h2);
+    }
+  };
+  // Computed by the callers, outside of the lock.
+  static Key KeyOf(const string& encoded);
+
+  explicit ImageCache(size_t capacity_bytes);
+
+  // Copies the image decoded from the bytes of key into img, if it is cached.
+  bool Get(const Key& key, cv::Mat* img);
+  // Caches a copy of img, evicting the least recently used images to make
+  // room, unless it is already cached. Images larger than the whole cache are
+  // not cached.
+  void Put(const Key& key, const cv::Mat& img);
+
+  uint64_t hits() const;
+  uint64_t misses() const;
+  uint64_t evictions() const;
+  size_t size() const;
+  size_t size_bytes() const;
+  inline size_t capacity_bytes() const { return capacity_bytes_; }
+
+ protected:
+  struct Entry {
+    Key key;
+    cv::Mat img;
+  };
+  typedef std::list<Entry> EntryList;
+
+  static size_t Bytes(const Entry& entry);
+
+  const size_t capacity_bytes_;
+  size_t size_bytes_;
+  uint64_t hits_;
+  uint64_t misses_;
+  uint64_t evictions_;
+  // Most recently used first.
+  EntryList entries_;
+  std::map<Key, EntryList::iterator> index_;
+  mutable boost::mutex mutex_;
+
+DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+#endif  // USE_OPENCV
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
@@ -297,6 +297,10 @@ inline bool MapLabelToDisplayName(const LabelMap& map,
   return MapLabelToDisplayName(map, true, label_to_display_name);
 }
 
+// Reads the size and number of components of a JPEG image from its header,
+// without decoding it. Returns false if data is not a JPEG image.
+bool GetJPEGSize(const string& data, int* height, int* width, int* channels);
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename, const int height,
     const int width, const int min_dim, const int max_dim, const bool is_color);
@@ -315,8 +319,22 @@ cv::Mat ReadImageToCVMat(const string& filename,
 
 cv::Mat ReadImageToCVMat(const string& filename);
 
+// Decodes the contents of an image file, as ReadImageToCVMat reads the file.
+cv::Mat DecodeImageToCVMat(const string& data, const int height,
+    const int width, const bool is_color);
+// Same, but lets the decoder shrink a JPEG first, see
+// DecodeDatumToCVMatReduced, so the pixels differ slightly.
+cv::Mat DecodeImageToCVMatReduced(const string& data, const int height,
+    const int width, const bool is_color);
+
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
+// Decodes a JPEG datum reduced by 2, 4 or 8, the largest factor that keeps it
+// at least min_height x min_width, which the decoder does much faster than a
+// full decode. Other images are decoded at full size. cv_read_flag is one of
+// CV_LOAD_IMAGE_COLOR, CV_LOAD_IMAGE_GRAYSCALE or CV_LOAD_IMAGE_UNCHANGED.
+cv::Mat DecodeDatumToCVMatReduced(const Datum& datum, int min_height,
+    int min_width, int cv_read_flag);
 
 void EncodeCVMatToDatum(const cv::Mat& cv_img, const string& encoding,
                         Datum* datum);
@@ -0,0 +1,45 @@
+#ifndef CAFFE_UTIL_LINE_INDEX_HPP_
+#define CAFFE_UTIL_LINE_INDEX_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A text file mapped into memory, with the offsets of its non-empty
+ * lines, so that a list of millions of files costs 8 bytes a line rather than
+ * a string each. Lines end with "\n" or "\r\n".
+ */
+class LineIndex {
+ public:
+  LineIndex() : map_(NULL), map_size_(0) { }
+  ~LineIndex() { Close(); }
+
+  // Maps filename and indexes its lines. Returns false if it cannot be read.
+  bool Open(const string& filename);
+  void Close();
+
+  inline int size() const { return starts_.size(); }
+  // Line i, without its end of line.
+  inline string line(int i) const {
+    return string(line_data(i), line_size(i));
+  }
+  inline const char* line_data(int i) const { return map_ + starts_[i]; }
+  size_t line_size(int i) const;
+
+ protected:
+  char* map_;
+  size_t map_size_;
+  vector<uint64_t> starts_;
+
+DISABLE_COPY_AND_ASSIGN(LineIndex);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LINE_INDEX_HPP_
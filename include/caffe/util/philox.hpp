@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_PHILOX_HPP_
+#define CAFFE_UTIL_PHILOX_HPP_
+
+#include <stdint.h>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The Philox4x32-10 counter-based generator (Salmon et al., "Parallel
+ * random numbers: as easy as 1, 2, 3", SC 2011), as a stream of 32-bit
+ * values usable with the boost distributions.
+ *
+ * The stream is a pure function of its 64-bit key and of the three upper
+ * words of its 128-bit counter, so streams need no state to be derived, and
+ * streams with different keys or counters are independent. The low counter
+ * word counts the blocks of four values drawn.
+ */
+class Philox {
+ public:
+  typedef uint32_t result_type;
+
+  Philox(uint64_t key, uint32_t c1, uint32_t c2, uint32_t c3);
+
+  inline result_type operator()() {
+    if (index_ == 4) {
+      Block();
+    }
+    return output_[index_++];
+  }
+  static inline result_type min() { return 0; }
+  static inline result_type max() { return 0xffffffff; }
+
+  // The 10 rounds of Philox4x32 on counter, with key.
+  static void Bijection(const uint32_t key[2], const uint32_t counter[4],
+      uint32_t out[4]);
+
+ protected:
+  void Block();
+
+  uint32_t key_[2];
+  uint32_t counter_[4];
+  uint32_t output_[4];
+  int index_;
+};
+
+/**
+ * @brief While in scope, makes the caffe_rng_* functions, caffe::shuffle and
+ * DataTransformer::Rand of the calling thread draw from the Philox stream of
+ * an item rather than from the thread's generator.
+ *
+ * The data layers open one around the augmentation of each item of a batch,
+ * keyed by a seed drawn at setup, the index of the batch and the index of the
+ * item in it, so that an item is augmented the same way whichever thread
+ * transforms it. Scopes nest.
+ */
+class ItemRNGScope {
+ public:
+  ItemRNGScope(uint64_t seed, uint64_t batch_id, int item_id);
+  ~ItemRNGScope();
+
+  // The stream of the innermost scope of the calling thread, or NULL.
+  static Philox* current();
+
+ protected:
+  Philox rng_;
+  Philox* previous_;
+
+DISABLE_COPY_AND_ASSIGN(ItemRNGScope);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PHILOX_HPP_
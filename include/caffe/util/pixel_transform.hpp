@@ -0,0 +1,29 @@
+#ifndef CAFFE_UTIL_PIXEL_TRANSFORM_HPP_
+#define CAFFE_UTIL_PIXEL_TRANSFORM_HPP_
+
+#include <stdint.h>
+
+namespace caffe {
+
+/**
+ * @brief Converts an 8-bit interleaved (HWC) image, typically a crop of a
+ *    larger one, to planar (CHW) Dtype in a single pass, mirroring it
+ *    horizontally, subtracting a per-channel mean and scaling on the way.
+ *
+ * Every output value only depends on its channel and input byte, so they are
+ * tabulated once per call and the pass itself is a table lookup per value:
+ * the results are exactly those of computing (pixel - mean[c]) * scale.
+ *
+ * @param src First pixel of the image.
+ * @param src_step Bytes between two rows of src.
+ * @param mean Per-channel mean, or NULL to only scale.
+ * @param dst Output, channels x height x width.
+ */
+template <typename Dtype>
+void TransformHWCToCHW(const uint8_t* src, int src_step, int height,
+    int width, int channels, bool mirror, const Dtype* mean, Dtype scale,
+    Dtype* dst);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PIXEL_TRANSFORM_HPP_
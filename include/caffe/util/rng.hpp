@@ -8,6 +8,7 @@
 #include "boost/random/uniform_int.hpp"
 
 #include "caffe/common.hpp"
+#include "caffe/util/philox.hpp"
 
 namespace caffe {
 
@@ -34,9 +35,14 @@ inline void shuffle(RandomAccessIterator begin, RandomAccessIterator end,
   }
 }
 
+// Shuffles with the stream of the current item if any, see ItemRNGScope.
 template <class RandomAccessIterator>
 inline void shuffle(RandomAccessIterator begin, RandomAccessIterator end) {
-  shuffle(begin, end, caffe_rng());
+  if (Philox* item_rng = ItemRNGScope::current()) {
+    shuffle(begin, end, item_rng);
+  } else {
+    shuffle(begin, end, caffe_rng());
+  }
 }
 }  // namespace caffe
 
@@ -9,17 +9,51 @@
 
 namespace caffe {
 
+/**
+ * @brief Boxes as a structure of arrays, so that the samplers check all their
+ * trials against all the objects of an image in flat loops the compiler
+ * vectorizes, instead of going through NormalizedBBox messages per pair.
+ */
+class BBoxArray {
+ public:
+  inline int size() const { return xmin_.size(); }
+  void clear();
+  void reserve(int n);
+  // Appends bbox; its area is BBoxSize(bbox).
+  void push_back(const NormalizedBBox& bbox);
+  void push_back(float xmin, float ymin, float xmax, float ymax);
+  void Get(int i, NormalizedBBox* bbox) const;
+
+  inline const float* xmin() const { return xmin_.data(); }
+  inline const float* ymin() const { return ymin_.data(); }
+  inline const float* xmax() const { return xmax_.data(); }
+  inline const float* ymax() const { return ymax_.data(); }
+  inline const float* area() const { return area_.data(); }
+
+ protected:
+  vector<float> xmin_, ymin_, xmax_, ymax_, area_;
+};
+
 void GenerateJitterSamples(const AnnotatedDatum& anno_datum, float jitter, vector<NormalizedBBox>* sampled_bboxes);
 
 // Find all annotated NormalizedBBox.
 void GroupObjectBBoxes(const AnnotatedDatum& anno_datum,
                        vector<NormalizedBBox>* object_bboxes);
 
+void GroupObjectBBoxes(const AnnotatedDatum& anno_datum,
+                       BBoxArray* object_bboxes);
+
 // Check if a sampled bbox satisfy the constraints with all object bboxes.
 bool SatisfySampleConstraint(const NormalizedBBox& sampled_bbox,
                              const vector<NormalizedBBox>& object_bboxes,
                              const SampleConstraint& sample_constraint);
 
+// SatisfySampleConstraint of each sampled bbox, all at once.
+void SatisfySampleConstraints(const BBoxArray& sampled_bboxes,
+                              const BBoxArray& object_bboxes,
+                              const SampleConstraint& sample_constraint,
+                              vector<char>* satisfied);
+
 // Sample a NormalizedBBox given the specifictions.
 void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox, float orl_ratio);
 void SampleBBox_Square(const AnnotatedDatum& anno_datum, const Sampler& sampler, 
@@ -27,13 +61,13 @@ void SampleBBox_Square(const AnnotatedDatum& anno_datum, const Sampler& sampler,
 
 // Generate samples from NormalizedBBox using the BatchSampler.
 void GenerateSamples(const NormalizedBBox& source_bbox,
-                     const vector<NormalizedBBox>& object_bboxes,
+                     const BBoxArray& object_bboxes,
                      const BatchSampler& batch_sampler,
                      vector<NormalizedBBox>* sampled_bboxes, float orl_ratio);
 
 void GenerateSamples_Square(const AnnotatedDatum& anno_datum,
                      const NormalizedBBox& source_bbox,
-                     const vector<NormalizedBBox>& object_bboxes,
+                     const BBoxArray& object_bboxes,
                      const BatchSampler& batch_sampler,
                      vector<NormalizedBBox>* sampled_bboxes);
 
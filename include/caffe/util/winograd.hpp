@@ -0,0 +1,49 @@
+#ifndef _CAFFE_UTIL_WINOGRAD_HPP_
+#define _CAFFE_UTIL_WINOGRAD_HPP_
+
+namespace caffe {
+
+// Transforms of the Winograd F(2x2, 3x3) convolution, which computes each
+// 2x2 output tile of a 3x3, stride 1 convolution from a 4x4 input tile with
+// 16 multiplications per input channel instead of 36. The transformed
+// kernels, inputs and outputs are kept as 16 matrices, one per element of the
+// 4x4 tile, so that the products over channels are 16 GEMMs:
+//   output[k] (num_output x num_tiles) =
+//       kernel[k] (num_output x channels) * input[k] (channels x num_tiles).
+// Matrix k starts at k * winograd_matrix_stride(rows * cols).
+
+// Pads the matrices so that they do not all start on the same cache sets,
+// which makes writing the 16 of them at once slow.
+inline int winograd_matrix_stride(const int matrix_size) {
+  const int stride = (matrix_size + 15) / 16 * 16;
+  return stride % 1024 ? stride : stride + 16;
+}
+
+// Number of tiles (2x2 of the output, 4x4 of the input) covering an output of
+// output_h x output_w.
+inline int winograd_num_tiles(const int output_h, const int output_w) {
+  return ((output_h + 1) / 2) * ((output_w + 1) / 2);
+}
+
+// kernel_tr (16 x num_output x channels) from the num_output x channels x 3x3
+// kernels.
+template <typename Dtype>
+void winograd_kernel_transform_cpu(const Dtype* kernel, const int num_output,
+    const int channels, Dtype* kernel_tr);
+
+// input_tr (16 x channels x tiles) from the channels x height x width image.
+template <typename Dtype>
+void winograd_input_transform_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    Dtype* input_tr);
+
+// The num_output x output_h x output_w output from output_tr
+// (16 x num_output x tiles).
+template <typename Dtype>
+void winograd_output_transform_cpu(const Dtype* output_tr,
+    const int num_output, const int output_h, const int output_w,
+    Dtype* data_out);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WINOGRAD_HPP_
@@ -0,0 +1,65 @@
+#ifndef CAFFE_UTIL_WORKER_POOL_HPP_
+#define CAFFE_UTIL_WORKER_POOL_HPP_
+
+#include <boost/function.hpp>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of threads that process the items of a batch in parallel.
+ *
+ * Item i is always handled by worker (i % size()), and every worker visits its
+ * items in increasing order. Each worker thread owns its own Caffe random
+ * stream (seeded from the creating thread like any InternalThread), so the
+ * augmentation applied to a given item is reproducible for a given seed.
+ * Worker 0 runs on the calling thread; a pool of size 1 starts no thread.
+ */
+class WorkerPool {
+ public:
+  // Called as job(item_id, worker_id).
+  typedef boost::function<void(int, int)> Job;
+
+  explicit WorkerPool(int num_workers);
+  ~WorkerPool();
+
+  inline int size() const { return num_workers_; }
+
+  /** Runs job on the items [0, num_items) and returns once all are done. */
+  void Run(int num_items, const Job& job);
+
+ protected:
+  class Worker : public InternalThread {
+   public:
+    Worker(WorkerPool* pool, int id);
+    virtual ~Worker();
+
+    // Receives the number of items of each job to run.
+    BlockingQueue<int> tasks_;
+
+   protected:
+    void InternalThreadEntry();
+
+    WorkerPool* pool_;
+    const int id_;
+
+  DISABLE_COPY_AND_ASSIGN(Worker);
+  };
+
+  void RunShare(int num_items, int worker_id);
+
+  const int num_workers_;
+  vector<shared_ptr<Worker> > workers_;
+  BlockingQueue<int> done_;
+  Job job_;
+
+DISABLE_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WORKER_POOL_HPP_
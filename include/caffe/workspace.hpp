@@ -0,0 +1,45 @@
+#ifndef CAFFE_WORKSPACE_HPP_
+#define CAFFE_WORKSPACE_HPP_
+
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Scratch memory shared by the layers of a Net, so that it takes the
+ *        largest of their needs instead of the sum.
+ *
+ * Layers run one at a time, so a layer may use the workspace during one of
+ * its Forward or Backward calls, but must not expect its contents to survive
+ * to the next call. The host and device memory are separate, and are only
+ * allocated once used.
+ */
+class Workspace {
+ public:
+  Workspace() : reserved_size_(0) {}
+
+  /// @brief Sets the size of the first allocations, to avoid growing them.
+  void Reserve(size_t size) {
+    reserved_size_ = std::max(reserved_size_, size);
+  }
+  size_t reserved_size() const { return reserved_size_; }
+
+  /// @brief Returns at least size bytes of host memory.
+  void* mutable_cpu_data(size_t size);
+  /// @brief Returns at least size bytes of device memory.
+  void* mutable_gpu_data(size_t size);
+
+ private:
+  size_t reserved_size_;
+  shared_ptr<SyncedMemory> cpu_data_;
+  shared_ptr<SyncedMemory> gpu_data_;
+
+  DISABLE_COPY_AND_ASSIGN(Workspace);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WORKSPACE_HPP_
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -146,6 +147,21 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
     diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK_GE(memory->size(), count_ * sizeof(Dtype));
+  // Growing past the smaller memory reallocates, and so stops sharing it.
+  capacity_ = std::min<int>(capacity_, memory->size() / sizeof(Dtype));
+  data_ = memory;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffMemory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK_GE(memory->size(), count_ * sizeof(Dtype));
+  capacity_ = std::min<int>(capacity_, memory->size() / sizeof(Dtype));
+  diff_ = memory;
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -1,11 +1,14 @@
+#include <boost/atomic.hpp>
 #include <boost/thread.hpp>
 #include <glog/logging.h>
 #include <cmath>
 #include <cstdio>
+#include <algorithm>
 #include <ctime>
 
 #include "caffe/common.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
@@ -49,6 +52,41 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+// Read by every thread that runs a net, so it is atomic even though it is
+// normally set once, before any net is built.
+static boost::atomic<int> cpu_threads_(1);
+
+int Caffe::cpu_threads() {
+  const int cpu_threads = cpu_threads_;
+  if (cpu_threads > 0) {
+    return cpu_threads;
+  }
+  return std::max<int>(boost::thread::hardware_concurrency(), 1);
+}
+
+int Caffe::cpu_threads_setting() {
+  return cpu_threads_;
+}
+
+void Caffe::set_cpu_threads(int val) {
+  CHECK_GE(val, 0);
+  cpu_threads_ = val;
+}
+
+WorkerPool& Caffe::cpu_pool() {
+  Caffe& caffe = Get();
+  const int num_threads = cpu_threads();
+  if (!caffe.cpu_pool_ || caffe.cpu_pool_->size() != num_threads) {
+    // Starting the workers draws their seeds from this thread's generator;
+    // restore it so that results do not depend on when the pool was made.
+    const rng_t rng = *caffe_rng();
+    caffe.cpu_pool_.reset();
+    caffe.cpu_pool_.reset(new WorkerPool(num_threads));
+    *caffe_rng() = rng;
+  }
+  return *caffe.cpu_pool_;
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -8,6 +9,8 @@
 #include "caffe/layers/annotated_data_layer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
@@ -80,10 +83,74 @@ DataReader<T>::QueuePair::~QueuePair() {
   }
 }
 
+template <typename T>
+DataReader<T>::Shard::Shard(const shared_ptr<db::Cursor>& cursor,
+    const string& start_key, int count, int pool_size, bool profile)
+    : cursor_(cursor), start_key_(start_key), count_(count),
+      profile_(profile ? new DataProfile() : NULL) {
+  for (int i = 0; i < pool_size; ++i) {
+    free_.push(new T());
+  }
+}
+
+template <typename T>
+DataReader<T>::Shard::~Shard() {
+  StopInternalThread();
+  T* t;
+  while (free_.try_pop(&t)) {
+    delete t;
+  }
+  while (full_.try_pop(&t)) {
+    delete t;
+  }
+}
+
+template <typename T>
+void DataReader<T>::Shard::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      StageTimer seek_timer(profile_.get(), DataProfile::READ);
+      cursor_->Seek(start_key_);
+      seek_timer.Stop();
+      for (int i = 0; i < count_ && !must_stop(); ++i) {
+        CHECK(cursor_->valid()) << "Record " << i << " after " << start_key_
+            << " disappeared";
+        StageTimer wait_timer(profile_.get(), DataProfile::QUEUE_WAIT);
+        T* t = free_.pop();
+        wait_timer.Stop();
+        StageTimer parse_timer(profile_.get(), DataProfile::PARSE);
+        CHECK(t->ParseFromArray(cursor_->value_data(), cursor_->value_size()))
+            << "Failed to parse record " << cursor_->key();
+        parse_timer.Stop();
+        full_.push(t);
+        StageTimer read_timer(profile_.get(), DataProfile::READ);
+        cursor_->Next();
+        read_timer.Stop();
+        if (profile_) {
+          boost::mutex::scoped_lock lock(reported_mutex_);
+          reported_.Merge(*profile_);
+          profile_->Reset();
+        }
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename T>
+void DataReader<T>::Shard::TakeProfile(DataProfile* total) {
+  boost::mutex::scoped_lock lock(reported_mutex_);
+  total->Merge(reported_);
+  reported_.Reset();
+}
+
 template <typename T>
 DataReader<T>::Body::Body(const LayerParameter& param)
     : param_(param),
-      new_queue_pairs_() {
+      new_queue_pairs_(),
+      next_shard_(0),
+      order_pos_(0) {
     StartInternalThread();
 }
 
@@ -97,6 +164,48 @@ void DataReader<T>::Body::InternalThreadEntry() {
     shared_ptr<db::DB> db(db::GetDB(param_.data_param().backend()));
     db->Open(param_.data_param().source(), db::READ);
     shared_ptr<db::Cursor> cursor(db->NewCursor());
+    int num_shards = std::max<int>(param_.data_param().reader_threads(), 1);
+    if (param_.data_param().shuffle()) {
+        random_reader_.reset(db->NewRandomReader());
+        CHECK_GT(random_reader_->keys().size(), 0)
+            << param_.data_param().source() << " is empty";
+        // Seeded from this thread's stream, so the epochs are reproducible.
+        rng_.reset(new Caffe::RNG(caffe_rng_rand()));
+        ShuffleEpoch();
+        LOG_IF(WARNING, num_shards > 1) << "Shuffled reading ignores "
+            << "reader_threads, using a single thread";
+    }
+    // Logged every prefetch_stats_interval batches of the first solver.
+    const int stats_records = param_.data_param().prefetch_stats_interval() *
+        param_.data_param().batch_size();
+    if (stats_records > 0) {
+        profile_.reset(new DataProfile());
+    }
+    if (!random_reader_ && num_shards > 1) {
+        // Shard k reads the k-th of num_shards contiguous ranges of the
+        // records, which start at keys found in one pass over them.
+        vector<string> start_keys;
+        vector<int> sizes;
+        db::SplitRanges(db.get(), cursor.get(), num_shards, &start_keys,
+            &sizes);
+        CHECK_GT(start_keys.size(), 0) << param_.data_param().source()
+            << " is empty";
+        num_shards = start_keys.size();
+        // Cursors are created here, one at a time, as LMDB does not allow
+        // concurrent mdb_dbi_open calls. All shards share the same db handle.
+        const int pool_size =
+            std::max<int>(param_.data_param().batch_size(), 1);
+        for (int k = 0; k < num_shards; ++k) {
+            shared_ptr<db::Cursor> shard_cursor(k == 0 ? cursor :
+                shared_ptr<db::Cursor>(db->NewCursor()));
+            shards_.push_back(shared_ptr<Shard>(new Shard(shard_cursor,
+                start_keys[k], sizes[k], pool_size, profile_ != NULL)));
+            shards_.back()->StartInternalThread();
+        }
+        LOG(INFO) << "Reading " << param_.data_param().source() << " with "
+            << num_shards << " threads";
+    }
+    int num_records = 0;
     vector<shared_ptr<QueuePair> > qps;
     try {
         int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
@@ -114,6 +223,9 @@ void DataReader<T>::Body::InternalThreadEntry() {
             for (int i = 0; i < solver_count; ++i) {
                 read_one(cursor.get(), qps[i].get());
             }
+            if (profile_ && ++num_records % stats_records == 0) {
+                LogProfile();
+            }
             // Check no additional readers have been created. This can happen if
             // more than one net is trained at a time per process, whether single
             // or multi solver. It might also happen if two data layers have same
@@ -123,16 +235,114 @@ void DataReader<T>::Body::InternalThreadEntry() {
     } catch (boost::thread_interrupted&) {
         // Interrupted exception is expected on shutdown
     }
+    // Join the shards before their cursors and the db go away. The interrupt
+    // of this thread may still be pending, and would cut their joins short.
+    boost::this_thread::disable_interruption no_interrupt;
+    shards_.clear();
+    random_reader_.reset();
+}
+
+template <typename T>
+void DataReader<T>::Body::LogProfile() {
+    const int num_batches = param_.data_param().prefetch_stats_interval();
+    if (shards_.empty()) {
+        LOG(INFO) << "Reader of " << param_.data_param().source()
+            << ", per batch: " << profile_->Summary(num_batches);
+    } else {
+        // The body only waits for the shards, which read and parse.
+        DataProfile shards_total;
+        for (int i = 0; i < shards_.size(); ++i) {
+            shards_[i]->TakeProfile(&shards_total);
+        }
+        LOG(INFO) << "Reader of " << param_.data_param().source()
+            << ", per batch: waiting for its shards "
+            << profile_->microseconds(DataProfile::READ) / 1000 / num_batches
+            << " ms; in its " << shards_.size() << " shard threads (summed): "
+            << shards_total.Summary(num_batches);
+    }
+    profile_->Reset();
+}
+
+template <typename T>
+void DataReader<T>::Body::ShuffleEpoch() {
+    const vector<string>& keys = random_reader_->keys();
+    if (order_.size() != keys.size()) {
+        order_.resize(keys.size());
+        for (int i = 0; i < order_.size(); ++i) {
+            order_[i] = i;
+        }
+    }
+    caffe::rng_t* rng = static_cast<caffe::rng_t*>(rng_->generator());
+    shuffle(order_.begin(), order_.end(), rng);
+    order_pos_ = 0;
+    const int lookahead = std::min<int>(
+        param_.data_param().batch_size(), order_.size());
+    for (int i = 0; i < lookahead; ++i) {
+        const char* data;
+        size_t size;
+        if (random_reader_->Get(keys[order_[i]], &data, &size)) {
+            random_reader_->WillNeed(data, size);
+        }
+    }
 }
 
 template <typename T>
 void DataReader<T>::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
+    if (!shards_.empty()) {
+        // Take the shards in turn, one record each: the ranges come
+        // interleaved rather than in the order of the source, but in the
+        // same order every epoch.
+        // Swapping hands over the parsed record without copying it.
+        T* t = qp->free_.pop();
+        Shard* shard = shards_[next_shard_].get();
+        StageTimer read_timer(profile_.get(), DataProfile::READ);
+        T* record = shard->full_.pop();
+        read_timer.Stop();
+        t->Swap(record);
+        shard->free_.push(record);
+        qp->full_.push(t);
+        next_shard_ = (next_shard_ + 1) % shards_.size();
+        return;
+    }
+    if (random_reader_) {
+        const vector<string>& keys = random_reader_->keys();
+        const char* data;
+        size_t size;
+        T* t = qp->free_.pop();
+        StageTimer read_timer(profile_.get(), DataProfile::READ);
+        CHECK(random_reader_->Get(keys[order_[order_pos_]], &data, &size))
+            << "Key " << keys[order_[order_pos_]] << " disappeared from "
+            << param_.data_param().source();
+        read_timer.Stop();
+        StageTimer parse_timer(profile_.get(), DataProfile::PARSE);
+        CHECK(t->ParseFromArray(data, size))
+            << "Failed to parse record " << keys[order_[order_pos_]];
+        parse_timer.Stop();
+        qp->full_.push(t);
+        // Hint the record one batch ahead, so it is paged in by the time we
+        // get to it.
+        const int ahead = order_pos_ + param_.data_param().batch_size();
+        if (ahead < order_.size() &&
+            random_reader_->Get(keys[order_[ahead]], &data, &size)) {
+            random_reader_->WillNeed(data, size);
+        }
+        if (++order_pos_ == order_.size()) {
+            DLOG(INFO) << "Restarting data prefetching in a new order.";
+            ShuffleEpoch();
+        }
+        return;
+    }
     T* t = qp->free_.pop();
-    // TODO deserialize in-place instead of copy?
-    t->ParseFromString(cursor->value());
+    StageTimer parse_timer(profile_.get(), DataProfile::PARSE);
+    // Deserialize straight from the memory-mapped value: no intermediate
+    // string, and the recycled message keeps its buffers across records.
+    CHECK(t->ParseFromArray(cursor->value_data(), cursor->value_size()))
+        << "Failed to parse record " << cursor->key();
+    parse_timer.Stop();
     qp->full_.push(t);
 
     // go to the next iter
+    StageTimer read_timer(profile_.get(), DataProfile::READ);
     cursor->Next();
     if (!cursor->valid()) {
         DLOG(INFO) << "Restarting data prefetching from start.";
@@ -2,13 +2,16 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include "caffe/data_transformer.hpp"
 #include "caffe/util/bbox_util.hpp"
 #include "caffe/util/im_transforms.hpp"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/pixel_transform.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -16,7 +19,8 @@ namespace caffe {
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
 		Phase phase)
-		: param_(param), phase_(phase) {
+		: param_(param), phase_(phase),
+			image_cache_(NULL), source_datum_(NULL), profile_(NULL) {
 	// check if we want to use mean_file
 	if (param_.has_mean_file()) {
 		CHECK_EQ(param_.mean_value_size(), 0) <<
@@ -159,13 +163,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 #ifdef USE_OPENCV
 		CHECK(!(param_.force_color() && param_.force_gray()))
 				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-		// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		cv::Mat cv_img = DecodeImage(datum);
 		// Transform the cv::image into blob.
 		return Transform(cv_img, transformed_blob, crop_bbox, do_mirror);
 #else
@@ -276,6 +274,19 @@ void DataTransformer<Dtype>::Transform(
 	Transform(anno_datum, transformed_blob, transformed_anno_vec, &do_mirror);
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(
+		const AnnotatedDatum& anno_datum, Blob<Dtype>* transformed_blob,
+		vector<AnnotationBox>* transformed_boxes) {
+	const Datum& datum = anno_datum.datum();
+	NormalizedBBox crop_bbox;
+	bool do_mirror;
+	Transform(datum, transformed_blob, &crop_bbox, &do_mirror);
+	const bool do_resize = true;
+	TransformAnnotation(anno_datum, do_resize, crop_bbox, do_mirror,
+											transformed_boxes);
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::TransformAnnotation(
 		const AnnotatedDatum& anno_datum, const bool do_resize,
@@ -284,99 +295,15 @@ void DataTransformer<Dtype>::TransformAnnotation(
 	const int img_height = anno_datum.datum().height();
 	const int img_width = anno_datum.datum().width();
 	if (anno_datum.type() == AnnotatedDatum_AnnotationType_BBOX) {
-		// Go through each AnnotationGroup.
+		vector<AnnotationBox> boxes;
 		for (int g = 0; g < anno_datum.annotation_group_size(); ++g) {
-			const AnnotationGroup& anno_group = anno_datum.annotation_group(g);
-			AnnotationGroup transformed_anno_group;
-			// Go through each Annotation.
-			bool has_valid_annotation = false;
-			for (int a = 0; a < anno_group.annotation_size(); ++a) {
-				const Annotation& anno = anno_group.annotation(a);
-				const NormalizedBBox& bbox = anno.bbox();
-                const AnnoFaceLandmarks& lmarks = anno.face_lm();
-                bool has_valid_lm = false;
-                const int has_lm = anno.has_lm();
-                if(has_lm > 0){
-                    CHECK_EQ(has_lm, 1);
-                    CHECK_GT(lmarks.righteye().x() , 0.f);
-                }
-				// Adjust bounding box annotation.
-				NormalizedBBox resize_bbox = bbox;
-                AnnoFaceLandmarks resize_lmarks = lmarks;
-				if (do_resize && param_.has_resize_param()) {
-					CHECK_GT(img_height, 0);
-					CHECK_GT(img_width, 0);
-					UpdateBBoxByResizePolicy(param_.resize_param(), img_width, img_height,
-																		&resize_bbox);
-                    if(has_lm > 0){
-                        UpdateLandmarkFacePoseByResizePolicy(param_.resize_param(),
-											img_width, img_height,
-											&resize_lmarks);
-                    }
-				}
-				if (param_.has_emit_constraint() &&
-						!MeetEmitConstraint(crop_bbox, resize_bbox,
-																param_.emit_constraint())) {
-					continue;
-				}
-				NormalizedBBox proj_bbox;
-                AnnoFaceLandmarks project_facemark = resize_lmarks;
-				if (ProjectBBox(crop_bbox, resize_bbox, &proj_bbox)) {
-					has_valid_annotation = true;
-					Annotation* transformed_anno =
-							transformed_anno_group.add_annotation();
-					transformed_anno->set_instance_id(anno.instance_id());
-					NormalizedBBox* transformed_bbox = transformed_anno->mutable_bbox();
-					transformed_bbox->CopyFrom(proj_bbox);
-					if (do_mirror) {
-						Dtype temp = transformed_bbox->xmin();
-						transformed_bbox->set_xmin(1 - transformed_bbox->xmax());
-						transformed_bbox->set_xmax(1 - temp);
-					}
-					if (do_resize && param_.has_resize_param()) {
-						ExtrapolateBBox(param_.resize_param(), img_height, img_width,
-								crop_bbox, transformed_bbox);
-					}    
-                    if(has_lm > 0 && ProjectfacemarksBBox(crop_bbox, &project_facemark)){
-                        has_valid_lm = true;
-                        point lefteye = project_facemark.lefteye();
-                        point righteye = project_facemark.righteye();
-                        point nose = project_facemark.nose();
-                        point leftmouth = project_facemark.leftmouth();
-                        point rightmouth = project_facemark.rightmouth();
-
-                        if(do_mirror){
-                            project_facemark.mutable_lefteye()->set_x(1-lefteye.x());
-                            project_facemark.mutable_righteye()->set_x(1-righteye.x());
-                            project_facemark.mutable_nose()->set_x(1-nose.x());
-                            project_facemark.mutable_leftmouth()->set_x(1-leftmouth.x());
-                            project_facemark.mutable_rightmouth()->set_x(1-rightmouth.x());
-                        }
-                    }
-					if(has_valid_lm){
-						transformed_anno->set_has_lm(1);
-					}
-                    else{
-						transformed_anno->set_has_lm(0);
-						project_facemark.mutable_lefteye()->set_x(-1.);
-						project_facemark.mutable_righteye()->set_x(-1.);
-						project_facemark.mutable_nose()->set_x(-1.);
-						project_facemark.mutable_leftmouth()->set_x(-1.);
-						project_facemark.mutable_rightmouth()->set_x(-1.);
-						project_facemark.mutable_lefteye()->set_y(-1.);
-						project_facemark.mutable_righteye()->set_y(-1.);
-						project_facemark.mutable_nose()->set_y(-1.);
-						project_facemark.mutable_leftmouth()->set_y(-1.);
-						project_facemark.mutable_rightmouth()->set_y(-1.);
-					}
-					AnnoFaceLandmarks* trans_lm = transformed_anno->mutable_face_lm();
-					trans_lm->CopyFrom(project_facemark);                  
-				}
-			}
+			boxes.clear();
+			TransformAnnotationGroup(anno_datum.annotation_group(g), img_height,
+					img_width, do_resize, crop_bbox, do_mirror, &boxes);
 			// Save for output.
-			if (has_valid_annotation) {
-				transformed_anno_group.set_group_label(anno_group.group_label());
-				transformed_anno_group_all->Add()->CopyFrom(transformed_anno_group);
+			if (!boxes.empty()) {
+				AnnotationBoxesToGroup(&boxes[0], boxes.size(),
+															 transformed_anno_group_all->Add());
 			}
 		}
 	} else {
@@ -384,6 +311,92 @@ void DataTransformer<Dtype>::TransformAnnotation(
 	}
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformAnnotation(
+		const AnnotatedDatum& anno_datum, const bool do_resize,
+		const NormalizedBBox& crop_bbox, const bool do_mirror,
+		vector<AnnotationBox>* transformed_boxes) {
+	const int img_height = anno_datum.datum().height();
+	const int img_width = anno_datum.datum().width();
+	if (anno_datum.type() == AnnotatedDatum_AnnotationType_BBOX) {
+		for (int g = 0; g < anno_datum.annotation_group_size(); ++g) {
+			TransformAnnotationGroup(anno_datum.annotation_group(g), img_height,
+					img_width, do_resize, crop_bbox, do_mirror, transformed_boxes);
+		}
+	} else {
+		LOG(FATAL) << "Unknown annotation type.";
+	}
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformAnnotationGroup(
+		const AnnotationGroup& anno_group, const int img_height,
+		const int img_width, const bool do_resize,
+		const NormalizedBBox& crop_bbox, const bool do_mirror,
+		vector<AnnotationBox>* transformed_boxes) {
+	// Go through each Annotation.
+	for (int a = 0; a < anno_group.annotation_size(); ++a) {
+		const Annotation& anno = anno_group.annotation(a);
+		const int has_lm = anno.has_lm();
+		if (has_lm > 0) {
+			CHECK_EQ(has_lm, 1);
+			CHECK_GT(anno.face_lm().righteye().x(), 0.f);
+		}
+		AnnotationBox box;
+		GetFaceLandmarks(anno.face_lm(), box.landmarks);
+		// Adjust bounding box annotation.
+		NormalizedBBox resize_bbox = anno.bbox();
+		if (do_resize && param_.has_resize_param()) {
+			CHECK_GT(img_height, 0);
+			CHECK_GT(img_width, 0);
+			UpdateBBoxByResizePolicy(param_.resize_param(), img_width, img_height,
+															 &resize_bbox);
+			if (has_lm > 0) {
+				UpdateLandmarksByResizePolicy(param_.resize_param(), img_width,
+																			img_height, box.landmarks);
+			}
+		}
+		if (param_.has_emit_constraint() &&
+				!MeetEmitConstraint(crop_bbox, resize_bbox,
+														param_.emit_constraint())) {
+			continue;
+		}
+		NormalizedBBox proj_bbox;
+		if (!ProjectBBox(crop_bbox, resize_bbox, &proj_bbox)) {
+			continue;
+		}
+		if (do_mirror) {
+			Dtype temp = proj_bbox.xmin();
+			proj_bbox.set_xmin(1 - proj_bbox.xmax());
+			proj_bbox.set_xmax(1 - temp);
+		}
+		if (do_resize && param_.has_resize_param()) {
+			ExtrapolateBBox(param_.resize_param(), img_height, img_width,
+					crop_bbox, &proj_bbox);
+		}
+		box.group_label = anno_group.group_label();
+		box.instance_id = anno.instance_id();
+		box.xmin = proj_bbox.xmin();
+		box.ymin = proj_bbox.ymin();
+		box.xmax = proj_bbox.xmax();
+		box.ymax = proj_bbox.ymax();
+		box.size = proj_bbox.size();
+		box.difficult = proj_bbox.difficult();
+		if (has_lm > 0 && ProjectLandmarks(crop_bbox, box.landmarks)) {
+			box.has_lm = 1;
+			if (do_mirror) {
+				for (int i = 0; i < kNumFaceLandmarks; ++i) {
+					box.landmarks[2 * i] = 1 - box.landmarks[2 * i];
+				}
+			}
+		} else {
+			box.has_lm = 0;
+			std::fill(box.landmarks, box.landmarks + 2 * kNumFaceLandmarks, -1.f);
+		}
+		transformed_boxes->push_back(box);
+	}
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const AnnoFaceAttributeDatum& anno_datum,
                  Blob<Dtype>* transformed_blob,
@@ -417,52 +430,46 @@ void DataTransformer<Dtype>::TransformAnnoFaceAttribute(
 		AnnoFaceAttribute* transformed_annoface_all){
 	const int img_height = anno_datum.datum().height();
 	const int img_width = anno_datum.datum().width();
-	AnnoFaceAttribute src_annoface = anno_datum.faceattri();
-	AnnoFaceLandmarks src_facemark = src_annoface.landmark();
-	AnnoFaceLandmarks project_facemark;
+	const AnnoFaceAttribute& src_annoface = anno_datum.faceattri();
 	if(anno_datum.type() == AnnoFaceAttributeDatum_AnnoType_FACEATTRIBUTE){
+		float src_points[2 * kNumFaceLandmarks];
+		GetFaceLandmarks(src_annoface.landmark(), src_points);
 		if(do_resize && param_.has_resize_param()){
 			CHECK_GT(img_height, 0);
 			CHECK_GT(img_width, 0);
-			UpdateLandmarkFacePoseByResizePolicy(param_.resize_param(),
+			UpdateLandmarksByResizePolicy(param_.resize_param(),
 											img_width, img_height,
-											&src_facemark);
+											src_points);
 		}
-		project_facemark.CopyFrom(src_facemark);
-		point lefteye = src_facemark.lefteye();
-		point righteye = src_facemark.righteye();
-		point nose = src_facemark.nose();
-		point leftmouth = src_facemark.leftmouth();
-		point rightmouth = src_facemark.rightmouth();
+		float project_points[2 * kNumFaceLandmarks];
+		std::copy(src_points, src_points + 2 * kNumFaceLandmarks, project_points);
+		const AnnoFaceOritation& src_oritation = src_annoface.faceoritation();
+		AnnoFaceOritation* oritation =
+				transformed_annoface_all->mutable_faceoritation();
 		if(do_mirror){
-			project_facemark.mutable_lefteye()->set_x(1-lefteye.x());
-			project_facemark.mutable_righteye()->set_x(1-righteye.x());
-			project_facemark.mutable_nose()->set_x(1-nose.x());
-			project_facemark.mutable_leftmouth()->set_x(1-leftmouth.x());
-			project_facemark.mutable_rightmouth()->set_x(1-rightmouth.x());
-			transformed_annoface_all->mutable_faceoritation()->set_yaw(-src_annoface.faceoritation().yaw());
-			transformed_annoface_all->mutable_faceoritation()->set_pitch(src_annoface.faceoritation().pitch());
-			transformed_annoface_all->mutable_faceoritation()->set_roll(-src_annoface.faceoritation().roll());
+			for (int i = 0; i < kNumFaceLandmarks; ++i) {
+				project_points[2 * i] = 1 - src_points[2 * i];
+			}
+			oritation->set_yaw(-src_oritation.yaw());
+			oritation->set_pitch(src_oritation.pitch());
+			oritation->set_roll(-src_oritation.roll());
 		}else{
-			transformed_annoface_all->mutable_faceoritation()->set_yaw(src_annoface.faceoritation().yaw());
-			transformed_annoface_all->mutable_faceoritation()->set_pitch(src_annoface.faceoritation().pitch());
-			transformed_annoface_all->mutable_faceoritation()->set_roll(src_annoface.faceoritation().roll());
+			oritation->set_yaw(src_oritation.yaw());
+			oritation->set_pitch(src_oritation.pitch());
+			oritation->set_roll(src_oritation.roll());
 		}
 		if(do_expand){
 			float src_width = crop_bbox.xmax() - crop_bbox.xmin();
 			float src_height = crop_bbox.ymax() - crop_bbox.ymin();
-			project_facemark.mutable_lefteye()->set_x((lefteye.x()-crop_bbox.xmin())/src_width);
-			project_facemark.mutable_lefteye()->set_y((lefteye.y()-crop_bbox.ymin())/src_height);
-			project_facemark.mutable_righteye()->set_x((righteye.x()-crop_bbox.xmin())/src_width);
-			project_facemark.mutable_righteye()->set_y((righteye.y()-crop_bbox.ymin())/src_height);
-			project_facemark.mutable_nose()->set_x((nose.x()-crop_bbox.xmin())/src_width);
-			project_facemark.mutable_nose()->set_y((nose.y()-crop_bbox.ymin())/src_height);
-			project_facemark.mutable_leftmouth()->set_x((leftmouth.x()-crop_bbox.xmin())/src_width);
-			project_facemark.mutable_leftmouth()->set_y((leftmouth.y()-crop_bbox.ymin())/src_height);
-			project_facemark.mutable_rightmouth()->set_x((rightmouth.x()-crop_bbox.xmin())/src_width);
-			project_facemark.mutable_rightmouth()->set_y((rightmouth.y()-crop_bbox.ymin())/src_height);
+			for (int i = 0; i < kNumFaceLandmarks; ++i) {
+				project_points[2 * i] =
+						(src_points[2 * i] - crop_bbox.xmin()) / src_width;
+				project_points[2 * i + 1] =
+						(src_points[2 * i + 1] - crop_bbox.ymin()) / src_height;
+			}
 		}
-		transformed_annoface_all->mutable_landmark()->CopyFrom(project_facemark);
+		SetFaceLandmarks(project_points,
+										 transformed_annoface_all->mutable_landmark());
 		transformed_annoface_all->set_gender(src_annoface.gender());
 		transformed_annoface_all->set_glass(src_annoface.glass());
 	}
@@ -520,13 +527,11 @@ void DataTransformer<Dtype>::CropImageAnchor(const Datum& datum, const Normalize
 	#ifdef USE_OPENCV
 		CHECK(!(param_.force_color() && param_.force_gray()))
 				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-			// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		// The crop is enlarged to the resize target, which would enlarge an
+		// image decoded reduced.
+		CHECK(!param_.reduced_decode())
+				<< "reduced_decode cannot be used with sampled crops";
+		cv::Mat cv_img = DecodeImage(datum);
 		// Crop the image.
 		cv::Mat crop_img;
 		CropImageData_Anchor(cv_img, bbox, &crop_img);
@@ -590,14 +595,11 @@ void DataTransformer<Dtype>::CropImage(const Datum& datum,
 	#ifdef USE_OPENCV
 		CHECK(!(param_.force_color() && param_.force_gray()))
 				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-			// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-			
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		// The crop is enlarged to the resize target, which would enlarge an
+		// image decoded reduced.
+		CHECK(!param_.reduced_decode())
+				<< "reduced_decode cannot be used with sampled crops";
+		cv::Mat cv_img = DecodeImage(datum);
 		// Crop the image.
 		cv::Mat crop_img;
 		CropImage(cv_img, bbox, &crop_img);
@@ -693,13 +695,8 @@ void DataTransformer<Dtype>::ExpandImage(const Datum& datum,
 #ifdef USE_OPENCV
 		CHECK(!(param_.force_color() && param_.force_gray()))
 				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-			// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		cv::Mat cv_img = DecodeImage(datum);
+		StageTimer expand_timer(profile_, DataProfile::EXPAND);
 		// Expand the image.
 		cv::Mat expand_img;
 		ExpandImage(cv_img, expand_ratio, expand_bbox, &expand_img);
@@ -880,13 +877,8 @@ void DataTransformer<Dtype>::DistortImage(const Datum& datum,
 	#ifdef USE_OPENCV
 		CHECK(!(param_.force_color() && param_.force_gray()))
 				<< "cannot set both force_color and force_gray";
-		cv::Mat cv_img;
-		if (param_.force_color() || param_.force_gray()) {
-			// If force_color then decode in color otherwise decode in gray.
-			cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-		} else {
-			cv_img = DecodeDatumToCVMatNative(datum);
-		}
+		cv::Mat cv_img = DecodeImage(datum);
+		StageTimer distort_timer(profile_, DataProfile::DISTORT);
 		// Distort the image.
 		cv::Mat distort_img = ApplyDistort(cv_img, param_.distort_param());
 		// Save the image into datum.
@@ -902,6 +894,80 @@ void DataTransformer<Dtype>::DistortImage(const Datum& datum,
 }
 
 #ifdef USE_OPENCV
+template<typename Dtype>
+bool DataTransformer<Dtype>::ReducedDecodeSize(const Datum& datum,
+		int* min_height, int* min_width) const {
+	if (!param_.reduced_decode() || !param_.has_resize_param()) {
+		return false;
+	}
+	const ResizeParameter& resize_param = param_.resize_param();
+	const int new_height = resize_param.height();
+	const int new_width = resize_param.width();
+	int height, width, channels;
+	if (new_height <= 0 || new_width <= 0 ||
+			!GetJPEGSize(datum.data(), &height, &width, &channels)) {
+		return false;
+	}
+	// The size the image content is resized to, padding excluded, as in
+	// ApplyResize.
+	const float orig_aspect = static_cast<float>(width) / height;
+	const float new_aspect = static_cast<float>(new_width) / new_height;
+	switch (resize_param.resize_mode()) {
+	case ResizeParameter_Resize_mode_WARP:
+	case ResizeParameter_Resize_mode_FIT_SMALL_SIZE:
+		InferNewSize(resize_param, width, height, min_width, min_height);
+		break;
+	case ResizeParameter_Resize_mode_FIT_LARGE_SIZE_AND_PAD:
+		if (orig_aspect > new_aspect) {
+			*min_width = new_width;
+			*min_height = floor(static_cast<float>(new_width) / orig_aspect);
+		} else {
+			*min_width = floor(orig_aspect * new_height);
+			*min_height = new_height;
+		}
+		break;
+	default:
+		return false;
+	}
+	return *min_height > 0 && *min_width > 0;
+}
+
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::DecodeImage(const Datum& datum) {
+	StageTimer timer(profile_, DataProfile::DECODE);
+	const bool cached = image_cache_ && &datum == source_datum_;
+	ImageCache::Key key;
+	cv::Mat cv_img;
+	if (cached) {
+		key = ImageCache::KeyOf(datum.data());
+		if (image_cache_->Get(key, &cv_img)) {
+			return cv_img;
+		}
+	}
+	// Distorting or expanding the image before it is resized to the target
+	// does not enlarge it, so whichever step decodes the source first may let
+	// the decoder shrink it, as long as it is no smaller than the target.
+	int min_height, min_width;
+	if (ReducedDecodeSize(datum, &min_height, &min_width)) {
+		int cv_read_flag = CV_LOAD_IMAGE_UNCHANGED;
+		if (param_.force_color() || param_.force_gray()) {
+			cv_read_flag = param_.force_color() ? CV_LOAD_IMAGE_COLOR :
+					CV_LOAD_IMAGE_GRAYSCALE;
+		}
+		cv_img = DecodeDatumToCVMatReduced(datum, min_height, min_width,
+				cv_read_flag);
+	} else if (param_.force_color() || param_.force_gray()) {
+		// If force_color then decode in color otherwise decode in gray.
+		cv_img = DecodeDatumToCVMat(datum, param_.force_color());
+	} else {
+		cv_img = DecodeDatumToCVMatNative(datum);
+	}
+	if (cached && cv_img.data) {
+		image_cache_->Put(key, cv_img);
+	}
+	return cv_img;
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
 																		Blob<Dtype>* transformed_blob) {
@@ -970,6 +1036,7 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 
 	cv::Mat cv_resized_image, cv_noised_image, cv_cropped_image;
 	if (param_.has_resize_param()) {
+		StageTimer timer(profile_, DataProfile::RESIZE);
 		cv_resized_image = ApplyResize(cv_img, param_.resize_param());
 	} else {
 		cv_resized_image = cv_img;
@@ -1016,6 +1083,15 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 	CHECK(cv_cropped_image.data);
 
 	Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+	if (!has_mean_file) {
+		// Crop, mirror, mean and scale in a single pass.
+		TransformHWCToCHW(cv_cropped_image.data,
+				static_cast<int>(cv_cropped_image.step), height, width,
+				img_channels, *do_mirror,
+				has_mean_values ? &mean_values_[0] : NULL, scale,
+				transformed_data);
+		return;
+	}
 	int top_index;
 	for (int h = 0; h < height; ++h) {
 		const uchar* ptr = cv_cropped_image.ptr<uchar>(h);
@@ -1547,8 +1623,11 @@ void DataTransformer<Dtype>::InitRand() {
 
 template <typename Dtype>
 int DataTransformer<Dtype>::Rand(int n) {
-	CHECK(rng_);
 	CHECK_GT(n, 0);
+	if (Philox* item_rng = ItemRNGScope::current()) {
+		return ((*item_rng)() % n);
+	}
+	CHECK(rng_);
 	caffe::rng_t* rng =
 			static_cast<caffe::rng_t*>(rng_->generator());
 	return ((*rng)() % n);
@@ -3,13 +3,16 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <map>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/annotated_data_layer.hpp"
+#include "caffe/util/bbox_util.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/philox.hpp"
 #include "caffe/util/sampler.hpp"
 
 
@@ -51,6 +54,10 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
     // Make sure dimension is consistent within batch.
     const TransformationParameter& transform_param =
         this->layer_param_.transform_param();
+    CHECK(!transform_param.reduced_decode() ||
+          (batch_samplers_.empty() && data_anchor_samplers_.empty()))
+        << "reduced_decode cannot be used with batch_sampler or "
+        << "data_anchor_sampler, whose crops enlarge the image.";
     if (transform_param.has_resize_param()) {
         if (transform_param.resize_param().resize_mode() ==
             ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
@@ -72,8 +79,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
     // Reshape top[0] and prefetch_data according to the batch_size.
     top_shape[0] = batch_size;
     top[0]->Reshape(top_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-        this->prefetch_[i].data_.Reshape(top_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+        this->prefetch_[i]->data_.Reshape(top_shape);
     }
     LOG(INFO) << "output data size: " << top[0]->num() << 
                 "," << top[0]->channels() << 
@@ -118,8 +125,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
             label_shape[0] = batch_size;
         }
         top[1]->Reshape(label_shape);
-        for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-            this->prefetch_[i].label_.Reshape(label_shape);
+        for (int i = 0; i < this->prefetch_.size(); ++i) {
+            this->prefetch_[i]->label_.Reshape(label_shape);
         }
     }
 }
@@ -138,10 +145,6 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // Reshape according to the first anno_datum of each batch
     // on single input batches allows for inputs of varying dimension.
     const int batch_size = this->layer_param_.data_param().batch_size();
-    const AnnotatedDataParameter& anno_data_param =
-        this->layer_param_.annotated_data_param();
-    const TransformationParameter& transform_param =
-    this->layer_param_.transform_param();
     AnnotatedDatum& anno_datum = *(reader_.full().peek());
     // Use data_transformer to infer the expected blob shape from anno_datum.
     vector<int> top_shape =
@@ -156,204 +159,38 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     if (this->output_labels_ && !has_anno_type_) {
         top_label = batch->label_.mutable_cpu_data();
     }
-    // Store transformed annotation.
-    map<int, vector<AnnotationGroup> > all_anno;
     int num_bboxes = 0;
 
+    // Pop the whole batch first so that items keep the reader order, then
+    // distort, expand, sample and transform them on the worker threads.
+    timer.Start();
+    StageTimer read_timer(this->profile(0), DataProfile::READ);
+    vector<AnnotatedDatum*> anno_datums(batch_size);
     for (int item_id = 0; item_id < batch_size; ++item_id) {
-        timer.Start();
-        // get a anno_datum
-        AnnotatedDatum& anno_datum = *(reader_.full().pop("Waiting for data"));
-        read_time += timer.MicroSeconds();
-        timer.Start();
-        AnnotatedDatum distort_datum;
-        AnnotatedDatum* expand_datum = NULL;
-        AnnotatedDatum* resized_anno_datum = NULL;
-        bool do_resize = false;
-        if (transform_param.has_distort_param()) {
-            distort_datum.CopyFrom(anno_datum);
-            this->data_transformer_->DistortImage(anno_datum.datum(),
-                                                distort_datum.mutable_datum());
-            if (transform_param.has_expand_param()) {
-                expand_datum = new AnnotatedDatum();
-                this->data_transformer_->ExpandImage(distort_datum, expand_datum);
-            } else {
-                expand_datum = &distort_datum;
-            }
-        } else {
-            if (transform_param.has_expand_param()) {
-                expand_datum = new AnnotatedDatum();
-                this->data_transformer_->ExpandImage(anno_datum, expand_datum);
-            } else {
-                expand_datum = &anno_datum;
-            }
-        }
-        AnnotatedDatum* sampled_datum = NULL;
-        bool has_sampled = false;
-        bool CropSample = false;
-        vector<NormalizedBBox> sampled_bboxes;
-        sampled_bboxes.clear();
-        if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_BATCH){
-            if (batch_samplers_.size() > 0) {
-                GenerateBatchSamples_Square(*expand_datum, batch_samplers_, &sampled_bboxes);
-                CropSample = true;
-            } else {
-                sampled_datum = expand_datum;
-            }
-        }
-        else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_JITTER){
-            GenerateJitterSamples(*expand_datum, 0.1, &sampled_bboxes);
-            CropSample = true;
-        }
-        else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_ANCHOR){
-            if(data_anchor_samplers_.size() > 0){
-                GenerateBatchDataAnchorSamples(*expand_datum, data_anchor_samplers_, &sampled_bboxes);
-                int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
-                sampled_datum = new AnnotatedDatum();
-                this->data_transformer_->CropImage_Sampling(*expand_datum,
-                                                    sampled_bboxes[rand_idx],
-                                                    sampled_datum);
-                has_sampled = true;
-            }else{
-                sampled_datum = expand_datum;
-            }
-        }
-        else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_GT_BBOX){
-            if (anno_data_param.has_bbox_sampler()) {
-                resized_anno_datum = new AnnotatedDatum();
-                do_resize = true;
-                GenerateLFFDSample(*expand_datum, &sampled_bboxes, 
-                                bbox_small_scale_, bbox_large_scale_, anchor_stride_,
-                                resized_anno_datum, transform_param, do_resize);
-                CHECK_GT(resized_anno_datum->datum().channels(), 0);
-                sampled_datum = new AnnotatedDatum();
-                this->data_transformer_->CropImage_Sampling(*resized_anno_datum,
-                                                sampled_bboxes[0], sampled_datum);
-                has_sampled = true;
-            } else {
-                sampled_datum = expand_datum;
-            }
-        }
-        else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_DEFAULT){
-            sampled_datum = expand_datum;
-        }
-        if(CropSample){        
-            if (sampled_bboxes.size() > 0) {
-                int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
-                sampled_datum = new AnnotatedDatum();
-                this->data_transformer_->CropImage(*expand_datum,
-                                                    sampled_bboxes[rand_idx],
-                                                    sampled_datum);
-                has_sampled = true;
-            } else {
-                sampled_datum = expand_datum;
-            }
-        }
-        CHECK(sampled_datum != NULL);
-        timer.Start();
-        vector<int> shape = this->data_transformer_->InferBlobShape(sampled_datum->datum());
-        if (transform_param.has_resize_param()) {
-            if (transform_param.resize_param().resize_mode() ==
-                ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
-                this->transformed_data_.Reshape(shape);
-                batch->data_.Reshape(shape);
-                top_data = batch->data_.mutable_cpu_data();
-            } else {
-                CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-                        shape.begin() + 1));
-            }
-        } else {
-            CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-                shape.begin() + 1));
-        }
-        // Apply data transformations (mirror, scale, crop...)
-        int offset = batch->data_.offset(item_id);
-        this->transformed_data_.set_cpu_data(top_data + offset);
-        vector<AnnotationGroup> transformed_anno_vec;
-        if (this->output_labels_) {
-            if (has_anno_type_) {
-                CHECK(sampled_datum->has_type()) << "Some datum misses AnnotationType.";
-                if (anno_data_param.has_anno_type()) {
-                    sampled_datum->set_type(anno_type_);
-                } else {
-                    CHECK_EQ(anno_type_, sampled_datum->type()) << "Different AnnotationType.";
-                }
-                // Transform datum and annotation_group at the same time
-                transformed_anno_vec.clear();
-                this->data_transformer_->Transform(*sampled_datum,
-                                                    &(this->transformed_data_),
-                                                    &transformed_anno_vec);
-                if (anno_type_ == AnnotatedDatum_AnnotationType_BBOX) {
-                    // Count the number of bboxes.
-                    for (int g = 0; g < transformed_anno_vec.size(); ++g) {
-                        num_bboxes += transformed_anno_vec[g].annotation_size();
-                    }
-                } else {
-                    LOG(FATAL) << "Unknown annotation type.";
-                }
-                all_anno[item_id] = transformed_anno_vec;
+        anno_datums[item_id] = reader_.full().pop("Waiting for data");
+    }
+    read_time += timer.MicroSeconds();
+    read_timer.Stop();
+    timer.Start();
+    // Store transformed annotation.
+    vector<vector<AnnotationBox> > transformed_annos(batch_size);
+    this->transform_pool_->Run(batch_size,
+        boost::bind(&AnnotatedDataLayer<Dtype>::transform_item, this, batch,
+                    &anno_datums, top_data, top_label, &transformed_annos,
+                    _1, _2));
+    ++this->batch_id_;
+    trans_time += timer.MicroSeconds();
+    StageTimer label_timer(this->profile(0), DataProfile::LABEL);
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+        reader_.free().push(anno_datums[item_id]);
+        if (this->output_labels_ && has_anno_type_) {
+            if (anno_type_ == AnnotatedDatum_AnnotationType_BBOX) {
+                // Count the number of bboxes.
+                num_bboxes += transformed_annos[item_id].size();
             } else {
-                this->data_transformer_->Transform(sampled_datum->datum(),
-                                                    &(this->transformed_data_));
-                // Otherwise, store the label from datum.
-                CHECK(sampled_datum->datum().has_label()) << "Cannot find any label.";
-                top_label[item_id] = sampled_datum->datum().label();
-            }
-        } 
-        else {
-            this->data_transformer_->Transform(sampled_datum->datum(), &(this->transformed_data_));
-        }
-        #define BOOL_TEST_DATA false
-        # if BOOL_TEST_DATA
-        cv::Mat cropImage;
-        std::string save_folder = "../../anchorTestImage";
-        std::string prefix_imgName = "crop_image";
-        int jj = 0;
-        std::string saved_img_name = save_folder + "/" + to_string(item_id) + "_" + to_string(jj) +".jpg";
-        const float* data = this->transformed_data_.cpu_data();
-        int Trans_Height = this->transformed_data_.height();
-        int Trans_Width = this->transformed_data_.width();
-        for(int row = 0; row < Trans_Height; row++){
-            unsigned char *ImgData = cropImage.ptr<uchar>(row);
-            for(int col = 0; col < Trans_Width; col++){
-            ImgData[3 * col + 0] = static_cast<uchar>(data[0 * Trans_Height * Trans_Width + row * Trans_Width + col]);
-            ImgData[3 * col + 1] = static_cast<uchar>(data[1 * Trans_Height * Trans_Width + row * Trans_Width + col]);
-            ImgData[3 * col + 2] = static_cast<uchar>(data[2 * Trans_Height * Trans_Width + row * Trans_Width + col]);
-            }
-        }
-        int Crop_Height = cropImage.rows;
-        int Crop_Width = cropImage.cols;
-        for (int g = 0; g < transformed_anno_vec.size(); ++g) {
-            const AnnotationGroup& anno_group = transformed_anno_vec[g];
-            for (int a = 0; a < anno_group.annotation_size(); ++a) {
-            const Annotation& anno = anno_group.annotation(a);
-            const NormalizedBBox& bbox = anno.bbox();
-            int xmin = int(bbox.xmin() * Crop_Width);
-            int ymin = int(bbox.ymin() * Crop_Height);
-            int xmax = int(bbox.xmax() * Crop_Width);
-            int ymax = int(bbox.ymax() * Crop_Height);
-            cv::rectangle(cropImage, cv::Point2i(xmin, ymin), cv::Point2i(xmax, ymax), cv::Scalar(255,0,0), 1, 1, 0);
+                LOG(FATAL) << "Unknown annotation type.";
             }
         }
-        cv::imwrite(saved_img_name, cropImage);
-        LOG(INFO)<<"*** Datum Write Into Jpg File Sucessfully! ***";
-        jj ++ ;
-        if(jj == 1000){
-            LOG(FATAL)<<"We have completed 1000 times images crop testd!";
-        }
-        #endif
-        // clear memory
-        if (has_sampled) {
-            delete sampled_datum;
-        }
-        if (transform_param.has_expand_param()) {
-            delete expand_datum;
-        }
-        if(do_resize){
-            delete resized_anno_datum;
-        }
-        trans_time += timer.MicroSeconds();
-        reader_.free().push(const_cast<AnnotatedDatum*>(&anno_datum));
     }
 
     // Store "rich" annotation if needed.
@@ -378,12 +215,14 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
                 if (YoloFormat_)
                     caffe_set<Dtype>(label_last_channels * num_bboxes * batch_size, -1, 
                                                     batch->label_.mutable_cpu_data());
-                fill_label(top_label, batch_size, all_anno, num_bboxes, label_last_channels);
+                fill_label(top_label, batch_size, transformed_annos, num_bboxes,
+                           label_last_channels);
             }
         } else {
             LOG(FATAL) << "Unknown annotation type.";
         }
     }
+    label_timer.Stop();
     timer.Stop();
     batch_timer.Stop();
     DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
@@ -391,42 +230,190 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the transform workers
+template<typename Dtype>
+void AnnotatedDataLayer<Dtype>::transform_item(Batch<Dtype>* batch,
+        const vector<AnnotatedDatum*>* anno_datums, Dtype* top_data,
+        Dtype* top_label, vector<vector<AnnotationBox> >* transformed_annos,
+        int item_id, int worker_id) {
+    ItemRNGScope item_rng(this->item_seed_, this->batch_id_, item_id);
+    const AnnotatedDataParameter& anno_data_param =
+        this->layer_param_.annotated_data_param();
+    const TransformationParameter& transform_param =
+        this->layer_param_.transform_param();
+    DataTransformer<Dtype>* transformer = this->transformer(worker_id);
+    AnnotatedDatum& anno_datum = *(*anno_datums)[item_id];
+    transformer->set_source_datum(&anno_datum.datum());
+    AnnotatedDatum distort_datum;
+    AnnotatedDatum* expand_datum = NULL;
+    AnnotatedDatum* resized_anno_datum = NULL;
+    bool do_resize = false;
+    if (transform_param.has_distort_param()) {
+        distort_datum.CopyFrom(anno_datum);
+        transformer->DistortImage(anno_datum.datum(),
+                                            distort_datum.mutable_datum());
+        if (transform_param.has_expand_param()) {
+            expand_datum = new AnnotatedDatum();
+            transformer->ExpandImage(distort_datum, expand_datum);
+        } else {
+            expand_datum = &distort_datum;
+        }
+    } else {
+        if (transform_param.has_expand_param()) {
+            expand_datum = new AnnotatedDatum();
+            transformer->ExpandImage(anno_datum, expand_datum);
+        } else {
+            expand_datum = &anno_datum;
+        }
+    }
+    AnnotatedDatum* sampled_datum = NULL;
+    bool has_sampled = false;
+    bool CropSample = false;
+    vector<NormalizedBBox> sampled_bboxes;
+    sampled_bboxes.clear();
+    StageTimer sample_timer(this->profile(worker_id), DataProfile::SAMPLE);
+    if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_BATCH){
+        if (batch_samplers_.size() > 0) {
+            GenerateBatchSamples_Square(*expand_datum, batch_samplers_, &sampled_bboxes);
+            CropSample = true;
+        } else {
+            sampled_datum = expand_datum;
+        }
+    }
+    else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_JITTER){
+        GenerateJitterSamples(*expand_datum, 0.1, &sampled_bboxes);
+        CropSample = true;
+    }
+    else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_ANCHOR){
+        if(data_anchor_samplers_.size() > 0){
+            GenerateBatchDataAnchorSamples(*expand_datum, data_anchor_samplers_, &sampled_bboxes);
+            int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
+            sampled_datum = new AnnotatedDatum();
+            transformer->CropImage_Sampling(*expand_datum,
+                                                sampled_bboxes[rand_idx],
+                                                sampled_datum);
+            has_sampled = true;
+        }else{
+            sampled_datum = expand_datum;
+        }
+    }
+    else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_GT_BBOX){
+        if (anno_data_param.has_bbox_sampler()) {
+            resized_anno_datum = new AnnotatedDatum();
+            do_resize = true;
+            GenerateLFFDSample(*expand_datum, &sampled_bboxes, 
+                            bbox_small_scale_, bbox_large_scale_, anchor_stride_,
+                            resized_anno_datum, transform_param, do_resize);
+            CHECK_GT(resized_anno_datum->datum().channels(), 0);
+            sampled_datum = new AnnotatedDatum();
+            transformer->CropImage_Sampling(*resized_anno_datum,
+                                            sampled_bboxes[0], sampled_datum);
+            has_sampled = true;
+        } else {
+            sampled_datum = expand_datum;
+        }
+    }
+    else if(crop_type_ == AnnotatedDataParameter_CROP_TYPE_CROP_DEFAULT){
+        sampled_datum = expand_datum;
+    }
+    if(CropSample){        
+        if (sampled_bboxes.size() > 0) {
+            int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
+            sampled_datum = new AnnotatedDatum();
+            transformer->CropImage(*expand_datum,
+                                                sampled_bboxes[rand_idx],
+                                                sampled_datum);
+            has_sampled = true;
+        } else {
+            sampled_datum = expand_datum;
+        }
+    }
+    sample_timer.Stop();
+    CHECK(sampled_datum != NULL);
+    vector<int> shape = transformer->InferBlobShape(sampled_datum->datum());
+    const vector<int>& top_shape = batch->data_.shape();
+    if (transform_param.has_resize_param()) {
+        if (transform_param.resize_param().resize_mode() ==
+            ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
+            // batch_size is 1, so no other worker touches the batch.
+            batch->data_.Reshape(shape);
+            top_data = batch->data_.mutable_cpu_data();
+        } else {
+            CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
+                    shape.begin() + 1));
+        }
+    } else {
+        CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
+            shape.begin() + 1));
+    }
+    StageTimer transform_timer(this->profile(worker_id),
+                               DataProfile::TRANSFORM);
+    // Apply data transformations (mirror, scale, crop...)
+    Blob<Dtype> transformed_data(shape);
+    transformed_data.set_cpu_data(top_data + batch->data_.offset(item_id));
+    vector<AnnotationBox>& transformed_anno_vec =
+        (*transformed_annos)[item_id];
+    if (this->output_labels_) {
+        if (has_anno_type_) {
+            CHECK(sampled_datum->has_type()) << "Some datum misses AnnotationType.";
+            if (anno_data_param.has_anno_type()) {
+                sampled_datum->set_type(anno_type_);
+            } else {
+                CHECK_EQ(anno_type_, sampled_datum->type()) << "Different AnnotationType.";
+            }
+            // Transform datum and annotation_group at the same time
+            transformed_anno_vec.clear();
+            transformer->Transform(*sampled_datum,
+                                                &transformed_data,
+                                                &transformed_anno_vec);
+        } else {
+            transformer->Transform(sampled_datum->datum(),
+                                                &transformed_data);
+            // Otherwise, store the label from datum.
+            CHECK(sampled_datum->datum().has_label()) << "Cannot find any label.";
+            top_label[item_id] = sampled_datum->datum().label();
+        }
+    } 
+    else {
+        transformer->Transform(sampled_datum->datum(), &transformed_data);
+    }
+    transform_timer.Stop();
+    // clear memory
+    if (has_sampled) {
+        delete sampled_datum;
+    }
+    if (transform_param.has_expand_param()) {
+        delete expand_datum;
+    }
+    if(do_resize){
+        delete resized_anno_datum;
+    }
+}
+
 template <typename Dtype>
-void AnnotatedDataLayer<Dtype>::fill_label(Dtype* top_label, int batch_size, 
-                std::map<int, vector<AnnotationGroup> > all_anno, 
-                int num_bboxes, 
+void AnnotatedDataLayer<Dtype>::fill_label(Dtype* top_label, int batch_size,
+                const vector<vector<AnnotationBox> >& all_anno,
+                int num_bboxes,
                 int label_last_channels){
     int idx = 0;
     for (int item_id = 0; item_id < batch_size; ++item_id) {
-        const vector<AnnotationGroup>& anno_vec = all_anno[item_id];
+        const vector<AnnotationBox>& boxes = all_anno[item_id];
         if(YoloFormat_)
             idx = item_id * num_bboxes * label_last_channels ;
-        for (int g = 0; g < anno_vec.size(); ++g) {
-            const AnnotationGroup& anno_group = anno_vec[g];
-            for (int a = 0; a < anno_group.annotation_size(); ++a) {
-                const Annotation& anno = anno_group.annotation(a);
-                const NormalizedBBox& bbox = anno.bbox();
-                top_label[idx++] = item_id;
-                top_label[idx++] = anno_group.group_label();
-                top_label[idx++] = anno.instance_id();
-                top_label[idx++] = bbox.xmin();
-                top_label[idx++] = bbox.ymin();
-                top_label[idx++] = bbox.xmax();
-                top_label[idx++] = bbox.ymax();
-                top_label[idx++] = bbox.difficult();
-                if(has_landmarks_){
-                    const AnnoFaceLandmarks& lm = anno.face_lm();
-                    top_label[idx++] = anno.has_lm();
-                    top_label[idx++] = lm.lefteye().x();
-                    top_label[idx++] = lm.lefteye().y();
-                    top_label[idx++] = lm.righteye().x();
-                    top_label[idx++] = lm.righteye().y();
-                    top_label[idx++] = lm.nose().x();
-                    top_label[idx++] = lm.nose().y();
-                    top_label[idx++] = lm.leftmouth().x();
-                    top_label[idx++] = lm.leftmouth().y();
-                    top_label[idx++] = lm.rightmouth().x();
-                    top_label[idx++] = lm.rightmouth().y();
+        for (int b = 0; b < boxes.size(); ++b) {
+            const AnnotationBox& box = boxes[b];
+            top_label[idx++] = item_id;
+            top_label[idx++] = box.group_label;
+            top_label[idx++] = box.instance_id;
+            top_label[idx++] = box.xmin;
+            top_label[idx++] = box.ymin;
+            top_label[idx++] = box.xmax;
+            top_label[idx++] = box.ymax;
+            top_label[idx++] = box.difficult;
+            if(has_landmarks_){
+                top_label[idx++] = box.has_lm;
+                for (int i = 0; i < 2 * kNumFaceLandmarks; ++i) {
+                    top_label[idx++] = box.landmarks[i];
                 }
             }
         }
@@ -239,6 +239,9 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   col_buffer_.Reshape(col_buffer_shape_);
+  for (int i = 0; i < worker_col_buffers_.size(); ++i) {
+    worker_col_buffers_[i]->Reshape(col_buffer_shape_);
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -253,15 +256,41 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::set_cpu_workers(int num_workers) {
+  col_buffers_cpu_.resize(num_workers);
+  if (is_1x1_) {
+    return;
+  }
+  const int col_count = col_buffer_.count();
+  if (this->workspace_) {
+    Dtype* col_buff = static_cast<Dtype*>(this->workspace_->mutable_cpu_data(
+        num_workers * col_count * sizeof(Dtype)));
+    for (int w = 0; w < num_workers; ++w) {
+      col_buffers_cpu_[w] = col_buff + w * col_count;
+    }
+    return;
+  }
+  while (worker_col_buffers_.size() < num_workers - 1) {
+    worker_col_buffers_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>(col_buffer_shape_)));
+  }
+  col_buffers_cpu_[0] = col_buffer_.mutable_cpu_data();
+  for (int w = 1; w < num_workers; ++w) {
+    col_buffers_cpu_[w] = worker_col_buffers_[w - 1]->mutable_cpu_data();
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
+    const Dtype* weights, Dtype* output, bool skip_im2col, int worker) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    Dtype* worker_col_buff = col_buffer_cpu(worker);
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, worker_col_buff);
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = worker_col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -281,11 +310,8 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
-  if (is_1x1_) {
-    col_buff = input;
-  }
+    const Dtype* weights, Dtype* input, int worker) {
+  Dtype* col_buff = is_1x1_ ? input : col_buffer_cpu(worker);
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
         conv_out_spatial_dim_, conv_out_channels_ / group_,
@@ -299,11 +325,12 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
+    const Dtype* output, Dtype* weights, int worker) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    Dtype* worker_col_buff = col_buffer_cpu(worker);
+    conv_im2col_cpu(input, worker_col_buff);
+    col_buff = worker_col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -322,15 +349,25 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
 
 #ifndef CPU_ONLY
 
+template <typename Dtype>
+Dtype* BaseConvolutionLayer<Dtype>::col_buffer_gpu() {
+  if (this->workspace_) {
+    return static_cast<Dtype*>(this->workspace_->mutable_gpu_data(
+        col_buffer_.count() * sizeof(Dtype)));
+  }
+  return col_buffer_.mutable_gpu_data();
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_gpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    Dtype* gpu_col_buff = col_buffer_gpu();
     if (!skip_im2col) {
-      conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
+      conv_im2col_gpu(input, gpu_col_buff);
     }
-    col_buff = col_buffer_.gpu_data();
+    col_buff = gpu_col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -351,10 +388,7 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_gpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_gpu_data();
-  if (is_1x1_) {
-    col_buff = input;
-  }
+  Dtype* col_buff = is_1x1_ ? input : col_buffer_gpu();
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
         conv_out_spatial_dim_, conv_out_channels_ / group_,
@@ -371,8 +405,9 @@ void BaseConvolutionLayer<Dtype>::weight_gpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
-    col_buff = col_buffer_.gpu_data();
+    Dtype* gpu_col_buff = col_buffer_gpu();
+    conv_im2col_gpu(input, gpu_col_buff);
+    col_buff = gpu_col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -7,7 +8,9 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -32,13 +35,131 @@ void BaseDataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   DataLayerSetUp(bottom, top);
 }
 
+template <typename Dtype>
+void BaseDataLayer<Dtype>::InitTransformPool() {
+  const int num_threads = std::max<int>(transform_param_.num_threads(), 1);
+  transformers_.clear();
+  transformers_.push_back(data_transformer_);
+  for (int i = 1; i < num_threads; ++i) {
+    shared_ptr<DataTransformer<Dtype> > transformer(
+        new DataTransformer<Dtype>(transform_param_, this->phase_));
+    transformer->InitRand();
+    transformers_.push_back(transformer);
+  }
+  transform_pool_.reset(new WorkerPool(num_threads));
+  item_seed_ = (static_cast<uint64_t>(caffe_rng_rand()) << 32) |
+      caffe_rng_rand();
+  batch_id_ = 0;
+  profiles_.clear();
+  if (this->layer_param_.data_param().prefetch_stats_interval() > 0) {
+    for (int i = 0; i < num_threads; ++i) {
+      profiles_.push_back(shared_ptr<DataProfile>(new DataProfile()));
+      transformers_[i]->set_profile(profiles_[i].get());
+    }
+  }
+  if (num_threads > 1) {
+    LOG(INFO) << this->layer_param_.name() << ": transforming batches with "
+        << num_threads << " threads";
+  }
+  const size_t cache_mb = this->layer_param_.data_param().image_cache_mb();
+  if (cache_mb > 0) {
+#ifdef USE_OPENCV
+    image_cache_.reset(new ImageCache(cache_mb << 20));
+    for (int i = 0; i < transformers_.size(); ++i) {
+      transformers_[i]->set_image_cache(image_cache_.get());
+    }
+    LOG(INFO) << this->layer_param_.name() << ": caching up to " << cache_mb
+        << " MB of decoded images";
+#else
+    LOG(WARNING) << "image_cache_mb requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  }
+}
+
+template <typename Dtype>
+void BaseDataLayer<Dtype>::LogImageCacheStats() const {
+#ifdef USE_OPENCV
+  if (!image_cache_) {
+    return;
+  }
+  const uint64_t hits = image_cache_->hits();
+  const uint64_t lookups = hits + image_cache_->misses();
+  LOG(INFO) << this->layer_param_.name() << ": image cache holds "
+      << image_cache_->size() << " images, "
+      << (image_cache_->size_bytes() >> 20) << "/"
+      << (image_cache_->capacity_bytes() >> 20) << " MB, hit "
+      << hits << "/" << lookups << " lookups, "
+      << image_cache_->evictions() << " evictions";
+#endif  // USE_OPENCV
+}
+
+template <typename Dtype>
+void BaseDataLayer<Dtype>::LogProfile(int num_batches, double batch_ms) {
+  if (profiles_.empty()) {
+    return;
+  }
+  DataProfile total;
+  for (int i = 0; i < profiles_.size(); ++i) {
+    total.Merge(*profiles_[i]);
+    profiles_[i]->Reset();
+  }
+  LOG(INFO) << this->layer_param_.name() << ": " << num_batches
+      << " batches in " << batch_ms / num_batches << " ms each; per batch: "
+      << total.Summary(num_batches)
+      << (profiles_.size() > 1 ? " (summed over the transform threads)" : "");
+}
+
+PrefetchStats::PrefetchStats()
+    : capacity_(0), interval_(0) {
+  Reset();
+}
+
+void PrefetchStats::Init(const string& name, int capacity, int interval) {
+  name_ = name;
+  capacity_ = capacity;
+  interval_ = interval;
+  Reset();
+}
+
+void PrefetchStats::Reset() {
+  count_ = 0;
+  starved_ = 0;
+  min_occupancy_ = capacity_;
+  occupancy_sum_ = 0;
+  wait_ms_ = 0;
+}
+
+void PrefetchStats::Record(int occupancy, float wait_ms) {
+  if (interval_ <= 0) {
+    return;
+  }
+  ++count_;
+  occupancy_sum_ += occupancy;
+  min_occupancy_ = std::min(min_occupancy_, occupancy);
+  if (occupancy == 0) {
+    ++starved_;
+  }
+  wait_ms_ += wait_ms;
+  if (count_ >= interval_) {
+    LOG(INFO) << name_ << ": prefetch queue holds "
+        << occupancy_sum_ / count_ << "/" << capacity_
+        << " batches on average (min " << min_occupancy_ << "), empty on "
+        << starved_ << "/" << count_ << " forwards, waited "
+        << wait_ms_ << " ms.";
+    Reset();
+  }
+}
+
 template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
+      prefetch_(param.data_param().prefetch()),
       prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+  CHECK_GT(prefetch_.size(), 0) << "prefetch must be positive";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -50,24 +171,27 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
 #endif
+  prefetch_stats_.Init(this->layer_param_.name(), prefetch_.size(),
+      this->layer_param_.data_param().prefetch_stats_interval());
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
+  this->InitTransformPool();
   StartInternalThread();
   DLOG(INFO) << "Prefetch initialized.";
 }
@@ -81,13 +205,32 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   }
 #endif
 
+  const int stats_interval =
+      this->layer_param_.data_param().prefetch_stats_interval();
+  int num_batches = 0;
+  CPUTimer batch_timer;
+  double batch_ms = 0;
   try {
     while (!must_stop()) {
-      Batch<Dtype>* batch = prefetch_free_.pop();
+      Batch<Dtype>* batch;
+      {
+        StageTimer timer(this->profile(0), DataProfile::QUEUE_WAIT);
+        batch = prefetch_free_.pop();
+      }
+      batch_timer.Start();
       load_batch(batch);
+      batch_ms += batch_timer.MilliSeconds();
+      if (stats_interval > 0 && ++num_batches % stats_interval == 0) {
+        this->LogImageCacheStats();
+        this->LogProfile(stats_interval, batch_ms);
+        batch_ms = 0;
+      }
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
+        if (this->output_labels_) {
+          batch->label_.data().get()->async_gpu_push(stream);
+        }
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
@@ -103,10 +246,20 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::PopFullBatch() {
+  CPUTimer timer;
+  timer.Start();
+  const int occupancy = prefetch_full_.size();
+  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  prefetch_stats_.Record(occupancy, timer.MilliSeconds());
+  return batch;
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = PopFullBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -128,8 +281,11 @@ template <typename Dtype>
 ReidPrefetchingDataLayer<Dtype>::ReidPrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_(param.data_param().prefetch()),
+      // The Reid layers have always kept one batch more than the others.
+      prefetch_(param.data_param().has_prefetch() ?
+          param.data_param().prefetch() : 4),
       prefetch_free_(), prefetch_full_(), prefetch_current_() {
+  CHECK_GT(prefetch_.size(), 0) << "prefetch must be positive";
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new ReidBatch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
@@ -169,8 +325,11 @@ void ReidPrefetchingDataLayer<Dtype>::LayerSetUp(
     }
   }
 #endif
+  prefetch_stats_.Init(this->layer_param_.name(), prefetch_.size(),
+      this->layer_param_.data_param().prefetch_stats_interval());
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
+  this->InitTransformPool();
   StartInternalThread();
   DLOG(INFO) << "Prefetch initialized.";
 }
@@ -211,6 +370,17 @@ void ReidPrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+ReidBatch<Dtype>* ReidPrefetchingDataLayer<Dtype>::PopFullBatch() {
+  CPUTimer timer;
+  timer.Start();
+  const int occupancy = prefetch_full_.size();
+  ReidBatch<Dtype>* batch =
+      prefetch_full_.pop("Data layer prefetch queue empty");
+  prefetch_stats_.Record(occupancy, timer.MilliSeconds());
+  return batch;
+}
+
 template <typename Dtype>
 void ReidPrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -218,7 +388,7 @@ void ReidPrefetchingDataLayer<Dtype>::Forward_cpu(
   if (prefetch_current_) {
     prefetch_free_.push(prefetch_current_);
   }
-  prefetch_current_ = this->prefetch_full_.pop("Data layer prefetch queue empty");
+  prefetch_current_ = PopFullBatch();
   // Reshape to loaded data.
   top[0]->Reshape(prefetch_current_->data_.num()*2, prefetch_current_->data_.channels(), prefetch_current_->data_.height(), prefetch_current_->data_.width());
   // Copy the data
@@ -242,9 +412,12 @@ template <typename Dtype>
 ImageDataPrefetchingDataLayer<Dtype>::ImageDataPrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
+      prefetch_(param.image_data_param().prefetch()),
       prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+  CHECK_GT(prefetch_.size(), 0) << "prefetch must be positive";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new pairBatch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -261,26 +434,29 @@ void ImageDataPrefetchingDataLayer<Dtype>::LayerSetUp(
   if (top.size() == 3) this->output_labels_ = true;
   else                 this->output_labels_ = false;
 
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
-      prefetch_[i].labelSample_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
+      prefetch_[i]->labelSample_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
-        prefetch_[i].labelSample_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
+        prefetch_[i]->labelSample_.mutable_gpu_data();
       }
     }
   }
 #endif
+  prefetch_stats_.Init(this->layer_param_.name(), prefetch_.size(),
+      this->layer_param_.data_param().prefetch_stats_interval());
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
+  this->InitTransformPool();
   StartInternalThread();
   DLOG(INFO) << "Prefetch initialized.";
 }
@@ -320,11 +496,22 @@ void ImageDataPrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+pairBatch<Dtype>* ImageDataPrefetchingDataLayer<Dtype>::PopFullBatch() {
+  CPUTimer timer;
+  timer.Start();
+  const int occupancy = prefetch_full_.size();
+  pairBatch<Dtype>* batch =
+      prefetch_full_.pop("Data layer prefetch queue empty");
+  prefetch_stats_.Record(occupancy, timer.MilliSeconds());
+  return batch;
+}
+
 template <typename Dtype>
 void ImageDataPrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
 
-  pairBatch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  pairBatch<Dtype>* batch = PopFullBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
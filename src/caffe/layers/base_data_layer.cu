@@ -7,7 +7,7 @@ namespace caffe {
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = PopFullBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -32,7 +32,7 @@ void ReidPrefetchingDataLayer<Dtype>::Forward_gpu(
   if (prefetch_current_) {
     prefetch_free_.push(prefetch_current_);
   }
-  prefetch_current_ = this->prefetch_full_.pop("Data layer prefetch queue empty");
+  prefetch_current_ = PopFullBatch();
   // CHECK
   CHECK_EQ(top[0]->count(), prefetch_current_->data_.count()*2);
   // Reshape to loaded data.
@@ -57,7 +57,7 @@ template <typename Dtype>
 void ImageDataPrefetchingDataLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
 
-  pairBatch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  pairBatch<Dtype>* batch = PopFullBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -1,9 +1,24 @@
+#include <boost/bind.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/depthwise_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  BaseConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  // With one input channel per group, group_ GEMMs of a single row each are
+  // far slower than convolving the channel planes directly.
+  depthwise_ = this->num_spatial_axes_ == 2 && this->group_ > 1 &&
+      this->group_ == this->channels_;
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::compute_output_shape() {
   const int* kernel_shape_data = this->kernel_shape_.cpu_data();
@@ -21,21 +36,117 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_depthwise(const Dtype* input,
+    const Dtype* weights, const Dtype* bias, Dtype* output, int item) {
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int n = item / this->num_output_;
+  const int c = item % this->num_output_;
+  const int in_c = c / (this->num_output_ / this->channels_);
+  depthwise_conv_cpu(input + (n * this->channels_ + in_c) * height * width,
+      height, width, weights + c * kernel[0] * kernel[1],
+      kernel[0], kernel[1], pad[0], pad[1], stride[0], stride[1],
+      dilation[0], dilation[1], output + item * this->out_spatial_dim_);
+  if (bias) {
+    caffe_add_scalar(this->out_spatial_dim_, bias[c],
+        output + item * this->out_spatial_dim_);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_depthwise(const Dtype* input,
+    const Dtype* weights, Dtype* output, int item) {
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int n = item / this->channels_;
+  const int multiplier = this->num_output_ / this->channels_;
+  Dtype* output_plane = output + item * height * width;
+  caffe_set(height * width, Dtype(0), output_plane);
+  for (int c = (item % this->channels_) * multiplier, m = 0; m < multiplier;
+       ++c, ++m) {
+    depthwise_conv_backward_data_cpu(input +
+        (n * this->num_output_ + c) * this->out_spatial_dim_, height, width,
+        weights + c * kernel[0] * kernel[1], kernel[0], kernel[1],
+        pad[0], pad[1], stride[0], stride[1], dilation[0], dilation[1],
+        output_plane);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::weight_cpu_depthwise(const Dtype* input,
+    const Dtype* output, Dtype* weights, int item) {
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int in_c = item / (this->num_output_ / this->channels_);
+  for (int n = 0; n < this->num_; ++n) {
+    depthwise_conv_backward_kernel_cpu(
+        input + (n * this->channels_ + in_c) * height * width,
+        output + (n * this->num_output_ + item) * this->out_spatial_dim_,
+        height, width, kernel[0], kernel[1], pad[0], pad[1],
+        stride[0], stride[1], dilation[0], dilation[1],
+        weights + item * kernel[0] * kernel[1]);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_item(const Dtype* input,
+    const Dtype* weights, const Dtype* bias, Dtype* output, int n,
+    int worker) {
+  this->forward_cpu_gemm(input + n * this->bottom_dim_, weights,
+      output + n * this->top_dim_, false, worker);
+  if (bias) {
+    this->forward_cpu_bias(output + n * this->top_dim_, bias);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_item(const Dtype* top_diff,
+    const Dtype* bottom_data, const Dtype* weights, Dtype* bottom_diff,
+    const vector<Dtype*>& weight_diffs, int n, int worker) {
+  // gradient w.r.t. weight. Note that we will accumulate diffs.
+  if (!weight_diffs.empty()) {
+    this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+        top_diff + n * this->top_dim_, weight_diffs[worker], worker);
+  }
+  // gradient w.r.t. bottom data, if necessary.
+  if (bottom_diff) {
+    this->backward_cpu_gemm(top_diff + n * this->top_dim_, weights,
+        bottom_diff + n * this->bottom_dim_, worker);
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  WorkerPool& pool = Caffe::cpu_pool();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
-      }
+    if (depthwise_) {
+      pool.Run(this->num_ * this->num_output_,
+          boost::bind(&ConvolutionLayer<Dtype>::forward_cpu_depthwise, this,
+              bottom_data, weight, bias, top_data, _1));
+      continue;
     }
+    this->set_cpu_workers(std::min(pool.size(), this->num_));
+    pool.Run(this->num_,
+        boost::bind(&ConvolutionLayer<Dtype>::forward_cpu_item, this,
+            bottom_data, weight, bias, top_data, _1, _2));
   }
 }
 
@@ -44,6 +155,7 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  WorkerPool& pool = Caffe::cpu_pool();
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
@@ -55,19 +167,45 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
       }
     }
+    if (depthwise_) {
+      if (this->param_propagate_down_[0]) {
+        pool.Run(this->num_output_,
+            boost::bind(&ConvolutionLayer<Dtype>::weight_cpu_depthwise, this,
+                bottom_data, top_diff, weight_diff, _1));
+      }
+      if (propagate_down[i]) {
+        pool.Run(this->num_ * this->channels_,
+            boost::bind(&ConvolutionLayer<Dtype>::backward_cpu_depthwise, this,
+                top_diff, weight, bottom_diff, _1));
+      }
+      continue;
+    }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
-        }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
+      const int num_workers = std::min(pool.size(), this->num_);
+      this->set_cpu_workers(num_workers);
+      // Worker 0 accumulates the weight gradient in place, the others in
+      // zeroed copies added to it afterwards, in worker order.
+      vector<Dtype*> weight_diffs;
+      if (this->param_propagate_down_[0]) {
+        weight_diffs.push_back(weight_diff);
+        for (int w = 1; w < num_workers; ++w) {
+          if (worker_weight_diffs_.size() < w) {
+            worker_weight_diffs_.push_back(shared_ptr<Blob<Dtype> >(
+                new Blob<Dtype>(this->blobs_[0]->shape())));
+          }
+          Dtype* diff = worker_weight_diffs_[w - 1]->mutable_cpu_data();
+          caffe_set(this->blobs_[0]->count(), Dtype(0), diff);
+          weight_diffs.push_back(diff);
         }
       }
+      pool.Run(this->num_,
+          boost::bind(&ConvolutionLayer<Dtype>::backward_cpu_item, this,
+              top_diff, bottom_data, weight,
+              propagate_down[i] ? bottom_diff : NULL, weight_diffs, _1, _2));
+      for (int w = 1; w < weight_diffs.size(); ++w) {
+        caffe_axpy(this->blobs_[0]->count(), Dtype(1), weight_diffs[w],
+            weight_diff);
+      }
     }
   }
 }
@@ -3,11 +3,13 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/philox.hpp"
 
 namespace caffe {
 
@@ -35,8 +37,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -45,8 +47,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -79,23 +81,24 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   if (this->output_labels_) {
     top_label = batch->label_.mutable_cpu_data();
   }
+  // Pop the whole batch first so that items keep the reader order, then
+  // transform them on the worker threads.
+  timer.Start();
+  StageTimer read_timer(this->profile(0), DataProfile::READ);
+  vector<Datum*> datums(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    // get a datum
-    Datum& datum = *(reader_.full().pop("Waiting for data"));
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      top_label[item_id] = datum.label();
-    }
-    trans_time += timer.MicroSeconds();
-
-    reader_.free().push(const_cast<Datum*>(&datum));
+    datums[item_id] = reader_.full().pop("Waiting for data");
+  }
+  read_time += timer.MicroSeconds();
+  read_timer.Stop();
+  timer.Start();
+  this->transform_pool_->Run(batch_size,
+      boost::bind(&DataLayer<Dtype>::transform_item, this, batch, &datums,
+                  top_data, top_label, _1, _2));
+  ++this->batch_id_;
+  trans_time += timer.MicroSeconds();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    reader_.free().push(datums[item_id]);
   }
   timer.Stop();
   batch_timer.Stop();
@@ -104,6 +107,26 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the transform workers
+template<typename Dtype>
+void DataLayer<Dtype>::transform_item(Batch<Dtype>* batch,
+    const vector<Datum*>* datums, Dtype* top_data, Dtype* top_label,
+    int item_id, int worker_id) {
+  ItemRNGScope item_rng(this->item_seed_, this->batch_id_, item_id);
+  const Datum& datum = *(*datums)[item_id];
+  // Apply data transformations (mirror, scale, crop...)
+  Blob<Dtype> transformed_data(this->transformed_data_.shape());
+  transformed_data.set_cpu_data(top_data + batch->data_.offset(item_id));
+  DataTransformer<Dtype>* transformer = this->transformer(worker_id);
+  transformer->set_source_datum(&datum);
+  StageTimer timer(this->profile(worker_id), DataProfile::TRANSFORM);
+  transformer->Transform(datum, &transformed_data);
+  // Copy label.
+  if (this->output_labels_) {
+    top_label[item_id] = datum.label();
+  }
+}
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
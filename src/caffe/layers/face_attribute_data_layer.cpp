@@ -3,6 +3,7 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <algorithm>
 #include <map>
 #include <vector>
@@ -10,6 +11,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/face_attribute_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/philox.hpp"
 
 namespace caffe{
 
@@ -48,8 +50,8 @@ void faceAttributeDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& b
     top_shape[0] = batch_size;
     top[0]->Reshape(top_shape);
     phase_ = this->layer_param_.phase();
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-        this->prefetch_[i].data_.Reshape(top_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+        this->prefetch_[i]->data_.Reshape(top_shape);
     }
     LOG(INFO) << "output data size: " << top[0]->num() << ","
         << top[0]->channels() << "," << top[0]->height() << ","
@@ -79,8 +81,8 @@ void faceAttributeDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& b
             label_shape[0] = batch_size;
         }
         top[1]->Reshape(label_shape);
-        for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-            this->prefetch_[i].label_.Reshape(label_shape);
+        for (int i = 0; i < this->prefetch_.size(); ++i) {
+            this->prefetch_[i]->label_.Reshape(label_shape);
         }
     }
     iterations_ = 0;
@@ -100,7 +102,6 @@ void faceAttributeDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // Reshape according to the first datum of each batch
     // on single input batches allows for inputs of varying dimension.
     const int batch_size = this->layer_param_.data_param().batch_size();
-    const TransformationParameter& transform_param = this->layer_param_.transform_param();
     AnnoFaceAttributeDatum& anno_datum = *(reader_.full().peek());
     // Use data_transformer to infer the expected blob shape from datum.
     vector<int> top_shape = this->data_transformer_->InferBlobShape(anno_datum.datum());
@@ -113,84 +114,31 @@ void faceAttributeDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     Dtype* top_label = NULL;  // suppress warnings about uninitialized variables
 
       // Store transformed annotation.
-    map<int, AnnoFaceAttribute > all_anno;
+    vector<AnnoFaceAttribute> all_anno(batch_size);
     map<int, vector<int>> batchImgShape;
     if (this->output_labels_ && !has_anno_type_) {
         top_label = batch->label_.mutable_cpu_data();
     }
+    // Pop the whole batch first so that items keep the reader order, then
+    // transform them on the worker threads.
+    timer.Start();
+    StageTimer read_timer(this->profile(0), DataProfile::READ);
+    vector<AnnoFaceAttributeDatum*> anno_datums(batch_size);
     for (int item_id = 0; item_id < batch_size; ++item_id) {
-        timer.Start();
-        // get a anno_datum
-        AnnoFaceAttributeDatum& anno_datum = *(reader_.full().pop("Waiting for data"));
-        batchImgShape[item_id].push_back (anno_datum.datum().width());
-        batchImgShape[item_id].push_back (anno_datum.datum().height());
-        AnnoFaceAttributeDatum distort_datum;
-        AnnoFaceAttributeDatum* expand_datum = NULL;
-        if (transform_param.has_distort_param()) {
-            distort_datum.CopyFrom(anno_datum);
-            this->data_transformer_->DistortImage(anno_datum.datum(),
-                                                    distort_datum.mutable_datum());
-            if (transform_param.has_expand_param()) {
-                expand_datum = new AnnoFaceAttributeDatum();
-                this->data_transformer_->ExpandImage(distort_datum, expand_datum);
-            } else {
-                expand_datum = &distort_datum;
-            }
-        } else {
-            if (transform_param.has_expand_param()) {
-                expand_datum = new AnnoFaceAttributeDatum();
-                this->data_transformer_->ExpandImage(anno_datum, expand_datum);
-            } else {
-                expand_datum = &anno_datum;
-            }
-        }
-        timer.Start();
-        vector<int> shape =
-            this->data_transformer_->InferBlobShape(expand_datum->datum());
-        if (transform_param.has_resize_param()) {
-            if (transform_param.resize_param().resize_mode() ==
-                ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
-                this->transformed_data_.Reshape(shape);
-                batch->data_.Reshape(shape);
-                top_data = batch->data_.mutable_cpu_data();
-            } else {
-                CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-                    shape.begin() + 1))<<"shape: "<<shape[0]<<" "
-                             <<shape[1]<<" "<<shape[2]<<" "
-                             <<shape[3]<<";top_shape: "<<top_shape[0]<<" "
-                             <<top_shape[1]<<" "<<top_shape[2]<<" "
-                             <<top_shape[3];
-            }
-        } else {
-            CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
-                shape.begin() + 1));
-        }
-        read_time += timer.MicroSeconds();
-        // Apply data transformations (mirror, scale, crop...)
-        int offset = batch->data_.offset(item_id);
-        this->transformed_data_.set_cpu_data(top_data + offset);
-        AnnoFaceAttribute transformed_anno_vec;
-        if (this->output_labels_) {
-            if (has_anno_type_) {
-                // Transform datum and annotation_group at the same time
-                this->data_transformer_->Transform(*expand_datum,
-                                                &(this->transformed_data_),
-                                                &transformed_anno_vec);
-                all_anno[item_id] = transformed_anno_vec;
-            } else {
-                this->data_transformer_->Transform(expand_datum->datum(),
-                                                &(this->transformed_data_));
-            }
-        } else {
-            this->data_transformer_->Transform(expand_datum->datum(),
-                                            &(this->transformed_data_));
-        }
-        // clear memory
-        if (transform_param.has_expand_param()) {
-            delete expand_datum;
-        }
-        trans_time += timer.MicroSeconds();
-        reader_.free().push(const_cast<AnnoFaceAttributeDatum*>(&anno_datum));
+        anno_datums[item_id] = reader_.full().pop("Waiting for data");
+        batchImgShape[item_id].push_back (anno_datums[item_id]->datum().width());
+        batchImgShape[item_id].push_back (anno_datums[item_id]->datum().height());
+    }
+    read_time += timer.MicroSeconds();
+    read_timer.Stop();
+    timer.Start();
+    this->transform_pool_->Run(batch_size,
+        boost::bind(&faceAttributeDataLayer<Dtype>::transform_item, this, batch,
+                    &anno_datums, top_data, &all_anno, _1, _2));
+    ++this->batch_id_;
+    trans_time += timer.MicroSeconds();
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+        reader_.free().push(anno_datums[item_id]);
     }
 
     // store "rich " landmark, face attributes
@@ -209,7 +157,7 @@ void faceAttributeDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
             top_label = batch->label_.mutable_cpu_data();
             int idx = 0;
             for (int item_id = 0; item_id < batch_size; ++item_id) {
-                AnnoFaceAttribute face = all_anno[item_id];
+                const AnnoFaceAttribute& face = all_anno[item_id];
                 top_label[idx++] = face.landmark().lefteye().x();
                 top_label[idx++] = face.landmark().righteye().x();
                 top_label[idx++] = face.landmark().nose().x();
@@ -255,6 +203,84 @@ void faceAttributeDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the transform workers
+template<typename Dtype>
+void faceAttributeDataLayer<Dtype>::transform_item(Batch<Dtype>* batch,
+        const vector<AnnoFaceAttributeDatum*>* anno_datums, Dtype* top_data,
+        vector<AnnoFaceAttribute>* all_anno, int item_id, int worker_id) {
+    ItemRNGScope item_rng(this->item_seed_, this->batch_id_, item_id);
+    const TransformationParameter& transform_param = this->layer_param_.transform_param();
+    DataTransformer<Dtype>* transformer = this->transformer(worker_id);
+    AnnoFaceAttributeDatum& anno_datum = *(*anno_datums)[item_id];
+    transformer->set_source_datum(&anno_datum.datum());
+    AnnoFaceAttributeDatum distort_datum;
+    AnnoFaceAttributeDatum* expand_datum = NULL;
+    if (transform_param.has_distort_param()) {
+        distort_datum.CopyFrom(anno_datum);
+        transformer->DistortImage(anno_datum.datum(),
+                                                distort_datum.mutable_datum());
+        if (transform_param.has_expand_param()) {
+            expand_datum = new AnnoFaceAttributeDatum();
+            transformer->ExpandImage(distort_datum, expand_datum);
+        } else {
+            expand_datum = &distort_datum;
+        }
+    } else {
+        if (transform_param.has_expand_param()) {
+            expand_datum = new AnnoFaceAttributeDatum();
+            transformer->ExpandImage(anno_datum, expand_datum);
+        } else {
+            expand_datum = &anno_datum;
+        }
+    }
+    vector<int> shape =
+        transformer->InferBlobShape(expand_datum->datum());
+    const vector<int>& top_shape = batch->data_.shape();
+    if (transform_param.has_resize_param()) {
+        if (transform_param.resize_param().resize_mode() ==
+            ResizeParameter_Resize_mode_FIT_SMALL_SIZE) {
+            // batch_size is 1, so no other worker touches the batch.
+            batch->data_.Reshape(shape);
+            top_data = batch->data_.mutable_cpu_data();
+        } else {
+            CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
+                shape.begin() + 1))<<"shape: "<<shape[0]<<" "
+                         <<shape[1]<<" "<<shape[2]<<" "
+                         <<shape[3]<<";top_shape: "<<top_shape[0]<<" "
+                         <<top_shape[1]<<" "<<top_shape[2]<<" "
+                         <<top_shape[3];
+        }
+    } else {
+        CHECK(std::equal(top_shape.begin() + 1, top_shape.begin() + 4,
+            shape.begin() + 1));
+    }
+    StageTimer transform_timer(this->profile(worker_id),
+                               DataProfile::TRANSFORM);
+    // Apply data transformations (mirror, scale, crop...)
+    Blob<Dtype> transformed_data(shape);
+    transformed_data.set_cpu_data(top_data + batch->data_.offset(item_id));
+    AnnoFaceAttribute& transformed_anno_vec = (*all_anno)[item_id];
+    if (this->output_labels_) {
+        if (has_anno_type_) {
+            // Transform datum and annotation_group at the same time
+            transformer->Transform(*expand_datum,
+                                            &transformed_data,
+                                            &transformed_anno_vec);
+        } else {
+            transformer->Transform(expand_datum->datum(),
+                                            &transformed_data);
+        }
+    } else {
+        transformer->Transform(expand_datum->datum(),
+                                        &transformed_data);
+    }
+    transform_timer.Stop();
+    // clear memory
+    if (transform_param.has_expand_param()) {
+        delete expand_datum;
+    }
+}
+
 INSTANTIATE_CLASS(faceAttributeDataLayer);
 REGISTER_LAYER_CLASS(faceAttributeData);
 
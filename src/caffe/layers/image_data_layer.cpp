@@ -7,8 +7,8 @@
 #include <utility>
 #include <vector>
 #include <algorithm>
-#include <random> // std::default_random_engine
-#include <chrono> // std::chrono::system_clock
+
+#include <boost/bind.hpp>
 
 
 #include "caffe/data_transformer.hpp"
@@ -17,6 +17,7 @@
 #include "caffe/util/benchmark.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 #include "caffe/util/rng.hpp"
 
 
@@ -79,6 +80,44 @@ void ImageDataLayer<Dtype>::get_random_erasing_box(float sl, float sh, float min
   }
 }
 
+template <typename Dtype>
+std::pair<std::string, int> ImageDataLayer<Dtype>::class_dir(
+    int class_id) const {
+  const string line = source_.line(class_id);
+  const size_t pos = line.find_last_of(' ');
+  const string& root_folder = this->layer_param_.image_data_param().root_folder();
+  return std::make_pair(root_folder + string("/") + line.substr(0, pos),
+                        atoi(line.substr(pos + 1).c_str()));
+}
+
+template <typename Dtype>
+const std::vector<std::string>& ImageDataLayer<Dtype>::class_files(
+    int class_id) {
+  if (!class_files_[class_id]) {
+    shared_ptr<std::vector<std::string> > files(
+        new std::vector<std::string>());
+    std::string subDir = class_dir(class_id).first;
+    struct dirent *faceSetDir;
+    DIR* dir = opendir(subDir.c_str());
+    if( dir == NULL )
+      LOG(FATAL) << subDir << " is not a directory or not exist!";
+    while ((faceSetDir = readdir(dir)) != NULL) {
+      if(strcmp(faceSetDir->d_name,".")==0 || strcmp(faceSetDir->d_name,"..")==0)
+        continue;
+      else if(faceSetDir->d_name[0] == '.')
+        continue;
+      else if (faceSetDir->d_type == DT_REG) {
+        files->push_back(subDir + string("/") + string(faceSetDir->d_name));
+      }
+    }
+    closedir(dir);
+    // readdir order depends on the filesystem.
+    std::sort(files->begin(), files->end());
+    class_files_[class_id] = files;
+  }
+  return *class_files_[class_id];
+}
+
 template <typename Dtype>
 void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -87,7 +126,6 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const bool is_color  = this->layer_param_.image_data_param().is_color();
   sample_num_ =  this->layer_param_.image_data_param().sample_num();
   label_num_= this->layer_param_.image_data_param().label_num();
-  string root_folder = this->layer_param_.image_data_param().root_folder();
   CHECK_EQ(label_num_*sample_num_, this->layer_param_.image_data_param().batch_size());
 
   problity_ = this->layer_param_.image_data_param().probability();
@@ -104,62 +142,28 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK((new_height == 0 && new_width == 0) ||
       (new_height > 0 && new_width > 0)) << "Current implementation requires "
       "new_height and new_width to be set at the same time.";
-  /**************遍历人脸数据集根目录文件夹**********/
-  #if 0
-  struct dirent *faceSetDir;
-  DIR* dir = opendir(root_folder.c_str());
-  if( dir == NULL )
-    LOG(FATAL)<<" is not a directory or not exist!";
-    
-  while ((faceSetDir = readdir(dir)) != NULL) {
-      if(strcmp(faceSetDir->d_name,".")==0 || strcmp(faceSetDir->d_name,"..")==0)    ///current dir OR parrent dir
-        continue;
-      else if(faceSetDir->d_name[0] == '.')
-        continue;
-      else if (faceSetDir->d_type == DT_DIR) {
-        std::string newDirectory = root_folder + string("/") + string(faceSetDir->d_name);
-        fullImageSetDir_.push_back(newDirectory);
-      }
-  }
-  closedir(dir);
-  #endif
 
   const string &sourceMap = this->layer_param_.image_data_param().source();
   LOG(INFO) << "Opening labelmap file: "<< sourceMap;
-  std::ifstream infile(sourceMap.c_str());
-  string line;
-  size_t pos;
-  int label;
-  while(std::getline(infile, line)){
-    pos = line.find_last_of(' ');
-    label = atoi(line.substr(pos+1).c_str());
-    std::string newDirectory = root_folder + string("/") + line.substr(0, pos);
-    fullImageSetDir_.push_back(std::make_pair(newDirectory, label));
-    //LOG(INFO)<< "directory: " << newDirectory << ", label: " << label;
+  CHECK(source_.Open(sourceMap)) << "Could not open " << sourceMap;
+  CHECK_GT(source_.size(), 0) << sourceMap << " is empty";
+  class_files_.clear();
+  class_files_.resize(source_.size());
+  LOG(INFO)<<" source size: " << source_.size() << ", get file directory successfully";
+
+  const int io_threads = this->layer_param_.image_data_param().io_threads();
+  readahead_.reset(new FileReadahead(io_threads,
+      this->layer_param_.image_data_param().readahead()));
+  if (io_threads > 0) {
+    LOG(INFO) << this->layer_param_.name() << ": reading images with "
+        << io_threads << " threads";
   }
-  infile.close();
-  LOG(INFO)<<" fullImageSetDir_ size: " << fullImageSetDir_.size() << ", get file directory successfully";
-  /**************遍历人脸数据集根目录文件夹完成*******/
 
   lines_id_ = 0;
     /**************获取第一个图像*************/
-  std::string subDir = fullImageSetDir_[0].first;
-  std::string imgfile;
-  struct dirent *faceSetDir;
-  DIR* dir = opendir(subDir.c_str());
-  if( dir == NULL )
-    LOG(FATAL) << subDir << " is not a directory or not exist!";
-  while ((faceSetDir = readdir(dir)) != NULL) {
-    if(strcmp(faceSetDir->d_name,".")==0 || strcmp(faceSetDir->d_name,"..")==0)
-      continue;
-    else if(faceSetDir->d_name[0] == '.')
-      continue;
-    else if (faceSetDir->d_type == DT_REG) {
-      imgfile = subDir + string("/") + string(faceSetDir->d_name);
-      break;
-    }
-  }
-  closedir(dir);
+  const std::vector<std::string>& first_files = class_files(0);
+  CHECK(!first_files.empty()) << class_dir(0).first << " has no image";
+  std::string imgfile = first_files[0];
   cv::Mat cv_img = ReadImageToCVMat(imgfile,
                                     new_height, new_width, is_color);
   CHECK(cv_img.data) << "Could not load " << imgfile;
@@ -169,8 +173,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.image_data_param().batch_size();
   CHECK_GT(batch_size, 0) << "Positive batch size required";
   top_shape[0] = batch_size;
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   top[0]->Reshape(top_shape);
 
@@ -180,14 +184,14 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   vector<int> label_shape(1, label_num_);
   top[1]->Reshape(label_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].label_.Reshape(label_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->label_.Reshape(label_shape);
   }
   // sample_label_
   vector<int> label_shape_sample(1, batch_size);
   top[2]->Reshape(label_shape_sample);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].labelSample_.Reshape(label_shape_sample);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->labelSample_.Reshape(label_shape_sample);
   }
 }
 
@@ -210,53 +214,50 @@ void ImageDataLayer<Dtype>::load_batch(pairBatch<Dtype>* batch) {
   const int new_height = image_data_param.new_height();
   const int new_width = image_data_param.new_width();
   const bool is_color = image_data_param.is_color();
-  string root_folder = image_data_param.root_folder();
 
   /**************随机挑选符合要求的人脸图片*************/
-  struct dirent *faceSetDir;
+  timer.Start();
+  StageTimer read_timer(this->profile(0), DataProfile::READ);
   std::vector<std::string> filelist;
   while (choosedImagefile_.size() < batch_size){
-    int rand_class_idx = caffe_rng_rand() % fullImageSetDir_.size();
+    int rand_class_idx = caffe_rng_rand() % source_.size();
     while(std::count(labelIdxSet_.begin(), labelIdxSet_.end(), rand_class_idx)!=0){
-      rand_class_idx = caffe_rng_rand() % fullImageSetDir_.size();
-    }
-    std::string subDir = fullImageSetDir_[rand_class_idx].first;
-    filelist.clear();
-    DIR* dir = opendir(subDir.c_str());
-    if( dir == NULL )
-      LOG(FATAL)<<" is not a directory or not exist!";
-    while ((faceSetDir = readdir(dir)) != NULL) {
-      if(strcmp(faceSetDir->d_name,".")==0 || strcmp(faceSetDir->d_name,"..")==0)
-        continue;
-      else if(faceSetDir->d_name[0] == '.')
-        continue;
-      else if (faceSetDir->d_type == DT_REG) {
-        std::string imgfile = subDir + string("/") + string(faceSetDir->d_name);
-        filelist.push_back(imgfile);
-      }
+      rand_class_idx = caffe_rng_rand() % source_.size();
     }
-    closedir(dir);
+    filelist = class_files(rand_class_idx);
+    const int class_label = class_dir(rand_class_idx).second;
     int nrof_image_in_class = filelist.size();
     int length = choosedImagefile_.size();
     int temp = std::min(nrof_image_in_class, batch_size - length );
     int nrof_image_from_class = std::min(sample_num_, temp);
-    unsigned seed = std::chrono::system_clock::now ().time_since_epoch ().count ();  
-    std::shuffle(filelist.begin(), filelist.end(), std::default_random_engine (seed));
+    caffe::shuffle(filelist.begin(), filelist.end());
     for(int i = 0; i < nrof_image_from_class; i++){
-      choosedImagefile_.push_back(std::make_pair(filelist[i], fullImageSetDir_[rand_class_idx].second));
+      choosedImagefile_.push_back(std::make_pair(filelist[i], class_label));
     }
     labelIdxSet_.push_back(rand_class_idx);
     label.push_back(nrof_image_from_class);
   }
   /**************遍历人脸数据集根目录遍历文件夹**********/
+  std::vector<std::string> files(batch_size);
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    files[item_id] = choosedImagefile_[item_id].first;
+  }
+  readahead_->Start(files);
 
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(choosedImagefile_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << choosedImagefile_[lines_id_].first;
+  string data;
+  CHECK(readahead_->Get(lines_id_, &data))
+      << "Could not load " << choosedImagefile_[lines_id_].first;
+  read_timer.Stop();
+  read_time += timer.MicroSeconds();
+  {
+    StageTimer decode_timer(this->profile(0), DataProfile::DECODE);
+    first_img_ = DecodeImage(data, new_height, new_width, is_color);
+  }
+  CHECK(first_img_.data) << "Could not load " << choosedImagefile_[lines_id_].first;
   // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(first_img_);
   this->transformed_data_.Reshape(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
@@ -266,33 +267,18 @@ void ImageDataLayer<Dtype>::load_batch(pairBatch<Dtype>* batch) {
   vector<int> label_shape(1, label_num_);
   batch->label_.Reshape(label_shape);
 
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
-  Dtype* labelSample = batch->labelSample_.mutable_cpu_data();
-  
-
-  // datum scales
-  for (int item_id = 0; item_id < batch_size; ++item_id) {
-    float sampleProb = 0.0f;
-    caffe_rng_uniform(1, 0.0f, 1.0f, &sampleProb);
-    // get a blob
-    timer.Start();
-    cv::Mat cv_img = ReadImageToCVMat(choosedImagefile_[item_id].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << choosedImagefile_[item_id].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    if(sampleProb > problity_){ 
-      // Apply transformations (mirror, crop...) to the image
-      get_random_erasing_box(scale_lower_, scale_higher_, min_aspect_ratio_, 
-                                max_aspect_ratio_, cv_img, mean_value);
-    }
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-    labelSample[item_id] = choosedImagefile_[item_id].second;
-  }
+  batch->data_.mutable_cpu_data();
+  batch->labelSample_.mutable_cpu_data();
+
+  // Read, decode and transform the images in parallel.
+  timer.Start();
+  this->transform_pool_->Run(batch_size,
+      boost::bind(&ImageDataLayer<Dtype>::transform_item, this, batch,
+                  _1, _2));
+  ++this->batch_id_;
+  trans_time += timer.MicroSeconds();
+  first_img_.release();
   for(int i = 0; i < label_num_; i++){
     prefetch_label[i] = label[i];
   }
@@ -302,6 +288,57 @@ void ImageDataLayer<Dtype>::load_batch(pairBatch<Dtype>* batch) {
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+template <typename Dtype>
+cv::Mat ImageDataLayer<Dtype>::DecodeImage(const string& data, int new_height,
+    int new_width, bool is_color) const {
+  if (this->layer_param_.transform_param().reduced_decode()) {
+    return DecodeImageToCVMatReduced(data, new_height, new_width, is_color);
+  }
+  return DecodeImageToCVMat(data, new_height, new_width, is_color);
+}
+
+// This function is called on the transform workers
+template <typename Dtype>
+void ImageDataLayer<Dtype>::transform_item(pairBatch<Dtype>* batch,
+    int item_id, int worker_id) {
+  ItemRNGScope item_rng(this->item_seed_, this->batch_id_, item_id);
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  const int new_height = image_data_param.new_height();
+  const int new_width = image_data_param.new_width();
+  const bool is_color = image_data_param.is_color();
+  DataProfile* profile = this->profile(worker_id);
+  float sampleProb = 0.0f;
+  caffe_rng_uniform(1, 0.0f, 1.0f, &sampleProb);
+  // get a blob
+  cv::Mat cv_img;
+  if (item_id == lines_id_) {
+    cv_img = first_img_;
+  } else {
+    string data;
+    {
+      StageTimer timer(profile, DataProfile::READ);
+      CHECK(readahead_->Get(item_id, &data))
+          << "Could not load " << choosedImagefile_[item_id].first;
+    }
+    StageTimer timer(profile, DataProfile::DECODE);
+    cv_img = DecodeImage(data, new_height, new_width, is_color);
+  }
+  CHECK(cv_img.data) << "Could not load " << choosedImagefile_[item_id].first;
+  StageTimer timer(profile, DataProfile::TRANSFORM);
+  if(sampleProb > problity_){ 
+    // Apply transformations (mirror, crop...) to the image
+    get_random_erasing_box(scale_lower_, scale_higher_, min_aspect_ratio_, 
+                              max_aspect_ratio_, cv_img, mean_value);
+  }
+  Blob<Dtype> transformed_data(this->transformed_data_.shape());
+  transformed_data.set_cpu_data(batch->data_.mutable_cpu_data() +
+      batch->data_.offset(item_id));
+  this->transformer(worker_id)->Transform(cv_img, &transformed_data);
+  batch->labelSample_.mutable_cpu_data()[item_id] =
+      choosedImagefile_[item_id].second;
+}
+
 INSTANTIATE_CLASS(ImageDataLayer);
 REGISTER_LAYER_CLASS(ImageData);
 
@@ -1,8 +1,11 @@
+#include <boost/bind.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
@@ -80,41 +83,88 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// Sets [begin, end) to the part-th of num_parts near equal slices of
+// [0, count).
+static inline void Slice(int count, int num_parts, int part, int* begin,
+    int* end) {
+  *begin = static_cast<int64_t>(count) * part / num_parts;
+  *end = static_cast<int64_t>(count) * (part + 1) / num_parts;
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_part(const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, Dtype* top_data, int num_parts,
+    int part) {
+  int begin, end;
+  Slice(M_, num_parts, part, &begin, &end);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+      end - begin, N_, K_, (Dtype)1.,
+      bottom_data + begin * K_, weight, (Dtype)0., top_data + begin * N_);
+  if (bias) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, end - begin, N_, 1,
+        (Dtype)1., bias_multiplier_.cpu_data(), bias, (Dtype)1.,
+        top_data + begin * N_);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::backward_cpu_part(const Dtype* top_diff,
+    const Dtype* weight, Dtype* bottom_diff, int num_parts, int part) {
+  int begin, end;
+  Slice(M_, num_parts, part, &begin, &end);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasTrans : CblasNoTrans,
+      end - begin, K_, N_,
+      (Dtype)1., top_diff + begin * N_, weight,
+      (Dtype)0., bottom_diff + begin * K_);
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::weight_cpu_part(const Dtype* top_diff,
+    const Dtype* bottom_data, Dtype* weight_diff, int num_parts, int part) {
+  int begin, end;
+  if (transpose_) {
+    // Rows [begin, end) of the K_ x N_ weights.
+    Slice(K_, num_parts, part, &begin, &end);
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans,
+        end - begin, N_, M_,
+        (Dtype)1., bottom_data + begin, K_, top_diff, N_,
+        (Dtype)1., weight_diff + begin * N_, N_);
+  } else {
+    // Rows [begin, end) of the N_ x K_ weights.
+    Slice(N_, num_parts, part, &begin, &end);
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans,
+        end - begin, K_, M_,
+        (Dtype)1., top_diff + begin, N_, bottom_data, K_,
+        (Dtype)1., weight_diff + begin * K_, K_);
+  }
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
-  if (bias_term_) {
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
-        bias_multiplier_.cpu_data(),
-        this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
-  }
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  WorkerPool& pool = Caffe::cpu_pool();
+  const int num_parts = std::min(pool.size(), M_);
+  pool.Run(num_parts, boost::bind(&InnerProductLayer<Dtype>::forward_cpu_part,
+      this, bottom_data, weight, bias, top_data, num_parts, _1));
 }
 
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  WorkerPool& pool = Caffe::cpu_pool();
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
     // Gradient with respect to weight
-    if (transpose_) {
-      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans,
-          K_, N_, M_,
-          (Dtype)1., bottom_data, top_diff,
-          (Dtype)1., this->blobs_[0]->mutable_cpu_diff());
-    } else {
-      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans,
-          N_, K_, M_,
-          (Dtype)1., top_diff, bottom_data,
-          (Dtype)1., this->blobs_[0]->mutable_cpu_diff());
-    }
+    const int num_parts = std::min(pool.size(), transpose_ ? K_ : N_);
+    pool.Run(num_parts, boost::bind(&InnerProductLayer<Dtype>::weight_cpu_part,
+        this, top_diff, bottom_data, this->blobs_[0]->mutable_cpu_diff(),
+        num_parts, _1));
   }
   if (bias_term_ && this->param_propagate_down_[1]) {
     const Dtype* top_diff = top[0]->cpu_diff();
@@ -126,17 +176,11 @@ void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (propagate_down[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     // Gradient with respect to bottom data
-    if (transpose_) {
-      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans,
-          M_, K_, N_,
-          (Dtype)1., top_diff, this->blobs_[0]->cpu_data(),
-          (Dtype)0., bottom[0]->mutable_cpu_diff());
-    } else {
-      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans,
-          M_, K_, N_,
-          (Dtype)1., top_diff, this->blobs_[0]->cpu_data(),
-          (Dtype)0., bottom[0]->mutable_cpu_diff());
-    }
+    const int num_parts = std::min(pool.size(), M_);
+    pool.Run(num_parts,
+        boost::bind(&InnerProductLayer<Dtype>::backward_cpu_part, this,
+            top_diff, this->blobs_[0]->cpu_data(),
+            bottom[0]->mutable_cpu_diff(), num_parts, _1));
   }
 }
 
@@ -6,6 +6,8 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/reid_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/philox.hpp"
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 namespace caffe {
@@ -124,7 +126,6 @@ template<typename Dtype>
 void ReidDataLayer<Dtype>::load_batch(ReidBatch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
-  double read_time = 0;
   double trans_time = 0;
   CPUTimer timer;
   CHECK(batch->data_.count());
@@ -146,50 +147,59 @@ void ReidDataLayer<Dtype>::load_batch(ReidBatch<Dtype>* batch) {
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
   batch->datap_.Reshape(top_shape);
-
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
-  Dtype* prefetch_datap = batch->datap_.mutable_cpu_data();
-  Dtype* prefetch_label = batch->label_.mutable_cpu_data();
-  Dtype* prefetch_labelp = batch->labelp_.mutable_cpu_data();
-
-  for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
-    const size_t true_idx = batches[item_id];
-    const size_t pair_idx = batches_pair[item_id];
-    cv::Mat cv_img_true = this->cv_imgs_[ true_idx ];
-    cv::Mat cv_img_pair = this->cv_imgs_[ pair_idx ];
-    CHECK(cv_img_true.data) << "Could not load " << this->lines_[true_idx].first;
-    CHECK(cv_img_pair.data) << "Could not load " << this->lines_[pair_idx].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    const int t_offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + t_offset);
-    this->data_transformer_->Transform(cv_img_true, &(this->transformed_data_));
-
-    // Pair Data
-    const int p_offset = batch->datap_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_datap + p_offset);
-    this->data_transformer_->Transform(cv_img_pair, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
-    CHECK_GE(lines_[true_idx].second, 0);
-    CHECK_GE(lines_[pair_idx].second, 0);
-    CHECK_LT(lines_[true_idx].second, this->label_set.size());
-    CHECK_LT(lines_[pair_idx].second, this->label_set.size());
-    prefetch_label[item_id]    = lines_[true_idx].second;
-    prefetch_labelp[item_id]   = lines_[pair_idx].second;
-
-    DLOG(INFO) << "Idx : " << item_id << " : " << lines_[true_idx].second << " vs " << lines_[pair_idx].second;
-  }
+  batch->data_.mutable_cpu_data();
+  batch->datap_.mutable_cpu_data();
+  batch->label_.mutable_cpu_data();
+  batch->labelp_.mutable_cpu_data();
+
+  // The pairs are drawn above from prefetch_rng_; transform them in parallel.
+  timer.Start();
+  this->transform_pool_->Run(batch_size,
+      boost::bind(&ReidDataLayer<Dtype>::transform_item, this, batch,
+                  boost::cref(batches), boost::cref(batches_pair), _1, _2));
+  ++this->batch_id_;
+  trans_time += timer.MicroSeconds();
   batch_timer.Stop();
   DLOG(INFO) << "Pair Idx : (" << batches[0] << "," << batches_pair[0] << ")";
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
-  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the transform workers
+template <typename Dtype>
+void ReidDataLayer<Dtype>::transform_item(ReidBatch<Dtype>* batch,
+    const vector<size_t>& batches, const vector<size_t>& batches_pair,
+    int item_id, int worker_id) {
+  ItemRNGScope item_rng(this->item_seed_, this->batch_id_, item_id);
+  const size_t true_idx = batches[item_id];
+  const size_t pair_idx = batches_pair[item_id];
+  const cv::Mat& cv_img_true = this->cv_imgs_[true_idx];
+  const cv::Mat& cv_img_pair = this->cv_imgs_[pair_idx];
+  CHECK(cv_img_true.data) << "Could not load " << this->lines_[true_idx].first;
+  CHECK(cv_img_pair.data) << "Could not load " << this->lines_[pair_idx].first;
+  StageTimer timer(this->profile(worker_id), DataProfile::TRANSFORM);
+  // Apply transformations (mirror, crop...) to the image
+  DataTransformer<Dtype>* transformer = this->transformer(worker_id);
+  Blob<Dtype> transformed_data(this->transformed_data_.shape());
+  transformed_data.set_cpu_data(batch->data_.mutable_cpu_data() +
+      batch->data_.offset(item_id));
+  transformer->Transform(cv_img_true, &transformed_data);
+
+  // Pair Data
+  transformed_data.set_cpu_data(batch->datap_.mutable_cpu_data() +
+      batch->datap_.offset(item_id));
+  transformer->Transform(cv_img_pair, &transformed_data);
+
+  CHECK_GE(lines_[true_idx].second, 0);
+  CHECK_GE(lines_[pair_idx].second, 0);
+  CHECK_LT(lines_[true_idx].second, this->label_set.size());
+  CHECK_LT(lines_[pair_idx].second, this->label_set.size());
+  batch->label_.mutable_cpu_data()[item_id] = lines_[true_idx].second;
+  batch->labelp_.mutable_cpu_data()[item_id] = lines_[pair_idx].second;
+
+  DLOG(INFO) << "Idx : " << item_id << " : " << lines_[true_idx].second << " vs " << lines_[pair_idx].second;
+}
+
 INSTANTIATE_CLASS(ReidDataLayer);
 REGISTER_LAYER_CLASS(ReidData);
 
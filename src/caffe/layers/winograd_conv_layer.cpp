@@ -0,0 +1,110 @@
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  winograd_ = this->num_spatial_axes_ == 2 && !this->depthwise_;
+  for (int i = 0; winograd_ && i < 2; ++i) {
+    winograd_ = this->kernel_shape_.cpu_data()[i] == 3 &&
+        this->stride_.cpu_data()[i] == 1 && this->dilation_.cpu_data()[i] == 1;
+  }
+  if (!winograd_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " falls back to "
+        << "the CAFFE engine: WINOGRAD only handles 2D 3x3 convolutions with "
+        << "stride 1 and no dilation, with more than one channel per group.";
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!winograd_) {
+    return;
+  }
+  const int num_tiles = winograd_num_tiles(this->output_shape_[0],
+      this->output_shape_[1]);
+  const int group_channels = this->channels_ / this->group_;
+  const int group_output = this->num_output_ / this->group_;
+  vector<int> shape(1, 16 * winograd_matrix_stride(
+      this->num_output_ * group_channels));
+  kernel_tr_.Reshape(shape);
+  shape[0] = 16 * winograd_matrix_stride(group_channels * num_tiles);
+  input_tr_.Reshape(shape);
+  shape[0] = 16 * winograd_matrix_stride(group_output * num_tiles);
+  output_tr_.Reshape(shape);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int group_channels = this->channels_ / this->group_;
+  const int group_output = this->num_output_ / this->group_;
+  const int num_tiles = winograd_num_tiles(this->output_shape_[0],
+      this->output_shape_[1]);
+  const int kernel_stride = winograd_matrix_stride(
+      this->num_output_ * group_channels);
+  const int input_stride = winograd_matrix_stride(group_channels * num_tiles);
+  const int output_stride = winograd_matrix_stride(group_output * num_tiles);
+  Dtype* kernel_tr;
+  Dtype* input_tr;
+  Dtype* output_tr;
+  if (this->workspace_) {
+    kernel_tr = static_cast<Dtype*>(this->workspace_->mutable_cpu_data(
+        sizeof(Dtype) * (kernel_tr_.count() + input_tr_.count() +
+        output_tr_.count())));
+    input_tr = kernel_tr + kernel_tr_.count();
+    output_tr = input_tr + input_tr_.count();
+  } else {
+    kernel_tr = kernel_tr_.mutable_cpu_data();
+    input_tr = input_tr_.mutable_cpu_data();
+    output_tr = output_tr_.mutable_cpu_data();
+  }
+  // The kernels change with every update, so transform them every time.
+  winograd_kernel_transform_cpu(this->blobs_[0]->cpu_data(),
+      this->num_output_, group_channels, kernel_tr);
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      for (int g = 0; g < this->group_; ++g) {
+        winograd_input_transform_cpu(bottom_data + n * this->bottom_dim_ +
+            g * group_channels * height * width, group_channels, height, width,
+            pad_h, pad_w, input_tr);
+        for (int k = 0; k < 16; ++k) {
+          caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_output,
+              num_tiles, group_channels, (Dtype)1., kernel_tr +
+              k * kernel_stride + g * group_output * group_channels,
+              input_tr + k * input_stride,
+              (Dtype)0., output_tr + k * output_stride);
+        }
+        winograd_output_transform_cpu(output_tr, group_output,
+            this->output_shape_[0], this->output_shape_[1], top_data +
+            n * this->top_dim_ + g * group_output * this->out_spatial_dim_);
+      }
+      if (this->bias_term_) {
+        const Dtype* bias = this->blobs_[1]->cpu_data();
+        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <climits>
 #include <map>
 #include <set>
 #include <string>
@@ -279,6 +280,10 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  ShareWorkspace();
+  if (param.plan_memory()) {
+    PlanMemory(param.force_backward());
+  }
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -948,6 +953,220 @@ void Net<Dtype>::ClearParamDiffs() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ShareWorkspace() {
+  workspace_.reset(new Workspace());
+  size_t workspace_sum = 0;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    // Shared layers may run at the same time as the layers of other nets.
+    if (layers_[layer_id]->IsShared()) { continue; }
+    layers_[layer_id]->set_workspace(workspace_);
+    const size_t size = layers_[layer_id]->WorkspaceSize();
+    workspace_->Reserve(size);
+    workspace_sum += size;
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory required for layer workspace: "
+      << workspace_->reserved_size() << " (shared, saving "
+      << workspace_sum - workspace_->reserved_size() << ")";
+}
+
+// Extends the lifetime [*first, *last] of a memory to include time.
+static inline void ExtendLifetime(const int time, int* first, int* last) {
+  *first = std::min(*first, time);
+  *last = std::max(*last, time);
+}
+
+// Returns the root of the set of i in the union-find forest parent.
+static int FindRoot(vector<int>* parent, int i) {
+  while ((*parent)[i] != i) {
+    (*parent)[i] = (*parent)[(*parent)[i]];
+    i = (*parent)[i];
+  }
+  return i;
+}
+
+// Returns the data (diff == false) or diff memory of blob, if it has one.
+template <typename Dtype>
+static SyncedMemory* BlobMemory(const Blob<Dtype>& blob, const bool diff) {
+  if (blob.count() == 0) { return NULL; }
+  return diff ? blob.diff().get() : blob.data().get();
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanMemory(const bool force_backward) {
+  const int num_layers = layers_.size();
+  const int num_blobs = blobs_.size();
+  // Layer i runs forward at time i and, when the backward pass is planned
+  // for, backward at time 2 * num_layers - 1 - i.
+  const bool backward = phase_ == TRAIN || force_backward;
+  // The data (d == 0) and diff (d == 1) of the blobs are grouped with those
+  // they may share memory with: the blobs that already do, and the tops and
+  // bottoms of the layers that may share it while running, like Split. The
+  // memory of a blob must then live as long as its group is in use.
+  vector<int> group[2];
+  for (int d = 0; d < 2; ++d) {
+    group[d].resize(num_blobs);
+    for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+      group[d][blob_id] = blob_id;
+    }
+  }
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const bool shares = layers_[layer_id]->SharesBottomMemory();
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int top_blob_id = top_id_vecs_[layer_id][top_id];
+      for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+           ++bottom_id) {
+        const int bottom_blob_id = bottom_id_vecs_[layer_id][bottom_id];
+        for (int d = 0; d < 2; ++d) {
+          SyncedMemory* top_memory = BlobMemory(*blobs_[top_blob_id], d);
+          if (shares || (top_memory && top_memory ==
+                         BlobMemory(*blobs_[bottom_blob_id], d))) {
+            group[d][FindRoot(&group[d], top_blob_id)] =
+                FindRoot(&group[d], bottom_blob_id);
+          }
+        }
+      }
+    }
+  }
+  // The lifetimes of the groups, and the blobs whose memory must be kept.
+  vector<int> first_use[2];
+  vector<int> last_use[2];
+  vector<bool> keep(num_blobs, false);
+  // Diffs that no backward writes are read as zeros, so must be kept.
+  vector<bool> diff_written(num_blobs, false);
+  for (int d = 0; d < 2; ++d) {
+    first_use[d].resize(num_blobs, INT_MAX);
+    last_use[d].resize(num_blobs, -1);
+  }
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const bool run_backward = backward && layer_need_backward_[layer_id];
+    const int backward_time = 2 * num_layers - 1 - layer_id;
+    vector<int> blob_ids(bottom_id_vecs_[layer_id]);
+    blob_ids.insert(blob_ids.end(), top_id_vecs_[layer_id].begin(),
+        top_id_vecs_[layer_id].end());
+    for (int i = 0; i < blob_ids.size(); ++i) {
+      const int data = FindRoot(&group[0], blob_ids[i]);
+      const int diff = FindRoot(&group[1], blob_ids[i]);
+      ExtendLifetime(layer_id, &first_use[0][data], &last_use[0][data]);
+      if (run_backward) {
+        ExtendLifetime(backward_time, &first_use[0][data], &last_use[0][data]);
+        ExtendLifetime(backward_time, &first_use[1][diff], &last_use[1][diff]);
+      }
+    }
+    for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+         ++bottom_id) {
+      if (run_backward && bottom_need_backward_[layer_id][bottom_id]) {
+        diff_written[bottom_id_vecs_[layer_id][bottom_id]] = true;
+      }
+    }
+    // Source layers, like Input or data layers, fill their tops outside of
+    // the pass, and shared layers also run in other nets.
+    if (bottom_id_vecs_[layer_id].empty() || layers_[layer_id]->IsShared()) {
+      for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+        keep[top_id_vecs_[layer_id][top_id]] = true;
+      }
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    keep[net_input_blob_indices_[i]] = true;
+  }
+  // The outputs are read after the pass.
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    last_use[0][FindRoot(&group[0], net_output_blob_indices_[i])] =
+        2 * num_layers;
+  }
+  // The distinct memories of the blobs, with the blobs using each as
+  // 2 * blob_id + d.
+  map<SyncedMemory*, int> memory_ids;
+  vector<vector<int> > memory_blobs;
+  vector<size_t> memory_size;
+  vector<int> memory_first;
+  vector<int> memory_last;
+  vector<bool> memory_kept;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    for (int d = 0; d < (backward ? 2 : 1); ++d) {
+      SyncedMemory* memory = BlobMemory(*blobs_[blob_id], d);
+      if (!memory) { continue; }
+      if (!memory_ids.count(memory)) {
+        memory_ids[memory] = memory_blobs.size();
+        memory_blobs.push_back(vector<int>());
+        memory_size.push_back(0);
+        memory_first.push_back(INT_MAX);
+        memory_last.push_back(-1);
+        // Memory filled while setting up the layers, like the loss weights
+        // in the diffs of the losses, must keep its contents.
+        memory_kept.push_back(memory->head() != SyncedMemory::UNINITIALIZED);
+      }
+      const int id = memory_ids[memory];
+      const int root = FindRoot(&group[d], blob_id);
+      memory_blobs[id].push_back(2 * blob_id + d);
+      memory_size[id] = std::max(memory_size[id],
+          blobs_[blob_id]->count() * sizeof(Dtype));
+      memory_first[id] = std::min(memory_first[id], first_use[d][root]);
+      memory_last[id] = std::max(memory_last[id], last_use[d][root]);
+      if (keep[blob_id] || (d && !diff_written[blob_id])) {
+        memory_kept[id] = true;
+      }
+    }
+  }
+  // The memories to plan, as (bytes, memory id), largest first.
+  vector<pair<size_t, int> > memories;
+  for (int id = 0; id < memory_blobs.size(); ++id) {
+    if (!memory_kept[id] && memory_last[id] >= 0) {
+      memories.push_back(make_pair(memory_size[id], id));
+    }
+  }
+  std::sort(memories.rbegin(), memories.rend());
+  // Put each memory in the first buffer whose memories are all used at other
+  // times, or in a new buffer of its size.
+  vector<size_t> buffer_sizes;
+  vector<vector<int> > buffer_memories;
+  vector<int> memory_buffer(memories.size());
+  size_t planned_size = 0;
+  for (int i = 0; i < memories.size(); ++i) {
+    const int id = memories[i].second;
+    int buffer = 0;
+    for (; buffer < buffer_sizes.size(); ++buffer) {
+      bool overlaps = false;
+      for (int j = 0; j < buffer_memories[buffer].size() && !overlaps; ++j) {
+        const int other = buffer_memories[buffer][j];
+        overlaps = memory_first[id] <= memory_last[other] &&
+            memory_first[other] <= memory_last[id];
+      }
+      if (!overlaps) { break; }
+    }
+    if (buffer == buffer_sizes.size()) {
+      buffer_sizes.push_back(memories[i].first);
+      buffer_memories.push_back(vector<int>());
+    }
+    buffer_memories[buffer].push_back(id);
+    memory_buffer[i] = buffer;
+    planned_size += memories[i].first;
+  }
+  // SyncedMemory allocates once used, so only the buffers take memory.
+  vector<shared_ptr<SyncedMemory> > buffers(buffer_sizes.size());
+  size_t buffers_size = 0;
+  for (int buffer = 0; buffer < buffers.size(); ++buffer) {
+    buffers[buffer].reset(new SyncedMemory(buffer_sizes[buffer]));
+    buffers_size += buffer_sizes[buffer];
+  }
+  for (int i = 0; i < memories.size(); ++i) {
+    const vector<int>& blobs = memory_blobs[memories[i].second];
+    for (int j = 0; j < blobs.size(); ++j) {
+      if (blobs[j] % 2) {
+        blobs_[blobs[j] / 2]->ShareDiffMemory(buffers[memory_buffer[i]]);
+      } else {
+        blobs_[blobs[j] / 2]->ShareDataMemory(buffers[memory_buffer[i]]);
+      }
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory planning: " << memories.size() << " blob memories of "
+      << planned_size << " bytes share " << buffers.size()
+      << " buffers of " << buffers_size << " bytes";
+}
+
 template <typename Dtype>
 void Net<Dtype>::ShareWeights() {
   for (int i = 0; i < params_.size(); ++i) {
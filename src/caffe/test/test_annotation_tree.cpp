@@ -0,0 +1,197 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/annotation_tree.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class AnnotationTreeTest : public ::testing::Test {
+ protected:
+  bool ParseXML(const string& text) {
+    return tree_.ParseXML(text.data(), text.size(), &error_);
+  }
+  bool ParseJSON(const string& text) {
+    return tree_.ParseJSON(text.data(), text.size(), &error_);
+  }
+  // Writes text to a temporary file and returns its name.
+  string WriteTemp(const string& text) {
+    string filename;
+    MakeTempFilename(&filename);
+    std::ofstream file(filename.c_str());
+    file << text;
+    return filename;
+  }
+
+  AnnotationTree tree_;
+  string error_;
+};
+
+TEST_F(AnnotationTreeTest, TestXML) {
+  ASSERT_TRUE(ParseXML("<?xml version=\"1.0\"?>\n<!-- comment -->\n"
+      "<annotation><size><width>500</width><height> 375 </height></size >"
+      "<object kind=\"a>b\"><name>dog &amp; cat&#65;&#x42;</name>"
+      "<empty/><text><![CDATA[<raw>]]></text></object>"
+      "<object><name>second</name></object></annotation>")) << error_;
+  const int annotation = tree_.Find(tree_.root(), "annotation");
+  ASSERT_GE(annotation, 0);
+  int value = 0;
+  EXPECT_TRUE(tree_.Get(annotation, "size.width", &value));
+  EXPECT_EQ(500, value);
+  // Whitespace around a number is fine, but the text is kept as it is.
+  EXPECT_TRUE(tree_.Get(annotation, "size.height", &value));
+  EXPECT_EQ(375, value);
+  EXPECT_EQ(" 375 ", tree_.data(tree_.Find(annotation, "size.height")));
+  EXPECT_EQ(-1, tree_.Find(annotation, "size.depth"));
+  // Attributes are dropped, and the objects come in document order.
+  const int object = tree_.Find(annotation, "object");
+  ASSERT_GE(object, 0);
+  EXPECT_EQ("dog & catAB", tree_.data(tree_.Find(object, "name")));
+  EXPECT_EQ("", tree_.data(tree_.Find(object, "empty")));
+  EXPECT_EQ("<raw>", tree_.data(tree_.Find(object, "text")));
+  int second = tree_.next_sibling(object);
+  ASSERT_GE(second, 0);
+  EXPECT_EQ("object", tree_.key(second));
+  EXPECT_EQ("second", tree_.data(tree_.first_child(second)));
+  EXPECT_EQ(-1, tree_.next_sibling(second));
+}
+
+TEST_F(AnnotationTreeTest, TestXMLMalformed) {
+  EXPECT_FALSE(ParseXML("<annotation><size>"));
+  EXPECT_FALSE(ParseXML("<annotation><!-- </annotation>"));
+  EXPECT_FALSE(ParseXML("</annotation>"));
+  EXPECT_FALSE(ParseXML("<a><b></a></b>"));
+  EXPECT_FALSE(ParseXML("<a></ab>"));
+}
+
+TEST_F(AnnotationTreeTest, TestJSON) {
+  ASSERT_TRUE(ParseJSON("{\"image\": {\"height\": 480, \"width\": 640,"
+      " \"file\": \"a\\\"b\\u00e9\"}, \"annotation\": [{\"category_id\": 18,"
+      " \"iscrowd\": true, \"bbox\": [258.15, -4.5e1, 3, 4]}, {}]}")) << error_;
+  int value = 0;
+  EXPECT_TRUE(tree_.Get(tree_.root(), "image.width", &value));
+  EXPECT_EQ(640, value);
+  EXPECT_EQ("a\"b\xc3\xa9", tree_.data(tree_.Find(tree_.root(), "image.file")));
+  // Array items have an empty key, and scalars keep their literal text.
+  const int annotation = tree_.Find(tree_.root(), "annotation");
+  const int object = tree_.first_child(annotation);
+  ASSERT_GE(object, 0);
+  EXPECT_EQ("", tree_.key(object));
+  EXPECT_EQ("18", tree_.Get(object, "category_id", string()));
+  EXPECT_EQ("true", tree_.data(tree_.Find(object, "iscrowd")));
+  EXPECT_EQ(-1, tree_.Get(object, "iscrowd", -1));
+  const int bbox = tree_.Find(object, "bbox");
+  int child = tree_.first_child(bbox);
+  float x = 0;
+  EXPECT_TRUE(AnnotationTree::ToFloat(tree_.data(child), &x));
+  EXPECT_FLOAT_EQ(258.15, x);
+  child = tree_.next_sibling(child);
+  EXPECT_TRUE(AnnotationTree::ToFloat(tree_.data(child), &x));
+  EXPECT_FLOAT_EQ(-45, x);
+  const int empty = tree_.next_sibling(object);
+  ASSERT_GE(empty, 0);
+  EXPECT_EQ(-1, tree_.first_child(empty));
+}
+
+TEST_F(AnnotationTreeTest, TestJSONMalformed) {
+  EXPECT_FALSE(ParseJSON("{\"a\": [1, 2}"));
+  EXPECT_FALSE(ParseJSON("{\"a\" 1}"));
+  EXPECT_FALSE(ParseJSON("{\"a\": \"b}"));
+  EXPECT_FALSE(ParseJSON("[1] 2"));
+}
+
+TEST_F(AnnotationTreeTest, TestConversions) {
+  int i = 0;
+  float f = 0;
+  EXPECT_TRUE(AnnotationTree::ToInt("\n12\n", &i));
+  EXPECT_EQ(12, i);
+  EXPECT_TRUE(AnnotationTree::ToInt("-7", &i));
+  EXPECT_EQ(-7, i);
+  // Like property_tree, a decimal is not an int, and garbage is not a number.
+  EXPECT_FALSE(AnnotationTree::ToInt("240.5", &i));
+  EXPECT_FALSE(AnnotationTree::ToInt("", &i));
+  EXPECT_FALSE(AnnotationTree::ToInt("1 2", &i));
+  EXPECT_TRUE(AnnotationTree::ToFloat("240.5", &f));
+  EXPECT_FLOAT_EQ(240.5, f);
+  EXPECT_TRUE(AnnotationTree::ToFloat(".5e1", &f));
+  EXPECT_FLOAT_EQ(5, f);
+  EXPECT_FALSE(AnnotationTree::ToFloat("0x10", &f));
+  EXPECT_FALSE(AnnotationTree::ToFloat("nan", &f));
+  EXPECT_FALSE(AnnotationTree::ToFloat("1e", &f));
+}
+
+TEST_F(AnnotationTreeTest, TestReadXMLToAnnotatedDatum) {
+  const string filename = WriteTemp("<annotation>\n"
+      "  <size><width>200</width><height>100</height></size>\n"
+      "  <object><name>cat</name><difficult>1</difficult>\n"
+      "    <bndbox><xmin>20</xmin><ymin>10</ymin><xmax>100.5</xmax>"
+      "<ymax>50</ymax></bndbox></object>\n"
+      "  <object><name>dog</name>\n"
+      "    <bndbox><xmin>0</xmin><ymin>0</ymin><xmax>200</xmax>"
+      "<ymax>100</ymax></bndbox>\n"
+      "    <lm><x1>50</x1><y1>25</y1><x5>10.5</x5></lm></object>\n"
+      "  <object><name>cat</name>\n"
+      "    <bndbox><xmin>40</xmin><ymin>20</ymin><xmax>60</xmax>"
+      "<ymax>30</ymax></bndbox></object>\n"
+      "</annotation>\n");
+  std::map<string, int> name_to_label;
+  name_to_label["cat"] = 1;
+  name_to_label["dog"] = 2;
+  AnnotatedDatum anno_datum;
+  EXPECT_TRUE(ReadXMLToAnnotatedDatum(filename, 100, 200, name_to_label,
+      &anno_datum));
+  ASSERT_EQ(2, anno_datum.annotation_group_size());
+  const AnnotationGroup& cats = anno_datum.annotation_group(0);
+  EXPECT_EQ(1, cats.group_label());
+  ASSERT_EQ(2, cats.annotation_size());
+  EXPECT_EQ(0, cats.annotation(0).instance_id());
+  EXPECT_EQ(1, cats.annotation(1).instance_id());
+  const NormalizedBBox& bbox = cats.annotation(0).bbox();
+  EXPECT_FLOAT_EQ(0.1, bbox.xmin());
+  EXPECT_FLOAT_EQ(0.1, bbox.ymin());
+  // A decimal does not read as an int, so xmax falls back to 0.
+  EXPECT_FLOAT_EQ(0, bbox.xmax());
+  EXPECT_FLOAT_EQ(0.5, bbox.ymax());
+  EXPECT_TRUE(bbox.difficult());
+  EXPECT_FALSE(cats.annotation(1).bbox().difficult());
+  const Annotation& dog = anno_datum.annotation_group(1).annotation(0);
+  EXPECT_EQ(2, anno_datum.annotation_group(1).group_label());
+  EXPECT_EQ(1, dog.has_lm());
+  EXPECT_FLOAT_EQ(0.25, dog.face_lm().lefteye().x());
+  EXPECT_FLOAT_EQ(0.25, dog.face_lm().lefteye().y());
+  EXPECT_FLOAT_EQ(0, dog.face_lm().nose().x());
+  EXPECT_FLOAT_EQ(10.5 / 200, dog.face_lm().rightmouth().x());
+}
+
+TEST_F(AnnotationTreeTest, TestReadJSONToAnnotatedDatum) {
+  const string filename = WriteTemp("{\"image\": {\"height\": 100, "
+      "\"width\": 200}, \"annotation\": [\n"
+      "  {\"category_id\": 3, \"bbox\": [20, 10, 80.5, 40]},\n"
+      "  {\"category_id\": \"3\", \"iscrowd\": 1, \"bbox\": [0, 0, 1, 1]}]}");
+  std::map<string, int> name_to_label;
+  name_to_label["3"] = 5;
+  AnnotatedDatum anno_datum;
+  EXPECT_TRUE(ReadJSONToAnnotatedDatum(filename, 100, 200, name_to_label,
+      &anno_datum));
+  ASSERT_EQ(1, anno_datum.annotation_group_size());
+  const AnnotationGroup& group = anno_datum.annotation_group(0);
+  EXPECT_EQ(5, group.group_label());
+  ASSERT_EQ(2, group.annotation_size());
+  const NormalizedBBox& bbox = group.annotation(0).bbox();
+  EXPECT_FLOAT_EQ(0.1, bbox.xmin());
+  EXPECT_FLOAT_EQ(0.1, bbox.ymin());
+  EXPECT_FLOAT_EQ(100.5 / 200, bbox.xmax());
+  EXPECT_FLOAT_EQ(0.5, bbox.ymax());
+  EXPECT_FALSE(bbox.difficult());
+  EXPECT_EQ(1, group.annotation(1).instance_id());
+  EXPECT_TRUE(group.annotation(1).bbox().difficult());
+}
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <map>
 #include <utility>
 #include <vector>
@@ -220,6 +221,72 @@ TEST_F(CPUBBoxUtilTest, TestClipBBox) {
   EXPECT_NEAR(clip_bbox.size(), 1., eps);
 }
 
+TEST_F(CPUBBoxUtilTest, TestProjectLandmarks) {
+  NormalizedBBox src_bbox;
+  src_bbox.set_xmin(0.2);
+  src_bbox.set_ymin(0.2);
+  src_bbox.set_xmax(0.6);
+  src_bbox.set_ymax(0.7);
+  const float inside[2 * kNumFaceLandmarks] =
+      {0.3, 0.3, 0.5, 0.3, 0.4, 0.45, 0.3, 0.6, 0.5, 0.6};
+  float points[2 * kNumFaceLandmarks];
+  std::copy(inside, inside + 2 * kNumFaceLandmarks, points);
+  EXPECT_TRUE(ProjectLandmarks(src_bbox, points));
+  EXPECT_NEAR(points[0], 0.25, eps);
+  EXPECT_NEAR(points[1], 0.2, eps);
+  EXPECT_NEAR(points[5], 0.5, eps);
+  EXPECT_NEAR(points[8], 0.75, eps);
+  // Same as ProjectfacemarksBBox.
+  AnnoFaceLandmarks marks;
+  SetFaceLandmarks(inside, &marks);
+  EXPECT_TRUE(ProjectfacemarksBBox(src_bbox, &marks));
+  float mark_points[2 * kNumFaceLandmarks];
+  GetFaceLandmarks(marks, mark_points);
+  for (int i = 0; i < 2 * kNumFaceLandmarks; ++i) {
+    EXPECT_EQ(points[i], mark_points[i]);
+  }
+
+  // One point outside the box.
+  std::copy(inside, inside + 2 * kNumFaceLandmarks, points);
+  points[6] = 0.1;
+  EXPECT_FALSE(ProjectLandmarks(src_bbox, points));
+  EXPECT_EQ(0.1f, points[6]);
+}
+
+TEST_F(CPUBBoxUtilTest, TestAnnotationBoxesToGroup) {
+  AnnotationBox boxes[2];
+  for (int b = 0; b < 2; ++b) {
+    AnnotationBox& box = boxes[b];
+    box.group_label = 3;
+    box.instance_id = b;
+    box.xmin = 0.1 * b;
+    box.ymin = 0.2;
+    box.xmax = 0.5;
+    box.ymax = 0.6;
+    box.size = 0.16;
+    box.difficult = b == 1;
+    box.has_lm = b;
+    for (int i = 0; i < 2 * kNumFaceLandmarks; ++i) {
+      box.landmarks[i] = b ? 0.05 * i : -1;
+    }
+  }
+  AnnotationGroup group;
+  AnnotationBoxesToGroup(boxes, 2, &group);
+  EXPECT_EQ(3, group.group_label());
+  ASSERT_EQ(2, group.annotation_size());
+  for (int b = 0; b < 2; ++b) {
+    const Annotation& anno = group.annotation(b);
+    EXPECT_EQ(b, anno.instance_id());
+    EXPECT_EQ(boxes[b].xmin, anno.bbox().xmin());
+    EXPECT_EQ(boxes[b].ymax, anno.bbox().ymax());
+    EXPECT_EQ(boxes[b].size, anno.bbox().size());
+    EXPECT_EQ(boxes[b].difficult, anno.bbox().difficult());
+    EXPECT_EQ(b, anno.has_lm());
+    EXPECT_EQ(boxes[b].landmarks[0], anno.face_lm().lefteye().x());
+    EXPECT_EQ(boxes[b].landmarks[9], anno.face_lm().rightmouth().y());
+  }
+}
+
 TEST_F(CPUBBoxUtilTest, TestOutputBBox) {
   NormalizedBBox bbox;
   bbox.set_xmin(-0.1);
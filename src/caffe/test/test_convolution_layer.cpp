@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -156,7 +157,8 @@ class ConvolutionLayerTest : public MultiDeviceTest<TypeParam> {
       : blob_bottom_(new Blob<Dtype>(2, 3, 6, 4)),
         blob_bottom_2_(new Blob<Dtype>(2, 3, 6, 4)),
         blob_top_(new Blob<Dtype>()),
-        blob_top_2_(new Blob<Dtype>()) {}
+        blob_top_2_(new Blob<Dtype>()),
+        cpu_threads_(Caffe::cpu_threads_setting()) {}
   virtual void SetUp() {
     // fill the values
     FillerParameter filler_param;
@@ -168,6 +170,11 @@ class ConvolutionLayerTest : public MultiDeviceTest<TypeParam> {
     blob_top_vec_.push_back(blob_top_);
   }
 
+  // Undoes the set_cpu_threads() of a test.
+  virtual void TearDown() {
+    Caffe::set_cpu_threads(cpu_threads_);
+  }
+
   virtual ~ConvolutionLayerTest() {
     delete blob_bottom_;
     delete blob_bottom_2_;
@@ -188,6 +195,7 @@ class ConvolutionLayerTest : public MultiDeviceTest<TypeParam> {
   shared_ptr<Blob<Dtype> > ref_blob_top_;
   vector<Blob<Dtype>*> blob_bottom_vec_;
   vector<Blob<Dtype>*> blob_top_vec_;
+  const int cpu_threads_;
 };
 
 TYPED_TEST_CASE(ConvolutionLayerTest, TestDtypesAndDevices);
@@ -495,6 +503,80 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestDepthwiseConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 4, 9, 7);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // kernel, stride, pad, dilation and channel multiplier of each case, the
+  // first four taking the specialized loops.
+  const int cases[][5] = {
+    {3, 1, 1, 1, 1}, {3, 2, 1, 1, 1}, {5, 1, 2, 1, 2}, {5, 2, 2, 1, 1},
+    {3, 1, 2, 2, 1}, {4, 3, 0, 1, 2}
+  };
+  for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(cases[i][0]);
+    convolution_param->add_stride(cases[i][1]);
+    convolution_param->add_pad(cases[i][2]);
+    convolution_param->add_dilation(cases[i][3]);
+    convolution_param->set_num_output(4 * cases[i][4]);
+    convolution_param->set_group(4);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    shared_ptr<Layer<Dtype> > layer(
+        new ConvolutionLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Check against reference convolution.
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int j = 0; j < this->blob_top_->count(); ++j) {
+      EXPECT_NEAR(top_data[j], ref_top_data[j], 1e-4) << "case " << i;
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 4, 7, 9);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // pad, group and stride of each case, the last one falling back.
+  const int cases[][3] = {{0, 1, 1}, {1, 1, 1}, {2, 2, 1}, {1, 1, 2}};
+  for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_pad(cases[i][0]);
+    convolution_param->set_group(cases[i][1]);
+    convolution_param->add_stride(cases[i][2]);
+    convolution_param->set_num_output(6);
+    convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    shared_ptr<Layer<Dtype> > layer(
+        new WinogradConvolutionLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Check against reference convolution.
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int j = 0; j < this->blob_top_->count(); ++j) {
+      EXPECT_NEAR(top_data[j], ref_top_data[j], 1e-4) << "case " << i;
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
@@ -811,6 +893,93 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestDepthwiseGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  // kernel, stride, pad, dilation and channel multiplier of each case.
+  const int cases[][5] = {{3, 1, 1, 1, 1}, {5, 2, 2, 1, 2}, {3, 2, 1, 2, 1}};
+  for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(cases[i][0]);
+    convolution_param->add_stride(cases[i][1]);
+    convolution_param->add_pad(cases[i][2]);
+    convolution_param->add_dilation(cases[i][3]);
+    convolution_param->set_num_output(3 * cases[i][4]);
+    convolution_param->set_group(3);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-3);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // One item per cpu thread, with the weight gradients of the second one
+  // accumulated separately, for one and then two bottoms.
+  Caffe::set_cpu_threads(2);
+  for (int num_bottoms = 1; num_bottoms <= 2; ++num_bottoms) {
+    if (num_bottoms == 2) {
+      this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+      this->blob_top_vec_.push_back(this->blob_top_2_);
+    }
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_stride(2);
+    convolution_param->set_num_output(2);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-3);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWorkspaceSize) {
+  typedef typename TypeParam::Dtype Dtype;
+  // On the cpu, each worker takes a column buffer, up to one per item of the
+  // batch of 2.
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(2);
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Caffe::set_cpu_threads(1);
+  const size_t size = layer.WorkspaceSize();
+  EXPECT_GT(size, 0);
+  const int num_workers = Caffe::mode() == Caffe::CPU ? 2 : 1;
+  Caffe::set_cpu_threads(2);
+  EXPECT_EQ(num_workers * size, layer.WorkspaceSize());
+  Caffe::set_cpu_threads(3);
+  EXPECT_EQ(num_workers * size, layer.WorkspaceSize());
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
@@ -67,7 +67,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  void TestRead(int num_threads = 1, int reader_threads = 1) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -75,10 +75,12 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_reader_threads(reader_threads);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
     transform_param->set_scale(scale);
+    transform_param->set_num_threads(num_threads);
 
     DataLayer<Dtype> layer(param);
     layer.SetUp(blob_bottom_vec_, blob_top_vec_);
@@ -91,18 +93,63 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     EXPECT_EQ(blob_top_label_->height(), 1);
     EXPECT_EQ(blob_top_label_->width(), 1);
 
+    // Each reader thread reads a contiguous range of the 5 records over and
+    // over, and the threads are taken in turn.
+    vector<int> range_start(reader_threads);
+    vector<int> range_size(reader_threads);
+    vector<int> range_pos(reader_threads, 0);
+    for (int k = 0; k < reader_threads; ++k) {
+      range_start[k] = 5 * k / reader_threads;
+      range_size[k] = 5 * (k + 1) / reader_threads - range_start[k];
+    }
+    int next_range = 0;
     for (int iter = 0; iter < 100; ++iter) {
       layer.Forward(blob_bottom_vec_, blob_top_vec_);
       for (int i = 0; i < 5; ++i) {
-        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        const int k = next_range;
+        const int label = range_start[k] + range_pos[k];
+        range_pos[k] = (range_pos[k] + 1) % range_size[k];
+        next_range = (next_range + 1) % reader_threads;
+        EXPECT_EQ(label, blob_top_label_->cpu_data()[i]);
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(scale * label, blob_top_data_->cpu_data()[i * 24 + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
       }
+    }
+  }
+
+  void TestReadShuffled() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    // A batch is exactly one epoch: every record once, in any order.
+    bool in_order = true;
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      vector<int> seen(5, 0);
       for (int i = 0; i < 5; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        ASSERT_GE(label, 0);
+        ASSERT_LT(label, 5);
+        ++seen[label];
+        in_order &= (label == i);
         for (int j = 0; j < 24; ++j) {
-          EXPECT_EQ(scale * i, blob_top_data_->cpu_data()[i * 24 + j])
-              << "debug: iter " << iter << " i " << i << " j " << j;
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j]);
         }
       }
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(1, seen[i]);
+      }
     }
+    EXPECT_FALSE(in_order);
   }
 
   void TestReshape(DataParameter_DB backend) {
@@ -224,7 +271,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
-  void TestReadCropTrainSequenceSeeded() {
+  void TestReadCropTrainSequenceSeeded(int num_threads = 1) {
     LayerParameter param;
     param.set_phase(TRAIN);
     DataParameter* data_param = param.mutable_data_param();
@@ -236,6 +283,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
         param.mutable_transform_param();
     transform_param->set_crop_size(1);
     transform_param->set_mirror(true);
+    transform_param->set_num_threads(num_threads);
 
     // Get crop sequence with Caffe seed 1701.
     Caffe::set_random_seed(seed_);
@@ -356,6 +404,12 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadShardedLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestRead(1, 3);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -389,6 +443,24 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
 }
 #endif  // USE_LEVELDB
 
+TYPED_TEST(DataLayerTest, TestReadRecord) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_RECORD);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardedRecord) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_RECORD);
+  this->TestRead(1, 3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffledRecord) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_RECORD);
+  this->TestReadShuffled();
+}
+
 #ifdef USE_LMDB
 TYPED_TEST(DataLayerTest, TestReadLMDB) {
   const bool unique_pixels = false;  // all pixels the same; images different
@@ -396,6 +468,24 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadMultiThreadLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestRead(3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestRead(1, 3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffledLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShuffled();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -414,6 +504,14 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededLMDB) {
   this->TestReadCropTrainSequenceSeeded();
 }
 
+// Test that the random crops stay reproducible when the items of a batch are
+// transformed by several threads.
+TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededMultiThreadLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadCropTrainSequenceSeeded(3);
+}
+
 // Test that the sequence of random crops differs across iterations when
 // Caffe::set_random_seed isn't called (and seeds from srand are ignored).
 TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceUnseededLMDB) {
@@ -0,0 +1,83 @@
+#include <boost/thread.hpp>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/data_profile.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+const float kMicrosecondsThreshold = 30000;
+
+class DataProfileTest : public ::testing::Test {
+ protected:
+  void Sleep(int milliseconds) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(milliseconds));
+  }
+};
+
+TEST_F(DataProfileTest, TestNestedStagesAreExclusive) {
+  DataProfile profile;
+  {
+    StageTimer transform(&profile, DataProfile::TRANSFORM);
+    {
+      StageTimer decode(&profile, DataProfile::DECODE);
+      Sleep(300);
+    }
+  }
+  EXPECT_EQ(profile.count(DataProfile::TRANSFORM), 1);
+  EXPECT_EQ(profile.count(DataProfile::DECODE), 1);
+  EXPECT_EQ(profile.count(DataProfile::READ), 0);
+  EXPECT_GE(profile.microseconds(DataProfile::DECODE),
+            300000 - kMicrosecondsThreshold);
+  EXPECT_LE(profile.microseconds(DataProfile::TRANSFORM),
+            kMicrosecondsThreshold);
+}
+
+TEST_F(DataProfileTest, TestTimeOutsideStagesIsIgnored) {
+  DataProfile profile;
+  StageTimer read(&profile, DataProfile::READ);
+  read.Stop();
+  Sleep(300);
+  // Stopping again does nothing.
+  read.Stop();
+  {
+    StageTimer label(&profile, DataProfile::LABEL);
+  }
+  EXPECT_LE(profile.microseconds(DataProfile::READ), kMicrosecondsThreshold);
+  EXPECT_LE(profile.microseconds(DataProfile::LABEL), kMicrosecondsThreshold);
+}
+
+TEST_F(DataProfileTest, TestMergeAndReset) {
+  DataProfile first, second;
+  {
+    StageTimer timer(&first, DataProfile::DISTORT);
+    Sleep(100);
+  }
+  {
+    StageTimer timer(&second, DataProfile::DISTORT);
+    Sleep(100);
+  }
+  first.Merge(second);
+  EXPECT_EQ(first.count(DataProfile::DISTORT), 2);
+  EXPECT_GE(first.microseconds(DataProfile::DISTORT),
+            200000 - kMicrosecondsThreshold);
+  const string summary = first.Summary(2);
+  EXPECT_NE(summary.find("distort"), string::npos) << summary;
+  EXPECT_EQ(summary.find("decode"), string::npos) << summary;
+  first.Reset();
+  EXPECT_EQ(first.count(DataProfile::DISTORT), 0);
+  EXPECT_EQ(first.microseconds(DataProfile::DISTORT), 0);
+  EXPECT_EQ(first.Summary(1), "");
+}
+
+TEST_F(DataProfileTest, TestNullProfile) {
+  StageTimer timer(NULL, DataProfile::READ);
+  timer.Stop();
+}
+
+}  // namespace caffe
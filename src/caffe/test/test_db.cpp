@@ -1,4 +1,5 @@
 #if defined(USE_LEVELDB) && defined(USE_LMDB) && defined(USE_OPENCV)
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 
 #include "boost/scoped_ptr.hpp"
@@ -7,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -57,8 +59,13 @@ struct TypeLMDB {
 };
 DataParameter_DB TypeLMDB::backend = DataParameter_DB_LMDB;
 
+struct TypeRecord {
+  static DataParameter_DB backend;
+};
+DataParameter_DB TypeRecord::backend = DataParameter_DB_RECORD;
+
 // typedef ::testing::Types<TypeLmdb> TestTypes;
-typedef ::testing::Types<TypeLevelDB, TypeLMDB> TestTypes;
+typedef ::testing::Types<TypeLevelDB, TypeLMDB, TypeRecord> TestTypes;
 
 TYPED_TEST_CASE(DBTest, TestTypes);
 
@@ -117,6 +124,22 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueData) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  EXPECT_TRUE(cursor->valid());
+  string value = cursor->value();
+  EXPECT_EQ(value.size(), cursor->value_size());
+  EXPECT_EQ(value, string(cursor->value_data(), cursor->value_size()));
+  Datum datum;
+  EXPECT_TRUE(datum.ParseFromArray(cursor->value_data(),
+      cursor->value_size()));
+  EXPECT_EQ(datum.channels(), 3);
+  EXPECT_EQ(datum.height(), 360);
+  EXPECT_EQ(datum.width(), 480);
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
@@ -132,5 +155,199 @@ TYPED_TEST(DBTest, TestWrite) {
   txn->Commit();
 }
 
+TYPED_TEST(DBTest, TestWriteMany) {
+  // More than the 10 MB an LMDB map starts with, in two transactions, the
+  // keys half in order and half not.
+  const int num_records = 1200;
+  const int value_size = 20000;
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::WRITE);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  for (int i = 0; i < num_records; ++i) {
+    const int id = i < num_records / 2 ? i : num_records * 3 / 2 - 1 - i;
+    txn->Put(format_int(id, 8), string(value_size, 'a' + id % 26));
+    if (i == num_records / 2) {
+      txn->Commit();
+      txn.reset(db->NewTransaction());
+    }
+  }
+  txn->Commit();
+  txn.reset();
+  db->Close();
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  if (TypeParam::backend == DataParameter_DB_RECORD) {
+    // Records come in the order they were written, after those of SetUp().
+    EXPECT_EQ("cat.jpg", cursor->key());
+    cursor->Next();
+    cursor->Next();
+    for (int i = 0; i < num_records; ++i) {
+      const int id = i < num_records / 2 ? i : num_records * 3 / 2 - 1 - i;
+      ASSERT_TRUE(cursor->valid());
+      EXPECT_EQ(format_int(id, 8), cursor->key());
+      EXPECT_EQ(string(value_size, 'a' + id % 26), cursor->value());
+      cursor->Next();
+    }
+    EXPECT_FALSE(cursor->valid());
+    return;
+  }
+  for (int id = 0; id < num_records; ++id) {
+    ASSERT_TRUE(cursor->valid());
+    EXPECT_EQ(format_int(id, 8), cursor->key());
+    EXPECT_EQ(string(value_size, 'a' + id % 26), cursor->value());
+    cursor->Next();
+  }
+  // The records written by SetUp() sort last.
+  EXPECT_EQ("cat.jpg", cursor->key());
+}
+
+typedef DBTest<TypeLMDB> LMDBTest;
+
+TEST_F(LMDBTest, TestSizeHint) {
+  scoped_ptr<db::DB> db(db::GetDB(backend_));
+  db->Open(source_, db::WRITE);
+  db->SetSizeHint(64 << 20);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  for (int i = 0; i < 2000; ++i) {
+    txn->Put(format_int(i, 8), string(30000, 'x'));
+  }
+  txn->Commit();
+  txn.reset();
+  db->Close();
+  db->Open(source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  int count = 0;
+  for (; cursor->valid(); cursor->Next()) {
+    ++count;
+  }
+  EXPECT_EQ(2002, count);
+}
+
+TEST_F(LMDBTest, TestRandomReader) {
+  for (int pass = 0; pass < 2; ++pass) {
+    // The second pass loads the cached key index.
+    scoped_ptr<db::DB> db(db::GetDB(backend_));
+    db->Open(source_, db::READ);
+    scoped_ptr<db::RandomReader> reader(db->NewRandomReader());
+    ASSERT_EQ(reader->keys().size(), 2);
+    EXPECT_EQ(reader->keys()[0], "cat.jpg");
+    EXPECT_EQ(reader->keys()[1], "fish-bike.jpg");
+    const char* data;
+    size_t size;
+    ASSERT_TRUE(reader->Get("fish-bike.jpg", &data, &size));
+    reader->WillNeed(data, size);
+    Datum datum;
+    EXPECT_TRUE(datum.ParseFromArray(data, size));
+    EXPECT_EQ(datum.height(), 323);
+    EXPECT_EQ(datum.width(), 481);
+    EXPECT_FALSE(reader->Get("dog.jpg", &data, &size));
+  }
+}
+
+typedef DBTest<TypeRecord> RecordDBTest;
+
+TEST_F(RecordDBTest, TestRandomReader) {
+  scoped_ptr<db::DB> db(db::GetDB(backend_));
+  db->Open(source_, db::READ);
+  scoped_ptr<db::RandomReader> reader(db->NewRandomReader());
+  ASSERT_EQ(reader->keys().size(), 2);
+  EXPECT_EQ(reader->keys()[0], "cat.jpg");
+  EXPECT_EQ(reader->keys()[1], "fish-bike.jpg");
+  const char* data;
+  size_t size;
+  ASSERT_TRUE(reader->Get("fish-bike.jpg", &data, &size));
+  reader->WillNeed(data, size);
+  Datum datum;
+  EXPECT_TRUE(datum.ParseFromArray(data, size));
+  EXPECT_EQ(datum.height(), 323);
+  EXPECT_EQ(datum.width(), 481);
+  EXPECT_FALSE(reader->Get("dog.jpg", &data, &size));
+}
+
+TEST_F(RecordDBTest, TestAppend) {
+  {
+    scoped_ptr<db::DB> db(db::GetDB(backend_));
+    db->Open(source_, db::WRITE);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    txn->Put("a", "first");
+    txn->Commit();
+    // Not committed, so dropped.
+    txn->Put("b", "second");
+  }
+  {
+    // An index entry cut short, as by a crash while committing, is ignored.
+    std::ofstream index((source_ + "/index").c_str(),
+        std::ios::out | std::ios::binary | std::ios::app);
+    index << "cut";
+  }
+  scoped_ptr<db::DB> db(db::GetDB(backend_));
+  db->Open(source_, db::WRITE);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  txn->Put("c", "third");
+  txn->Commit();
+  txn.reset();
+  db->Close();
+  db->Open(source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  cursor->Next();
+  cursor->Next();
+  ASSERT_TRUE(cursor->valid());
+  EXPECT_EQ("a", cursor->key());
+  EXPECT_EQ("first", cursor->value());
+  cursor->Next();
+  ASSERT_TRUE(cursor->valid());
+  EXPECT_EQ("c", cursor->key());
+  EXPECT_EQ("third", cursor->value());
+  cursor->Next();
+  EXPECT_FALSE(cursor->valid());
+}
+
+TEST_F(RecordDBTest, TestOverwrite) {
+  scoped_ptr<db::DB> db(db::GetDB(backend_));
+  db->Open(source_, db::WRITE);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  txn->Put("cat.jpg", "replaced");
+  txn->Commit();
+  txn.reset();
+  db->Close();
+  // Appending resumes after the new value, not after the last record.
+  db->Open(source_, db::WRITE);
+  txn.reset(db->NewTransaction());
+  txn->Put("a", "appended");
+  txn->Commit();
+  txn.reset();
+  db->Close();
+  db->Open(source_, db::READ);
+  scoped_ptr<db::RandomReader> reader(db->NewRandomReader());
+  ASSERT_EQ(reader->keys().size(), 3);
+  // The record keeps its position.
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  ASSERT_TRUE(cursor->valid());
+  EXPECT_EQ("cat.jpg", cursor->key());
+  EXPECT_EQ("replaced", cursor->value());
+  cursor->Next();
+  EXPECT_EQ("fish-bike.jpg", cursor->key());
+  cursor->Next();
+  EXPECT_EQ("a", cursor->key());
+  EXPECT_EQ("appended", cursor->value());
+  cursor->Next();
+  EXPECT_FALSE(cursor->valid());
+}
+
+TEST_F(RecordDBTest, TestCloseBeforeTransaction) {
+  {
+    scoped_ptr<db::DB> db(db::GetDB(backend_));
+    db->Open(source_, db::WRITE);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    txn->Put("a", "uncommitted");
+    db->Close();
+  }
+  scoped_ptr<db::DB> db(db::GetDB(backend_));
+  db->Open(source_, db::WRITE);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  cursor->Seek("a");
+  EXPECT_FALSE(cursor->valid());
+}
+
 }  // namespace caffe
 #endif  // USE_LEVELDB, USE_LMDB and USE_OPENCV
@@ -0,0 +1,80 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/file_readahead.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FileReadaheadTest : public ::testing::TestWithParam<int> {
+ protected:
+  virtual void SetUp() {
+    for (int i = 0; i < 20; ++i) {
+      string filename;
+      MakeTempFilename(&filename);
+      std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+      file << i << ":" << string(i * 1000, 'x');
+      files_.push_back(filename);
+    }
+  }
+
+  // Checks that data holds file i.
+  void CheckData(int i, const string& data) {
+    const size_t colon = data.find(':');
+    ASSERT_NE(string::npos, colon);
+    EXPECT_EQ(format_int(i), data.substr(0, colon));
+    EXPECT_EQ(colon + 1 + i * 1000, data.size());
+  }
+
+  vector<string> files_;
+};
+
+TEST_P(FileReadaheadTest, TestRead) {
+  FileReadahead readahead(GetParam(), 3);
+  // Twice, to check that a list can follow another.
+  for (int pass = 0; pass < 2; ++pass) {
+    readahead.Start(files_);
+    for (int i = 0; i < files_.size(); ++i) {
+      string data;
+      ASSERT_TRUE(readahead.Get(i, &data));
+      CheckData(i, data);
+    }
+  }
+}
+
+TEST_P(FileReadaheadTest, TestOutOfOrder) {
+  // A file past the window is read anyway once it is waited for.
+  FileReadahead readahead(GetParam(), 1);
+  readahead.Start(files_);
+  string data;
+  for (int i = files_.size() - 1; i >= 0; --i) {
+    ASSERT_TRUE(readahead.Get(i, &data));
+    CheckData(i, data);
+  }
+}
+
+TEST_P(FileReadaheadTest, TestMissing) {
+  FileReadahead readahead(GetParam(), 4);
+  vector<string> files;
+  files.push_back(files_[0]);
+  files.push_back(files_[0] + ".missing");
+  files.push_back(files_[1]);
+  readahead.Start(files);
+  string data;
+  EXPECT_TRUE(readahead.Get(0, &data));
+  EXPECT_FALSE(readahead.Get(1, &data));
+  EXPECT_TRUE(data.empty());
+  EXPECT_TRUE(readahead.Get(2, &data));
+  CheckData(1, data);
+}
+
+INSTANTIATE_TEST_CASE_P(Threads, FileReadaheadTest, ::testing::Values(0, 1, 4));
+
+}  // namespace caffe
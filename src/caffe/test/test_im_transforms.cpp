@@ -1,7 +1,10 @@
+#include <cstdlib>
+
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
 #include "caffe/util/im_transforms.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -92,6 +95,103 @@ TEST_F(ImTransformsTest, TestApplyResize) {
   CHECK_EQ(out_img.cols, 30);
   CHECK_EQ(out_img.rows, 30);
 }
+
+// Applies the distortions one at a time, the way ApplyDistort used to.
+static cv::Mat DistortOneByOne(const cv::Mat& in_img,
+                               const DistortionParameter& param) {
+  cv::Mat out_img = in_img.clone();
+  float prob;
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool contrast_first = prob > 0.5;
+  RandomBrightness(out_img, &out_img, param.brightness_prob(),
+                   param.brightness_delta());
+  if (contrast_first) {
+    RandomContrast(out_img, &out_img, param.contrast_prob(),
+                   param.contrast_lower(), param.contrast_upper());
+  }
+  RandomSaturation(out_img, &out_img, param.saturation_prob(),
+                   param.saturation_lower(), param.saturation_upper());
+  RandomHue(out_img, &out_img, param.hue_prob(), param.hue_delta());
+  if (!contrast_first) {
+    RandomContrast(out_img, &out_img, param.contrast_prob(),
+                   param.contrast_lower(), param.contrast_upper());
+  }
+  RandomOrderChannels(out_img, &out_img, param.random_order_prob());
+  return out_img;
+}
+
+class ApplyDistortTest : public ImTransformsTest {
+ protected:
+  ApplyDistortTest() : img_(24, 32, CV_8UC3) {
+    cv::randu(img_, cv::Scalar::all(0), cv::Scalar::all(256));
+    param_.set_brightness_prob(1);
+    param_.set_brightness_delta(32);
+    param_.set_contrast_prob(1);
+    param_.set_contrast_lower(0.5);
+    param_.set_contrast_upper(1.5);
+    param_.set_random_order_prob(1);
+  }
+
+  // Checks that ApplyDistort gives exactly what applying the distortions one
+  // by one does, for a few seeds.
+  void TestMatchesOneByOne() {
+    for (int seed = 1701; seed < 1711; ++seed) {
+      Caffe::set_random_seed(seed);
+      srand(seed);
+      const cv::Mat fused = ApplyDistort(img_, param_);
+      Caffe::set_random_seed(seed);
+      srand(seed);
+      const cv::Mat expected = DistortOneByOne(img_, param_);
+      ASSERT_EQ(fused.type(), expected.type());
+      ASSERT_EQ(fused.size(), expected.size());
+      EXPECT_EQ(cv::norm(fused, expected, cv::NORM_INF), 0) << "seed " << seed;
+    }
+  }
+
+  cv::Mat img_;
+  DistortionParameter param_;
+};
+
+TEST_F(ApplyDistortTest, TestBrightnessContrastOrder) {
+  this->TestMatchesOneByOne();
+}
+
+TEST_F(ApplyDistortTest, TestSaturation) {
+  param_.set_saturation_prob(1);
+  param_.set_saturation_lower(0.5);
+  param_.set_saturation_upper(1.5);
+  this->TestMatchesOneByOne();
+}
+
+TEST_F(ApplyDistortTest, TestHue) {
+  param_.set_hue_prob(1);
+  param_.set_hue_delta(18);
+  this->TestMatchesOneByOne();
+}
+
+TEST_F(ApplyDistortTest, TestSaturationHueDeterministic) {
+  // Both go through a single HSV round trip, which differs from two.
+  param_.set_saturation_prob(1);
+  param_.set_saturation_lower(0.5);
+  param_.set_saturation_upper(1.5);
+  param_.set_hue_prob(1);
+  param_.set_hue_delta(18);
+  const cv::Mat original = img_.clone();
+  Caffe::set_random_seed(1701);
+  srand(1701);
+  const cv::Mat first = ApplyDistort(img_, param_);
+  Caffe::set_random_seed(1701);
+  srand(1701);
+  const cv::Mat second = ApplyDistort(img_, param_);
+  EXPECT_EQ(cv::norm(first, second, cv::NORM_INF), 0);
+  EXPECT_EQ(cv::norm(img_, original, cv::NORM_INF), 0);
+}
+
+TEST_F(ApplyDistortTest, TestNothingDrawn) {
+  param_.Clear();
+  const cv::Mat out_img = ApplyDistort(img_, param_);
+  EXPECT_EQ(out_img.data, img_.data);
+}
 #endif  // USE_OPENCV
 
 }  // namespace caffe
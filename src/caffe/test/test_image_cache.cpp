@@ -0,0 +1,83 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  // A 10x10 color image (300 bytes) filled with value.
+  cv::Mat MakeImage(int value) {
+    return cv::Mat(10, 10, CV_8UC3, cv::Scalar(value, value, value));
+  }
+};
+
+TEST_F(ImageCacheTest, TestHitMiss) {
+  ImageCache cache(1 << 20);
+  cv::Mat img;
+  EXPECT_FALSE(cache.Get(ImageCache::KeyOf("a"), &img));
+  cache.Put(ImageCache::KeyOf("a"), MakeImage(1));
+  ASSERT_TRUE(cache.Get(ImageCache::KeyOf("a"), &img));
+  EXPECT_EQ(img.at<cv::Vec3b>(5, 5)[0], 1);
+  EXPECT_FALSE(cache.Get(ImageCache::KeyOf("b"), &img));
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 2);
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(ImageCacheTest, TestCopies) {
+  ImageCache cache(1 << 20);
+  cv::Mat put = MakeImage(1);
+  cache.Put(ImageCache::KeyOf("a"), put);
+  put.setTo(cv::Scalar(2, 2, 2));
+  cv::Mat img;
+  ASSERT_TRUE(cache.Get(ImageCache::KeyOf("a"), &img));
+  EXPECT_EQ(img.at<cv::Vec3b>(0, 0)[0], 1);
+  // Modifying what we got back does not alter the cache either.
+  img.setTo(cv::Scalar(3, 3, 3));
+  ASSERT_TRUE(cache.Get(ImageCache::KeyOf("a"), &img));
+  EXPECT_EQ(img.at<cv::Vec3b>(0, 0)[0], 1);
+}
+
+TEST_F(ImageCacheTest, TestLRUEviction) {
+  // Room for two images and their keys.
+  ImageCache cache(2 * (300 + sizeof(ImageCache::Key)));
+  cv::Mat img;
+  cache.Put(ImageCache::KeyOf("a"), MakeImage(1));
+  cache.Put(ImageCache::KeyOf("b"), MakeImage(2));
+  // Touch a, so that b is the least recently used.
+  ASSERT_TRUE(cache.Get(ImageCache::KeyOf("a"), &img));
+  cache.Put(ImageCache::KeyOf("c"), MakeImage(3));
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.evictions(), 1);
+  EXPECT_TRUE(cache.Get(ImageCache::KeyOf("a"), &img));
+  EXPECT_FALSE(cache.Get(ImageCache::KeyOf("b"), &img));
+  EXPECT_TRUE(cache.Get(ImageCache::KeyOf("c"), &img));
+  EXPECT_EQ(img.at<cv::Vec3b>(0, 0)[0], 3);
+  EXPECT_LE(cache.size_bytes(), cache.capacity_bytes());
+}
+
+TEST_F(ImageCacheTest, TestKeys) {
+  // Every byte counts, including those past the last 16 byte block.
+  const string encoded(37, 'x');
+  ImageCache::Key key = ImageCache::KeyOf(encoded);
+  for (int i = 0; i < encoded.size(); ++i) {
+    string other = encoded;
+    other[i] = 'y';
+    ImageCache::Key other_key = ImageCache::KeyOf(other);
+    EXPECT_TRUE(key < other_key || other_key < key) << "byte " << i;
+  }
+  ImageCache::Key shorter = ImageCache::KeyOf(encoded.substr(1));
+  EXPECT_TRUE(key < shorter || shorter < key);
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
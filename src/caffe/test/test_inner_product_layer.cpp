@@ -23,13 +23,18 @@ class InnerProductLayerTest : public MultiDeviceTest<TypeParam> {
   InnerProductLayerTest()
       : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
         blob_bottom_nobatch_(new Blob<Dtype>(1, 2, 3, 4)),
-        blob_top_(new Blob<Dtype>()) {
+        blob_top_(new Blob<Dtype>()),
+        cpu_threads_(Caffe::cpu_threads_setting()) {
     // fill the values
     FillerParameter filler_param;
     UniformFiller<Dtype> filler(filler_param);
     filler.Fill(this->blob_bottom_);
     blob_top_vec_.push_back(blob_top_);
   }
+  // Undoes the set_cpu_threads() of a test.
+  virtual void TearDown() {
+    Caffe::set_cpu_threads(cpu_threads_);
+  }
   virtual ~InnerProductLayerTest() {
     delete blob_bottom_;
     delete blob_bottom_nobatch_;
@@ -40,6 +45,7 @@ class InnerProductLayerTest : public MultiDeviceTest<TypeParam> {
   Blob<Dtype>* const blob_top_;
   vector<Blob<Dtype>*> blob_bottom_vec_;
   vector<Blob<Dtype>*> blob_top_vec_;
+  const int cpu_threads_;
 };
 
 TYPED_TEST_CASE(InnerProductLayerTest, TestDtypesAndDevices);
@@ -292,6 +298,26 @@ TYPED_TEST(InnerProductLayerTest, TestGradientTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestGradientThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The products split over the rows of the batch and of the weights.
+  Caffe::set_cpu_threads(2);
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(7);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    inner_product_param->set_transpose(transpose);
+    InnerProductLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-3);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestBackwardTranspose) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_);
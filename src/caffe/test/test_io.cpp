@@ -443,6 +443,55 @@ TEST_F(IOTest, TestDecodeDatumToCVMatNative) {
   EXPECT_EQ(cv_img.cols, 480);
 }
 
+TEST_F(IOTest, TestGetJPEGSize) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  int height, width, channels;
+  EXPECT_TRUE(GetJPEGSize(datum.data(), &height, &width, &channels));
+  EXPECT_EQ(height, 360);
+  EXPECT_EQ(width, 480);
+  EXPECT_EQ(channels, 3);
+  EXPECT_FALSE(GetJPEGSize("not a jpeg", &height, &width, &channels));
+}
+
+TEST_F(IOTest, TestDecodeDatumToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  // 360x480 reduced by 2 is the smallest that fits 150x200.
+  cv::Mat cv_img = DecodeDatumToCVMatReduced(datum, 150, 200,
+      CV_LOAD_IMAGE_COLOR);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 180);
+  EXPECT_EQ(cv_img.cols, 240);
+  cv_img = DecodeDatumToCVMatReduced(datum, 40, 60, CV_LOAD_IMAGE_GRAYSCALE);
+  EXPECT_EQ(cv_img.channels(), 1);
+  EXPECT_EQ(cv_img.rows, 45);
+  EXPECT_EQ(cv_img.cols, 60);
+  // Too large a target for any reduction.
+  cv_img = DecodeDatumToCVMatReduced(datum, 300, 300, CV_LOAD_IMAGE_UNCHANGED);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 360);
+  EXPECT_EQ(cv_img.cols, 480);
+}
+
+TEST_F(IOTest, TestDecodeImageToCVMatReduced) {
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  Datum datum;
+  EXPECT_TRUE(ReadFileToDatum(filename, &datum));
+  // Reduced, then resized to the requested size.
+  cv::Mat cv_img = DecodeImageToCVMatReduced(datum.data(), 100, 150, true);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 100);
+  EXPECT_EQ(cv_img.cols, 150);
+  // Without a size, the image is decoded in full.
+  cv_img = DecodeImageToCVMatReduced(datum.data(), 0, 0, false);
+  EXPECT_EQ(cv_img.channels(), 1);
+  EXPECT_EQ(cv_img.rows, 360);
+  EXPECT_EQ(cv_img.cols, 480);
+}
+
 TEST_F(IOTest, TestDecodeDatumNativeGray) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat_gray.jpg";
   Datum datum;
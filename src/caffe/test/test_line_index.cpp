@@ -0,0 +1,55 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/line_index.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class LineIndexTest : public ::testing::Test {
+ protected:
+  string WriteTemp(const string& text) {
+    string filename;
+    MakeTempFilename(&filename);
+    std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+    file << text;
+    return filename;
+  }
+};
+
+TEST_F(LineIndexTest, TestLines) {
+  LineIndex index;
+  ASSERT_TRUE(index.Open(WriteTemp("a/b 1\n\nc d 2\r\n\r\n  e 3")));
+  ASSERT_EQ(3, index.size());
+  EXPECT_EQ("a/b 1", index.line(0));
+  // Only the end of line is dropped, not the spaces.
+  EXPECT_EQ("c d 2", index.line(1));
+  EXPECT_EQ("  e 3", index.line(2));
+  EXPECT_EQ(5, index.line_size(2));
+}
+
+TEST_F(LineIndexTest, TestEmpty) {
+  LineIndex index;
+  ASSERT_TRUE(index.Open(WriteTemp("")));
+  EXPECT_EQ(0, index.size());
+  ASSERT_TRUE(index.Open(WriteTemp("\n\n")));
+  EXPECT_EQ(0, index.size());
+  ASSERT_TRUE(index.Open(WriteTemp("x\n")));
+  ASSERT_EQ(1, index.size());
+  EXPECT_EQ("x", index.line(0));
+}
+
+TEST_F(LineIndexTest, TestMissing) {
+  LineIndex index;
+  string filename;
+  MakeTempFilename(&filename);
+  EXPECT_FALSE(index.Open(filename + ".missing"));
+  EXPECT_EQ(0, index.size());
+}
+
+}  // namespace caffe
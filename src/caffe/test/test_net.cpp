@@ -1,3 +1,4 @@
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -629,6 +630,147 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitWorkspaceNet() {
+    const string& proto =
+        "name: 'WorkspaceNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 10 dim: 9 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 5 "
+        "    pad: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 5 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    engine: WINOGRAD "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'deconv' "
+        "  type: 'Deconvolution' "
+        "  bottom: 'conv2' "
+        "  top: 'deconv' "
+        "  convolution_param { "
+        "    num_output: 2 "
+        "    kernel_size: 2 "
+        "    stride: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitPlanMemoryNet(const Phase phase, const bool plan_memory) {
+    const string& proto =
+        "name: 'PlanMemoryNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  input_param { "
+        "    shape: { dim: 4 dim: 5 } "
+        "    shape: { dim: 4 dim: 3 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'norm' "
+        "  type: 'Reduction' "
+        "  bottom: 'ip2' "
+        "  top: 'norm' "
+        "  reduction_param { "
+        "    operation: SUMSQ "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip2' "
+        "  top: 'sigmoid' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sigmoid' "
+        "  top: 'ip3' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip3' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.mutable_state()->set_phase(phase);
+    param.set_plan_memory(plan_memory);
+    net_.reset(new Net<Dtype>(param));
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -2583,6 +2725,82 @@ TYPED_TEST(NetTest, TestAllInOneNetVal) {
   ASSERT_TRUE(found_loss);
 }
 
+TYPED_TEST(NetTest, TestSharedWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The layers share their scratch memory in the net; check that they compute
+  // the same as layers with their own.
+  this->InitWorkspaceNet();
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->blob_by_name("data").get());
+  this->net_->Forward();
+  for (int i = 1; i < this->net_->layers().size(); ++i) {
+    Layer<Dtype>& net_layer = *this->net_->layers()[i];
+    EXPECT_GT(net_layer.WorkspaceSize(), 0);
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(net_layer.layer_param());
+    Blob<Dtype> top;
+    vector<Blob<Dtype>*> top_vec(1, &top);
+    layer->SetUp(this->net_->bottom_vecs()[i], top_vec);
+    for (int j = 0; j < layer->blobs().size(); ++j) {
+      layer->blobs()[j]->CopyFrom(*net_layer.blobs()[j]);
+    }
+    layer->Forward(this->net_->bottom_vecs()[i], top_vec);
+    const Blob<Dtype>* net_top = this->net_->top_vecs()[i][0];
+    ASSERT_EQ(net_top->count(), top.count());
+    for (int k = 0; k < top.count(); ++k) {
+      EXPECT_EQ(net_top->cpu_data()[k], top.cpu_data()[k]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestPlanMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The nets with planned memory compute the same as the others, with fewer
+  // memories. The diff of the Split top to the Reduction is never written,
+  // so must stay zero.
+  const Phase phases[] = {caffe::TEST, caffe::TRAIN};
+  for (int i = 0; i < 2; ++i) {
+    vector<shared_ptr<Net<Dtype> > > nets;
+    vector<int> num_memories;
+    for (int plan_memory = 0; plan_memory < 2; ++plan_memory) {
+      Caffe::set_random_seed(this->seed_);
+      this->InitPlanMemoryNet(phases[i], plan_memory);
+      FillerParameter filler_param;
+      GaussianFiller<Dtype> filler(filler_param);
+      filler.Fill(this->net_->blob_by_name("data").get());
+      filler.Fill(this->net_->blob_by_name("target").get());
+      this->net_->Forward();
+      if (phases[i] == caffe::TRAIN) {
+        this->net_->Backward();
+      }
+      std::set<SyncedMemory*> memories;
+      for (int j = 0; j < this->net_->blobs().size(); ++j) {
+        memories.insert(this->net_->blobs()[j]->data().get());
+        memories.insert(this->net_->blobs()[j]->diff().get());
+      }
+      nets.push_back(this->net_);
+      num_memories.push_back(memories.size());
+    }
+    EXPECT_LT(num_memories[1], num_memories[0]);
+    for (int j = 0; j < nets[0]->output_blobs().size(); ++j) {
+      const Blob<Dtype>* output = nets[0]->output_blobs()[j];
+      const Blob<Dtype>* planned_output = nets[1]->output_blobs()[j];
+      for (int k = 0; k < output->count(); ++k) {
+        EXPECT_EQ(output->cpu_data()[k], planned_output->cpu_data()[k]);
+      }
+    }
+    if (phases[i] == caffe::TEST) { continue; }
+    for (int j = 0; j < nets[0]->learnable_params().size(); ++j) {
+      const Blob<Dtype>* param = nets[0]->learnable_params()[j];
+      const Blob<Dtype>* planned_param = nets[1]->learnable_params()[j];
+      for (int k = 0; k < param->count(); ++k) {
+        EXPECT_EQ(param->cpu_diff()[k], planned_param->cpu_diff()[k]);
+      }
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestAllInOneNetDeploy) {
   vector<string> stages;
   stages.push_back("deploy");
@@ -0,0 +1,92 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
+#include "caffe/util/rng.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class PhiloxTest : public ::testing::Test {
+ protected:
+  // Draws the uniform values and the shuffle of one item.
+  static void Draw(uint64_t seed, uint64_t batch_id, int item_id,
+      vector<float>* values, vector<int>* order) {
+    ItemRNGScope item_rng(seed, batch_id, item_id);
+    values->resize(16);
+    caffe_rng_uniform<float>(values->size(), 0, 1, &(*values)[0]);
+    order->resize(16);
+    for (int i = 0; i < order->size(); ++i) {
+      (*order)[i] = i;
+    }
+    shuffle(order->begin(), order->end());
+  }
+};
+
+TEST_F(PhiloxTest, TestKnownAnswers) {
+  // From the test vectors of the Random123 library.
+  uint32_t key[2] = {0, 0};
+  uint32_t counter[4] = {0, 0, 0, 0};
+  uint32_t out[4];
+  Philox::Bijection(key, counter, out);
+  EXPECT_EQ(0x6627e8d5, out[0]);
+  EXPECT_EQ(0xe169c58d, out[1]);
+  EXPECT_EQ(0xbc57ac4c, out[2]);
+  EXPECT_EQ(0x9b00dbd8, out[3]);
+  key[0] = key[1] = 0xffffffff;
+  counter[0] = counter[1] = counter[2] = counter[3] = 0xffffffff;
+  Philox::Bijection(key, counter, out);
+  EXPECT_EQ(0x408f276d, out[0]);
+  EXPECT_EQ(0x41c83b0e, out[1]);
+  EXPECT_EQ(0xa20bc7c6, out[2]);
+  EXPECT_EQ(0x6d5451fd, out[3]);
+}
+
+TEST_F(PhiloxTest, TestStream) {
+  Philox a(7, 1, 2, 3), b(7, 1, 2, 3), c(7, 1, 2, 4);
+  int same = 0;
+  for (int i = 0; i < 64; ++i) {
+    const uint32_t value = a();
+    EXPECT_EQ(value, b());
+    same += value == c();
+  }
+  EXPECT_LT(same, 2);
+}
+
+TEST_F(PhiloxTest, TestItemIndependentOfThread) {
+  vector<float> values, thread_values, other_values;
+  vector<int> order, thread_order, other_order;
+  Draw(1701, 3, 5, &values, &order);
+  // Drawing from the thread's generator in between changes nothing.
+  caffe_rng_rand();
+  boost::thread thread(boost::bind(&PhiloxTest::Draw, 1701, 3, 5,
+      &thread_values, &thread_order));
+  thread.join();
+  EXPECT_EQ(values, thread_values);
+  EXPECT_EQ(order, thread_order);
+  Draw(1701, 3, 6, &other_values, &other_order);
+  EXPECT_NE(values, other_values);
+}
+
+TEST_F(PhiloxTest, TestNestedScopes) {
+  EXPECT_TRUE(ItemRNGScope::current() == NULL);
+  ItemRNGScope outer(1, 2, 3);
+  Philox* outer_rng = ItemRNGScope::current();
+  EXPECT_TRUE(outer_rng != NULL);
+  {
+    ItemRNGScope inner(1, 2, 4);
+    EXPECT_TRUE(ItemRNGScope::current() != outer_rng);
+  }
+  EXPECT_TRUE(ItemRNGScope::current() == outer_rng);
+  Philox expected(1, 3, 2, 0);
+  EXPECT_EQ(expected(), caffe_rng_rand());
+}
+
+}  // namespace caffe
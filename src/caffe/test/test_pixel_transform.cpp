@@ -0,0 +1,73 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/pixel_transform.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class PixelTransformTest : public ::testing::Test {
+ protected:
+  // Transforms a width x height crop at (2, 1) of a 13 x 7 image, and checks
+  // it against the straightforward per-pixel computation.
+  void TestCrop(int channels, bool mirror, bool use_mean) {
+    const int img_height = 7;
+    const int img_width = 13;
+    const int height = 4;
+    const int width = 9;
+    const int step = img_width * channels;
+    vector<uint8_t> img(img_height * step);
+    for (int i = 0; i < img.size(); ++i) {
+      img[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    vector<Dtype> mean(channels);
+    for (int c = 0; c < channels; ++c) {
+      mean[c] = 100 + 10 * c;
+    }
+    const Dtype scale = 0.5;
+    const uint8_t* src = &img[1 * step + 2 * channels];
+    vector<Dtype> out(channels * height * width);
+    TransformHWCToCHW(src, step, height, width, channels, mirror,
+        use_mean ? &mean[0] : static_cast<Dtype*>(NULL), scale, &out[0]);
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        const int w_out = mirror ? width - 1 - w : w;
+        for (int c = 0; c < channels; ++c) {
+          const Dtype pixel = src[h * step + w * channels + c];
+          const Dtype expected = use_mean ?
+              (pixel - mean[c]) * scale : pixel * scale;
+          EXPECT_EQ(expected, out[(c * height + h) * width + w_out])
+              << "c " << c << " h " << h << " w " << w;
+        }
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(PixelTransformTest, TestDtypes);
+
+TYPED_TEST(PixelTransformTest, TestColor) {
+  this->TestCrop(3, false, true);
+}
+
+TYPED_TEST(PixelTransformTest, TestColorMirror) {
+  this->TestCrop(3, true, true);
+}
+
+TYPED_TEST(PixelTransformTest, TestGrayNoMean) {
+  this->TestCrop(1, false, false);
+}
+
+TYPED_TEST(PixelTransformTest, TestGrayMirror) {
+  this->TestCrop(1, true, true);
+}
+
+TYPED_TEST(PixelTransformTest, TestManyChannelsMirror) {
+  this->TestCrop(5, true, true);
+}
+
+}  // namespace caffe
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/sampler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SamplerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+  }
+
+  static NormalizedBBox RandomBBox() {
+    float box[4];
+    caffe_rng_uniform(4, 0.f, 1.f, box);
+    NormalizedBBox bbox;
+    bbox.set_xmin(std::min(box[0], box[2]));
+    bbox.set_ymin(std::min(box[1], box[3]));
+    bbox.set_xmax(std::max(box[0], box[2]));
+    bbox.set_ymax(std::max(box[1], box[3]));
+    return bbox;
+  }
+
+  // Checks SatisfySampleConstraints against SatisfySampleConstraint.
+  void CheckConstraint(const SampleConstraint& constraint) {
+    vector<NormalizedBBox> objects;
+    BBoxArray object_array;
+    for (int i = 0; i < 20; ++i) {
+      objects.push_back(RandomBBox());
+      object_array.push_back(objects.back());
+    }
+    // Sampled boxes equal to an object, touching it and outside of it.
+    vector<NormalizedBBox> samples(1, objects[0]);
+    samples.push_back(objects[1]);
+    samples.back().set_xmin(objects[1].xmax());
+    samples.back().set_xmax(1.f);
+    for (int i = 0; i < 200; ++i) {
+      samples.push_back(RandomBBox());
+    }
+    BBoxArray sample_array;
+    for (int i = 0; i < samples.size(); ++i) {
+      sample_array.push_back(samples[i]);
+    }
+    vector<char> satisfied;
+    SatisfySampleConstraints(sample_array, object_array, constraint,
+                             &satisfied);
+    ASSERT_EQ(samples.size(), satisfied.size());
+    int num_satisfied = 0;
+    for (int i = 0; i < samples.size(); ++i) {
+      EXPECT_EQ(SatisfySampleConstraint(samples[i], objects, constraint),
+                satisfied[i] != 0) << "sample " << i;
+      num_satisfied += satisfied[i];
+    }
+    // The constraints below keep some samples, but not all.
+    if (constraint.ByteSize() > 0) {
+      EXPECT_GT(num_satisfied, 0);
+      EXPECT_LT(num_satisfied, samples.size());
+    }
+  }
+};
+
+TEST_F(SamplerTest, TestNoConstraint) {
+  CheckConstraint(SampleConstraint());
+}
+
+TEST_F(SamplerTest, TestJaccardOverlap) {
+  SampleConstraint constraint;
+  constraint.set_min_jaccard_overlap(0.5);
+  CheckConstraint(constraint);
+  constraint.set_max_jaccard_overlap(0.7);
+  CheckConstraint(constraint);
+}
+
+TEST_F(SamplerTest, TestSampleCoverage) {
+  SampleConstraint constraint;
+  constraint.set_min_sample_coverage(0.3);
+  CheckConstraint(constraint);
+  constraint.set_min_sample_coverage(0.05);
+  constraint.set_max_sample_coverage(0.2);
+  CheckConstraint(constraint);
+}
+
+TEST_F(SamplerTest, TestObjectCoverage) {
+  SampleConstraint constraint;
+  constraint.set_min_object_coverage(0.9);
+  CheckConstraint(constraint);
+}
+
+TEST_F(SamplerTest, TestMixedConstraints) {
+  // Only the first kind of constraint given decides.
+  SampleConstraint constraint;
+  constraint.set_min_sample_coverage(0.5);
+  constraint.set_max_object_coverage(0.2);
+  CheckConstraint(constraint);
+}
+
+TEST_F(SamplerTest, TestGenerateSamples) {
+  BatchSampler batch_sampler;
+  batch_sampler.mutable_sampler()->set_min_scale(0.3);
+  batch_sampler.mutable_sampler()->set_max_scale(1);
+  batch_sampler.mutable_sample_constraint()->set_min_jaccard_overlap(0.1);
+  batch_sampler.set_max_sample(3);
+  batch_sampler.set_max_trials(50);
+  NormalizedBBox source_bbox;
+  source_bbox.set_xmin(0.5);
+  source_bbox.set_ymin(0.5);
+  source_bbox.set_xmax(1);
+  source_bbox.set_ymax(1);
+  BBoxArray objects;
+  objects.push_back(source_bbox);
+  vector<NormalizedBBox> sampled_bboxes;
+  GenerateSamples(source_bbox, objects, batch_sampler, &sampled_bboxes, 1);
+  ASSERT_EQ(3, sampled_bboxes.size());
+  vector<NormalizedBBox> object_bboxes(1, source_bbox);
+  for (int i = 0; i < sampled_bboxes.size(); ++i) {
+    const NormalizedBBox& bbox = sampled_bboxes[i];
+    EXPECT_GE(bbox.xmin(), 0.5);
+    EXPECT_GE(bbox.ymin(), 0.5);
+    EXPECT_LE(bbox.xmax(), 1);
+    EXPECT_LE(bbox.ymax(), 1);
+    EXPECT_TRUE(SatisfySampleConstraint(bbox, object_bboxes,
+                                        batch_sampler.sample_constraint()));
+  }
+}
+
+TEST_F(SamplerTest, TestGenerateSamplesOneAtATime) {
+  // Drawn in chunks, the samples kept are those kept checking the trials one
+  // at a time, up to max_sample.
+  BatchSampler batch_sampler;
+  batch_sampler.mutable_sampler()->set_min_scale(0.3);
+  batch_sampler.mutable_sampler()->set_max_scale(1);
+  batch_sampler.mutable_sample_constraint()->set_min_jaccard_overlap(0.5);
+  batch_sampler.set_max_trials(50);
+  NormalizedBBox source_bbox;
+  source_bbox.set_xmin(0);
+  source_bbox.set_ymin(0);
+  source_bbox.set_xmax(1);
+  source_bbox.set_ymax(1);
+  NormalizedBBox object;
+  object.set_xmin(0.2);
+  object.set_ymin(0.3);
+  object.set_xmax(0.8);
+  object.set_ymax(0.7);
+  BBoxArray objects;
+  objects.push_back(object);
+  vector<NormalizedBBox> object_bboxes(1, object);
+  for (int max_sample = -1; max_sample < 4; ++max_sample) {
+    if (max_sample >= 0) {
+      batch_sampler.set_max_sample(max_sample);
+    }
+    Caffe::set_random_seed(1702);
+    vector<NormalizedBBox> sampled_bboxes;
+    GenerateSamples(source_bbox, objects, batch_sampler, &sampled_bboxes, 1);
+    Caffe::set_random_seed(1702);
+    vector<NormalizedBBox> expected;
+    for (int i = 0; i < batch_sampler.max_trials(); ++i) {
+      if (max_sample >= 0 && expected.size() >= max_sample) {
+        break;
+      }
+      NormalizedBBox sampled_bbox, located_bbox;
+      SampleBBox(batch_sampler.sampler(), &sampled_bbox, 1);
+      LocateBBox(source_bbox, sampled_bbox, &located_bbox);
+      if (SatisfySampleConstraint(located_bbox, object_bboxes,
+                                  batch_sampler.sample_constraint())) {
+        expected.push_back(located_bbox);
+      }
+    }
+    ASSERT_EQ(expected.size(), sampled_bboxes.size());
+    EXPECT_EQ(max_sample == 0, expected.empty());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_FLOAT_EQ(expected[i].xmin(), sampled_bboxes[i].xmin());
+      EXPECT_FLOAT_EQ(expected[i].ymin(), sampled_bboxes[i].ymin());
+      EXPECT_FLOAT_EQ(expected[i].xmax(), sampled_bboxes[i].xmax());
+      EXPECT_FLOAT_EQ(expected[i].ymax(), sampled_bboxes[i].ymax());
+    }
+  }
+}
+
+}  // namespace caffe
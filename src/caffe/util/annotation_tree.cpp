@@ -0,0 +1,572 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/annotation_tree.hpp"
+
+namespace caffe {
+
+namespace {
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Appends code point c to out in UTF-8.
+void AppendUTF8(uint32_t c, string* out) {
+  if (c < 0x80) {
+    out->push_back(static_cast<char>(c));
+  } else if (c < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (c >> 6)));
+    out->push_back(static_cast<char>(0x80 | (c & 0x3F)));
+  } else if (c < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (c >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (c & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (c >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (c & 0x3F)));
+  }
+}
+
+// Appends the text [begin, end) to out, translating the predefined and the
+// numeric XML entities. Others are kept as they are.
+void AppendXMLText(const char* begin, const char* end, string* out) {
+  static const struct { const char* name; char c; } kEntities[] = {
+    {"lt;", '<'}, {"gt;", '>'}, {"amp;", '&'}, {"quot;", '"'}, {"apos;", '\''}
+  };
+  const char* p = begin;
+  while (p < end) {
+    const char* amp = static_cast<const char*>(memchr(p, '&', end - p));
+    if (!amp) {
+      out->append(p, end);
+      return;
+    }
+    out->append(p, amp);
+    p = amp + 1;
+    bool translated = false;
+    if (p < end && *p == '#') {
+      const bool hex = p + 1 < end && p[1] == 'x';
+      const char* digits = p + (hex ? 2 : 1);
+      const char* q = digits;
+      uint32_t code = 0;
+      while (q < end && (hex ? isxdigit(*q) : isdigit(*q)) && code < 0x110000) {
+        code = code * (hex ? 16 : 10) +
+            (isdigit(*q) ? *q - '0' : (tolower(*q) - 'a' + 10));
+        ++q;
+      }
+      if (q > digits && q < end && *q == ';' && code < 0x110000) {
+        AppendUTF8(code, out);
+        p = q + 1;
+        translated = true;
+      }
+    } else {
+      for (size_t i = 0; i < sizeof(kEntities) / sizeof(kEntities[0]); ++i) {
+        const size_t length = strlen(kEntities[i].name);
+        if (static_cast<size_t>(end - p) >= length &&
+            memcmp(p, kEntities[i].name, length) == 0) {
+          out->push_back(kEntities[i].c);
+          p += length;
+          translated = true;
+          break;
+        }
+      }
+    }
+    if (!translated) {
+      out->push_back('&');
+    }
+  }
+}
+
+// Returns the first occurrence of token in [p, end), or NULL.
+const char* FindToken(const char* p, const char* end, const char* token) {
+  const size_t length = strlen(token);
+  for (; static_cast<size_t>(end - p) >= length; ++p) {
+    p = static_cast<const char*>(memchr(p, token[0], end - p));
+    if (!p || static_cast<size_t>(end - p) < length) {
+      return NULL;
+    }
+    if (memcmp(p, token, length) == 0) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+inline bool StartsWith(const char* p, const char* end, const char* token) {
+  const size_t length = strlen(token);
+  return static_cast<size_t>(end - p) >= length &&
+      memcmp(p, token, length) == 0;
+}
+
+}  // namespace
+
+AnnotationTree::AnnotationTree() : size_(0) {
+  Clear();
+}
+
+void AnnotationTree::Clear() {
+  size_ = 0;
+  AddChild(-1);
+}
+
+int AnnotationTree::AddChild(int parent) {
+  if (size_ == static_cast<int>(nodes_.size())) {
+    nodes_.push_back(Node());
+  }
+  const int id = size_++;
+  Node& node = nodes_[id];
+  node.key.clear();
+  node.data.clear();
+  node.first_child = -1;
+  node.last_child = -1;
+  node.next_sibling = -1;
+  if (parent >= 0) {
+    Node& p = nodes_[parent];
+    if (p.last_child < 0) {
+      p.first_child = id;
+    } else {
+      nodes_[p.last_child].next_sibling = id;
+    }
+    p.last_child = id;
+  }
+  return id;
+}
+
+bool AnnotationTree::ParseXML(const char* data, size_t size, string* error) {
+  Clear();
+  const char* p = data;
+  const char* const end = data + size;
+  // The elements not closed yet, innermost last.
+  std::vector<int> open(1, root());
+  while (p < end) {
+    if (*p != '<') {
+      // Text. Like property_tree, keep all of it, whitespace included, but
+      // outside of the document element.
+      const char* q = static_cast<const char*>(memchr(p, '<', end - p));
+      if (!q) {
+        q = end;
+      }
+      if (open.size() > 1) {
+        AppendXMLText(p, q, &nodes_[open.back()].data);
+      }
+      p = q;
+    } else if (StartsWith(p, end, "<?")) {
+      const char* q = FindToken(p + 2, end, "?>");
+      if (!q) {
+        *error = "unterminated processing instruction";
+        return false;
+      }
+      p = q + 2;
+    } else if (StartsWith(p, end, "<!--")) {
+      const char* q = FindToken(p + 4, end, "-->");
+      if (!q) {
+        *error = "unterminated comment";
+        return false;
+      }
+      p = q + 3;
+    } else if (StartsWith(p, end, "<![CDATA[")) {
+      const char* q = FindToken(p + 9, end, "]]>");
+      if (!q) {
+        *error = "unterminated CDATA section";
+        return false;
+      }
+      if (open.size() > 1) {
+        nodes_[open.back()].data.append(p + 9, q);
+      }
+      p = q + 3;
+    } else if (StartsWith(p, end, "<!")) {
+      // DOCTYPE and the like, possibly with an internal subset.
+      int depth = 0;
+      for (p += 2; p < end && (*p != '>' || depth > 0); ++p) {
+        depth += (*p == '[') - (*p == ']');
+      }
+      if (p == end) {
+        *error = "unterminated declaration";
+        return false;
+      }
+      ++p;
+    } else if (StartsWith(p, end, "</")) {
+      const char* q = static_cast<const char*>(memchr(p, '>', end - p));
+      if (!q) {
+        *error = "unterminated end tag";
+        return false;
+      }
+      if (open.size() == 1) {
+        *error = "unexpected end tag";
+        return false;
+      }
+      // The name may be followed by whitespace.
+      const char* name_end = q;
+      while (name_end > p + 2 && IsSpace(name_end[-1])) {
+        --name_end;
+      }
+      const string& key = nodes_[open.back()].key;
+      if (key.compare(0, string::npos, p + 2, name_end - (p + 2)) != 0) {
+        *error = "end tag " + string(p + 2, name_end) + " does not match " +
+            key;
+        return false;
+      }
+      open.pop_back();
+      p = q + 1;
+    } else {
+      // Start tag: name, then attributes, which are skipped.
+      const char* name = ++p;
+      while (p < end && !IsSpace(*p) && *p != '>' && *p != '/') {
+        ++p;
+      }
+      if (p == name) {
+        *error = "expected an element name";
+        return false;
+      }
+      const int node = AddChild(open.back());
+      nodes_[node].key.assign(name, p);
+      char quote = 0;
+      for (; p < end && (quote || *p != '>'); ++p) {
+        if (quote) {
+          quote = *p == quote ? 0 : quote;
+        } else if (*p == '"' || *p == '\'') {
+          quote = *p;
+        }
+      }
+      if (p == end) {
+        *error = "unterminated start tag";
+        return false;
+      }
+      if (p[-1] != '/') {
+        open.push_back(node);
+      }
+      ++p;
+    }
+  }
+  if (open.size() > 1) {
+    *error = "unclosed element " + nodes_[open.back()].key;
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+// Reads the tokens of a JSON document.
+class JSONReader {
+ public:
+  JSONReader(const char* data, size_t size) : p_(data), end_(data + size) {}
+
+  void SkipSpace() {
+    while (p_ < end_ && IsSpace(*p_)) {
+      ++p_;
+    }
+  }
+  bool AtEnd() {
+    SkipSpace();
+    return p_ == end_;
+  }
+  bool Consume(char c) {
+    SkipSpace();
+    if (p_ < end_ && *p_ == c) {
+      ++p_;
+      return true;
+    }
+    return false;
+  }
+  char Peek() {
+    SkipSpace();
+    return p_ < end_ ? *p_ : 0;
+  }
+
+  bool ReadHex4(uint32_t* value) {
+    if (end_ - p_ < 4) {
+      return false;
+    }
+    *value = 0;
+    for (int i = 0; i < 4; ++i, ++p_) {
+      if (!isxdigit(*p_)) {
+        return false;
+      }
+      *value = *value * 16 +
+          (isdigit(*p_) ? *p_ - '0' : (tolower(*p_) - 'a' + 10));
+    }
+    return true;
+  }
+
+  bool ReadString(string* out) {
+    if (!Consume('"')) {
+      return false;
+    }
+    out->clear();
+    while (p_ < end_ && *p_ != '"') {
+      const char* q = p_;
+      while (q < end_ && *q != '"' && *q != '\\') {
+        ++q;
+      }
+      out->append(p_, q);
+      p_ = q;
+      if (p_ < end_ && *p_ == '\\') {
+        if (++p_ == end_) {
+          return false;
+        }
+        const char c = *p_++;
+        switch (c) {
+          case '"': case '\\': case '/': out->push_back(c); break;
+          case 'b': out->push_back('\b'); break;
+          case 'f': out->push_back('\f'); break;
+          case 'n': out->push_back('\n'); break;
+          case 'r': out->push_back('\r'); break;
+          case 't': out->push_back('\t'); break;
+          case 'u': {
+            uint32_t code;
+            if (!ReadHex4(&code)) {
+              return false;
+            }
+            if (code >= 0xD800 && code < 0xDC00 && end_ - p_ >= 6 &&
+                p_[0] == '\\' && p_[1] == 'u') {
+              p_ += 2;
+              uint32_t low;
+              if (!ReadHex4(&low) || low < 0xDC00 || low >= 0xE000) {
+                return false;
+              }
+              code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            AppendUTF8(code, out);
+            break;
+          }
+          default:
+            return false;
+        }
+      }
+    }
+    return Consume('"');
+  }
+
+  // Numbers and literals keep their text.
+  bool ReadScalar(string* out) {
+    SkipSpace();
+    const char* start = p_;
+    if (StartsWith(p_, end_, "true")) {
+      p_ += 4;
+    } else if (StartsWith(p_, end_, "false")) {
+      p_ += 5;
+    } else if (StartsWith(p_, end_, "null")) {
+      p_ += 4;
+    } else {
+      if (p_ < end_ && *p_ == '-') {
+        ++p_;
+      }
+      const char* digits = p_;
+      while (p_ < end_ && isdigit(*p_)) {
+        ++p_;
+      }
+      if (p_ == digits) {
+        return false;
+      }
+      if (p_ < end_ && *p_ == '.') {
+        digits = ++p_;
+        while (p_ < end_ && isdigit(*p_)) {
+          ++p_;
+        }
+        if (p_ == digits) {
+          return false;
+        }
+      }
+      if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+        ++p_;
+        if (p_ < end_ && (*p_ == '+' || *p_ == '-')) {
+          ++p_;
+        }
+        digits = p_;
+        while (p_ < end_ && isdigit(*p_)) {
+          ++p_;
+        }
+        if (p_ == digits) {
+          return false;
+        }
+      }
+    }
+    out->assign(start, p_);
+    return true;
+  }
+
+  const char* position() const { return p_; }
+
+ private:
+  const char* p_;
+  const char* const end_;
+};
+
+}  // namespace
+
+bool AnnotationTree::ParseJSON(const char* data, size_t size, string* error) {
+  Clear();
+  JSONReader reader(data, size);
+  // Containers not closed yet, innermost last, and whether they are objects.
+  std::vector<int> open;
+  std::vector<bool> is_object;
+  int node = root();
+  while (true) {
+    // Read the value of node.
+    const char c = reader.Peek();
+    bool opened = false;
+    if (c == '{' || c == '[') {
+      reader.Consume(c);
+      if (!reader.Consume(c == '{' ? '}' : ']')) {
+        open.push_back(node);
+        is_object.push_back(c == '{');
+        opened = true;
+      }
+    } else if (c == '"') {
+      if (!reader.ReadString(&nodes_[node].data)) {
+        *error = "bad string";
+        return false;
+      }
+    } else if (!reader.ReadScalar(&nodes_[node].data)) {
+      *error = "expected a value";
+      return false;
+    }
+    // Close the containers that end here, unless we just opened one.
+    while (!opened && !open.empty() && !reader.Consume(',')) {
+      if (!reader.Consume(is_object.back() ? '}' : ']')) {
+        *error = "expected ',' or the end of a container";
+        return false;
+      }
+      open.pop_back();
+      is_object.pop_back();
+    }
+    if (open.empty()) {
+      break;
+    }
+    // Start the next member or item.
+    node = AddChild(open.back());
+    if (is_object.back() && (!reader.ReadString(&nodes_[node].key) ||
+                             !reader.Consume(':'))) {
+      *error = "expected a member name and ':'";
+      return false;
+    }
+  }
+  if (!reader.AtEnd()) {
+    *error = "trailing characters";
+    return false;
+  }
+  return true;
+}
+
+int AnnotationTree::Find(int node, const string& path) const {
+  size_t begin = 0;
+  while (node >= 0 && begin <= path.size()) {
+    size_t end = path.find('.', begin);
+    if (end == string::npos) {
+      end = path.size();
+    }
+    if (end == begin && path.empty()) {
+      return node;
+    }
+    int child = first_child(node);
+    while (child >= 0 &&
+           nodes_[child].key.compare(0, string::npos, path, begin,
+                                     end - begin) != 0) {
+      child = next_sibling(child);
+    }
+    node = child;
+    begin = end + 1;
+  }
+  return node;
+}
+
+bool AnnotationTree::Get(int node, const string& path, int* value) const {
+  const int found = Find(node, path);
+  return found >= 0 && ToInt(data(found), value);
+}
+
+bool AnnotationTree::Get(int node, const string& path, float* value) const {
+  const int found = Find(node, path);
+  return found >= 0 && ToFloat(data(found), value);
+}
+
+bool AnnotationTree::Get(int node, const string& path, string* value) const {
+  const int found = Find(node, path);
+  if (found < 0) {
+    return false;
+  }
+  *value = data(found);
+  return true;
+}
+
+bool AnnotationTree::ToInt(const string& text, int* value) {
+  const char* begin = text.c_str();
+  char* end;
+  errno = 0;
+  const long parsed = strtol(begin, &end, 10);  // NOLINT(runtime/int)
+  if (end == begin || errno == ERANGE || parsed < INT_MIN ||
+      parsed > INT_MAX) {
+    return false;
+  }
+  while (isspace(*end)) {
+    ++end;
+  }
+  if (*end != '\0') {
+    return false;
+  }
+  *value = static_cast<int>(parsed);
+  return true;
+}
+
+bool AnnotationTree::ToFloat(const string& text, float* value) {
+  // Only accept what a stream would: decimal digits with an optional
+  // fraction and exponent, not strtof's hex, inf or nan.
+  const char* p = text.c_str();
+  while (isspace(*p)) {
+    ++p;
+  }
+  const char* start = p;
+  if (*p == '+' || *p == '-') {
+    ++p;
+  }
+  int digits = 0;
+  while (isdigit(*p)) {
+    ++p;
+    ++digits;
+  }
+  if (*p == '.') {
+    ++p;
+    while (isdigit(*p)) {
+      ++p;
+      ++digits;
+    }
+  }
+  if (digits == 0) {
+    return false;
+  }
+  if (*p == 'e' || *p == 'E') {
+    ++p;
+    if (*p == '+' || *p == '-') {
+      ++p;
+    }
+    if (!isdigit(*p)) {
+      return false;
+    }
+    while (isdigit(*p)) {
+      ++p;
+    }
+  }
+  const char* number_end = p;
+  while (isspace(*p)) {
+    ++p;
+  }
+  if (*p != '\0') {
+    return false;
+  }
+  const string number(start, number_end);
+  *value = strtof(number.c_str(), NULL);
+  return true;
+}
+
+}  // namespace caffe
@@ -247,44 +247,73 @@ bool ProjectBBox(const NormalizedBBox& src_bbox, const NormalizedBBox& bbox,
     }
 }
 
-bool ProjectfacemarksBBox(const NormalizedBBox& src_bbox, AnnoFaceLandmarks* marks) {
-    if((marks->lefteye().x() >= src_bbox.xmax() || marks->lefteye().x() <= src_bbox.xmin()) ||
-       (marks->lefteye().y() >= src_bbox.ymax() || marks->lefteye().y() <= src_bbox.ymin()) ||
-       (marks->righteye().x() >= src_bbox.xmax() || marks->righteye().x() <= src_bbox.xmin())  ||
-       (marks->righteye().y() >= src_bbox.ymax() || marks->righteye().y() <= src_bbox.ymin()) ||
-       (marks->nose().x() >= src_bbox.xmax() || marks->nose().x() <= src_bbox.xmin())  ||
-       (marks->nose().y() >= src_bbox.ymax() || marks->nose().y() <= src_bbox.ymin()) ||
-       (marks->leftmouth().x() >= src_bbox.xmax() || marks->leftmouth().x() <= src_bbox.xmin())  ||
-       (marks->leftmouth().y() >= src_bbox.ymax() || marks->leftmouth().y() <= src_bbox.ymin()) ||
-       (marks->rightmouth().x() >= src_bbox.xmax() || marks->rightmouth().x() <= src_bbox.xmin())  ||
-       (marks->rightmouth().y() >= src_bbox.ymax() || marks->rightmouth().y() <= src_bbox.ymin())){
-         return false;
+bool ProjectLandmarks(const NormalizedBBox& src_bbox, float* points) {
+    for (int i = 0; i < kNumFaceLandmarks; ++i) {
+        const float x = points[2 * i], y = points[2 * i + 1];
+        if (x >= src_bbox.xmax() || x <= src_bbox.xmin() ||
+            y >= src_bbox.ymax() || y <= src_bbox.ymin()) {
+            return false;
+        }
     }
     float src_width = src_bbox.xmax() - src_bbox.xmin();
     float src_height = src_bbox.ymax() - src_bbox.ymin();
-    marks->mutable_lefteye()->set_x((marks->lefteye().x() - src_bbox.xmin()) / src_width);
-    marks->mutable_lefteye()->set_y((marks->lefteye().y() - src_bbox.ymin()) / src_height);
-    marks->mutable_righteye()->set_x((marks->righteye().x() - src_bbox.xmin()) / src_width);
-    marks->mutable_righteye()->set_y((marks->righteye().y() - src_bbox.ymin()) / src_height);
-    marks->mutable_nose()->set_x((marks->nose().x() - src_bbox.xmin()) / src_width);
-    marks->mutable_nose()->set_y((marks->nose().y() - src_bbox.ymin()) / src_height);
-    marks->mutable_leftmouth()->set_x((marks->leftmouth().x() - src_bbox.xmin()) / src_width);
-    marks->mutable_leftmouth()->set_y((marks->leftmouth().y() - src_bbox.ymin()) / src_height);
-    marks->mutable_rightmouth()->set_x((marks->rightmouth().x() - src_bbox.xmin()) / src_width);
-    marks->mutable_rightmouth()->set_y((marks->rightmouth().y() - src_bbox.ymin()) / src_height);
-    if(marks->lefteye().x() > 0 && marks->lefteye().x() <= 1.0 &&
-      marks->lefteye().y() > 0 && marks->lefteye().y() <= 1.0 &&
-      marks->righteye().x() > 0 && marks->righteye().x() <= 1.0 &&
-      marks->righteye().y() > 0 && marks->righteye().y() <= 1.0 &&
-      marks->nose().x() > 0 && marks->nose().x() <= 1.0 &&
-      marks->nose().y() > 0 && marks->nose().y() <= 1.0 &&
-      marks->leftmouth().x() > 0 && marks->leftmouth().x() <= 1.0 &&
-      marks->leftmouth().y() > 0 && marks->leftmouth().y() <= 1.0 &&
-      marks->rightmouth().x() > 0 && marks->rightmouth().x() <= 1.0 &&
-      marks->rightmouth().y() > 0 && marks->rightmouth().y() <= 1.0){
-      return true;
-    }else{
-      return false;
+    bool inside = true;
+    for (int i = 0; i < kNumFaceLandmarks; ++i) {
+        float& x = points[2 * i];
+        float& y = points[2 * i + 1];
+        x = (x - src_bbox.xmin()) / src_width;
+        y = (y - src_bbox.ymin()) / src_height;
+        inside = inside && x > 0 && x <= 1.0 && y > 0 && y <= 1.0;
+    }
+    return inside;
+}
+
+bool ProjectfacemarksBBox(const NormalizedBBox& src_bbox, AnnoFaceLandmarks* marks) {
+    float points[2 * kNumFaceLandmarks];
+    GetFaceLandmarks(*marks, points);
+    const bool inside = ProjectLandmarks(src_bbox, points);
+    SetFaceLandmarks(points, marks);
+    return inside;
+}
+
+void GetFaceLandmarks(const AnnoFaceLandmarks& marks, float* points) {
+    const point* parts[kNumFaceLandmarks] = {&marks.lefteye(),
+        &marks.righteye(), &marks.nose(), &marks.leftmouth(),
+        &marks.rightmouth()};
+    for (int i = 0; i < kNumFaceLandmarks; ++i) {
+        points[2 * i] = parts[i]->x();
+        points[2 * i + 1] = parts[i]->y();
+    }
+}
+
+void SetFaceLandmarks(const float* points, AnnoFaceLandmarks* marks) {
+    point* parts[kNumFaceLandmarks] = {marks->mutable_lefteye(),
+        marks->mutable_righteye(), marks->mutable_nose(),
+        marks->mutable_leftmouth(), marks->mutable_rightmouth()};
+    for (int i = 0; i < kNumFaceLandmarks; ++i) {
+        parts[i]->set_x(points[2 * i]);
+        parts[i]->set_y(points[2 * i + 1]);
+    }
+}
+
+void AnnotationBoxesToGroup(const AnnotationBox* boxes, int num,
+                            AnnotationGroup* anno_group) {
+    for (int i = 0; i < num; ++i) {
+        const AnnotationBox& box = boxes[i];
+        Annotation* anno = anno_group->add_annotation();
+        anno->set_instance_id(box.instance_id);
+        NormalizedBBox* bbox = anno->mutable_bbox();
+        bbox->set_xmin(box.xmin);
+        bbox->set_ymin(box.ymin);
+        bbox->set_xmax(box.xmax);
+        bbox->set_ymax(box.ymax);
+        bbox->set_difficult(box.difficult);
+        bbox->set_size(box.size);
+        anno->set_has_lm(box.has_lm);
+        SetFaceLandmarks(box.landmarks, anno->mutable_face_lm());
+    }
+    if (num > 0) {
+        anno_group->set_group_label(boxes[0].group_label);
     }
 }
 
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/data_profile.hpp"
+
+namespace caffe {
+
+DataProfile::DataProfile() {
+  Reset();
+}
+
+void DataProfile::Charge() {
+  const boost::posix_time::ptime now =
+      boost::posix_time::microsec_clock::universal_time();
+  if (!open_.empty()) {
+    us_[open_.back()] += (now - last_).total_microseconds();
+  }
+  last_ = now;
+}
+
+void DataProfile::Enter(Stage stage) {
+  CHECK_GE(stage, 0);
+  CHECK_LT(stage, NUM_STAGES);
+  Charge();
+  open_.push_back(stage);
+  ++count_[stage];
+}
+
+void DataProfile::Leave() {
+  CHECK(!open_.empty()) << "No stage to leave";
+  Charge();
+  open_.pop_back();
+}
+
+void DataProfile::Merge(const DataProfile& other) {
+  CHECK(other.open_.empty()) << "Merging a profile with open stages";
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    us_[i] += other.us_[i];
+    count_[i] += other.count_[i];
+  }
+}
+
+void DataProfile::Reset() {
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    us_[i] = 0;
+    count_[i] = 0;
+  }
+}
+
+const char* DataProfile::StageName(Stage stage) {
+  static const char* names[NUM_STAGES] = {
+    "read", "parse", "decode", "distort", "expand", "sample", "resize",
+    "transform", "label", "queue wait"
+  };
+  CHECK_GE(stage, 0);
+  CHECK_LT(stage, NUM_STAGES);
+  return names[stage];
+}
+
+string DataProfile::Summary(int num_batches) const {
+  std::ostringstream stream;
+  stream.precision(3);
+  stream << std::fixed;
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    if (count_[i] == 0) {
+      continue;
+    }
+    if (stream.tellp() > 0) {
+      stream << ", ";
+    }
+    stream << StageName(static_cast<Stage>(i)) << " "
+        << us_[i] / 1000 / std::max(num_batches, 1) << " ms";
+  }
+  return stream.str();
+}
+
+}  // namespace caffe
@@ -1,11 +1,47 @@
 #include "caffe/util/db.hpp"
 #include "caffe/util/db_leveldb.hpp"
 #include "caffe/util/db_lmdb.hpp"
+#include "caffe/util/db_record.hpp"
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 namespace caffe { namespace db {
 
+RandomReader* DB::NewRandomReader() {
+  LOG(FATAL) << "Random access is not supported by this database backend";
+  return NULL;
+}
+
+void SplitRanges(DB* db, Cursor* cursor, int num_ranges,
+    vector<string>* start_keys, vector<int>* sizes) {
+  start_keys->clear();
+  sizes->clear();
+  cursor->SeekToFirst();
+  int64_t count = db->Count();
+  if (count < 0) {
+    for (count = 0; cursor->valid(); cursor->Next()) {
+      ++count;
+    }
+    cursor->SeekToFirst();
+  }
+  num_ranges = std::min<int64_t>(num_ranges, count);
+  int64_t index = 0;
+  for (int k = 0; k < num_ranges; ++k) {
+    const int64_t begin = count * k / num_ranges;
+    const int64_t end = count * (k + 1) / num_ranges;
+    for (; index < begin && cursor->valid(); ++index) {
+      cursor->Next();
+    }
+    CHECK(cursor->valid()) << "Record " << begin << " of " << count
+        << " disappeared";
+    start_keys->push_back(cursor->key());
+    sizes->push_back(end - begin);
+  }
+  cursor->SeekToFirst();
+}
+
 DB* GetDB(DataParameter::DB backend) {
   switch (backend) {
 #ifdef USE_LEVELDB
@@ -16,6 +52,8 @@ DB* GetDB(DataParameter::DB backend) {
   case DataParameter_DB_LMDB:
     return new LMDB();
 #endif  // USE_LMDB
+  case DataParameter_DB_RECORD:
+    return new RecordDB();
   default:
     LOG(FATAL) << "Unknown database backend";
     return NULL;
@@ -33,6 +71,9 @@ DB* GetDB(const string& backend) {
     return new LMDB();
   }
 #endif  // USE_LMDB
+  if (backend == "record") {
+    return new RecordDB();
+  }
   LOG(FATAL) << "Unknown database backend";
   return NULL;
 }
@@ -1,9 +1,16 @@
 #ifdef USE_LMDB
 #include "caffe/util/db_lmdb.hpp"
 
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace caffe { namespace db {
 
@@ -32,6 +39,7 @@ void LMDB::Open(const string& source, Mode mode) {
     MDB_CHECK(rc);
   }
 #endif
+  source_ = source;
   LOG(INFO) << "Opened lmdb " << source;
 }
 
@@ -44,68 +52,325 @@ LMDBCursor* LMDB::NewCursor() {
   return new LMDBCursor(mdb_txn, mdb_cursor);
 }
 
+void LMDB::Close() {
+  if (mdb_env_ == NULL) {
+    return;
+  }
+  if (write_stats_.records > 0) {
+    const double seconds = write_stats_.timer.MilliSeconds() / 1000.;
+    LOG(INFO) << "Wrote " << write_stats_.records << " records, "
+        << (write_stats_.bytes >> 20) << " MB, to " << source_ << " in "
+        << seconds << " s: " << write_stats_.records / seconds
+        << " records/s, " << (write_stats_.bytes >> 20) / seconds << " MB/s. "
+        << "The map grew " << write_stats_.map_grows << " times.";
+    write_stats_ = LMDBWriteStats();
+  }
+  mdb_dbi_close(mdb_env_, mdb_dbi_);
+  mdb_env_close(mdb_env_);
+  mdb_env_ = NULL;
+}
+
 LMDBTransaction* LMDB::NewTransaction() {
-  return new LMDBTransaction(mdb_env_);
+  return new LMDBTransaction(mdb_env_, &write_stats_);
 }
 
-void LMDBTransaction::Put(const string& key, const string& value) {
-  keys.push_back(key);
-  values.push_back(value);
+void LMDB::SetSizeHint(uint64_t bytes) {
+  if (bytes == 0) {
+    return;
+  }
+  MDB_envinfo info;
+  MDB_CHECK(mdb_env_info(mdb_env_, &info));
+  MDB_stat stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &stat));
+  // Room for the records, their nodes and the branch pages, in whole MB.
+  const uint64_t needed = (info.me_last_pgno + 1) * stat.ms_psize +
+      bytes + bytes / 8 + (16 << 20);
+  const size_t map_size = (needed + (1 << 20) - 1) >> 20 << 20;
+  if (map_size > info.me_mapsize) {
+    LOG(INFO) << "Sizing LMDB map to " << (map_size >> 20) << " MB";
+    MDB_CHECK(mdb_env_set_mapsize(mdb_env_, map_size));
+  }
 }
 
-void LMDBTransaction::Commit() {
-  MDB_dbi mdb_dbi;
-  MDB_val mdb_key, mdb_data;
-  MDB_txn *mdb_txn;
-
-  // Initialize MDB variables
-  MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, 0, &mdb_txn));
-  MDB_CHECK(mdb_dbi_open(mdb_txn, NULL, 0, &mdb_dbi));
-
-  for (int i = 0; i < keys.size(); i++) {
-    mdb_key.mv_size = keys[i].size();
-    mdb_key.mv_data = const_cast<char*>(keys[i].data());
-    mdb_data.mv_size = values[i].size();
-    mdb_data.mv_data = const_cast<char*>(values[i].data());
-
-    // Add data to the transaction
-    int put_rc = mdb_put(mdb_txn, mdb_dbi, &mdb_key, &mdb_data, 0);
-    if (put_rc == MDB_MAP_FULL) {
-      // Out of memory - double the map size and retry
-      mdb_txn_abort(mdb_txn);
-      mdb_dbi_close(mdb_env_, mdb_dbi);
-      DoubleMapSize();
-      Commit();
-      return;
+int64_t LMDB::Count() {
+  MDB_stat mdb_stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &mdb_stat));
+  return mdb_stat.ms_entries;
+}
+
+LMDBRandomReader* LMDB::NewRandomReader() {
+  MDB_txn* mdb_txn;
+  MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, MDB_RDONLY, &mdb_txn));
+  MDB_CHECK(mdb_dbi_open(mdb_txn, NULL, 0, &mdb_dbi_));
+  return new LMDBRandomReader(mdb_env_, mdb_txn, mdb_dbi_, source_);
+}
+
+LMDBRandomReader::LMDBRandomReader(MDB_env* mdb_env, MDB_txn* mdb_txn,
+    MDB_dbi mdb_dbi, const string& source)
+    : mdb_env_(mdb_env), mdb_txn_(mdb_txn), mdb_dbi_(mdb_dbi) {
+  MDB_stat stat;
+  MDB_CHECK(mdb_stat(mdb_txn_, mdb_dbi_, &stat));
+  MDB_envinfo info;
+  MDB_CHECK(mdb_env_info(mdb_env_, &info));
+  string filename = source;
+  while (filename.size() > 1 && filename[filename.size() - 1] == '/') {
+    filename.erase(filename.size() - 1);
+  }
+  filename += ".keys";
+  if (!LoadKeys(filename, stat.ms_entries, info.me_last_txnid)) {
+    MDB_cursor* mdb_cursor;
+    MDB_val mdb_key, mdb_value;
+    MDB_CHECK(mdb_cursor_open(mdb_txn_, mdb_dbi_, &mdb_cursor));
+    keys_.reserve(stat.ms_entries);
+    int mdb_status;
+    while ((mdb_status = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_value,
+        MDB_NEXT)) == MDB_SUCCESS) {
+      keys_.push_back(string(static_cast<const char*>(mdb_key.mv_data),
+          mdb_key.mv_size));
+    }
+    CHECK_EQ(mdb_status, MDB_NOTFOUND) << mdb_strerror(mdb_status);
+    mdb_cursor_close(mdb_cursor);
+    LOG(INFO) << "Indexed " << keys_.size() << " keys of " << source;
+    SaveKeys(filename, stat.ms_entries, info.me_last_txnid);
+  }
+  madvise(info.me_mapaddr, info.me_mapsize, MADV_RANDOM);
+}
+
+bool LMDBRandomReader::Get(const string& key, const char** data,
+    size_t* size) {
+  MDB_val mdb_key, mdb_value;
+  mdb_key.mv_size = key.size();
+  mdb_key.mv_data = const_cast<char*>(key.data());
+  int mdb_status = mdb_get(mdb_txn_, mdb_dbi_, &mdb_key, &mdb_value);
+  if (mdb_status == MDB_NOTFOUND) {
+    return false;
+  }
+  MDB_CHECK(mdb_status);
+  *data = static_cast<const char*>(mdb_value.mv_data);
+  *size = mdb_value.mv_size;
+  return true;
+}
+
+void LMDBRandomReader::WillNeed(const char* data, size_t size) {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t begin = reinterpret_cast<size_t>(data) & ~(page_size - 1);
+  const size_t end = reinterpret_cast<size_t>(data) + size;
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+bool LMDBRandomReader::LoadKeys(const string& filename, uint64_t entries,
+    uint64_t txnid) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  uint64_t header[2];
+  file.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!file || header[0] != entries || header[1] != txnid) {
+    LOG(INFO) << "Key index " << filename << " is out of date";
+    return false;
+  }
+  keys_.resize(entries);
+  for (uint64_t i = 0; i < entries; ++i) {
+    uint32_t length;
+    file.read(reinterpret_cast<char*>(&length), sizeof(length));
+    keys_[i].resize(length);
+    if (length > 0) {
+      file.read(&keys_[i][0], length);
     }
-    // May have failed for some other reason
-    MDB_CHECK(put_rc);
   }
+  if (!file) {
+    LOG(WARNING) << "Failed to read key index " << filename;
+    keys_.clear();
+    return false;
+  }
+  LOG(INFO) << "Loaded " << keys_.size() << " keys from " << filename;
+  return true;
+}
 
-  // Commit the transaction
-  int commit_rc = mdb_txn_commit(mdb_txn);
-  if (commit_rc == MDB_MAP_FULL) {
-    // Out of memory - double the map size and retry
-    mdb_dbi_close(mdb_env_, mdb_dbi);
-    DoubleMapSize();
-    Commit();
+void LMDBRandomReader::SaveKeys(const string& filename, uint64_t entries,
+    uint64_t txnid) {
+  // Written aside then renamed, so concurrent readers never see half a file.
+  // The name is unique, as several readers may save the keys at once.
+  string tmp = filename + ".XXXXXX";
+  const int fd = mkstemp(&tmp[0]);
+  if (fd == -1) {
+    LOG(WARNING) << "Could not cache the key index in " << filename;
     return;
   }
-  // May have failed for some other reason
-  MDB_CHECK(commit_rc);
+  fchmod(fd, 0644);
+  close(fd);
+  std::ofstream file(tmp.c_str(),
+      std::ios::out | std::ios::binary | std::ios::trunc);
+  const uint64_t header[2] = {entries, txnid};
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+  for (int i = 0; i < keys_.size(); ++i) {
+    const uint32_t length = keys_[i].size();
+    file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    file.write(keys_[i].data(), length);
+  }
+  file.close();
+  if (!file || std::rename(tmp.c_str(), filename.c_str()) != 0) {
+    LOG(WARNING) << "Could not cache the key index in " << filename;
+    std::remove(tmp.c_str());
+  }
+}
+
+LMDBTransaction::LMDBTransaction(MDB_env* mdb_env, LMDBWriteStats* stats)
+    : mdb_env_(mdb_env), mdb_txn_(NULL), stats_(stats), puts_(0),
+      pending_bytes_(0) {
+  MDB_stat stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &stat));
+  page_size_ = stat.ms_psize;
+}
+
+LMDBTransaction::~LMDBTransaction() {
+  if (mdb_txn_ != NULL) {
+    mdb_txn_abort(mdb_txn_);
+  }
+}
+
+void LMDBTransaction::Begin() {
+  MDB_envinfo info;
+  MDB_CHECK(mdb_env_info(mdb_env_, &info));
+  map_size_ = info.me_mapsize;
+  used_ = (info.me_last_pgno + 1) * page_size_;
+  MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, 0, &mdb_txn_));
+  MDB_CHECK(mdb_dbi_open(mdb_txn_, NULL, 0, &mdb_dbi_));
+  // Appending is only allowed past the last key.
+  MDB_cursor* mdb_cursor;
+  MDB_val mdb_key, mdb_value;
+  MDB_CHECK(mdb_cursor_open(mdb_txn_, mdb_dbi_, &mdb_cursor));
+  int mdb_status = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_value, MDB_LAST);
+  has_last_key_ = mdb_status == MDB_SUCCESS;
+  if (has_last_key_) {
+    last_key_.assign(static_cast<const char*>(mdb_key.mv_data),
+        mdb_key.mv_size);
+  } else {
+    CHECK_EQ(mdb_status, MDB_NOTFOUND) << mdb_strerror(mdb_status);
+  }
+  mdb_cursor_close(mdb_cursor);
+  puts_ = 0;
+  stats_->timer.Start();
+}
 
-  // Cleanup after successful commit
-  mdb_dbi_close(mdb_env_, mdb_dbi);
-  keys.clear();
-  values.clear();
+size_t LMDBTransaction::Footprint(const string& key, const string& value,
+    bool append) const {
+  // A leaf node has a header of 8 bytes and a 2 byte slot. Large values go
+  // to overflow pages of their own, the node only pointing at them.
+  const size_t node = key.size() + 10;
+  size_t footprint;
+  if (value.size() > page_size_ / 4) {
+    footprint = node + 8 +
+        (value.size() + 16 + page_size_ - 1) / page_size_ * page_size_;
+  } else {
+    footprint = node + value.size();
+  }
+  // Inserting in the middle splits pages half full, and copies the leaf it
+  // lands in.
+  return append ? footprint : 2 * footprint + page_size_;
 }
 
-void LMDBTransaction::DoubleMapSize() {
-  struct MDB_envinfo current_info;
-  MDB_CHECK(mdb_env_info(mdb_env_, &current_info));
-  size_t new_size = current_info.me_mapsize * 2;
-  DLOG(INFO) << "Doubling LMDB map size to " << (new_size>>20) << "MB ...";
+void LMDBTransaction::GrowMap(size_t needed) {
+  if (mdb_txn_ != NULL) {
+    if (puts_ > 0) {
+      MDB_CHECK(mdb_txn_commit(mdb_txn_));
+    } else {
+      mdb_txn_abort(mdb_txn_);
+    }
+    mdb_txn_ = NULL;
+    ClearPending();
+  }
+  MDB_envinfo info;
+  MDB_CHECK(mdb_env_info(mdb_env_, &info));
+  size_t new_size = info.me_mapsize;
+  const size_t used = (info.me_last_pgno + 1) * page_size_;
+  while (new_size < used + needed + needed / 8 + new_size / 64) {
+    new_size *= 2;
+  }
+  LOG(INFO) << "Growing LMDB map to " << (new_size >> 20) << " MB";
   MDB_CHECK(mdb_env_set_mapsize(mdb_env_, new_size));
+  ++stats_->map_grows;
+}
+
+void LMDBTransaction::ClearPending() {
+  pending_.clear();
+  pending_bytes_ = 0;
+}
+
+int LMDBTransaction::Write(const string& key, const string& value) {
+  // LMDB orders keys as memcmp does, the shorter first on a tie, like
+  // string::compare.
+  const bool append = !has_last_key_ || key.compare(last_key_) > 0;
+  MDB_val mdb_key, mdb_data;
+  mdb_key.mv_size = key.size();
+  mdb_key.mv_data = const_cast<char*>(key.data());
+  mdb_data.mv_size = value.size();
+  mdb_data.mv_data = const_cast<char*>(value.data());
+  const int mdb_status = mdb_put(mdb_txn_, mdb_dbi_, &mdb_key, &mdb_data,
+      append ? MDB_APPEND : 0);
+  if (mdb_status == MDB_SUCCESS) {
+    if (append) {
+      last_key_ = key;
+      has_last_key_ = true;
+    }
+    used_ += Footprint(key, value, append);
+    ++puts_;
+  }
+  return mdb_status;
+}
+
+void LMDBTransaction::Put(const string& key, const string& value) {
+  if (mdb_txn_ == NULL) {
+    Begin();
+  }
+  const bool append = !has_last_key_ || key.compare(last_key_) > 0;
+  const size_t footprint = Footprint(key, value, append);
+  // Leave some room for the branch pages.
+  if (used_ + footprint + map_size_ / 64 + 16 * page_size_ > map_size_) {
+    GrowMap(footprint + 16 * page_size_);
+    Begin();
+  }
+  int mdb_status = Write(key, value);
+  while (mdb_status == MDB_MAP_FULL) {
+    // The estimate fell short. The failed transaction can only be aborted,
+    // so grow the map and put the records since the last commit again.
+    LOG(WARNING) << "The LMDB map filled up before it was expected to, with "
+        << used_ << " of " << map_size_ << " bytes used";
+    mdb_txn_abort(mdb_txn_);
+    mdb_txn_ = NULL;
+    GrowMap(2 * (pending_bytes_ + footprint) + 16 * page_size_);
+    Begin();
+    mdb_status = MDB_SUCCESS;
+    for (int i = 0; i < pending_.size() && mdb_status == MDB_SUCCESS; ++i) {
+      mdb_status = Write(pending_[i].first, pending_[i].second);
+    }
+    if (mdb_status == MDB_SUCCESS) {
+      mdb_status = Write(key, value);
+    }
+  }
+  MDB_CHECK(mdb_status);
+  ++stats_->records;
+  stats_->bytes += key.size() + value.size();
+  // Keep a copy for the replay, up to kMaxPendingBytes; past that, commit
+  // rather than hold on to more.
+  pending_bytes_ += key.size() + value.size();
+  if (pending_bytes_ > kMaxPendingBytes) {
+    MDB_CHECK(mdb_txn_commit(mdb_txn_));
+    mdb_txn_ = NULL;
+    ClearPending();
+  } else {
+    pending_.push_back(std::make_pair(key, value));
+  }
+}
+
+void LMDBTransaction::Commit() {
+  if (mdb_txn_ == NULL) {
+    return;
+  }
+  MDB_CHECK(mdb_txn_commit(mdb_txn_));
+  mdb_txn_ = NULL;
+  ClearPending();
 }
 
 }  // namespace db
@@ -0,0 +1,389 @@
+#include "caffe/util/db_record.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
+
+namespace caffe { namespace db {
+
+namespace {
+
+const char kMagic[8] = {'C', 'A', 'F', 'F', 'E', 'R', 'E', 'C'};
+const uint32_t kVersion = 1;
+const size_t kHeaderSize = sizeof(kMagic) + 2 * sizeof(uint32_t);
+// Chunk, key size, value offset and value size.
+const size_t kEntrySize = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+// Amount of a chunk asked to be read ahead of a cursor.
+const uint64_t kReadahead = 16 << 20;
+
+void AppendEntry(uint32_t chunk, const string& key, uint64_t offset,
+    uint64_t size, string* out) {
+  const uint32_t key_size = key.size();
+  out->append(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+  out->append(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+  out->append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+  out->append(reinterpret_cast<const char*>(&size), sizeof(size));
+  out->append(key);
+}
+
+// Reads the entry at p, and moves p past it, unless it is cut short.
+bool ParseEntry(const char** p, const char* end, uint32_t* chunk,
+    string* key, uint64_t* offset, uint64_t* size) {
+  if (static_cast<size_t>(end - *p) < kEntrySize) {
+    return false;
+  }
+  uint32_t key_size;
+  memcpy(chunk, *p, sizeof(*chunk));
+  memcpy(&key_size, *p + 4, sizeof(key_size));
+  memcpy(offset, *p + 8, sizeof(*offset));
+  memcpy(size, *p + 16, sizeof(*size));
+  if (static_cast<size_t>(end - *p) - kEntrySize < key_size) {
+    return false;
+  }
+  key->assign(*p + kEntrySize, key_size);
+  *p += kEntrySize + key_size;
+  return true;
+}
+
+// Size of a file, or -1 if it does not exist.
+int64_t FileSize(const string& filename) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) {
+    return -1;
+  }
+  return st.st_size;
+}
+
+}  // namespace
+
+RecordCursor::RecordCursor(RecordDB* db)
+    : db_(db), size_(db->records_.size()), index_(0), readahead_chunk_(-1),
+      readahead_end_(0) {
+  SeekToFirst();
+}
+
+string RecordCursor::key() {
+  return db_->keys_[index_];
+}
+
+const char* RecordCursor::value_data() {
+  ReadAhead();
+  return db_->data(index_);
+}
+
+size_t RecordCursor::value_size() {
+  return db_->records_[index_].size;
+}
+
+void RecordCursor::Seek(const string& key) {
+  boost::unordered_map<string, int>::const_iterator it =
+      db_->key_index_.find(key);
+  Seek(it == db_->key_index_.end() ? size_ : it->second);
+}
+
+void RecordCursor::ReadAhead() {
+  // Keep the next few MB of the chunk coming in large reads.
+  const RecordDB::Record& record = db_->records_[index_];
+  const RecordDB::Chunk& chunk = db_->chunks_[record.chunk];
+  const uint64_t end = record.offset + record.size;
+  if (record.chunk != readahead_chunk_ ||
+      end + kReadahead / 2 > readahead_end_) {
+    static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t begin = (record.chunk == readahead_chunk_ ?
+        std::max(readahead_end_, record.offset) : record.offset) &
+        ~(page_size - 1);
+    readahead_chunk_ = record.chunk;
+    readahead_end_ = std::min(begin + kReadahead, chunk.map_size);
+    if (readahead_end_ > begin) {
+      madvise(chunk.map + begin, readahead_end_ - begin, MADV_WILLNEED);
+    }
+  }
+}
+
+RecordRandomReader::RecordRandomReader(RecordDB* db) : db_(db) {
+  // Readahead only wastes I/O on random reads; WillNeed() prefetches a value
+  // instead.
+  for (int c = 0; c < db_->chunks_.size(); ++c) {
+    if (db_->chunks_[c].map) {
+      madvise(db_->chunks_[c].map, db_->chunks_[c].map_size, MADV_RANDOM);
+    }
+  }
+}
+
+const vector<string>& RecordRandomReader::keys() {
+  return db_->keys_;
+}
+
+bool RecordRandomReader::Get(const string& key, const char** data,
+    size_t* size) {
+  boost::unordered_map<string, int>::const_iterator it =
+      db_->key_index_.find(key);
+  if (it == db_->key_index_.end()) {
+    return false;
+  }
+  *data = db_->data(it->second);
+  *size = db_->records_[it->second].size;
+  return true;
+}
+
+void RecordRandomReader::WillNeed(const char* data, size_t size) {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t begin = reinterpret_cast<size_t>(data) & ~(page_size - 1);
+  const size_t end = reinterpret_cast<size_t>(data) + size;
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+RecordTransaction::~RecordTransaction() {
+  if (!pending_.empty()) {
+    db_->Rollback(pending_);
+  }
+}
+
+void RecordTransaction::Put(const string& key, const string& value) {
+  db_->Append(key, value, &pending_);
+}
+
+void RecordTransaction::Commit() {
+  db_->Commit(pending_);
+  pending_.clear();
+}
+
+string RecordDB::ChunkName(int chunk) const {
+  return source_ + "/data_" + format_int(chunk, 5);
+}
+
+void RecordDB::Open(const string& source, Mode mode) {
+  source_ = source;
+  const string index_name = source_ + "/index";
+  if (mode == NEW) {
+    CHECK_EQ(mkdir(source.c_str(), 0744), 0) << "mkdir " << source
+        << " failed";
+    index_file_ = fopen(index_name.c_str(), "wb");
+    CHECK(index_file_) << "Could not create " << index_name;
+    const uint32_t header[2] = {kVersion, 0};
+    CHECK_EQ(fwrite(kMagic, sizeof(kMagic), 1, index_file_), 1);
+    CHECK_EQ(fwrite(header, sizeof(header), 1, index_file_), 1);
+    CHECK_EQ(fflush(index_file_), 0);
+    OpenChunk(0, 0);
+    LOG(INFO) << "Opened record db " << source;
+    return;
+  }
+  const uint64_t index_size = LoadIndex();
+  if (mode == WRITE) {
+    // Drop whatever was written after the last complete record.
+    for (int c = data_chunk_ + 1; FileSize(ChunkName(c)) >= 0; ++c) {
+      CHECK_EQ(std::remove(ChunkName(c).c_str()), 0);
+    }
+    if (FileSize(ChunkName(data_chunk_)) >= 0) {
+      CHECK_EQ(truncate(ChunkName(data_chunk_).c_str(), data_size_), 0);
+    }
+    CHECK_EQ(truncate(index_name.c_str(), index_size), 0);
+    index_file_ = fopen(index_name.c_str(), "ab");
+    CHECK(index_file_) << "Could not open " << index_name;
+    OpenChunk(data_chunk_, data_size_);
+  }
+  MapChunks();
+  LOG(INFO) << "Opened record db " << source << " with " << records_.size()
+      << " records";
+}
+
+void RecordDB::Close() {
+  if (data_file_) {
+    CHECK_EQ(fclose(data_file_), 0);
+    data_file_ = NULL;
+  }
+  if (index_file_) {
+    CHECK_EQ(fclose(index_file_), 0);
+    index_file_ = NULL;
+  }
+  UnmapChunks();
+  keys_.clear();
+  records_.clear();
+  key_index_.clear();
+}
+
+RecordCursor* RecordDB::NewCursor() {
+  MapChunks();
+  return new RecordCursor(this);
+}
+
+RecordTransaction* RecordDB::NewTransaction() {
+  CHECK(data_file_) << source_ << " is not open for writing";
+  return new RecordTransaction(this);
+}
+
+RecordRandomReader* RecordDB::NewRandomReader() {
+  MapChunks();
+  return new RecordRandomReader(this);
+}
+
+uint64_t RecordDB::LoadIndex() {
+  const string index_name = source_ + "/index";
+  std::ifstream file(index_name.c_str(), std::ios::in | std::ios::binary);
+  CHECK(file) << "Could not open " << index_name;
+  const string index((std::istreambuf_iterator<char>(file)),
+      std::istreambuf_iterator<char>());
+  uint32_t version = 0;
+  CHECK(index.size() >= kHeaderSize &&
+      memcmp(index.data(), kMagic, sizeof(kMagic)) == 0)
+      << index_name << " is not a record db index";
+  memcpy(&version, index.data() + sizeof(kMagic), sizeof(version));
+  CHECK_EQ(version, kVersion) << "Unsupported version of " << index_name;
+  vector<int64_t> chunk_sizes;
+  const char* p = index.data() + kHeaderSize;
+  const char* const end = index.data() + index.size();
+  uint32_t chunk;
+  string key;
+  Record record;
+  data_chunk_ = 0;
+  data_size_ = 0;
+  while (ParseEntry(&p, end, &chunk, &key, &record.offset, &record.size)) {
+    while (chunk >= chunk_sizes.size()) {
+      chunk_sizes.push_back(FileSize(ChunkName(chunk_sizes.size())));
+    }
+    if (chunk_sizes[chunk] < 0 || record.offset + record.size >
+        static_cast<uint64_t>(chunk_sizes[chunk])) {
+      break;
+    }
+    record.chunk = chunk;
+    AddRecord(key, record);
+    data_chunk_ = chunk;
+    data_size_ = record.offset + record.size;
+  }
+  LOG_IF(WARNING, p != end) << "Ignoring the end of " << index_name
+      << ", cut short or pointing past the data, after " << records_.size()
+      << " records";
+  return p - index.data();
+}
+
+void RecordDB::AddRecord(const string& key, const Record& record) {
+  std::pair<boost::unordered_map<string, int>::iterator, bool> inserted =
+      key_index_.insert(std::make_pair(key, records_.size()));
+  if (inserted.second) {
+    keys_.push_back(key);
+    records_.push_back(record);
+  } else {
+    records_[inserted.first->second] = record;
+  }
+}
+
+void RecordDB::MapChunks() {
+  // The extent of the committed records of each chunk.
+  vector<uint64_t> extents;
+  for (int i = 0; i < records_.size(); ++i) {
+    const Record& record = records_[i];
+    if (record.chunk >= extents.size()) {
+      extents.resize(record.chunk + 1, 0);
+    }
+    extents[record.chunk] = std::max(extents[record.chunk],
+        record.offset + record.size);
+  }
+  chunks_.resize(std::max(chunks_.size(), extents.size()));
+  for (int c = 0; c < extents.size(); ++c) {
+    Chunk& chunk = chunks_[c];
+    if (extents[c] == 0 || chunk.map_size >= extents[c]) {
+      continue;
+    }
+    if (chunk.map) {
+      // Values handed out from the old map stay valid until Close.
+      retired_chunks_.push_back(chunk);
+    }
+    const string name = ChunkName(c);
+    const int fd = open(name.c_str(), O_RDONLY);
+    CHECK_NE(fd, -1) << "Could not open " << name;
+    chunk.map_size = FileSize(name);
+    void* map = mmap(NULL, chunk.map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    CHECK(map != MAP_FAILED) << "Could not map " << name;
+    chunk.map = static_cast<char*>(map);
+  }
+}
+
+void RecordDB::UnmapChunks() {
+  for (int c = 0; c < chunks_.size(); ++c) {
+    if (chunks_[c].map) {
+      munmap(chunks_[c].map, chunks_[c].map_size);
+    }
+  }
+  chunks_.clear();
+  for (int c = 0; c < retired_chunks_.size(); ++c) {
+    munmap(retired_chunks_[c].map, retired_chunks_[c].map_size);
+  }
+  retired_chunks_.clear();
+}
+
+void RecordDB::OpenChunk(int chunk, uint64_t size) {
+  const string name = ChunkName(chunk);
+  data_file_ = fopen(name.c_str(), "ab");
+  CHECK(data_file_) << "Could not open " << name;
+  data_chunk_ = chunk;
+  data_size_ = size;
+}
+
+void RecordDB::Append(const string& key, const string& value,
+    string* pending) {
+  CHECK(data_file_) << source_ << " is closed";
+  if (data_size_ > 0 && data_size_ + value.size() > kChunkSize) {
+    CHECK_EQ(fclose(data_file_), 0);
+    OpenChunk(data_chunk_ + 1, 0);
+  }
+  if (!value.empty()) {
+    CHECK_EQ(fwrite(value.data(), value.size(), 1, data_file_), 1)
+        << "Could not write to " << ChunkName(data_chunk_);
+  }
+  AppendEntry(data_chunk_, key, data_size_, value.size(), pending);
+  data_size_ += value.size();
+}
+
+void RecordDB::Commit(const string& pending) {
+  if (pending.empty()) {
+    return;
+  }
+  CHECK(data_file_) << source_ << " is closed";
+  // The values first, so the index never points past them.
+  CHECK_EQ(fflush(data_file_), 0) << "Could not write to "
+      << ChunkName(data_chunk_);
+  CHECK_EQ(fwrite(pending.data(), pending.size(), 1, index_file_), 1);
+  CHECK_EQ(fflush(index_file_), 0) << "Could not write to " << source_
+      << "/index";
+  const char* p = pending.data();
+  const char* const end = p + pending.size();
+  uint32_t chunk;
+  string key;
+  Record record;
+  while (ParseEntry(&p, end, &chunk, &key, &record.offset, &record.size)) {
+    record.chunk = chunk;
+    AddRecord(key, record);
+  }
+}
+
+void RecordDB::Rollback(const string& pending) {
+  if (!data_file_) {
+    // Closed already: opening it for writing drops the values.
+    return;
+  }
+  const char* p = pending.data();
+  uint32_t chunk;
+  string key;
+  uint64_t offset, size;
+  CHECK(ParseEntry(&p, p + pending.size(), &chunk, &key, &offset, &size));
+  CHECK_EQ(fclose(data_file_), 0);
+  for (int c = chunk + 1; c <= data_chunk_; ++c) {
+    CHECK_EQ(std::remove(ChunkName(c).c_str()), 0);
+  }
+  CHECK_EQ(truncate(ChunkName(chunk).c_str(), offset), 0);
+  OpenChunk(chunk, offset);
+}
+
+}  // namespace db
+}  // namespace caffe
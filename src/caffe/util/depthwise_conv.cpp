@@ -0,0 +1,332 @@
+#include <algorithm>
+
+#include "caffe/util/depthwise_conv.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Same unsigned comparison trick as in im2col.cpp: true iff 0 <= a < b.
+inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
+  return static_cast<unsigned>(a) < static_cast<unsigned>(b);
+}
+
+struct PlaneShape {
+  int height, width;
+  int kernel_h, kernel_w;
+  int pad_h, pad_w;
+  int stride_h, stride_w;
+  int dilation_h, dilation_w;
+  int output_h, output_w;
+  // Output columns [col_begin, col_end) read inside the input row for every
+  // kernel column, so their loops need no bounds checks.
+  int col_begin, col_end;
+};
+
+PlaneShape MakeShape(const int height, const int width, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w) {
+  PlaneShape s;
+  s.height = height;
+  s.width = width;
+  s.kernel_h = kernel_h;
+  s.kernel_w = kernel_w;
+  s.pad_h = pad_h;
+  s.pad_w = pad_w;
+  s.stride_h = stride_h;
+  s.stride_w = stride_w;
+  s.dilation_h = dilation_h;
+  s.dilation_w = dilation_w;
+  const int extent_w = dilation_w * (kernel_w - 1) + 1;
+  s.output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  s.output_w = (width + 2 * pad_w - extent_w) / stride_w + 1;
+  s.col_begin = std::min(s.output_w, (pad_w + stride_w - 1) / stride_w);
+  const int last = width - extent_w + pad_w;
+  s.col_end = last < 0 ? 0 : std::min(s.output_w, last / stride_w + 1);
+  s.col_end = std::max(s.col_end, s.col_begin);
+  return s;
+}
+
+// Returns kernel * 10 + stride for the shapes with a specialized loop, 0 for
+// the others.
+int Specialization(const PlaneShape& s) {
+  if (s.kernel_h != s.kernel_w || s.stride_h != s.stride_w ||
+      s.dilation_h != 1 || s.dilation_w != 1) {
+    return 0;
+  }
+  if ((s.kernel_h == 3 || s.kernel_h == 5) &&
+      (s.stride_h == 1 || s.stride_h == 2)) {
+    return s.kernel_h * 10 + s.stride_h;
+  }
+  return 0;
+}
+
+// In the loops below, kKernel > 0 makes the kernel size, the stride and the
+// dilation (then 1) compile time constants, so that the compiler unrolls the
+// kernel loops. The unchecked columns go by four, written out so that -O2
+// packs them into vector instructions.
+
+template <typename Dtype, int kKernel, int kStride>
+void forward_plane(const Dtype* data_im, const Dtype* kernel,
+    const PlaneShape& s, Dtype* data_out) {
+  const int kernel_h = kKernel ? kKernel : s.kernel_h;
+  const int kernel_w = kKernel ? kKernel : s.kernel_w;
+  const int stride_h = kKernel ? kStride : s.stride_h;
+  const int stride_w = kKernel ? kStride : s.stride_w;
+  const int dilation_h = kKernel ? 1 : s.dilation_h;
+  const int dilation_w = kKernel ? 1 : s.dilation_w;
+  for (int out_row = 0; out_row < s.output_h; ++out_row) {
+    Dtype* __restrict__ out = data_out + out_row * s.output_w;
+    std::fill(out, out + s.output_w, Dtype(0));
+    for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+      const int in_row = out_row * stride_h - s.pad_h +
+          kernel_row * dilation_h;
+      if (!is_a_ge_zero_and_a_lt_b(in_row, s.height)) {
+        continue;
+      }
+      const Dtype* __restrict__ in = data_im + in_row * s.width;
+      for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+        const Dtype weight = kernel[kernel_row * kernel_w + kernel_col];
+        const int offset = kernel_col * dilation_w - s.pad_w;
+        for (int out_col = 0; out_col < s.col_begin; ++out_col) {
+          const int in_col = out_col * stride_w + offset;
+          if (is_a_ge_zero_and_a_lt_b(in_col, s.width)) {
+            out[out_col] += weight * in[in_col];
+          }
+        }
+        int out_col = s.col_begin;
+        for (; out_col + 4 <= s.col_end; out_col += 4) {
+          const Dtype* src = in + out_col * stride_w + offset;
+          out[out_col] += weight * src[0];
+          out[out_col + 1] += weight * src[stride_w];
+          out[out_col + 2] += weight * src[2 * stride_w];
+          out[out_col + 3] += weight * src[3 * stride_w];
+        }
+        for (; out_col < s.col_end; ++out_col) {
+          out[out_col] += weight * in[out_col * stride_w + offset];
+        }
+        for (int out_col = s.col_end; out_col < s.output_w; ++out_col) {
+          const int in_col = out_col * stride_w + offset;
+          if (is_a_ge_zero_and_a_lt_b(in_col, s.width)) {
+            out[out_col] += weight * in[in_col];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype, int kKernel, int kStride>
+void backward_data_plane(const Dtype* out_diff, const Dtype* kernel,
+    const PlaneShape& s, Dtype* im_diff) {
+  const int kernel_h = kKernel ? kKernel : s.kernel_h;
+  const int kernel_w = kKernel ? kKernel : s.kernel_w;
+  const int stride_h = kKernel ? kStride : s.stride_h;
+  const int stride_w = kKernel ? kStride : s.stride_w;
+  const int dilation_h = kKernel ? 1 : s.dilation_h;
+  const int dilation_w = kKernel ? 1 : s.dilation_w;
+  for (int out_row = 0; out_row < s.output_h; ++out_row) {
+    const Dtype* __restrict__ out = out_diff + out_row * s.output_w;
+    for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+      const int in_row = out_row * stride_h - s.pad_h +
+          kernel_row * dilation_h;
+      if (!is_a_ge_zero_and_a_lt_b(in_row, s.height)) {
+        continue;
+      }
+      Dtype* __restrict__ in = im_diff + in_row * s.width;
+      for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+        const Dtype weight = kernel[kernel_row * kernel_w + kernel_col];
+        const int offset = kernel_col * dilation_w - s.pad_w;
+        for (int out_col = 0; out_col < s.col_begin; ++out_col) {
+          const int in_col = out_col * stride_w + offset;
+          if (is_a_ge_zero_and_a_lt_b(in_col, s.width)) {
+            in[in_col] += weight * out[out_col];
+          }
+        }
+        int out_col = s.col_begin;
+        for (; out_col + 4 <= s.col_end; out_col += 4) {
+          Dtype* dst = in + out_col * stride_w + offset;
+          dst[0] += weight * out[out_col];
+          dst[stride_w] += weight * out[out_col + 1];
+          dst[2 * stride_w] += weight * out[out_col + 2];
+          dst[3 * stride_w] += weight * out[out_col + 3];
+        }
+        for (; out_col < s.col_end; ++out_col) {
+          in[out_col * stride_w + offset] += weight * out[out_col];
+        }
+        for (int out_col = s.col_end; out_col < s.output_w; ++out_col) {
+          const int in_col = out_col * stride_w + offset;
+          if (is_a_ge_zero_and_a_lt_b(in_col, s.width)) {
+            in[in_col] += weight * out[out_col];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype, int kKernel, int kStride>
+void backward_kernel_plane(const Dtype* data_im, const Dtype* out_diff,
+    const PlaneShape& s, Dtype* kernel_diff) {
+  const int kernel_h = kKernel ? kKernel : s.kernel_h;
+  const int kernel_w = kKernel ? kKernel : s.kernel_w;
+  const int stride_h = kKernel ? kStride : s.stride_h;
+  const int stride_w = kKernel ? kStride : s.stride_w;
+  const int dilation_h = kKernel ? 1 : s.dilation_h;
+  const int dilation_w = kKernel ? 1 : s.dilation_w;
+  for (int out_row = 0; out_row < s.output_h; ++out_row) {
+    const Dtype* __restrict__ out = out_diff + out_row * s.output_w;
+    for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+      const int in_row = out_row * stride_h - s.pad_h +
+          kernel_row * dilation_h;
+      if (!is_a_ge_zero_and_a_lt_b(in_row, s.height)) {
+        continue;
+      }
+      const Dtype* __restrict__ in = data_im + in_row * s.width;
+      for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+        const int offset = kernel_col * dilation_w - s.pad_w;
+        Dtype sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+        int out_col = s.col_begin;
+        for (; out_col + 4 <= s.col_end; out_col += 4) {
+          const Dtype* src = in + out_col * stride_w + offset;
+          sum0 += out[out_col] * src[0];
+          sum1 += out[out_col + 1] * src[stride_w];
+          sum2 += out[out_col + 2] * src[2 * stride_w];
+          sum3 += out[out_col + 3] * src[3 * stride_w];
+        }
+        Dtype sum = (sum0 + sum1) + (sum2 + sum3);
+        for (; out_col < s.col_end; ++out_col) {
+          sum += out[out_col] * in[out_col * stride_w + offset];
+        }
+        for (int out_col = 0; out_col < s.col_begin; ++out_col) {
+          const int in_col = out_col * stride_w + offset;
+          if (is_a_ge_zero_and_a_lt_b(in_col, s.width)) {
+            sum += out[out_col] * in[in_col];
+          }
+        }
+        for (int out_col = s.col_end; out_col < s.output_w; ++out_col) {
+          const int in_col = out_col * stride_w + offset;
+          if (is_a_ge_zero_and_a_lt_b(in_col, s.width)) {
+            sum += out[out_col] * in[in_col];
+          }
+        }
+        kernel_diff[kernel_row * kernel_w + kernel_col] += sum;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void depthwise_conv_cpu(const Dtype* data_im, const int height,
+    const int width, const Dtype* kernel, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    Dtype* data_out) {
+  const PlaneShape s = MakeShape(height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w);
+  switch (Specialization(s)) {
+  case 31:
+    forward_plane<Dtype, 3, 1>(data_im, kernel, s, data_out);
+    break;
+  case 32:
+    forward_plane<Dtype, 3, 2>(data_im, kernel, s, data_out);
+    break;
+  case 51:
+    forward_plane<Dtype, 5, 1>(data_im, kernel, s, data_out);
+    break;
+  case 52:
+    forward_plane<Dtype, 5, 2>(data_im, kernel, s, data_out);
+    break;
+  default:
+    forward_plane<Dtype, 0, 0>(data_im, kernel, s, data_out);
+  }
+}
+
+template <typename Dtype>
+void depthwise_conv_backward_data_cpu(const Dtype* out_diff,
+    const int height, const int width, const Dtype* kernel,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, Dtype* im_diff) {
+  const PlaneShape s = MakeShape(height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w);
+  switch (Specialization(s)) {
+  case 31:
+    backward_data_plane<Dtype, 3, 1>(out_diff, kernel, s, im_diff);
+    break;
+  case 32:
+    backward_data_plane<Dtype, 3, 2>(out_diff, kernel, s, im_diff);
+    break;
+  case 51:
+    backward_data_plane<Dtype, 5, 1>(out_diff, kernel, s, im_diff);
+    break;
+  case 52:
+    backward_data_plane<Dtype, 5, 2>(out_diff, kernel, s, im_diff);
+    break;
+  default:
+    backward_data_plane<Dtype, 0, 0>(out_diff, kernel, s, im_diff);
+  }
+}
+
+template <typename Dtype>
+void depthwise_conv_backward_kernel_cpu(const Dtype* data_im,
+    const Dtype* out_diff, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, Dtype* kernel_diff) {
+  const PlaneShape s = MakeShape(height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w);
+  switch (Specialization(s)) {
+  case 31:
+    backward_kernel_plane<Dtype, 3, 1>(data_im, out_diff, s, kernel_diff);
+    break;
+  case 32:
+    backward_kernel_plane<Dtype, 3, 2>(data_im, out_diff, s, kernel_diff);
+    break;
+  case 51:
+    backward_kernel_plane<Dtype, 5, 1>(data_im, out_diff, s, kernel_diff);
+    break;
+  case 52:
+    backward_kernel_plane<Dtype, 5, 2>(data_im, out_diff, s, kernel_diff);
+    break;
+  default:
+    backward_kernel_plane<Dtype, 0, 0>(data_im, out_diff, s, kernel_diff);
+  }
+}
+
+// Explicit instantiation
+template void depthwise_conv_cpu<float>(const float* data_im,
+    const int height, const int width, const float* kernel,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* data_out);
+template void depthwise_conv_cpu<double>(const double* data_im,
+    const int height, const int width, const double* kernel,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, double* data_out);
+template void depthwise_conv_backward_data_cpu<float>(const float* out_diff,
+    const int height, const int width, const float* kernel,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* im_diff);
+template void depthwise_conv_backward_data_cpu<double>(
+    const double* out_diff, const int height, const int width,
+    const double* kernel, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, double* im_diff);
+template void depthwise_conv_backward_kernel_cpu<float>(const float* data_im,
+    const float* out_diff, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* kernel_diff);
+template void depthwise_conv_backward_kernel_cpu<double>(
+    const double* data_im, const double* out_diff, const int height,
+    const int width, const int kernel_h, const int kernel_w, const int pad_h,
+    const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, double* kernel_diff);
+
+}  // namespace caffe
@@ -0,0 +1,117 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/file_readahead.hpp"
+
+namespace caffe {
+
+class FileReadahead::sync {
+ public:
+  boost::mutex mutex_;
+  // Signals the readers that there is a file to read, or that they must stop.
+  boost::condition_variable to_read_;
+  // Signals Get that a file was read, and Start that no read is in flight.
+  boost::condition_variable read_;
+  boost::thread_group threads_;
+};
+
+FileReadahead::FileReadahead(int num_threads, int window)
+    : num_threads_(std::max(num_threads, 0)), window_(std::max(window, 1)),
+      next_(0), in_flight_(0), taken_(0), wanted_(-1), stop_(false),
+      sync_(new sync()) {
+  for (int i = 0; i < num_threads_; ++i) {
+    sync_->threads_.create_thread(boost::bind(&FileReadahead::Entry, this));
+  }
+}
+
+FileReadahead::~FileReadahead() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stop_ = true;
+  }
+  sync_->to_read_.notify_all();
+  sync_->threads_.join_all();
+}
+
+void FileReadahead::Start(const vector<string>& files) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (in_flight_ > 0) {
+    sync_->read_.wait(lock);
+  }
+  files_ = files;
+  data_.clear();
+  data_.resize(files.size());
+  state_.assign(files.size(), 0);
+  next_ = 0;
+  taken_ = 0;
+  wanted_ = -1;
+  lock.unlock();
+  sync_->to_read_.notify_all();
+}
+
+bool FileReadahead::Get(int i, string* data) {
+  CHECK_GE(i, 0);
+  CHECK_LT(i, files_.size());
+  if (num_threads_ == 0) {
+    return ReadFile(files_[i], data);
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  ++taken_;
+  wanted_ = std::max(wanted_, i);
+  // Taking a file makes room for the next one, and waiting for one past the
+  // window extends it.
+  sync_->to_read_.notify_all();
+  while (state_[i] == 0) {
+    sync_->read_.wait(lock);
+  }
+  data->swap(data_[i]);
+  data_[i].clear();
+  return state_[i] > 0;
+}
+
+void FileReadahead::Entry() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!stop_ && (next_ >= files_.size() ||
+        (next_ >= taken_ + window_ && next_ > wanted_))) {
+      sync_->to_read_.wait(lock);
+    }
+    if (stop_) {
+      return;
+    }
+    const int i = next_++;
+    ++in_flight_;
+    const string filename = files_[i];
+    lock.unlock();
+    string data;
+    const bool ok = ReadFile(filename, &data);
+    lock.lock();
+    data_[i].swap(data);
+    state_[i] = ok ? 1 : -1;
+    --in_flight_;
+    sync_->read_.notify_all();
+  }
+}
+
+bool FileReadahead::ReadFile(const string& filename, string* data) {
+  std::ifstream file(filename.c_str(),
+      std::ios::in | std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    data->clear();
+    return false;
+  }
+  const std::streampos size = file.tellg();
+  data->resize(size);
+  file.seekg(0, std::ios::beg);
+  if (size > 0) {
+    file.read(&(*data)[0], size);
+  }
+  return file.good();
+}
+
+}  // namespace caffe
@@ -14,12 +14,16 @@
 #endif
 #endif  // USE_OPENCV
 
+#include <boost/thread/tss.hpp>
+
 #include <algorithm>
 #include <numeric>
 #include <vector>
 
+#include "caffe/util/bbox_util.hpp"
 #include "caffe/util/im_transforms.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 #define GET_VALID_VALUE(value, min, max) ((((value) >= (min) ? (value) : (min)) < (max) ? ((value) >= (min) ? (value) : (min)): (max)))
 
 namespace caffe {
@@ -97,88 +101,50 @@ void UpdateBBoxByResizePolicy(const ResizeParameter& param,
   bbox->set_ymax(y_max / new_height);
 }
 
-void UpdateLandmarkFacePoseByResizePolicy(const ResizeParameter& param,
+void UpdateLandmarksByResizePolicy(const ResizeParameter& param,
                               const int old_width, const int old_height,
-                              AnnoFaceLandmarks* lface){
+                              float* points) {
     float new_height = param.height();
     float new_width = param.width();
 
     float orig_aspect = static_cast<float>(old_width) / old_height;
     float new_aspect = new_width / new_height;
 
-    float le_x = lface->lefteye().x() * old_width;
-    float le_y = lface->lefteye().y() * old_height;
-    float re_x = lface->righteye().x() * old_width;
-    float re_y = lface->righteye().y() * old_height;
-    float no_x = lface->nose().x() * old_width;
-    float no_y = lface->nose().y() * old_height;
-
-    float lm_x = lface->leftmouth().x() * old_width;
-    float lm_y = lface->leftmouth().y() * old_height;
-    float rm_x = lface->rightmouth().x() * old_width;
-    float rm_y = lface->rightmouth().y() * old_height;
     float padding;
-    switch (param.resize_mode()) {
-        case ResizeParameter_Resize_mode_WARP:
-
-            le_x = GET_VALID_VALUE(le_x * new_width / old_width, (0.), new_width);
-            le_y = GET_VALID_VALUE(le_y * new_height / old_height, (0.), new_height);
-            re_x = GET_VALID_VALUE(re_x * new_width / old_width, (0.), new_width);
-            re_y = GET_VALID_VALUE(re_y * new_height / old_height, (0.), new_height);
-            no_x = GET_VALID_VALUE(no_x * new_width / old_width, (0.), new_width);
-            no_y = GET_VALID_VALUE(no_y * new_height / old_height, (0.), new_height);
-
-            lm_x = GET_VALID_VALUE(lm_x * new_width / old_width, (0.), new_width);
-            lm_y = GET_VALID_VALUE(lm_y * new_height / old_height, (0.), new_height);
-            rm_x = GET_VALID_VALUE(rm_x * new_width / old_width, (0.), new_width);
-            rm_y = GET_VALID_VALUE(rm_y * new_height / old_height, (0.), new_height);
-            break;
-        case ResizeParameter_Resize_mode_FIT_LARGE_SIZE_AND_PAD:
-            if (orig_aspect > new_aspect) {
-                padding = (new_height - new_width / orig_aspect) / 2;
-                
-                le_x = GET_VALID_VALUE(le_x * new_width / old_width, (0.), new_width);
-                le_y = GET_VALID_VALUE((padding + le_y * (new_height - 2 * padding) / old_height), (0.), new_height);
-                re_x = GET_VALID_VALUE(re_x * new_width / old_width, (0.), new_width);
-                re_y = GET_VALID_VALUE((padding + re_y * (new_height - 2 * padding) / old_height), (0.), new_height);
-                no_x = GET_VALID_VALUE(no_x * new_width / old_width, (0.), new_width);
-                no_y = GET_VALID_VALUE((padding + no_y * (new_height - 2 * padding) / old_height), (0.), new_height);
-
-                lm_x = GET_VALID_VALUE(lm_x * new_width / old_width, (0.), new_width);
-                lm_y = GET_VALID_VALUE((padding + lm_y * (new_height - 2 * padding) / old_height), (0.), new_height);
-                rm_x = GET_VALID_VALUE(rm_x * new_width / old_width, (0.), new_width);
-                rm_y = GET_VALID_VALUE((padding + rm_y * (new_height - 2 * padding) / old_height), (0.), new_height);
-            } else {
-                padding = (new_width - orig_aspect * new_height) / 2;
-                
-                le_x = GET_VALID_VALUE((padding + le_x * (new_width - 2 * padding) / old_width), (0.), new_width);
-                le_y = GET_VALID_VALUE(le_y * new_height / old_height, (0.), new_height);
-                re_x = GET_VALID_VALUE((padding + re_x * (new_width - 2 * padding) / old_width), (0.), new_width);
-                re_y = GET_VALID_VALUE(re_y * new_height / old_height, (0.), new_height);
-                no_x = GET_VALID_VALUE((padding + no_x * (new_width - 2 * padding) / old_width), (0.), new_width);
-                no_y = GET_VALID_VALUE(no_y * new_height / old_height, (0.), new_height);
-
-                lm_x = GET_VALID_VALUE((padding + lm_x * (new_width - 2 * padding) / old_width), (0.), new_width);
-                lm_y = GET_VALID_VALUE(lm_y * new_height / old_height, (0.), new_height);
-                rm_x = GET_VALID_VALUE((padding + rm_x * (new_width - 2 * padding) / old_width), (0.), new_width);
-                rm_y = GET_VALID_VALUE(rm_y * new_height / old_height, (0.), new_height);
-            }
-            break;
-        default:
-            LOG(FATAL) << "Unknown resize mode.";
+    for (int i = 0; i < kNumFaceLandmarks; ++i) {
+        float x = points[2 * i] * old_width;
+        float y = points[2 * i + 1] * old_height;
+        switch (param.resize_mode()) {
+            case ResizeParameter_Resize_mode_WARP:
+                x = GET_VALID_VALUE(x * new_width / old_width, (0.), new_width);
+                y = GET_VALID_VALUE(y * new_height / old_height, (0.), new_height);
+                break;
+            case ResizeParameter_Resize_mode_FIT_LARGE_SIZE_AND_PAD:
+                if (orig_aspect > new_aspect) {
+                    padding = (new_height - new_width / orig_aspect) / 2;
+                    x = GET_VALID_VALUE(x * new_width / old_width, (0.), new_width);
+                    y = GET_VALID_VALUE((padding + y * (new_height - 2 * padding) / old_height), (0.), new_height);
+                } else {
+                    padding = (new_width - orig_aspect * new_height) / 2;
+                    x = GET_VALID_VALUE((padding + x * (new_width - 2 * padding) / old_width), (0.), new_width);
+                    y = GET_VALID_VALUE(y * new_height / old_height, (0.), new_height);
+                }
+                break;
+            default:
+                LOG(FATAL) << "Unknown resize mode.";
+        }
+        points[2 * i] = x / new_width;
+        points[2 * i + 1] = y / new_height;
     }
+}
 
-    lface->mutable_lefteye()->set_x(le_x / new_width);
-    lface->mutable_lefteye()->set_y(le_y / new_height);
-    lface->mutable_righteye()->set_x(re_x / new_width);
-    lface->mutable_righteye()->set_y(re_y / new_height);
-    lface->mutable_nose()->set_x(no_x / new_width);
-    lface->mutable_nose()->set_y(no_y / new_height);
-
-    lface->mutable_leftmouth()->set_x(lm_x / new_width);
-    lface->mutable_leftmouth()->set_y(lm_y / new_height);
-    lface->mutable_rightmouth()->set_x(rm_x / new_width);
-    lface->mutable_rightmouth()->set_y(rm_y / new_height);
+void UpdateLandmarkFacePoseByResizePolicy(const ResizeParameter& param,
+                              const int old_width, const int old_height,
+                              AnnoFaceLandmarks* lface){
+    float points[2 * kNumFaceLandmarks];
+    GetFaceLandmarks(*lface, points);
+    UpdateLandmarksByResizePolicy(param, old_width, old_height, points);
+    SetFaceLandmarks(points, lface);
 }
 
 void InferNewSize(const ResizeParameter& resize_param,
@@ -761,14 +727,16 @@ void RandomOrderChannels(const cv::Mat& in_img, cv::Mat* out_img,
     CHECK_EQ(channels.size(), 3);
 
     // Shuffle the channels.
-    std::random_shuffle(channels.begin(), channels.end());
+    caffe::shuffle(channels.begin(), channels.end());
     cv::merge(channels, *out_img);
   } else {
     *out_img = in_img;
   }
 }
 
-cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param) {
+// The distortions one by one, for images ApplyDistort has no kernel for.
+static cv::Mat ApplyDistortChain(const cv::Mat& in_img,
+                                 const DistortionParameter& param) {
   cv::Mat out_img = in_img;
   float prob;
   caffe_rng_uniform(1, 0.f, 1.f, &prob);
@@ -813,6 +781,155 @@ cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param) {
 
   return out_img;
 }
+
+// Per-thread buffers of ApplyDistort, reused from one image to the next.
+struct DistortScratch {
+  cv::Mat hsv;
+  cv::Mat bgr;
+};
+
+static boost::thread_specific_ptr<DistortScratch> distort_scratch_;
+
+// Draws whether to apply a distortion and, if so, its amount, consuming the
+// RNG exactly like the Random*() functions do.
+static bool RandomAmount(const float prob, const float lower,
+                         const float upper, float* amount) {
+  float p;
+  caffe_rng_uniform(1, 0.f, 1.f, &p);
+  if (p >= prob) {
+    return false;
+  }
+  caffe_rng_uniform(1, lower, upper, amount);
+  return true;
+}
+
+// Composes the value map x -> saturate(x * alpha + beta) into lut.
+static void ComposeLUT(const float alpha, const float beta, uchar* lut) {
+  for (int v = 0; v < 256; ++v) {
+    lut[v] = cv::saturate_cast<uchar>(lut[v] * alpha + beta);
+  }
+}
+
+cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param) {
+  if (in_img.type() != CV_8UC3) {
+    return ApplyDistortChain(in_img, param);
+  }
+  if (param.brightness_prob() > 0) {
+    CHECK_GE(param.brightness_delta(), 0)
+        << "brightness_delta must be non-negative.";
+  }
+  if (param.contrast_prob() > 0) {
+    CHECK_GE(param.contrast_upper(), param.contrast_lower())
+        << "contrast upper must be >= lower.";
+    CHECK_GE(param.contrast_lower(), 0)
+        << "contrast lower must be non-negative.";
+  }
+  if (param.saturation_prob() > 0) {
+    CHECK_GE(param.saturation_upper(), param.saturation_lower())
+        << "saturation upper must be >= lower.";
+    CHECK_GE(param.saturation_lower(), 0)
+        << "saturation lower must be non-negative.";
+  }
+  if (param.hue_prob() > 0) {
+    CHECK_GE(param.hue_delta(), 0) << "hue_delta must be non-negative.";
+  }
+
+  // Draw everything in the order of ApplyDistortChain, so that a seed gives
+  // the same distortions as it always did.
+  float prob;
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool contrast_first = prob > 0.5;
+  float brightness, contrast, saturation, hue;
+  const bool do_brightness = RandomAmount(param.brightness_prob(),
+      -param.brightness_delta(), param.brightness_delta(), &brightness);
+  bool do_contrast = false;
+  if (contrast_first) {
+    do_contrast = RandomAmount(param.contrast_prob(), param.contrast_lower(),
+        param.contrast_upper(), &contrast);
+  }
+  const bool do_saturation = RandomAmount(param.saturation_prob(),
+      param.saturation_lower(), param.saturation_upper(), &saturation);
+  const bool do_hue = RandomAmount(param.hue_prob(), -param.hue_delta(),
+      param.hue_delta(), &hue);
+  if (!contrast_first) {
+    do_contrast = RandomAmount(param.contrast_prob(), param.contrast_lower(),
+        param.contrast_upper(), &contrast);
+  }
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool do_order = prob < param.random_order_prob();
+  int order[3] = {0, 1, 2};
+  if (do_order) {
+    caffe::shuffle(order, order + 3);
+  }
+
+  // Brightness and contrast map every channel value the same way, so they
+  // become one table applied before the HSV stage and one after it. Both
+  // commute with reordering the channels.
+  uchar pre[256], post[256];
+  for (int v = 0; v < 256; ++v) {
+    pre[v] = post[v] = v;
+  }
+  bool do_pre = false, do_post = false;
+  if (do_brightness && fabs(brightness) > 0) {
+    ComposeLUT(1, brightness, pre);
+    do_pre = true;
+  }
+  if (do_contrast && fabs(contrast - 1.f) > 1e-3) {
+    if (contrast_first) {
+      ComposeLUT(contrast, 0, pre);
+      do_pre = true;
+    } else {
+      ComposeLUT(contrast, 0, post);
+      do_post = true;
+    }
+  }
+  // Saturation and hue share a single round trip through HSV.
+  const bool do_hsv = do_saturation || (do_hue && fabs(hue) > 0);
+  if (!do_hsv) {
+    for (int v = 0; v < 256; ++v) {
+      post[v] = post[pre[v]];
+    }
+    do_post = do_post || do_pre;
+    do_pre = false;
+  }
+  if (!do_pre && !do_hsv && !do_post && !do_order) {
+    return in_img;
+  }
+
+  if (!distort_scratch_.get()) {
+    distort_scratch_.reset(new DistortScratch());
+  }
+  DistortScratch* scratch = distort_scratch_.get();
+  cv::Mat out_img(in_img.size(), in_img.type());
+  const cv::Mat* src = &in_img;
+  if (do_pre) {
+    cv::LUT(*src, cv::Mat(1, 256, CV_8U, pre), out_img);
+    src = &out_img;
+  }
+  if (do_hsv) {
+    uchar hsv_lut[256 * 3];
+    for (int v = 0; v < 256; ++v) {
+      hsv_lut[3 * v] = do_hue ? cv::saturate_cast<uchar>(v + hue) : v;
+      hsv_lut[3 * v + 1] = do_saturation ?
+          cv::saturate_cast<uchar>(v * saturation) : v;
+      hsv_lut[3 * v + 2] = v;
+    }
+    cv::cvtColor(*src, scratch->hsv, CV_BGR2HSV);
+    cv::LUT(scratch->hsv, cv::Mat(1, 256, CV_8UC3, hsv_lut), scratch->hsv);
+    cv::Mat* bgr = do_order ? &scratch->bgr : &out_img;
+    cv::cvtColor(scratch->hsv, *bgr, CV_HSV2BGR);
+    src = bgr;
+  }
+  if (do_order) {
+    const int from_to[] = {order[0], 0, order[1], 1, order[2], 2};
+    cv::mixChannels(src, 1, &out_img, 1, from_to, 3);
+    src = &out_img;
+  }
+  if (do_post) {
+    cv::LUT(*src, cv::Mat(1, 256, CV_8U, post), out_img);
+  }
+  return out_img;
+}
 #endif  // USE_OPENCV
 
 }  // namespace caffe
@@ -0,0 +1,140 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+ImageCache::ImageCache(size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes), size_bytes_(0),
+      hits_(0), misses_(0), evictions_(0) {
+}
+
+static inline uint64_t Rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t Fmix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+ImageCache::Key ImageCache::KeyOf(const string& encoded) {
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  const size_t size = encoded.size();
+  const size_t num_blocks = size / 16;
+  const char* data = encoded.data();
+  uint64_t h1 = 0;
+  uint64_t h2 = 0;
+  for (size_t i = 0; i < num_blocks; ++i) {
+    uint64_t k1, k2;
+    memcpy(&k1, data + 16 * i, sizeof(k1));
+    memcpy(&k2, data + 16 * i + 8, sizeof(k2));
+    h1 ^= Rotl(k1 * c1, 31) * c2;
+    h1 = (Rotl(h1, 27) + h2) * 5 + 0x52dce729;
+    h2 ^= Rotl(k2 * c2, 33) * c1;
+    h2 = (Rotl(h2, 31) + h1) * 5 + 0x38495ab5;
+  }
+  // The last 0 to 15 bytes.
+  const uint8_t* tail =
+      reinterpret_cast<const uint8_t*>(data + 16 * num_blocks);
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  for (int i = size % 16 - 1; i >= 8; --i) {
+    k2 = (k2 << 8) | tail[i];
+  }
+  for (int i = std::min<int>(size % 16, 8) - 1; i >= 0; --i) {
+    k1 = (k1 << 8) | tail[i];
+  }
+  h2 ^= Rotl(k2 * c2, 33) * c1;
+  h1 ^= Rotl(k1 * c1, 31) * c2;
+  h1 ^= size;
+  h2 ^= size;
+  h1 += h2;
+  h2 += h1;
+  h1 = Fmix(h1);
+  h2 = Fmix(h2);
+  h1 += h2;
+  h2 += h1;
+  Key key = {h1, h2};
+  return key;
+}
+
+size_t ImageCache::Bytes(const Entry& entry) {
+  return sizeof(entry.key) + entry.img.total() * entry.img.elemSize();
+}
+
+bool ImageCache::Get(const Key& key, cv::Mat* img) {
+  boost::mutex::scoped_lock lock(mutex_);
+  std::map<Key, EntryList::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  it->second->img.copyTo(*img);
+  return true;
+}
+
+void ImageCache::Put(const Key& key, const cv::Mat& img) {
+  Entry entry;
+  entry.key = key;
+  img.copyTo(entry.img);
+  const size_t bytes = Bytes(entry);
+  if (bytes > capacity_bytes_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(mutex_);
+  if (index_.count(key)) {
+    // Another worker decoded the same record.
+    return;
+  }
+  while (size_bytes_ + bytes > capacity_bytes_) {
+    size_bytes_ -= Bytes(entries_.back());
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+    ++evictions_;
+  }
+  entries_.push_front(entry);
+  index_[key] = entries_.begin();
+  size_bytes_ += bytes;
+}
+
+uint64_t ImageCache::hits() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return hits_;
+}
+
+uint64_t ImageCache::misses() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return misses_;
+}
+
+uint64_t ImageCache::evictions() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return evictions_;
+}
+
+size_t ImageCache::size() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return entries_.size();
+}
+
+size_t ImageCache::size_bytes() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return size_bytes_;
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
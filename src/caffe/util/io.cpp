@@ -1,10 +1,7 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/foreach.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
+#include <boost/thread/tss.hpp>
 #include <fcntl.h>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
@@ -26,6 +23,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/annotation_tree.hpp"
 #include "caffe/util/io.hpp"
 
 
@@ -39,7 +37,6 @@ const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
 
 namespace caffe {
 
-using namespace boost::property_tree;  // NOLINT(build/namespaces)
 using google::protobuf::io::FileInputStream;
 using google::protobuf::io::FileOutputStream;
 using google::protobuf::io::ZeroCopyInputStream;
@@ -86,6 +83,53 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
     CHECK(proto.SerializeToOstream(&output));
 }
 
+bool GetJPEGSize(const string& data, int* height, int* width, int* channels) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+  const size_t size = data.size();
+  if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+    return false;
+  }
+  // Walk the marker segments up to the start of frame.
+  size_t i = 2;
+  while (i + 4 <= size) {
+    if (p[i] != 0xFF) {
+      return false;
+    }
+    const unsigned char marker = p[i + 1];
+    if (marker == 0xFF) {
+      // Fill byte.
+      ++i;
+      continue;
+    }
+    i += 2;
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+      // Markers without a segment.
+      continue;
+    }
+    if (marker == 0xD9 || marker == 0xDA) {
+      // End of image or start of scan before any frame header.
+      return false;
+    }
+    const size_t length = (p[i] << 8) | p[i + 1];
+    if (length < 2) {
+      return false;
+    }
+    // SOF0 to SOF15, except DHT, JPG and DAC which share the range.
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (i + 8 > size) {
+        return false;
+      }
+      *height = (p[i + 3] << 8) | p[i + 4];
+      *width = (p[i + 5] << 8) | p[i + 6];
+      *channels = p[i + 7];
+      return *height > 0 && *width > 0;
+    }
+    i += length;
+  }
+  return false;
+}
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename, const int height,
     const int width, const int min_dim, const int max_dim,
@@ -149,6 +193,24 @@ cv::Mat ReadImageToCVMat(const string& filename) {
   return ReadImageToCVMat(filename, 0, 0, true);
 }
 
+cv::Mat DecodeImageToCVMat(const string& data, const int height,
+    const int width, const bool is_color) {
+  cv::Mat cv_img;
+  int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
+    CV_LOAD_IMAGE_GRAYSCALE);
+  cv::Mat buf(1, data.size(), CV_8UC1, const_cast<char*>(data.data()));
+  cv::Mat cv_img_origin = cv::imdecode(buf, cv_read_flag);
+  if (!cv_img_origin.data) {
+    return cv_img_origin;
+  }
+  if (height > 0 && width > 0) {
+    cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
+  } else {
+    cv_img = cv_img_origin;
+  }
+  return cv_img;
+}
+
 // Do the file extension and encoding match?
 static bool matchExt(const std::string & fn,
                      std::string en) {
@@ -332,20 +394,52 @@ bool ReadFileToDatum(const string& filename, const int label,
   }
 }
 
+// Per-thread tree and file buffer of the annotation readers, reused from one
+// label file to the next.
+struct AnnotationScratch {
+  AnnotationTree tree;
+  string buffer;
+};
+
+static boost::thread_specific_ptr<AnnotationScratch> annotation_scratch_;
+
+// Reads and parses an XML or JSON annotation file, failing on a malformed one
+// as property_tree's readers would. The tree is valid until the next call
+// from the same thread.
+static const AnnotationTree& ReadAnnotationTree(const string& labelfile,
+    bool json) {
+  if (!annotation_scratch_.get()) {
+    annotation_scratch_.reset(new AnnotationScratch());
+  }
+  AnnotationScratch* scratch = annotation_scratch_.get();
+  fstream file(labelfile.c_str(), ios::in|ios::binary|ios::ate);
+  CHECK(file.is_open()) << "Could not open " << labelfile;
+  const std::streamoff size = file.tellg();
+  string& buffer = scratch->buffer;
+  buffer.resize(size);
+  file.seekg(0, ios::beg);
+  file.read(&buffer[0], size);
+  file.close();
+  string error;
+  AnnotationTree& tree = scratch->tree;
+  const bool parsed = json ? tree.ParseJSON(buffer.data(), size, &error) :
+      tree.ParseXML(buffer.data(), size, &error);
+  CHECK(parsed) << labelfile << ": " << error;
+  return tree;
+}
+
 // Parse VOC/ILSVRC detection annotation.
 bool ReadXMLToAnnotatedDatum(const string& labelfile, const int img_height,
     const int img_width, const std::map<string, int>& name_to_label,
     AnnotatedDatum* anno_datum) {
-    ptree pt;
-    read_xml(labelfile, pt);
+    const AnnotationTree& pt = ReadAnnotationTree(labelfile, false);
 
     // Parse annotation.
     int width = 0, height = 0;
-    try {
-        height = pt.get<int>("annotation.size.height");
-        width = pt.get<int>("annotation.size.width");
-    } catch (const ptree_error &e) {
-        LOG(WARNING) << "When parsing " << labelfile << ": " << e.what();
+    if (!pt.Get(pt.root(), "annotation.size.height", &height) ||
+        !pt.Get(pt.root(), "annotation.size.width", &width)) {
+        LOG(WARNING) << "When parsing " << labelfile
+            << ": no valid annotation.size.height/width";
         height = img_height;
         width = img_width;
     }
@@ -355,21 +449,23 @@ bool ReadXMLToAnnotatedDatum(const string& labelfile, const int img_height,
         " inconsistent image width.";
     CHECK(width != 0 && height != 0) << labelfile <<
         " no valid image width/height.";
+    const int annotation = pt.Find(pt.root(), "annotation");
+    CHECK_GE(annotation, 0) << labelfile << " has no annotation.";
     int instance_id = 0;
-    BOOST_FOREACH(ptree::value_type &v1, pt.get_child("annotation")) {
-        ptree pt1 = v1.second;
-        if (v1.first == "object") {
+    for (int v1 = pt.first_child(annotation); v1 >= 0;
+         v1 = pt.next_sibling(v1)) {
+        if (pt.key(v1) == "object") {
             Annotation* anno = NULL;
             bool difficult = false;
             bool has_lm = false;
             float lm_x1 = -1.0, lm_y1 = -1.0, lm_x2 = -1.0, lm_y2 = -1.0,
             lm_x3 = -1.0, lm_y3 = -1.0, lm_x4 = -1.0, lm_y4 = -1.0, 
             lm_x5 = -1.0, lm_y5 = -1.0;
-            ptree object = v1.second;
-            BOOST_FOREACH(ptree::value_type &v2, object.get_child("")) {
-                ptree pt2 = v2.second;
-                if (v2.first == "name") {
-                    string name = pt2.data();
+            for (int v2 = pt.first_child(v1); v2 >= 0;
+                 v2 = pt.next_sibling(v2)) {
+                const string& key = pt.key(v2);
+                if (key == "name") {
+                    const string& name = pt.data(v2);
                     if (name_to_label.find(name) == name_to_label.end()) {
                         LOG(FATAL) << "Unknown name: " << name;
                     }
@@ -397,13 +493,13 @@ bool ReadXMLToAnnotatedDatum(const string& labelfile, const int img_height,
                         instance_id = 0;
                     }
                     anno->set_instance_id(instance_id++);
-                } else if (v2.first == "difficult") {
-                    difficult = pt2.data() == "1";
-                }else if (v2.first == "bndbox") {
-                    int xmin = pt2.get("xmin", 0);
-                    int ymin = pt2.get("ymin", 0);
-                    int xmax = pt2.get("xmax", 0);
-                    int ymax = pt2.get("ymax", 0);
+                } else if (key == "difficult") {
+                    difficult = pt.data(v2) == "1";
+                }else if (key == "bndbox") {
+                    int xmin = pt.Get(v2, "xmin", 0);
+                    int ymin = pt.Get(v2, "ymin", 0);
+                    int xmax = pt.Get(v2, "xmax", 0);
+                    int ymax = pt.Get(v2, "ymax", 0);
                     CHECK_NOTNULL(anno);
                     LOG_IF(WARNING, xmin > width) << labelfile <<
                         " bounding box exceeds image boundary.";
@@ -432,17 +528,17 @@ bool ReadXMLToAnnotatedDatum(const string& labelfile, const int img_height,
                     bbox->set_xmax(static_cast<float>(xmax) / width);
                     bbox->set_ymax(static_cast<float>(ymax) / height);
                     bbox->set_difficult(difficult);
-                }else if (v2.first == "lm"){
-                    lm_x1 = pt2.get<float>("x1", 0);
-                    lm_y1 = pt2.get<float>("y1", 0);
-                    lm_x2 = pt2.get<float>("x2", 0);
-                    lm_y2 = pt2.get<float>("y2", 0);
-                    lm_x3 = pt2.get<float>("x3", 0);
-                    lm_y3 = pt2.get<float>("y3", 0);
-                    lm_x4 = pt2.get<float>("x4", 0);
-                    lm_y4 = pt2.get<float>("y4", 0);
-                    lm_x5 = pt2.get<float>("x5", 0);
-                    lm_y5 = pt2.get<float>("y5", 0);
+                }else if (key == "lm"){
+                    lm_x1 = pt.Get(v2, "x1", 0.f);
+                    lm_y1 = pt.Get(v2, "y1", 0.f);
+                    lm_x2 = pt.Get(v2, "x2", 0.f);
+                    lm_y2 = pt.Get(v2, "y2", 0.f);
+                    lm_x3 = pt.Get(v2, "x3", 0.f);
+                    lm_y3 = pt.Get(v2, "y3", 0.f);
+                    lm_x4 = pt.Get(v2, "x4", 0.f);
+                    lm_y4 = pt.Get(v2, "y4", 0.f);
+                    lm_x5 = pt.Get(v2, "x5", 0.f);
+                    lm_y5 = pt.Get(v2, "y5", 0.f);
                     CHECK_NOTNULL(anno);
                     AnnoFaceLandmarks* lmarks = anno->mutable_face_lm();
                     lmarks->mutable_lefteye()->set_x(static_cast<float>(lm_x1 / width));
@@ -456,8 +552,8 @@ bool ReadXMLToAnnotatedDatum(const string& labelfile, const int img_height,
                     lmarks->mutable_rightmouth()->set_x(static_cast<float>(lm_x5 / width));
                     lmarks->mutable_rightmouth()->set_y(static_cast<float>(lm_y5 / height));
                     anno->set_has_lm(1);
-                }else if (v2.first == "has_lm"){
-                    has_lm = pt2.data() == "0";
+                }else if (key == "has_lm"){
+                    has_lm = pt.data(v2) == "0";
                     if(has_lm){
                         anno->set_has_lm(0);
                     }
@@ -465,36 +561,37 @@ bool ReadXMLToAnnotatedDatum(const string& labelfile, const int img_height,
             }
         }
     }
-    #if 1
-    int group_size = anno_datum->annotation_group_size();
-    LOG(INFO)<<"group_size: "<<group_size;
-    for(int nn = 0; nn< group_size; nn++)
-    {
-        const AnnotationGroup anno_group = anno_datum->annotation_group(nn);
-        LOG(INFO) << "=============================";
-        LOG(INFO) <<"anno_group label: "<<anno_group.group_label();
-        int anno_size = anno_group.annotation_size();
-        for(int jj=0; jj<anno_size; jj++)
+    // Dump what was parsed.
+    if (VLOG_IS_ON(1)) {
+        int group_size = anno_datum->annotation_group_size();
+        LOG(INFO)<<"group_size: "<<group_size;
+        for(int nn = 0; nn< group_size; nn++)
         {
-            const Annotation anno = anno_group.annotation(jj);
-            LOG(INFO)<< "anno_instance_id: "<<anno.instance_id();
-            NormalizedBBox bbox = anno.bbox();
-            LOG(INFO) << "bbox->xmin: "<<bbox.xmin()<<" bbox->ymin: "<<bbox.ymin()
-                        <<" bbox->xmax: "<<bbox.xmax()<<" bbox->ymax: "<<bbox.ymax()
-                        <<" bbox->label: "<<bbox.label();
-
-            int has_lm = anno.has_lm();
-            if(has_lm >0){
-                AnnoFaceLandmarks lm = anno.face_lm();
-                LOG(INFO) <<"lefteye: "<<lm.lefteye().x()<<", "<<lm.lefteye().y()
-                          <<" righteye: "<<lm.righteye().x()<<", "<<lm.righteye().y()
-                          <<" nose: "<<lm.nose().x()<<", "<<lm.nose().y()
-                          <<" leftmouth: "<<lm.leftmouth().x()<<", "<<lm.leftmouth().y()
-                          <<" rightmouth: "<<lm.rightmouth().x()<<", "<<lm.rightmouth().y();
+            const AnnotationGroup anno_group = anno_datum->annotation_group(nn);
+            LOG(INFO) << "=============================";
+            LOG(INFO) <<"anno_group label: "<<anno_group.group_label();
+            int anno_size = anno_group.annotation_size();
+            for(int jj=0; jj<anno_size; jj++)
+            {
+                const Annotation anno = anno_group.annotation(jj);
+                LOG(INFO)<< "anno_instance_id: "<<anno.instance_id();
+                NormalizedBBox bbox = anno.bbox();
+                LOG(INFO) << "bbox->xmin: "<<bbox.xmin()<<" bbox->ymin: "<<bbox.ymin()
+                            <<" bbox->xmax: "<<bbox.xmax()<<" bbox->ymax: "<<bbox.ymax()
+                            <<" bbox->label: "<<bbox.label();
+
+                int has_lm = anno.has_lm();
+                if(has_lm >0){
+                    AnnoFaceLandmarks lm = anno.face_lm();
+                    LOG(INFO) <<"lefteye: "<<lm.lefteye().x()<<", "<<lm.lefteye().y()
+                              <<" righteye: "<<lm.righteye().x()<<", "<<lm.righteye().y()
+                              <<" nose: "<<lm.nose().x()<<", "<<lm.nose().y()
+                              <<" leftmouth: "<<lm.leftmouth().x()<<", "<<lm.leftmouth().y()
+                              <<" rightmouth: "<<lm.rightmouth().x()<<", "<<lm.rightmouth().y();
+                }
             }
         }
     }
-    #endif
     return true;
 }
 
@@ -502,16 +599,14 @@ bool ReadXMLToAnnotatedDatum(const string& labelfile, const int img_height,
 bool ReadJSONToAnnotatedDatum(const string& labelfile, const int img_height,
     const int img_width, const std::map<string, int>& name_to_label,
     AnnotatedDatum* anno_datum) {
-  ptree pt;
-  read_json(labelfile, pt);
+  const AnnotationTree& pt = ReadAnnotationTree(labelfile, true);
 
   // Get image info.
   int width = 0, height = 0;
-  try {
-    height = pt.get<int>("image.height");
-    width = pt.get<int>("image.width");
-  } catch (const ptree_error &e) {
-    LOG(WARNING) << "When parsing " << labelfile << ": " << e.what();
+  if (!pt.Get(pt.root(), "image.height", &height) ||
+      !pt.Get(pt.root(), "image.width", &width)) {
+    LOG(WARNING) << "When parsing " << labelfile
+        << ": no valid image.height/width";
     height = img_height;
     width = img_width;
   }
@@ -523,13 +618,17 @@ bool ReadJSONToAnnotatedDatum(const string& labelfile, const int img_height,
       " no valid image width/height.";
 
   // Get annotation info.
+  const int annotation = pt.Find(pt.root(), "annotation");
+  CHECK_GE(annotation, 0) << labelfile << " has no annotation.";
   int instance_id = 0;
-  BOOST_FOREACH(ptree::value_type& v1, pt.get_child("annotation")) {
+  for (int object = pt.first_child(annotation); object >= 0;
+       object = pt.next_sibling(object)) {
     Annotation* anno = NULL;
     bool iscrowd = false;
-    ptree object = v1.second;
     // Get category_id.
-    string name = object.get<string>("category_id");
+    string name;
+    const bool has_name = pt.Get(object, "category_id", &name);
+    CHECK(has_name) << labelfile << " annotation without category_id.";
     if (name_to_label.find(name) == name_to_label.end()) {
       LOG(FATAL) << "Unknown name: " << name;
     }
@@ -559,12 +658,18 @@ bool ReadJSONToAnnotatedDatum(const string& labelfile, const int img_height,
     anno->set_instance_id(instance_id++);
 
     // Get iscrowd.
-    iscrowd = object.get<int>("iscrowd", 0);
+    iscrowd = pt.Get(object, "iscrowd", 0);
 
     // Get bbox.
+    const int bbox_node = pt.Find(object, "bbox");
+    CHECK_GE(bbox_node, 0) << labelfile << " annotation without bbox.";
     vector<float> bbox_items;
-    BOOST_FOREACH(ptree::value_type& v2, object.get_child("bbox")) {
-      bbox_items.push_back(v2.second.get_value<float>());
+    for (int v2 = pt.first_child(bbox_node); v2 >= 0;
+         v2 = pt.next_sibling(v2)) {
+      float item = 0;
+      const bool converted = AnnotationTree::ToFloat(pt.data(v2), &item);
+      CHECK(converted) << labelfile << " bad bbox value " << pt.data(v2);
+      bbox_items.push_back(item);
     }
     CHECK_EQ(bbox_items.size(), 4);
     float xmin = bbox_items[0];
@@ -889,8 +994,9 @@ cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  cv_img = cv::imdecode(vec_data, -1);
+  // Decode in place, the encoded bytes can be large.
+  cv::Mat buf(1, data.size(), CV_8UC1, const_cast<char*>(data.data()));
+  cv_img = cv::imdecode(buf, -1);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
@@ -900,16 +1006,82 @@ cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
+  // Decode in place, the encoded bytes can be large.
+  cv::Mat buf(1, data.size(), CV_8UC1, const_cast<char*>(data.data()));
   int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
     CV_LOAD_IMAGE_GRAYSCALE);
-  cv_img = cv::imdecode(vec_data, cv_read_flag);
+  cv_img = cv::imdecode(buf, cv_read_flag);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
   return cv_img;
 }
 
+// The imdecode flag that decodes the JPEG data reduced by 2, 4 or 8, the
+// largest factor that keeps it at least min_height x min_width, or
+// cv_read_flag for other images and sizes that are not set.
+static int ReducedReadFlag(const string& data, int min_height, int min_width,
+    int cv_read_flag) {
+  int flag = cv_read_flag;
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2)
+  int height, width, channels;
+  if (min_height > 0 && min_width > 0 &&
+      GetJPEGSize(data, &height, &width, &channels)) {
+    // libjpeg rounds the reduced size up.
+    int reduction = 8;
+    while (reduction > 1 && ((height + reduction - 1) / reduction < min_height
+        || (width + reduction - 1) / reduction < min_width)) {
+      reduction /= 2;
+    }
+    const bool color = cv_read_flag == CV_LOAD_IMAGE_COLOR ||
+        (cv_read_flag < 0 && channels > 1);
+    switch (reduction) {
+    case 8:
+      flag = color ? cv::IMREAD_REDUCED_COLOR_8 :
+          cv::IMREAD_REDUCED_GRAYSCALE_8;
+      break;
+    case 4:
+      flag = color ? cv::IMREAD_REDUCED_COLOR_4 :
+          cv::IMREAD_REDUCED_GRAYSCALE_4;
+      break;
+    case 2:
+      flag = color ? cv::IMREAD_REDUCED_COLOR_2 :
+          cv::IMREAD_REDUCED_GRAYSCALE_2;
+      break;
+    default:
+      break;
+    }
+  }
+#endif
+  return flag;
+}
+
+cv::Mat DecodeDatumToCVMatReduced(const Datum& datum, int min_height,
+    int min_width, int cv_read_flag) {
+  CHECK(datum.encoded()) << "Datum not encoded";
+  const string& data = datum.data();
+  cv::Mat buf(1, data.size(), CV_8UC1, const_cast<char*>(data.data()));
+  cv::Mat cv_img = cv::imdecode(buf,
+      ReducedReadFlag(data, min_height, min_width, cv_read_flag));
+  if (!cv_img.data) {
+    LOG(ERROR) << "Could not decode datum ";
+  }
+  return cv_img;
+}
+
+cv::Mat DecodeImageToCVMatReduced(const string& data, const int height,
+    const int width, const bool is_color) {
+  const int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
+    CV_LOAD_IMAGE_GRAYSCALE);
+  cv::Mat buf(1, data.size(), CV_8UC1, const_cast<char*>(data.data()));
+  cv::Mat cv_img = cv::imdecode(buf,
+      ReducedReadFlag(data, height, width, cv_read_flag));
+  if (cv_img.data && height > 0 && width > 0) {
+    cv::resize(cv_img, cv_img, cv::Size(width, height));
+  }
+  return cv_img;
+}
+
 // If Datum is encoded will decoded using DecodeDatumToCVMat and CVMatToDatum
 // If Datum is not encoded will do nothing
 bool DecodeDatumNative(Datum* datum) {
@@ -0,0 +1,68 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "caffe/util/line_index.hpp"
+
+namespace caffe {
+
+bool LineIndex::Open(const string& filename) {
+  Close();
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  map_size_ = st.st_size;
+  if (map_size_ > 0) {
+    void* map = mmap(NULL, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      map_size_ = 0;
+      close(fd);
+      return false;
+    }
+    map_ = static_cast<char*>(map);
+    madvise(map_, map_size_, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  for (size_t begin = 0; begin < map_size_; ) {
+    const char* newline = static_cast<const char*>(
+        memchr(map_ + begin, '\n', map_size_ - begin));
+    const size_t end = newline ? newline - map_ : map_size_;
+    if (end > begin && !(end == begin + 1 && map_[begin] == '\r')) {
+      starts_.push_back(begin);
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
+void LineIndex::Close() {
+  if (map_) {
+    munmap(map_, map_size_);
+  }
+  map_ = NULL;
+  map_size_ = 0;
+  starts_.clear();
+}
+
+size_t LineIndex::line_size(int i) const {
+  const char* begin = line_data(i);
+  const char* newline = static_cast<const char*>(
+      memchr(begin, '\n', map_size_ - starts_[i]));
+  size_t size = newline ? newline - begin : map_size_ - starts_[i];
+  if (size > 0 && begin[size - 1] == '\r') {
+    --size;
+  }
+  return size;
+}
+
+}  // namespace caffe
@@ -5,6 +5,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -40,6 +41,24 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
       ldb, beta, C, N);
 }
 
+template<>
+void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+template<>
+void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
 template <>
 void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const float alpha, const float* A, const float* x,
@@ -263,9 +282,32 @@ void caffe_abs<double>(const int n, const double* a, double* y) {
 }
 
 unsigned int caffe_rng_rand() {
+  if (Philox* item_rng = ItemRNGScope::current()) {
+    return (*item_rng)();
+  }
   return (*caffe_rng())();
 }
 
+// Fills r with n values of distribution, drawn from the stream of the
+// current item if any, else from the thread's generator.
+template <typename Distribution, typename T>
+static void caffe_rng_fill(const Distribution& distribution, const int n,
+    T* r) {
+  if (Philox* item_rng = ItemRNGScope::current()) {
+    boost::variate_generator<Philox*, Distribution>
+        variate_generator(item_rng, distribution);
+    for (int i = 0; i < n; ++i) {
+      r[i] = variate_generator();
+    }
+  } else {
+    boost::variate_generator<caffe::rng_t*, Distribution>
+        variate_generator(caffe_rng(), distribution);
+    for (int i = 0; i < n; ++i) {
+      r[i] = variate_generator();
+    }
+  }
+}
+
 template <typename Dtype>
 Dtype caffe_nextafter(const Dtype b) {
   return boost::math::nextafter<Dtype>(
@@ -284,11 +326,7 @@ void caffe_rng_uniform(const int n, const Dtype a, const Dtype b, Dtype* r) {
   CHECK(r);
   CHECK_LE(a, b);
   boost::uniform_real<Dtype> random_distribution(a, caffe_nextafter<Dtype>(b));
-  boost::variate_generator<caffe::rng_t*, boost::uniform_real<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  caffe_rng_fill(random_distribution, n, r);
 }
 
 template
@@ -306,11 +344,7 @@ void caffe_rng_gaussian(const int n, const Dtype a,
   CHECK(r);
   CHECK_GT(sigma, 0);
   boost::normal_distribution<Dtype> random_distribution(a, sigma);
-  boost::variate_generator<caffe::rng_t*, boost::normal_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  caffe_rng_fill(random_distribution, n, r);
 }
 
 template
@@ -328,11 +362,7 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r) {
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
   boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  caffe_rng_fill(random_distribution, n, r);
 }
 
 template
@@ -348,11 +378,7 @@ void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r) {
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
   boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = static_cast<unsigned int>(variate_generator());
-  }
+  caffe_rng_fill(random_distribution, n, r);
 }
 
 template
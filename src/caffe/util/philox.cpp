@@ -0,0 +1,80 @@
+#include <boost/thread/tss.hpp>
+
+#include "caffe/util/philox.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The scopes own their streams, so the thread only holds a pointer.
+void DoNotDelete(Philox*) { }
+
+boost::thread_specific_ptr<Philox> current_item_rng(&DoNotDelete);
+
+inline void MulHiLo(uint32_t a, uint32_t b, uint32_t* hi, uint32_t* lo) {
+  const uint64_t product = static_cast<uint64_t>(a) * b;
+  *hi = static_cast<uint32_t>(product >> 32);
+  *lo = static_cast<uint32_t>(product);
+}
+
+}  // namespace
+
+Philox::Philox(uint64_t key, uint32_t c1, uint32_t c2, uint32_t c3)
+    : index_(4) {
+  key_[0] = static_cast<uint32_t>(key);
+  key_[1] = static_cast<uint32_t>(key >> 32);
+  counter_[0] = 0;
+  counter_[1] = c1;
+  counter_[2] = c2;
+  counter_[3] = c3;
+}
+
+void Philox::Bijection(const uint32_t key[2], const uint32_t counter[4],
+    uint32_t out[4]) {
+  const uint32_t kMul0 = 0xD2511F53;
+  const uint32_t kMul1 = 0xCD9E8D57;
+  const uint32_t kWeyl0 = 0x9E3779B9;
+  const uint32_t kWeyl1 = 0xBB67AE85;
+  uint32_t k0 = key[0], k1 = key[1];
+  uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2],
+      c3 = counter[3];
+  for (int round = 0; round < 10; ++round) {
+    uint32_t hi0, lo0, hi1, lo1;
+    MulHiLo(kMul0, c0, &hi0, &lo0);
+    MulHiLo(kMul1, c2, &hi1, &lo1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += kWeyl0;
+    k1 += kWeyl1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+void Philox::Block() {
+  Bijection(key_, counter_, output_);
+  ++counter_[0];
+  index_ = 0;
+}
+
+ItemRNGScope::ItemRNGScope(uint64_t seed, uint64_t batch_id, int item_id)
+    : rng_(seed, static_cast<uint32_t>(item_id),
+           static_cast<uint32_t>(batch_id),
+           static_cast<uint32_t>(batch_id >> 32)),
+      previous_(current_item_rng.get()) {
+  current_item_rng.reset(&rng_);
+}
+
+ItemRNGScope::~ItemRNGScope() {
+  current_item_rng.reset(previous_);
+}
+
+Philox* ItemRNGScope::current() {
+  return current_item_rng.get();
+}
+
+}  // namespace caffe
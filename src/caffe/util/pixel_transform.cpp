@@ -0,0 +1,64 @@
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/pixel_transform.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void TransformHWCToCHW(const uint8_t* src, int src_step, int height,
+    int width, int channels, bool mirror, const Dtype* mean, Dtype scale,
+    Dtype* dst) {
+  CHECK_GT(channels, 0);
+  // Tables for up to 4 channels live on the stack.
+  Dtype stack_lut[4 * 256];
+  vector<Dtype> heap_lut;
+  Dtype* lut = stack_lut;
+  if (channels > 4) {
+    heap_lut.resize(channels * 256);
+    lut = &heap_lut[0];
+  }
+  for (int c = 0; c < channels; ++c) {
+    for (int v = 0; v < 256; ++v) {
+      const Dtype pixel = static_cast<Dtype>(v);
+      lut[c * 256 + v] = mean ? (pixel - mean[c]) * scale : pixel * scale;
+    }
+  }
+  // Writing mirrored rows backwards keeps the input read sequential.
+  const int plane = height * width;
+  const int first = mirror ? width - 1 : 0;
+  const int step = mirror ? -1 : 1;
+  for (int h = 0; h < height; ++h) {
+    const uint8_t* in = src + h * src_step;
+    Dtype* out = dst + h * width + first;
+    if (channels == 3) {
+      const Dtype* lut0 = lut;
+      const Dtype* lut1 = lut + 256;
+      const Dtype* lut2 = lut + 512;
+      for (int w = 0; w < width; ++w, in += 3, out += step) {
+        out[0] = lut0[in[0]];
+        out[plane] = lut1[in[1]];
+        out[2 * plane] = lut2[in[2]];
+      }
+    } else if (channels == 1) {
+      for (int w = 0; w < width; ++w, ++in, out += step) {
+        *out = lut[*in];
+      }
+    } else {
+      for (int w = 0; w < width; ++w, out += step) {
+        for (int c = 0; c < channels; ++c, ++in) {
+          out[c * plane] = lut[c * 256 + *in];
+        }
+      }
+    }
+  }
+}
+
+template void TransformHWCToCHW<float>(const uint8_t* src, int src_step,
+    int height, int width, int channels, bool mirror, const float* mean,
+    float scale, float* dst);
+template void TransformHWCToCHW<double>(const uint8_t* src, int src_step,
+    int height, int width, int channels, bool mirror, const double* mean,
+    double scale, double* dst);
+
+}  // namespace caffe
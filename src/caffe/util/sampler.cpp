@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <limits>
 #include <vector>
 
 #include "caffe/util/bbox_util.hpp"
@@ -13,6 +14,47 @@ using google::protobuf::RepeatedPtrField;
 
 namespace caffe {
 
+void BBoxArray::clear() {
+    xmin_.clear();
+    ymin_.clear();
+    xmax_.clear();
+    ymax_.clear();
+    area_.clear();
+}
+
+void BBoxArray::reserve(int n) {
+    xmin_.reserve(n);
+    ymin_.reserve(n);
+    xmax_.reserve(n);
+    ymax_.reserve(n);
+    area_.reserve(n);
+}
+
+void BBoxArray::push_back(const NormalizedBBox& bbox) {
+    xmin_.push_back(bbox.xmin());
+    ymin_.push_back(bbox.ymin());
+    xmax_.push_back(bbox.xmax());
+    ymax_.push_back(bbox.ymax());
+    area_.push_back(BBoxSize(bbox));
+}
+
+void BBoxArray::push_back(float xmin, float ymin, float xmax, float ymax) {
+    xmin_.push_back(xmin);
+    ymin_.push_back(ymin);
+    xmax_.push_back(xmax);
+    ymax_.push_back(ymax);
+    area_.push_back(xmax < xmin || ymax < ymin ? 0.f :
+                    (xmax - xmin) * (ymax - ymin));
+}
+
+void BBoxArray::Get(int i, NormalizedBBox* bbox) const {
+    bbox->Clear();
+    bbox->set_xmin(xmin_[i]);
+    bbox->set_ymin(ymin_[i]);
+    bbox->set_xmax(xmax_[i]);
+    bbox->set_ymax(ymax_[i]);
+}
+
 void GenerateJitterSamples(const AnnotatedDatum& anno_datum, float jitter, vector<NormalizedBBox>* sampled_bboxes)
 {
     NormalizedBBox sampled_bbox;
@@ -69,6 +111,17 @@ void GroupObjectBBoxes(const AnnotatedDatum& anno_datum,
     }
 }
 
+void GroupObjectBBoxes(const AnnotatedDatum& anno_datum,
+                       BBoxArray* object_bboxes) {
+    object_bboxes->clear();
+    for (int i = 0; i < anno_datum.annotation_group_size(); ++i) {
+        const AnnotationGroup& anno_group = anno_datum.annotation_group(i);
+        for (int j = 0; j < anno_group.annotation_size(); ++j) {
+            object_bboxes->push_back(anno_group.annotation(j).bbox());
+        }
+    }
+}
+
 bool SatisfySampleConstraint(const NormalizedBBox& sampled_bbox,
                              const vector<NormalizedBBox>& object_bboxes,
                              const SampleConstraint& sample_constraint) {
@@ -134,7 +187,114 @@ bool SatisfySampleConstraint(const NormalizedBBox& sampled_bbox,
     return found;
 }
 
-void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox, float orl_ratio) {
+void SatisfySampleConstraints(const BBoxArray& sampled_bboxes,
+                              const BBoxArray& object_bboxes,
+                              const SampleConstraint& sample_constraint,
+                              vector<char>* satisfied) {
+    const int num_samples = sampled_bboxes.size();
+    const int num_objects = object_bboxes.size();
+    // As in SatisfySampleConstraint, the first kind of constraint given
+    // decides: a sample is positive if one object passes it. Each kind divides
+    // the intersection by sample_weight * sample area + object_weight * object
+    // area - intersect_weight * intersection, so one loop serves all three.
+    float sample_weight, object_weight, intersect_weight;
+    bool has_min, has_max;
+    float min_value, max_value;
+    if (sample_constraint.has_min_jaccard_overlap() ||
+        sample_constraint.has_max_jaccard_overlap()) {
+        sample_weight = object_weight = intersect_weight = 1;
+        has_min = sample_constraint.has_min_jaccard_overlap();
+        has_max = sample_constraint.has_max_jaccard_overlap();
+        min_value = sample_constraint.min_jaccard_overlap();
+        max_value = sample_constraint.max_jaccard_overlap();
+    } else if (sample_constraint.has_min_sample_coverage() ||
+               sample_constraint.has_max_sample_coverage()) {
+        sample_weight = 1;
+        object_weight = intersect_weight = 0;
+        has_min = sample_constraint.has_min_sample_coverage();
+        has_max = sample_constraint.has_max_sample_coverage();
+        min_value = sample_constraint.min_sample_coverage();
+        max_value = sample_constraint.max_sample_coverage();
+    } else if (sample_constraint.has_min_object_coverage() ||
+               sample_constraint.has_max_object_coverage()) {
+        object_weight = 1;
+        sample_weight = intersect_weight = 0;
+        has_min = sample_constraint.has_min_object_coverage();
+        has_max = sample_constraint.has_max_object_coverage();
+        min_value = sample_constraint.min_object_coverage();
+        max_value = sample_constraint.max_object_coverage();
+    } else {
+        // By default, the sampled_bbox is "positive" if no constraints are defined.
+        satisfied->assign(num_samples, 1);
+        return;
+    }
+    if (!has_min) {
+        min_value = -std::numeric_limits<float>::infinity();
+    }
+    if (!has_max) {
+        max_value = std::numeric_limits<float>::infinity();
+    }
+    satisfied->resize(num_samples);
+    const float* object_xmin = object_bboxes.xmin();
+    const float* object_ymin = object_bboxes.ymin();
+    const float* object_xmax = object_bboxes.xmax();
+    const float* object_ymax = object_bboxes.ymax();
+    const float* object_area = object_bboxes.area();
+    for (int i = 0; i < num_samples; ++i) {
+        const float xmin = sampled_bboxes.xmin()[i];
+        const float ymin = sampled_bboxes.ymin()[i];
+        const float xmax = sampled_bboxes.xmax()[i];
+        const float ymax = sampled_bboxes.ymax()[i];
+        const float area = sample_weight * sampled_bboxes.area()[i];
+        int found = 0;
+        for (int j = 0; j < num_objects; ++j) {
+            const float width = std::min(xmax, object_xmax[j]) -
+                std::max(xmin, object_xmin[j]);
+            const float height = std::min(ymax, object_ymax[j]) -
+                std::max(ymin, object_ymin[j]);
+            const float intersect =
+                std::max(width, 0.f) * std::max(height, 0.f);
+            const float base = area + object_weight * object_area[j] -
+                intersect_weight * intersect;
+            const float value = intersect > 0 ? intersect / base : 0.f;
+            found |= !(value < min_value) & !(value > max_value);
+        }
+        (*satisfied)[i] = found;
+    }
+}
+
+// Number of trials drawn, then checked against the objects, at a time. The
+// trials stop at the end of the chunk in which max_sample samples are kept,
+// so only a few more are drawn than when checking them one at a time.
+static const int kTrialChunk = 8;
+
+// Keeps the first max_sample candidates, or all of them if max_sample < 0,
+// that satisfy sample_constraint, and returns their number.
+static int SelectSamples(const BBoxArray& candidates,
+                          const BBoxArray& object_bboxes,
+                          const SampleConstraint& sample_constraint,
+                          int max_sample,
+                          vector<NormalizedBBox>* sampled_bboxes) {
+    vector<char> satisfied;
+    SatisfySampleConstraints(candidates, object_bboxes, sample_constraint,
+                             &satisfied);
+    int found = 0;
+    for (int i = 0; i < candidates.size(); ++i) {
+        if (max_sample >= 0 && found >= max_sample) {
+            break;
+        }
+        if (satisfied[i]) {
+            ++found;
+            sampled_bboxes->push_back(NormalizedBBox());
+            candidates.Get(i, &sampled_bboxes->back());
+        }
+    }
+    return found;
+}
+
+// Draws a box in the normalized space [0, 1] as SampleBBox does, into
+// box = {xmin, ymin, xmax, ymax}.
+static void SampleBox(const Sampler& sampler, float* box) {
     // Get random scale.
     CHECK_GE(sampler.max_scale(), sampler.min_scale());
     CHECK_GT(sampler.min_scale(), 0.);
@@ -163,22 +323,29 @@ void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox, float orl_
     caffe_rng_uniform(1, 0.f, 1 - bbox_width, &w_off);
     caffe_rng_uniform(1, 0.f, 1 - bbox_height, &h_off);
 
-    sampled_bbox->set_xmin(w_off);
-    sampled_bbox->set_ymin(h_off);
-    sampled_bbox->set_xmax(w_off + bbox_width);
-    sampled_bbox->set_ymax(h_off + bbox_height);
+    box[0] = w_off;
+    box[1] = h_off;
+    box[2] = w_off + bbox_width;
+    box[3] = h_off + bbox_height;
 }
 
-void SampleBBox_Square(const AnnotatedDatum& anno_datum, const Sampler& sampler, NormalizedBBox* sampled_bbox) {
+void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox, float orl_ratio) {
+    float box[4];
+    SampleBox(sampler, box);
+    sampled_bbox->set_xmin(box[0]);
+    sampled_bbox->set_ymin(box[1]);
+    sampled_bbox->set_xmax(box[2]);
+    sampled_bbox->set_ymax(box[3]);
+}
+
+// Draws a box as SampleBBox_Square does, into box = {xmin, ymin, xmax, ymax}.
+static void SampleBox_Square(int datum_height, int datum_width,
+                             const Sampler& sampler, float* box) {
     // Get random scale.
     CHECK_GE(sampler.max_scale(), sampler.min_scale());
     CHECK_GT(sampler.min_scale(), 0.);
     CHECK_LE(sampler.max_scale(), 1.);
 
-    const Datum datum = anno_datum.datum();
-
-    int datum_height = datum.height();
-    int datum_width = datum.width();
     int min_side = datum_height;
     float min_side_scale = 0.0;
 
@@ -202,60 +369,87 @@ void SampleBBox_Square(const AnnotatedDatum& anno_datum, const Sampler& sampler,
     caffe_rng_uniform(1, 0.f, 1 - bbox_width, &w_off);
     caffe_rng_uniform(1, 0.f, 1 - bbox_height, &h_off);
 
-    sampled_bbox->set_xmin(w_off);
-    sampled_bbox->set_ymin(h_off);
-    sampled_bbox->set_xmax(w_off + bbox_width);
-    sampled_bbox->set_ymax(h_off + bbox_height);
+    box[0] = w_off;
+    box[1] = h_off;
+    box[2] = w_off + bbox_width;
+    box[3] = h_off + bbox_height;
 }
 
+void SampleBBox_Square(const AnnotatedDatum& anno_datum, const Sampler& sampler, NormalizedBBox* sampled_bbox) {
+    float box[4];
+    SampleBox_Square(anno_datum.datum().height(), anno_datum.datum().width(),
+                     sampler, box);
+    sampled_bbox->set_xmin(box[0]);
+    sampled_bbox->set_ymin(box[1]);
+    sampled_bbox->set_xmax(box[2]);
+    sampled_bbox->set_ymax(box[3]);
+}
 
+// Transforms box w.r.t. source_bbox as LocateBBox does, and appends it.
+static void LocateBox(const NormalizedBBox& source_bbox, const float* box,
+                      BBoxArray* located) {
+    const float src_width = source_bbox.xmax() - source_bbox.xmin();
+    const float src_height = source_bbox.ymax() - source_bbox.ymin();
+    located->push_back(source_bbox.xmin() + box[0] * src_width,
+                       source_bbox.ymin() + box[1] * src_height,
+                       source_bbox.xmin() + box[2] * src_width,
+                       source_bbox.ymin() + box[3] * src_height);
+}
 
+// The trials are drawn and checked kTrialChunk at a time; the samples kept
+// are the same as when checking them one at a time.
 void GenerateSamples(const NormalizedBBox& source_bbox,
-                     const vector<NormalizedBBox>& object_bboxes,
+                     const BBoxArray& object_bboxes,
                      const BatchSampler& batch_sampler,
                      vector<NormalizedBBox>* sampled_bboxes, float orl_ratio) {
+    const int max_sample = batch_sampler.has_max_sample() ?
+        batch_sampler.max_sample() : -1;
+    BBoxArray trials;
+    trials.reserve(kTrialChunk);
     int found = 0;
-    for (int i = 0; i < batch_sampler.max_trials(); ++i) {
-        if (batch_sampler.has_max_sample() &&
-            found >= batch_sampler.max_sample()) {
-        break;
-        }
-        // Generate sampled_bbox in the normalized space [0, 1].
-        NormalizedBBox sampled_bbox;
-        SampleBBox(batch_sampler.sampler(), &sampled_bbox, orl_ratio);
-        // Transform the sampled_bbox w.r.t. source_bbox.
-        LocateBBox(source_bbox, sampled_bbox, &sampled_bbox);
-        // Determine if the sampled bbox is positive or negative by the constraint.
-        if (SatisfySampleConstraint(sampled_bbox, object_bboxes,
-                                    batch_sampler.sample_constraint())) {
-        ++found;
-        sampled_bboxes->push_back(sampled_bbox);
+    for (int i = 0; i < batch_sampler.max_trials() &&
+         (max_sample < 0 || found < max_sample);) {
+        trials.clear();
+        for (; trials.size() < kTrialChunk &&
+             i < batch_sampler.max_trials(); ++i) {
+            // Generate a box in the normalized space [0, 1].
+            float box[4];
+            SampleBox(batch_sampler.sampler(), box);
+            LocateBox(source_bbox, box, &trials);
         }
+        found += SelectSamples(trials, object_bboxes,
+                               batch_sampler.sample_constraint(),
+                               max_sample < 0 ? -1 : max_sample - found,
+                               sampled_bboxes);
     }
 }
 
 void GenerateSamples_Square(const AnnotatedDatum& anno_datum,
                      const NormalizedBBox& source_bbox,
-                     const vector<NormalizedBBox>& object_bboxes,
+                     const BBoxArray& object_bboxes,
                      const BatchSampler& batch_sampler,
                      vector<NormalizedBBox>* sampled_bboxes) {
+    const int datum_height = anno_datum.datum().height();
+    const int datum_width = anno_datum.datum().width();
+    const int max_sample = batch_sampler.has_max_sample() ?
+        batch_sampler.max_sample() : -1;
+    BBoxArray trials;
+    trials.reserve(kTrialChunk);
     int found = 0;
-    for (int i = 0; i < batch_sampler.max_trials(); ++i) {
-        if (batch_sampler.has_max_sample() &&
-            found >= batch_sampler.max_sample()) {
-        break;
-        }
-        // Generate sampled_bbox in the normalized space [0, 1].
-        NormalizedBBox sampled_bbox;
-        SampleBBox_Square(anno_datum, batch_sampler.sampler(), &sampled_bbox);
-        // Transform the sampled_bbox w.r.t. source_bbox.
-        LocateBBox(source_bbox, sampled_bbox, &sampled_bbox);
-        // Determine if the sampled bbox is positive or negative by the constraint.
-        if (SatisfySampleConstraint(sampled_bbox, object_bboxes,
-                                    batch_sampler.sample_constraint())) {
-            ++found;
-            sampled_bboxes->push_back(sampled_bbox);
+    for (int i = 0; i < batch_sampler.max_trials() &&
+         (max_sample < 0 || found < max_sample);) {
+        trials.clear();
+        for (; trials.size() < kTrialChunk &&
+             i < batch_sampler.max_trials(); ++i) {
+            float box[4];
+            SampleBox_Square(datum_height, datum_width,
+                             batch_sampler.sampler(), box);
+            LocateBox(source_bbox, box, &trials);
         }
+        found += SelectSamples(trials, object_bboxes,
+                               batch_sampler.sample_constraint(),
+                               max_sample < 0 ? -1 : max_sample - found,
+                               sampled_bboxes);
     }
 }
 
@@ -264,7 +458,7 @@ void GenerateBatchSamples(const AnnotatedDatum& anno_datum,
                           const vector<BatchSampler>& batch_samplers,
                           vector<NormalizedBBox>* sampled_bboxes) {
     sampled_bboxes->clear();
-    vector<NormalizedBBox> object_bboxes;
+    BBoxArray object_bboxes;
     GroupObjectBBoxes(anno_datum, &object_bboxes);
     const int img_height = anno_datum.datum().height();
     const int img_width = anno_datum.datum().width();
@@ -286,7 +480,7 @@ void GenerateBatchSamples_Square(const AnnotatedDatum& anno_datum,
                           const vector<BatchSampler>& batch_samplers,
                           vector<NormalizedBBox>* sampled_bboxes) {
     sampled_bboxes->clear();
-    vector<NormalizedBBox> object_bboxes;
+    BBoxArray object_bboxes;
     GroupObjectBBoxes(anno_datum, &object_bboxes);
     for (int i = 0; i < batch_samplers.size(); ++i) {
         if (batch_samplers[i].use_original_image()) {
@@ -381,24 +575,35 @@ void GenerateBatchDataAnchorSamples(const AnnotatedDatum& anno_datum,
     CHECK_EQ(data_anchor_samplers.size(), 1);
     vector<NormalizedBBox> object_bboxes;
     GroupObjectBBoxes(anno_datum, &object_bboxes);
+    BBoxArray object_array;
+    for (int i = 0; i < object_bboxes.size(); ++i) {
+        object_array.push_back(object_bboxes[i]);
+    }
     for (int i = 0; i < data_anchor_samplers.size(); ++i) {
         if (data_anchor_samplers[i].use_original_image()) {
-            int found = 0;
+            const DataAnchorSampler& sampler = data_anchor_samplers[i];
             NormalizedBBox sampled_bbox;
-            for (int j = 0; j < data_anchor_samplers[i].max_trials(); ++j) {
-                if (data_anchor_samplers[i].has_max_sample() &&
-                    found >= data_anchor_samplers[i].max_sample()) {
-                break;
-                }
-                GenerateDataAnchorSample(anno_datum, data_anchor_samplers[i], object_bboxes, 
-                                        &sampled_bbox);
-                if (SatisfySampleConstraint(sampled_bbox, object_bboxes,
-                                            data_anchor_samplers[i].sample_constraint())){
-                    found++;
-                    sampled_bboxes->push_back(sampled_bbox);
+            const int max_sample =
+                sampler.has_max_sample() ? sampler.max_sample() : -1;
+            BBoxArray trials;
+            trials.reserve(kTrialChunk);
+            int found = 0;
+            for (int j = 0; j < sampler.max_trials() &&
+                 (max_sample < 0 || found < max_sample);) {
+                trials.clear();
+                for (; trials.size() < kTrialChunk &&
+                     j < sampler.max_trials(); ++j) {
+                    GenerateDataAnchorSample(anno_datum, sampler,
+                                             object_bboxes, &sampled_bbox);
+                    trials.push_back(sampled_bbox);
                 }
+                found += SelectSamples(trials, object_array,
+                                       sampler.sample_constraint(),
+                                       max_sample < 0 ? -1 : max_sample - found,
+                                       sampled_bboxes);
             }
             if(found == 0){
+                sampled_bbox.Clear();
                 sampled_bbox.set_xmin(0.f);
                 sampled_bbox.set_ymin(0.f);
                 sampled_bbox.set_xmax(1.f);
@@ -0,0 +1,145 @@
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+// With the usual notation, kernel_tr = G g G^T, input_tr = B^T d B and
+// output = A^T m A, where
+//   G = [1 0 0; 1/2 1/2 1/2; 1/2 -1/2 1/2; 0 0 1],
+//   B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1],
+//   A^T = [1 1 1 0; 0 1 -1 -1].
+
+template <typename Dtype>
+void winograd_kernel_transform_cpu(const Dtype* kernel, const int num_output,
+    const int channels, Dtype* kernel_tr) {
+  const int matrix_size = num_output * channels;
+  const int matrix_stride = winograd_matrix_stride(matrix_size);
+  for (int i = 0; i < matrix_size; ++i, kernel += 9) {
+    // G g
+    Dtype t[4][3];
+    for (int j = 0; j < 3; ++j) {
+      t[0][j] = kernel[j];
+      t[1][j] = (kernel[j] + kernel[3 + j] + kernel[6 + j]) / 2;
+      t[2][j] = (kernel[j] - kernel[3 + j] + kernel[6 + j]) / 2;
+      t[3][j] = kernel[6 + j];
+    }
+    // (G g) G^T
+    for (int j = 0; j < 4; ++j) {
+      Dtype* u = kernel_tr + j * 4 * matrix_stride + i;
+      u[0] = t[j][0];
+      u[matrix_stride] = (t[j][0] + t[j][1] + t[j][2]) / 2;
+      u[2 * matrix_stride] = (t[j][0] - t[j][1] + t[j][2]) / 2;
+      u[3 * matrix_stride] = t[j][2];
+    }
+  }
+}
+
+template <typename Dtype>
+void winograd_input_transform_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    Dtype* input_tr) {
+  const int tiles_h = (height + 2 * pad_h - 1) / 2;
+  const int tiles_w = (width + 2 * pad_w - 1) / 2;
+  const int num_tiles = tiles_h * tiles_w;
+  const int matrix_stride = winograd_matrix_stride(channels * num_tiles);
+  for (int c = 0; c < channels; ++c, data_im += height * width) {
+    Dtype* tile_tr = input_tr + c * num_tiles;
+    for (int tile_row = 0; tile_row < tiles_h; ++tile_row) {
+      const int row = tile_row * 2 - pad_h;
+      for (int tile_col = 0; tile_col < tiles_w; ++tile_col, ++tile_tr) {
+        const int col = tile_col * 2 - pad_w;
+        Dtype d[4][4];
+        if (row >= 0 && row + 4 <= height && col >= 0 && col + 4 <= width) {
+          const Dtype* src = data_im + row * width + col;
+          for (int i = 0; i < 4; ++i, src += width) {
+            for (int j = 0; j < 4; ++j) {
+              d[i][j] = src[j];
+            }
+          }
+        } else {
+          for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+              d[i][j] = (row + i >= 0 && row + i < height &&
+                         col + j >= 0 && col + j < width) ?
+                  data_im[(row + i) * width + col + j] : Dtype(0);
+            }
+          }
+        }
+        // B^T d
+        Dtype t[4][4];
+        for (int j = 0; j < 4; ++j) {
+          t[0][j] = d[0][j] - d[2][j];
+          t[1][j] = d[1][j] + d[2][j];
+          t[2][j] = d[2][j] - d[1][j];
+          t[3][j] = d[1][j] - d[3][j];
+        }
+        // (B^T d) B
+        for (int i = 0; i < 4; ++i) {
+          Dtype* v = tile_tr + i * 4 * matrix_stride;
+          v[0] = t[i][0] - t[i][2];
+          v[matrix_stride] = t[i][1] + t[i][2];
+          v[2 * matrix_stride] = t[i][2] - t[i][1];
+          v[3 * matrix_stride] = t[i][1] - t[i][3];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void winograd_output_transform_cpu(const Dtype* output_tr,
+    const int num_output, const int output_h, const int output_w,
+    Dtype* data_out) {
+  const int tiles_h = (output_h + 1) / 2;
+  const int tiles_w = (output_w + 1) / 2;
+  const int num_tiles = tiles_h * tiles_w;
+  const int matrix_stride = winograd_matrix_stride(num_output * num_tiles);
+  for (int o = 0; o < num_output; ++o, data_out += output_h * output_w) {
+    const Dtype* tile_tr = output_tr + o * num_tiles;
+    for (int tile_row = 0; tile_row < tiles_h; ++tile_row) {
+      const int row = tile_row * 2;
+      for (int tile_col = 0; tile_col < tiles_w; ++tile_col, ++tile_tr) {
+        const int col = tile_col * 2;
+        Dtype m[4][4];
+        for (int i = 0; i < 4; ++i) {
+          for (int j = 0; j < 4; ++j) {
+            m[i][j] = tile_tr[(i * 4 + j) * matrix_stride];
+          }
+        }
+        // A^T m
+        Dtype t[2][4];
+        for (int j = 0; j < 4; ++j) {
+          t[0][j] = m[0][j] + m[1][j] + m[2][j];
+          t[1][j] = m[1][j] - m[2][j] - m[3][j];
+        }
+        // (A^T m) A, cropped to the output
+        for (int i = 0; i < 2 && row + i < output_h; ++i) {
+          Dtype* y = data_out + (row + i) * output_w + col;
+          y[0] = t[i][0] + t[i][1] + t[i][2];
+          if (col + 1 < output_w) {
+            y[1] = t[i][1] - t[i][2] - t[i][3];
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void winograd_kernel_transform_cpu<float>(const float* kernel,
+    const int num_output, const int channels, float* kernel_tr);
+template void winograd_kernel_transform_cpu<double>(const double* kernel,
+    const int num_output, const int channels, double* kernel_tr);
+template void winograd_input_transform_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, float* input_tr);
+template void winograd_input_transform_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, double* input_tr);
+template void winograd_output_transform_cpu<float>(const float* output_tr,
+    const int num_output, const int output_h, const int output_w,
+    float* data_out);
+template void winograd_output_transform_cpu<double>(const double* output_tr,
+    const int num_output, const int output_h, const int output_w,
+    double* data_out);
+
+}  // namespace caffe
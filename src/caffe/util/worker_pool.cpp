@@ -0,0 +1,65 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+
+#include "caffe/util/worker_pool.hpp"
+
+namespace caffe {
+
+WorkerPool::WorkerPool(int num_workers)
+    : num_workers_(num_workers) {
+  CHECK_GE(num_workers, 1) << "A worker pool needs at least one worker.";
+  for (int i = 1; i < num_workers_; ++i) {
+    workers_.push_back(shared_ptr<Worker>(new Worker(this, i)));
+    workers_.back()->StartInternalThread();
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  // Joins the worker threads before the queues they wait on go away.
+  workers_.clear();
+}
+
+void WorkerPool::Run(int num_items, const Job& job) {
+  if (num_items <= 0) {
+    return;
+  }
+  job_ = job;
+  const int num_active = std::min(num_workers_, num_items);
+  // Pushing onto the task queues publishes job_ to the workers.
+  for (int i = 1; i < num_active; ++i) {
+    workers_[i - 1]->tasks_.push(num_items);
+  }
+  RunShare(num_items, 0);
+  for (int i = 1; i < num_active; ++i) {
+    done_.pop();
+  }
+}
+
+void WorkerPool::RunShare(int num_items, int worker_id) {
+  for (int item_id = worker_id; item_id < num_items;
+       item_id += num_workers_) {
+    job_(item_id, worker_id);
+  }
+}
+
+WorkerPool::Worker::Worker(WorkerPool* pool, int id)
+    : tasks_(), pool_(pool), id_(id) {
+}
+
+WorkerPool::Worker::~Worker() {
+  StopInternalThread();
+}
+
+void WorkerPool::Worker::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      int num_items = tasks_.pop();
+      pool_->RunShare(num_items, id_);
+      pool_->done_.push(id_);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,29 @@
+#include <algorithm>
+
+#include "caffe/workspace.hpp"
+
+namespace caffe {
+
+void* Workspace::mutable_cpu_data(size_t size) {
+  if (!cpu_data_ || cpu_data_->size() < size) {
+    // The old contents need not be kept, so free them first.
+    cpu_data_.reset();
+    cpu_data_.reset(new SyncedMemory(std::max(size, reserved_size_)));
+  }
+  return cpu_data_->mutable_cpu_data();
+}
+
+void* Workspace::mutable_gpu_data(size_t size) {
+#ifndef CPU_ONLY
+  if (!gpu_data_ || gpu_data_->size() < size) {
+    gpu_data_.reset();
+    gpu_data_.reset(new SyncedMemory(std::max(size, reserved_size_)));
+  }
+  return gpu_data_->mutable_gpu_data();
+#else
+  NO_GPU;
+  return NULL;
+#endif
+}
+
+}  // namespace caffe
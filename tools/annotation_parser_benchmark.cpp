@@ -0,0 +1,245 @@
+// Times the reading of XML or JSON annotation files into AnnotatedDatum, as
+// done by convert_annoset, with a boost::property_tree reader equivalent to
+// the one ReadXMLToAnnotatedDatum and ReadJSONToAnnotatedDatum used to have
+// and with the AnnotationTree based readers, and checks that both give the
+// same protos. Labels are numbered in order of first appearance.
+// Usage:
+//    annotation_parser_benchmark [FLAGS] LISTFILE
+//
+// where LISTFILE has the path of one annotation file per line.
+
+#include <boost/foreach.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/annotation_tree.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using boost::property_tree::ptree;
+using std::map;
+using std::string;
+using std::vector;
+
+DEFINE_string(anno_type, "xml", "The type of the annotation files: xml or "
+    "json.");
+DEFINE_int32(iterations, 1, "Number of passes over the files per reader.");
+
+// Appends an annotation to the group of label, numbered after the last one.
+static Annotation* AddAnnotation(int label, AnnotatedDatum* anno_datum) {
+  AnnotationGroup* group = NULL;
+  for (int g = 0; g < anno_datum->annotation_group_size(); ++g) {
+    if (anno_datum->annotation_group(g).group_label() == label) {
+      group = anno_datum->mutable_annotation_group(g);
+    }
+  }
+  if (!group) {
+    group = anno_datum->add_annotation_group();
+    group->set_group_label(label);
+  }
+  const int instance_id = group->annotation_size() == 0 ? 0 :
+      group->annotation(group->annotation_size() - 1).instance_id() + 1;
+  Annotation* anno = group->add_annotation();
+  anno->set_instance_id(instance_id);
+  return anno;
+}
+
+// The property_tree reading of ReadXMLToAnnotatedDatum, without the checks.
+static void ReferenceReadXML(const string& labelfile, int img_height,
+    int img_width, const map<string, int>& name_to_label,
+    AnnotatedDatum* anno_datum) {
+  ptree pt;
+  read_xml(labelfile, pt);
+  int width = 0, height = 0;
+  try {
+    height = pt.get<int>("annotation.size.height");
+    width = pt.get<int>("annotation.size.width");
+  } catch (const boost::property_tree::ptree_error &e) {
+    height = img_height;
+    width = img_width;
+  }
+  BOOST_FOREACH(ptree::value_type& v1, pt.get_child("annotation")) {
+    if (v1.first != "object") {
+      continue;
+    }
+    Annotation* anno = NULL;
+    bool difficult = false;
+    BOOST_FOREACH(ptree::value_type& v2, v1.second) {
+      const ptree& pt2 = v2.second;
+      if (v2.first == "name") {
+        anno = AddAnnotation(name_to_label.find(pt2.data())->second,
+            anno_datum);
+      } else if (v2.first == "difficult") {
+        difficult = pt2.data() == "1";
+      } else if (v2.first == "bndbox") {
+        NormalizedBBox* bbox = anno->mutable_bbox();
+        bbox->set_xmin(static_cast<float>(pt2.get("xmin", 0)) / width);
+        bbox->set_ymin(static_cast<float>(pt2.get("ymin", 0)) / height);
+        bbox->set_xmax(static_cast<float>(pt2.get("xmax", 0)) / width);
+        bbox->set_ymax(static_cast<float>(pt2.get("ymax", 0)) / height);
+        bbox->set_difficult(difficult);
+      } else if (v2.first == "lm") {
+        AnnoFaceLandmarks* lm = anno->mutable_face_lm();
+        lm->mutable_lefteye()->set_x(pt2.get<float>("x1", 0) / width);
+        lm->mutable_lefteye()->set_y(pt2.get<float>("y1", 0) / height);
+        lm->mutable_righteye()->set_x(pt2.get<float>("x2", 0) / width);
+        lm->mutable_righteye()->set_y(pt2.get<float>("y2", 0) / height);
+        lm->mutable_nose()->set_x(pt2.get<float>("x3", 0) / width);
+        lm->mutable_nose()->set_y(pt2.get<float>("y3", 0) / height);
+        lm->mutable_leftmouth()->set_x(pt2.get<float>("x4", 0) / width);
+        lm->mutable_leftmouth()->set_y(pt2.get<float>("y4", 0) / height);
+        lm->mutable_rightmouth()->set_x(pt2.get<float>("x5", 0) / width);
+        lm->mutable_rightmouth()->set_y(pt2.get<float>("y5", 0) / height);
+        anno->set_has_lm(1);
+      } else if (v2.first == "has_lm" && pt2.data() == "0") {
+        anno->set_has_lm(0);
+      }
+    }
+  }
+}
+
+// The property_tree reading of ReadJSONToAnnotatedDatum, without the checks.
+static void ReferenceReadJSON(const string& labelfile, int img_height,
+    int img_width, const map<string, int>& name_to_label,
+    AnnotatedDatum* anno_datum) {
+  ptree pt;
+  read_json(labelfile, pt);
+  int width = 0, height = 0;
+  try {
+    height = pt.get<int>("image.height");
+    width = pt.get<int>("image.width");
+  } catch (const boost::property_tree::ptree_error &e) {
+    height = img_height;
+    width = img_width;
+  }
+  BOOST_FOREACH(ptree::value_type& v1, pt.get_child("annotation")) {
+    const ptree& object = v1.second;
+    Annotation* anno = AddAnnotation(
+        name_to_label.find(object.get<string>("category_id"))->second,
+        anno_datum);
+    const bool iscrowd = object.get<int>("iscrowd", 0);
+    vector<float> items;
+    BOOST_FOREACH(const ptree::value_type& v2, object.get_child("bbox")) {
+      items.push_back(v2.second.get_value<float>());
+    }
+    CHECK_EQ(items.size(), 4);
+    NormalizedBBox* bbox = anno->mutable_bbox();
+    bbox->set_xmin(items[0] / width);
+    bbox->set_ymin(items[1] / height);
+    bbox->set_xmax((items[0] + items[2]) / width);
+    bbox->set_ymax((items[1] + items[3]) / height);
+    bbox->set_difficult(iscrowd);
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::SetUsageMessage("Benchmark the annotation file readers\n"
+        "Usage:\n"
+        "    annotation_parser_benchmark [FLAGS] LISTFILE\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc < 2) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/annotation_parser_benchmark");
+    return 1;
+  }
+  const bool json = FLAGS_anno_type == "json";
+  CHECK(json || FLAGS_anno_type == "xml") << "Unknown anno_type "
+      << FLAGS_anno_type;
+
+  // Collect the files, their image sizes and their labels, untimed.
+  std::ifstream infile(argv[1]);
+  vector<string> files;
+  vector<std::pair<int, int> > sizes;
+  map<string, int> name_to_label;
+  AnnotationTree tree;
+  string file;
+  while (infile >> file) {
+    std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+    CHECK(in) << "Could not open " << file;
+    const string text((std::istreambuf_iterator<char>(in)),
+        std::istreambuf_iterator<char>());
+    string error;
+    CHECK(json ? tree.ParseJSON(text.data(), text.size(), &error) :
+        tree.ParseXML(text.data(), text.size(), &error))
+        << file << ": " << error;
+    int height = 0, width = 0;
+    CHECK(tree.Get(tree.root(), json ? "image.height" :
+        "annotation.size.height", &height) && tree.Get(tree.root(),
+        json ? "image.width" : "annotation.size.width", &width))
+        << file << " has no image size.";
+    const int annotation = tree.Find(tree.root(), "annotation");
+    for (int object = annotation < 0 ? -1 : tree.first_child(annotation);
+         object >= 0; object = tree.next_sibling(object)) {
+      string name;
+      if (json ? tree.Get(object, "category_id", &name) :
+          tree.key(object) == "object" && tree.Get(object, "name", &name)) {
+        name_to_label.insert(std::make_pair(name,
+            static_cast<int>(name_to_label.size()) + 1));
+      }
+    }
+    files.push_back(file);
+    sizes.push_back(std::make_pair(height, width));
+  }
+  CHECK(!files.empty()) << "No files in " << argv[1];
+
+  vector<AnnotatedDatum> expected(files.size());
+  vector<AnnotatedDatum> out(files.size());
+  CPUTimer timer;
+  timer.Start();
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    for (int i = 0; i < files.size(); ++i) {
+      expected[i].Clear();
+      if (json) {
+        ReferenceReadJSON(files[i], sizes[i].first, sizes[i].second,
+            name_to_label, &expected[i]);
+      } else {
+        ReferenceReadXML(files[i], sizes[i].first, sizes[i].second,
+            name_to_label, &expected[i]);
+      }
+    }
+  }
+  const double reference_ms = timer.MilliSeconds();
+  timer.Start();
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    for (int i = 0; i < files.size(); ++i) {
+      out[i].Clear();
+      if (json) {
+        ReadJSONToAnnotatedDatum(files[i], sizes[i].first, sizes[i].second,
+            name_to_label, &out[i]);
+      } else {
+        ReadXMLToAnnotatedDatum(files[i], sizes[i].first, sizes[i].second,
+            name_to_label, &out[i]);
+      }
+    }
+  }
+  const double fast_ms = timer.MilliSeconds();
+  for (int i = 0; i < files.size(); ++i) {
+    CHECK_EQ(out[i].SerializeAsString(), expected[i].SerializeAsString())
+        << "The readers disagree on " << files[i];
+  }
+
+  const int total = files.size() * FLAGS_iterations;
+  LOG(INFO) << "Reading " << files.size() << " " << FLAGS_anno_type
+      << " files " << FLAGS_iterations << " times";
+  LOG(INFO) << "property_tree:  " << total * 1000. / reference_ms
+      << " files/sec.";
+  LOG(INFO) << "AnnotationTree: " << total * 1000. / fast_ms
+      << " files/sec.";
+  LOG(INFO) << "Speedup: " << reference_ms / fast_ms << "x";
+  return 0;
+}
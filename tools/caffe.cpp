@@ -48,6 +48,12 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_int32(cpu_threads, 1,
+    "Optional; the number of threads the CPU layers may split their work "
+    "over, 0 for one per hardware thread.");
+DEFINE_bool(plan_memory, false,
+    "Optional; let the blobs of the model share memory when they are not in "
+    "use at the same time. Only used for 'test' and 'time'.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -127,6 +133,22 @@ vector<string> get_stages_from_flags() {
   return stages;
 }
 
+// Read the model from flags, in the given phase
+caffe::NetParameter get_net_param_from_flags(caffe::Phase phase) {
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(phase);
+  vector<string> stages = get_stages_from_flags();
+  for (int i = 0; i < stages.size(); i++) {
+    param.mutable_state()->add_stage(stages[i]);
+  }
+  param.mutable_state()->set_level(FLAGS_level);
+  if (FLAGS_plan_memory) {
+    param.set_plan_memory(true);
+  }
+  return param;
+}
+
 // caffe commands to call by
 //     caffe <command> <args>
 //
@@ -261,7 +283,6 @@ RegisterBrewFunction(train);
 int test() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to score.";
   CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to score.";
-  vector<string> stages = get_stages_from_flags();
 
   // Set device id and mode
   vector<int> gpus;
@@ -280,7 +301,7 @@ int test() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
+  Net<float> caffe_net(get_net_param_from_flags(caffe::TEST));
   caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
@@ -334,7 +355,6 @@ RegisterBrewFunction(test);
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
   caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
-  vector<string> stages = get_stages_from_flags();
 
   // Set device id and mode
   vector<int> gpus;
@@ -348,7 +368,7 @@ int time() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  Net<float> caffe_net(get_net_param_from_flags(phase));
 
   // Do a clean forward and backward pass, so that memory allocation are done
   // and future iterations will be more stable.
@@ -436,6 +456,7 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  Caffe::set_cpu_threads(FLAGS_cpu_threads);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
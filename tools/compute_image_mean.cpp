@@ -1,25 +1,193 @@
+// This program computes the mean image of a database of images, and the mean
+// and standard deviation of each channel.
+// Usage:
+//    compute_image_mean [FLAGS] INPUT_DB [OUTPUT_FILE]
+//
+// The database is read by --threads workers, each with its own cursor over
+// a contiguous range of the records, decoding the images as it goes. Sums are kept
+// with pairwise summation, so the result does not lose precision on large
+// databases, and only depends on the number of threads through rounding.
+
 #include <stdint.h>
 #include <algorithm>
+#include <cmath>
+#include <sstream>
 #include <string>
-#include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/scoped_ptr.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 
-using std::max;
-using std::pair;
 using boost::scoped_ptr;
+using boost::shared_ptr;
 
 DEFINE_string(backend, "lmdb",
-        "The backend {leveldb, lmdb} containing the images");
+        "The backend {leveldb, lmdb, record} containing the images");
+DEFINE_string(datum_type, "datum",
+    "The records of the database: datum, or annotated for AnnotatedDatum.");
+DEFINE_int32(threads, 4,
+    "Number of threads reading and decoding the records.");
+
+// Sums vectors of the same size by pairwise summation: items are added into
+// blocks of kBlockSize, and the sum of 2^k blocks is only ever added to
+// another sum of 2^k blocks, which keeps the rounding error in O(log n).
+class PairwiseSum {
+ public:
+  static const int kBlockSize = 256;
+
+  explicit PairwiseSum(int size)
+      : size_(size), block_(size, 0.), block_items_(0) { }
+
+  // The sum of the current block, to add the next item to, and EndItem()
+  // once it is added.
+  double* block() { return &block_[0]; }
+  void EndItem() {
+    if (++block_items_ == kBlockSize) {
+      Flush();
+    }
+  }
+
+  // The sum of everything added, smallest partial sums first.
+  std::vector<double> Total() {
+    Flush();
+    std::vector<double> total(size_, 0.);
+    for (int level = 0; level < levels_.size(); ++level) {
+      for (int i = 0; i < levels_[level].size(); ++i) {
+        total[i] += levels_[level][i];
+      }
+    }
+    return total;
+  }
+
+ private:
+  void Flush() {
+    // Like incrementing a binary counter, level k holding 2^k blocks.
+    for (int level = 0; ; ++level) {
+      if (level == levels_.size()) {
+        levels_.push_back(std::vector<double>());
+      }
+      if (levels_[level].empty()) {
+        levels_[level].swap(block_);
+        break;
+      }
+      for (int i = 0; i < block_.size(); ++i) {
+        block_[i] += levels_[level][i];
+      }
+      levels_[level].clear();
+    }
+    block_.assign(size_, 0.);
+    block_items_ = 0;
+  }
+
+  const int size_;
+  std::vector<double> block_;
+  int block_items_;
+  std::vector<std::vector<double> > levels_;
+};
+
+// Accumulates the size records of a cursor from start_key on.
+class MeanShard {
+ public:
+  MeanShard(db::Cursor* cursor, const string& start_key, int size,
+      int channels, int data_size)
+      : cursor_(cursor), start_key_(start_key), size_(size),
+        channels_(channels), data_size_(data_size), sum_(data_size),
+        square_sum_(channels), count_(0) { }
+
+  void Run(boost::mutex* mutex, int* processed) {
+    cursor_->Seek(start_key_);
+    AnnotatedDatum anno_datum;
+    Datum* datum = anno_datum.mutable_datum();
+    const bool annotated = FLAGS_datum_type == "annotated";
+    const int dim = data_size_ / channels_;
+    for (int n = 0; n < size_; ++n, cursor_->Next()) {
+      CHECK(cursor_->valid()) << "Record " << n << " after " << start_key_
+          << " disappeared";
+      if (annotated) {
+        CHECK(anno_datum.ParseFromArray(cursor_->value_data(),
+            cursor_->value_size())) << "Failed to parse " << cursor_->key();
+      } else {
+        CHECK(datum->ParseFromArray(cursor_->value_data(),
+            cursor_->value_size())) << "Failed to parse " << cursor_->key();
+      }
+      DecodeDatumNative(datum);
+      const string& data = datum->data();
+      const int size_in_datum = std::max<int>(data.size(),
+          datum->float_data_size());
+      CHECK_EQ(size_in_datum, data_size_) << "Incorrect data field size "
+          << size_in_datum;
+      double* sum = sum_.block();
+      for (int c = 0; c < channels_; ++c) {
+        double square_sum = 0;
+        if (data.size() != 0) {
+          const uint8_t* pixels =
+              reinterpret_cast<const uint8_t*>(data.data()) + c * dim;
+          double* channel_sum = sum + c * dim;
+          for (int i = 0; i < dim; ++i) {
+            const double pixel = pixels[i];
+            channel_sum[i] += pixel;
+            square_sum += pixel * pixel;
+          }
+        } else {
+          double* channel_sum = sum + c * dim;
+          for (int i = 0; i < dim; ++i) {
+            const double value = datum->float_data(c * dim + i);
+            channel_sum[i] += value;
+            square_sum += value * value;
+          }
+        }
+        square_sum_.block()[c] += square_sum;
+      }
+      sum_.EndItem();
+      square_sum_.EndItem();
+      if (++count_ % 1000 == 0) {
+        boost::mutex::scoped_lock lock(*mutex);
+        *processed += 1000;
+        LOG_IF(INFO, *processed % 10000 == 0) << "Processed " << *processed
+            << " files.";
+      }
+    }
+  }
+
+  PairwiseSum& sum() { return sum_; }
+  PairwiseSum& square_sum() { return square_sum_; }
+  int count() const { return count_; }
+
+ private:
+  db::Cursor* cursor_;
+  const string start_key_;
+  const int size_;
+  const int channels_;
+  const int data_size_;
+  PairwiseSum sum_;
+  PairwiseSum square_sum_;
+  int count_;
+};
+
+// Adds up the totals of the shards in a balanced tree.
+static std::vector<double> ReduceTotals(std::vector<std::vector<double> >* v) {
+  for (int step = 1; step < v->size(); step *= 2) {
+    for (int i = 0; i + step < v->size(); i += 2 * step) {
+      std::vector<double>& a = (*v)[i];
+      const std::vector<double>& b = (*v)[i + step];
+      for (int j = 0; j < a.size(); ++j) {
+        a[j] += b[j];
+      }
+    }
+  }
+  return v->front();
+}
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -40,82 +208,111 @@ int main(int argc, char** argv) {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/compute_image_mean");
     return 1;
   }
+  CHECK(FLAGS_datum_type == "datum" || FLAGS_datum_type == "annotated")
+      << "Unknown datum_type " << FLAGS_datum_type;
 
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[1], db::READ);
-  scoped_ptr<db::Cursor> cursor(db->NewCursor());
 
-  BlobProto sum_blob;
-  int count = 0;
   // load first datum
-  Datum datum;
-  datum.ParseFromString(cursor->value());
-
+  AnnotatedDatum anno_datum;
+  Datum& datum = *anno_datum.mutable_datum();
+  {
+    scoped_ptr<db::Cursor> cursor(db->NewCursor());
+    CHECK(cursor->valid()) << argv[1] << " is empty";
+    if (FLAGS_datum_type == "annotated") {
+      anno_datum.ParseFromString(cursor->value());
+    } else {
+      datum.ParseFromString(cursor->value());
+    }
+  }
   if (DecodeDatumNative(&datum)) {
     LOG(INFO) << "Decoding Datum";
   }
 
+  BlobProto sum_blob;
   sum_blob.set_num(1);
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
-  const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
-  }
-  LOG(INFO) << "Starting Iteration";
-  while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
-
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
-      }
-    }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(INFO) << "Processed " << count << " files.";
+  const int channels = datum.channels();
+  const int dim = datum.height() * datum.width();
+  const int data_size = channels * dim;
+
+  // Cursors are created here, one at a time, as LMDB does not allow
+  // concurrent mdb_dbi_open calls. The ranges start at keys found in one
+  // pass over the records.
+  std::vector<shared_ptr<db::Cursor> > cursors;
+  std::vector<shared_ptr<MeanShard> > shards;
+  std::vector<string> start_keys;
+  std::vector<int> sizes;
+  cursors.push_back(shared_ptr<db::Cursor>(db->NewCursor()));
+  db::SplitRanges(db.get(), cursors.back().get(),
+      std::max<int>(FLAGS_threads, 1), &start_keys, &sizes);
+  const int num_threads = start_keys.size();
+  for (int k = 0; k < num_threads; ++k) {
+    if (k > 0) {
+      cursors.push_back(shared_ptr<db::Cursor>(db->NewCursor()));
     }
-    cursor->Next();
+    shards.push_back(shared_ptr<MeanShard>(new MeanShard(
+        cursors.back().get(), start_keys[k], sizes[k], channels, data_size)));
+  }
+  LOG(INFO) << "Starting Iteration with " << num_threads << " threads";
+  CPUTimer timer;
+  timer.Start();
+  boost::mutex mutex;
+  int processed = 0;
+  boost::thread_group threads;
+  for (int k = 0; k < num_threads; ++k) {
+    threads.create_thread(boost::bind(&MeanShard::Run, shards[k].get(),
+        &mutex, &processed));
   }
+  threads.join_all();
+  const double seconds = timer.MilliSeconds() / 1000.;
 
-  if (count % 10000 != 0) {
-    LOG(INFO) << "Processed " << count << " files.";
+  int count = 0;
+  std::vector<std::vector<double> > sums;
+  std::vector<std::vector<double> > square_sums;
+  for (int k = 0; k < num_threads; ++k) {
+    count += shards[k]->count();
+    sums.push_back(shards[k]->sum().Total());
+    square_sums.push_back(shards[k]->square_sum().Total());
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  LOG(INFO) << "Processed " << count << " files in " << seconds << " s, "
+      << count / seconds << " images/s.";
+  const std::vector<double> sum = ReduceTotals(&sums);
+  const std::vector<double> square_sum = ReduceTotals(&square_sums);
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(sum[i] / count);
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
-  const int dim = sum_blob.height() * sum_blob.width();
-  std::vector<float> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
+  std::ostringstream transform_param;
+  transform_param << "transform_param {";
+  double std_sum = 0;
   for (int c = 0; c < channels; ++c) {
+    double channel_sum = 0;
     for (int i = 0; i < dim; ++i) {
-      mean_values[c] += sum_blob.data(dim * c + i);
+      channel_sum += sum[dim * c + i];
     }
-    LOG(INFO) << "mean_value channel [" << c << "]:" << mean_values[c] / dim;
+    const double mean = channel_sum / count / dim;
+    const double variance = square_sum[c] / count / dim - mean * mean;
+    const double stddev = std::sqrt(std::max(variance, 0.));
+    std_sum += stddev;
+    LOG(INFO) << "mean_value channel [" << c << "]:" << mean;
+    LOG(INFO) << "std channel [" << c << "]:" << stddev;
+    transform_param << " mean_value: " << mean;
+  }
+  // TransformationParameter has a single scale, so take the mean std.
+  if (std_sum > 0) {
+    transform_param << " scale: " << channels / std_sum;
   }
+  transform_param << " }";
+  LOG(INFO) << transform_param.str();
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -12,19 +12,27 @@
 // For detection task, the file should be in the format as
 //   imgfolder1/img1.JPEG annofolder1/anno1.xml
 //   ....
+//
+// Images are read and encoded by --threads workers, and written in the order
+// of the list. An interrupted conversion can be continued with --resume.
 
 #include <algorithm>
+#include <cstdlib>
 #include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "boost/filesystem.hpp"
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "boost/variant.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
+#include "caffe/internal_thread.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
@@ -33,13 +41,14 @@
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
 using boost::scoped_ptr;
+using boost::shared_ptr;
 
 DEFINE_bool(gray, false,
     "When this option is on, treat images as grayscale ones");
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
 DEFINE_string(backend, "lmdb",
-    "The backend {lmdb, leveldb} for storing the result");
+    "The backend {lmdb, leveldb, record} for storing the result");
 DEFINE_string(anno_type, "classification",
     "The type of annotation {classification, detection, faceattributes, faceattri}.");
 DEFINE_string(label_type, "xml",
@@ -60,6 +69,178 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 1,
+    "Number of threads reading and encoding the images. The output does not "
+    "depend on it.");
+DEFINE_bool(resume, false,
+    "Continue an interrupted conversion into an existing DB_NAME, after the "
+    "last record it holds. The list must be in the same order, so use the "
+    "same --shuffle_seed if shuffling.");
+DEFINE_int32(shuffle_seed, 0,
+    "If non-zero, seed of --shuffle, to get the same order again.");
+
+typedef std::pair<std::string, boost::variant<int, std::string> > Line;
+
+// What the workers need to convert a line of the list.
+struct ConvertOptions {
+  string anno_type;
+  string label_type;
+  string encode_type;
+  bool encoded;
+  bool is_color;
+  int resize_height;
+  int resize_width;
+  int min_dim;
+  int max_dim;
+  AnnotatedDatum_AnnotationType type;
+  AnnoFaceAttributeDatum_AnnoType anno_face;
+  AnnotatedCCpdDatum_AnnotationType anno_ccpd_type;
+  std::map<std::string, int> name_to_label;
+};
+
+// A converted line, passed from a worker to the writer and back.
+struct ConvertedLine {
+  bool status;
+  string value;
+  // channels * height * width of the image, and the size of its data, for
+  // --check_size.
+  int data_size;
+  int data_bytes;
+};
+
+// Converts lines first, first + step, first + 2 * step... of the list. With
+// one worker per residue, the writer restores the list order by taking the
+// workers in turn.
+class ConvertWorker : public InternalThread {
+ public:
+  ConvertWorker(const ConvertOptions& options, const std::vector<Line>& lines,
+      int first, int step, int pool_size)
+      : options_(options), lines_(lines), first_(first), step_(step),
+        pool_(pool_size) {
+    for (int i = 0; i < pool_size; ++i) {
+      free_.push(i);
+    }
+  }
+  virtual ~ConvertWorker() {
+    StopInternalThread();
+  }
+
+  ConvertedLine* converted(int slot) { return &pool_[slot]; }
+
+  // Slots of the pool, as BlockingQueue is only instantiated for a few
+  // types.
+  BlockingQueue<int> free_;
+  BlockingQueue<int> full_;
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      for (int line_id = first_; line_id < lines_.size() && !must_stop();
+           line_id += step_) {
+        const int slot = free_.pop();
+        Convert(lines_[line_id], &pool_[slot]);
+        full_.push(slot);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  void Convert(const Line& line, ConvertedLine* converted) {
+    const ConvertOptions& o = options_;
+    std::string enc = o.encode_type;
+    if (o.encoded && !enc.size()) {
+      // Guess the encoding type from the file name
+      string fn = line.first;
+      size_t p = fn.rfind('.');
+      if ( p == fn.npos )
+        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+      enc = fn.substr(p);
+      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    }
+    const std::string& filename = line.first;
+    Datum* datum = anno_datum_.mutable_datum();
+    bool status = true;
+    if (o.anno_type == "classification") {
+      status = ReadImageToDatum(filename, boost::get<int>(line.second),
+          o.resize_height, o.resize_width, o.min_dim, o.max_dim, o.is_color,
+          enc, datum);
+    } else if (o.anno_type == "detection") {
+      status = ReadRichImageToAnnotatedDatum(filename,
+          boost::get<std::string>(line.second), o.resize_height,
+          o.resize_width, o.min_dim, o.max_dim, o.is_color, enc, o.type,
+          o.label_type, o.name_to_label, &anno_datum_);
+      anno_datum_.set_type(AnnotatedDatum_AnnotationType_BBOX);
+    } else if (o.anno_type == "faceattributes") {
+      // lines contain imagename & label.txt
+      status = ReadRichFaceAttributeToAnnotatedDatum(filename,
+          boost::get<std::string>(line.second), o.resize_height,
+          o.resize_width, o.min_dim, o.max_dim, o.is_color, enc, o.anno_face,
+          o.label_type, &anno_face_datum_);
+      anno_face_datum_.set_type(AnnoFaceAttributeDatum_AnnoType_FACEATTRIBUTE);
+    } else if (o.anno_type == "Rec_ccpd") {
+      status = ReadRichCcpdToAnnotatedDatum(filename,
+          boost::get<std::string>(line.second), o.resize_height,
+          o.resize_width, o.min_dim, o.max_dim, o.is_color, enc,
+          o.anno_ccpd_type, o.label_type, o.name_to_label, &anno_ccpd_datum_);
+      anno_ccpd_datum_.set_type(AnnotatedCCpdDatum_AnnotationType_CCPD);
+    }
+    converted->status = status;
+    if (!status) {
+      return;
+    }
+    converted->data_size =
+        datum->channels() * datum->height() * datum->width();
+    converted->data_bytes = datum->data().size();
+    if (o.anno_type == "classification" || o.anno_type == "detection") {
+      CHECK(anno_datum_.SerializeToString(&converted->value));
+    } else if (o.anno_type == "faceattributes") {
+      CHECK(anno_face_datum_.SerializeToString(&converted->value));
+    } else if (o.anno_type == "Rec_ccpd") {
+      CHECK(anno_ccpd_datum_.SerializeToString(&converted->value));
+    } else {
+      converted->value.clear();
+    }
+  }
+
+  const ConvertOptions& options_;
+  const std::vector<Line>& lines_;
+  const int first_;
+  const int step_;
+  std::vector<ConvertedLine> pool_;
+  AnnotatedDatum anno_datum_;
+  AnnoFaceAttributeDatum anno_face_datum_;
+  AnnotatedCCpdDatum anno_ccpd_datum_;
+};
+
+// A guess of the bytes taken by the records of lines [begin, end), from the
+// sizes of a sample of the images, or 0 if the images are stored decoded at
+// their own size.
+static uint64_t EstimateRecordBytes(const std::vector<Line>& lines, int begin,
+    const ConvertOptions& o) {
+  const int count = lines.size() - begin;
+  if (count <= 0) {
+    return 0;
+  }
+  uint64_t image_bytes = 0;
+  if (o.encoded || o.encode_type.size()) {
+    const int step = std::max(count / 100, 1);
+    int sampled = 0;
+    for (int i = begin; i < lines.size(); i += step) {
+      boost::system::error_code ec;
+      const uintmax_t size = boost::filesystem::file_size(lines[i].first, ec);
+      if (!ec) {
+        image_bytes += size;
+        ++sampled;
+      }
+    }
+    image_bytes = sampled > 0 ? image_bytes / sampled : 0;
+  } else if (o.resize_height > 0 && o.resize_width > 0) {
+    image_bytes = o.resize_height * o.resize_width * (o.is_color ? 3 : 1);
+  }
+  // Plus the key, the annotations and the proto fields.
+  return image_bytes > 0 ? (image_bytes + 256) * count : 0;
+}
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -82,21 +263,19 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  const bool is_color = !FLAGS_gray;
+  ConvertOptions options;
+  options.is_color = !FLAGS_gray;
   const bool check_size = FLAGS_check_size;
-  const bool encoded = FLAGS_encoded;
-  const string encode_type = FLAGS_encode_type;
+  options.encoded = FLAGS_encoded;
+  options.encode_type = FLAGS_encode_type;
   const string anno_type = FLAGS_anno_type;
-  AnnotatedDatum_AnnotationType type;
-  AnnoFaceAttributeDatum_AnnoType anno_face;
-  AnnotatedCCpdDatum_AnnotationType anno_ccpd_type;
-  const string label_type = FLAGS_label_type;
+  options.anno_type = anno_type;
+  options.label_type = FLAGS_label_type;
   const string label_map_file = FLAGS_label_map_file;
   const bool check_label = FLAGS_check_label;
-  std::map<std::string, int> name_to_label;
 
   std::ifstream infile(argv[2]);
-  std::vector<std::pair<std::string, boost::variant<int, std::string> > > lines;
+  std::vector<Line> lines;
   std::string filename;
   int label;
   std::string labelname;
@@ -105,26 +284,26 @@ int main(int argc, char** argv) {
       lines.push_back(std::make_pair(filename, label));
     }
   } else if (anno_type == "detection") {
-    type = AnnotatedDatum_AnnotationType_BBOX;
+    options.type = AnnotatedDatum_AnnotationType_BBOX;
     LabelMap label_map;
     CHECK(ReadProtoFromTextFile(label_map_file, &label_map))
         << "Failed to read label map file.";
-    CHECK(MapNameToLabel(label_map, check_label, &name_to_label))
+    CHECK(MapNameToLabel(label_map, check_label, &options.name_to_label))
         << "Failed to convert name to label.";
     while (infile >> filename >> labelname) {
       lines.push_back(std::make_pair(filename, labelname));
     }
   } else if(anno_type == "faceattributes") {
-		anno_face = AnnoFaceAttributeDatum_AnnoType_FACEATTRIBUTE;
+		options.anno_face = AnnoFaceAttributeDatum_AnnoType_FACEATTRIBUTE;
     while (infile >> filename >> labelname) {
       lines.push_back(std::make_pair(filename, labelname));
     }
 	} else if (anno_type == "Rec_ccpd") {
-    anno_ccpd_type = AnnotatedCCpdDatum_AnnotationType_CCPD;
+    options.anno_ccpd_type = AnnotatedCCpdDatum_AnnotationType_CCPD;
     LabelMap label_map;
     CHECK(ReadProtoFromTextFile(label_map_file, &label_map))
         << "Failed to read label map file.";
-    CHECK(MapNameToLabel(label_map, check_label, &name_to_label))
+    CHECK(MapNameToLabel(label_map, check_label, &options.name_to_label))
         << "Failed to convert name to label.";
     while (infile >> filename >> labelname) {
       lines.push_back(std::make_pair(filename, labelname));
@@ -133,100 +312,103 @@ int main(int argc, char** argv) {
   if (FLAGS_shuffle) {
     // randomly shuffle data
     LOG(INFO) << "Shuffling data";
-    shuffle(lines.begin(), lines.end());
+    if (FLAGS_shuffle_seed) {
+      caffe::rng_t rng(FLAGS_shuffle_seed);
+      shuffle(lines.begin(), lines.end(), &rng);
+    } else {
+      CHECK(!FLAGS_resume) << "Resuming a shuffled conversion requires the "
+          << "--shuffle_seed it was started with";
+      shuffle(lines.begin(), lines.end());
+    }
   }
   LOG(INFO) << "A total of " << lines.size() << " images.";
 
-  if (encode_type.size() && !encoded)
+  if (options.encode_type.size() && !options.encoded)
     LOG(INFO) << "encode_type specified, assuming encoded=true.";
 
-  int min_dim = std::max<int>(0, FLAGS_min_dim);
-  int max_dim = std::max<int>(0, FLAGS_max_dim);
-  int resize_height = std::max<int>(0, FLAGS_resize_height);
-  int resize_width = std::max<int>(0, FLAGS_resize_width);
+  options.min_dim = std::max<int>(0, FLAGS_min_dim);
+  options.max_dim = std::max<int>(0, FLAGS_max_dim);
+  options.resize_height = std::max<int>(0, FLAGS_resize_height);
+  options.resize_width = std::max<int>(0, FLAGS_resize_width);
 
-  // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
-  db->Open(argv[3], db::NEW);
+  int count = 0;
+  int start_line = 0;
+  if (FLAGS_resume) {
+    // Continue after the last record, whose key starts with its line number.
+    db->Open(argv[3], db::WRITE);
+    scoped_ptr<db::Cursor> cursor(db->NewCursor());
+    string last_key;
+    for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+      last_key = cursor->key();
+      ++count;
+    }
+    if (count > 0) {
+      start_line = atoi(last_key.substr(0, 8).c_str()) + 1;
+      CHECK(start_line <= lines.size() && last_key ==
+          caffe::format_int(start_line - 1, 8) + "_" +
+          lines[start_line - 1].first)
+          << "The last record of " << argv[3] << ", " << last_key
+          << ", does not match the list: it changed, or was shuffled "
+          << "differently.";
+    }
+    LOG(INFO) << "Resuming after " << count << " records, at line "
+        << start_line;
+  } else {
+    // Create new DB
+    db->Open(argv[3], db::NEW);
+  }
+  db->SetSizeHint(EstimateRecordBytes(lines, start_line, options));
   scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
-  // Storing to db
-  std::string root_folder(argv[1]);
-  AnnotatedDatum anno_datum;
-  Datum* datum = anno_datum.mutable_datum();
-  AnnoFaceAttributeDatum anno_faceAttriDatum;
-  AnnotatedCCpdDatum anno_ccpdDatum;
+  // Start the workers. Each one stays at most a few lines ahead of the
+  // writer, which bounds the memory used.
+  const int num_workers = std::max<int>(FLAGS_threads, 1);
+  const int pool_size = 16;
+  std::vector<shared_ptr<ConvertWorker> > workers;
+  for (int k = 0; k < num_workers; ++k) {
+    workers.push_back(shared_ptr<ConvertWorker>(new ConvertWorker(options,
+        lines, start_line + k, num_workers, pool_size)));
+    workers.back()->StartInternalThread();
+  }
+  if (num_workers > 1) {
+    LOG(INFO) << "Converting with " << num_workers << " threads";
+  }
 
-  int count = 0;
+  // Storing to db, in the order of the list, while the workers convert the
+  // next lines.
   int data_size = 0;
   bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status = true;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    filename = lines[line_id].first;
-    if (anno_type == "classification") {
-      label = boost::get<int>(lines[line_id].second);
-      status = ReadImageToDatum(filename, label, resize_height, resize_width,
-          min_dim, max_dim, is_color, enc, datum);
-    }else if (anno_type == "detection") {
-      labelname = boost::get<std::string>(lines[line_id].second);
-      status = ReadRichImageToAnnotatedDatum(filename, labelname, resize_height,
-          resize_width, min_dim, max_dim, is_color, enc, type, label_type,
-          name_to_label, &anno_datum);
-      anno_datum.set_type(AnnotatedDatum_AnnotationType_BBOX);
-    } else if(anno_type == "faceattributes") {
-      labelname = boost::get<std::string>(lines[line_id].second); // lines contain imagename & label.txt
-		  status = ReadRichFaceAttributeToAnnotatedDatum(filename,
-          labelname, resize_height, resize_width, min_dim, max_dim, is_color,
-          enc, anno_face, label_type, &anno_faceAttriDatum);
-      anno_faceAttriDatum.set_type(AnnoFaceAttributeDatum_AnnoType_FACEATTRIBUTE);
-	  }else if (anno_type == "Rec_ccpd") {
-      labelname = boost::get<std::string>(lines[line_id].second);
-      status = ReadRichCcpdToAnnotatedDatum(filename, labelname, resize_height,
-          resize_width, min_dim, max_dim, is_color, enc, anno_ccpd_type, label_type,
-          name_to_label, &anno_ccpdDatum);
-      anno_ccpdDatum.set_type(AnnotatedCCpdDatum_AnnotationType_CCPD);
-    }
-    if (status == false) {
+  const bool known_type = anno_type == "classification" ||
+      anno_type == "detection" || anno_type == "faceattributes" ||
+      anno_type == "Rec_ccpd";
+  for (int line_id = start_line; line_id < lines.size(); ++line_id) {
+    ConvertWorker* worker =
+        workers[(line_id - start_line) % num_workers].get();
+    const int slot = worker->full_.pop();
+    ConvertedLine* converted = worker->converted(slot);
+    if (converted->status == false) {
       LOG(WARNING) << "Failed to read " << lines[line_id].first;
+      worker->free_.push(slot);
       continue;
     }
     if (check_size) {
       if (!data_size_initialized) {
-        data_size = datum->channels() * datum->height() * datum->width();
+        data_size = converted->data_size;
         data_size_initialized = true;
       } else {
-        const std::string& data = datum->data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
+        CHECK_EQ(converted->data_bytes, data_size)
+            << "Incorrect data field size " << converted->data_bytes;
       }
     }
     // sequential
     string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
 
     // Put in db
-    string out;
-    if(anno_type == "classification" || anno_type == "detection")
-    {
-      CHECK(anno_datum.SerializeToString(&out));
-      txn->Put(key_str, out);
-    }else if(anno_type == "faceattributes") {
-      CHECK(anno_faceAttriDatum.SerializeToString(&out));
-      txn->Put(key_str, out);
-    }else if(anno_type == "Rec_ccpd") {
-      CHECK(anno_ccpdDatum.SerializeToString(&out));
-      txn->Put(key_str, out);
+    if (known_type) {
+      txn->Put(key_str, converted->value);
     }
+    worker->free_.push(slot);
     if (++count % 1000 == 0) {
       // Commit db
       txn->Commit();
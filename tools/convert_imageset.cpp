@@ -14,6 +14,7 @@
 #include <utility>
 #include <vector>
 
+#include "boost/filesystem.hpp"
 #include "boost/scoped_ptr.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
@@ -33,7 +34,7 @@ DEFINE_bool(gray, false,
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
 DEFINE_string(backend, "lmdb",
-        "The backend {lmdb, leveldb} for storing the result");
+        "The backend {lmdb, leveldb, record} for storing the result");
 DEFINE_int32(resize_width, 0, "Width images are resized to");
 DEFINE_int32(resize_height, 0, "Height images are resized to");
 DEFINE_bool(check_size, false,
@@ -43,6 +44,35 @@ DEFINE_bool(encoded, false,
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
 
+// A guess of the bytes taken by the records of images, from the sizes of a
+// sample of them, or 0 if they are stored decoded at their own size.
+static uint64_t EstimateRecordBytes(
+    const std::vector<std::pair<std::string, int> >& lines, bool encoded,
+    int resize_height, int resize_width, bool is_color) {
+  if (lines.empty()) {
+    return 0;
+  }
+  uint64_t image_bytes = 0;
+  if (encoded) {
+    const int step = std::max<int>(lines.size() / 100, 1);
+    int sampled = 0;
+    for (int i = 0; i < lines.size(); i += step) {
+      boost::system::error_code ec;
+      const uintmax_t size =
+          boost::filesystem::file_size(lines[i].first + ".jpg", ec);
+      if (!ec) {
+        image_bytes += size;
+        ++sampled;
+      }
+    }
+    image_bytes = sampled > 0 ? image_bytes / sampled : 0;
+  } else if (resize_height > 0 && resize_width > 0) {
+    image_bytes = resize_height * resize_width * (is_color ? 3 : 1);
+  }
+  // Plus the key and the proto fields.
+  return image_bytes > 0 ? (image_bytes + 64) * lines.size() : 0;
+}
+
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
   ::google::InitGoogleLogging(argv[0]);
@@ -97,6 +127,8 @@ int main(int argc, char** argv) {
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
+  db->SetSizeHint(EstimateRecordBytes(lines, encoded || encode_type.size(),
+      resize_height, resize_width, is_color));
   scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
   // Storing to db
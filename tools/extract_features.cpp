@@ -1,24 +1,230 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/thread.hpp"
 #include "google/protobuf/text_format.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 
 using caffe::Blob;
+using caffe::BlockingQueue;
 using caffe::Caffe;
 using caffe::Datum;
 using caffe::Net;
 using std::string;
+using std::vector;
 namespace db = caffe::db;
 
+// Converts to IEEE half precision, rounding to nearest even.
+static uint16_t FloatToHalf(float value) {
+  uint32_t x;
+  memcpy(&x, &value, sizeof(x));
+  const uint32_t sign = (x >> 16) & 0x8000;
+  const uint32_t abs = x & 0x7fffffff;
+  if (abs >= 0x7f800000) {  // inf or nan
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  if (abs >= 0x477ff000) {  // rounds past 65504
+    return sign | 0x7c00;
+  }
+  uint32_t half, rest, halfway;
+  if (abs >= 0x38800000) {  // normal
+    half = (abs - 0x38000000) >> 13;
+    rest = abs & 0x1fff;
+    halfway = 0x1000;
+  } else if (abs >= 0x33000000) {  // subnormal
+    const int shift = 126 - static_cast<int>(abs >> 23);
+    const uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+    half = mantissa >> shift;
+    rest = mantissa & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+  } else {
+    return sign;
+  }
+  if (rest > halfway || (rest == halfway && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+// Where the features of one blob go.
+class FeatureSink {
+ public:
+  virtual ~FeatureSink() { }
+  // Writes num features of dim values each.
+  virtual void Write(const float* data, int num, int dim) = 0;
+  virtual void Close() = 0;
+};
+
+// A Datum per feature, keyed by its index, in a leveldb, lmdb or record db.
+class DBFeatureSink : public FeatureSink {
+ public:
+  DBFeatureSink(const string& name, const string& db_type, int channels,
+      int height, int width)
+      : db_(db::GetDB(db_type)), count_(0) {
+    db_->Open(name, db::NEW);
+    txn_.reset(db_->NewTransaction());
+    datum_.set_channels(channels);
+    datum_.set_height(height);
+    datum_.set_width(width);
+  }
+  virtual void Write(const float* data, int num, int dim) {
+    google::protobuf::RepeatedField<float>* values =
+        datum_.mutable_float_data();
+    for (int n = 0; n < num; ++n) {
+      values->Clear();
+      values->Reserve(dim);
+      for (int d = 0; d < dim; ++d) {
+        values->AddAlreadyReserved(data[n * dim + d]);
+      }
+      CHECK(datum_.SerializeToString(&value_));
+      txn_->Put(caffe::format_int(count_, 10), value_);
+      if (++count_ % 1000 == 0) {
+        txn_->Commit();
+        txn_.reset(db_->NewTransaction());
+      }
+    }
+  }
+  virtual void Close() {
+    if (count_ % 1000 != 0) {
+      txn_->Commit();
+    }
+    txn_.reset();
+    db_->Close();
+  }
+
+ private:
+  boost::shared_ptr<db::DB> db_;
+  boost::shared_ptr<db::Transaction> txn_;
+  Datum datum_;
+  string value_;
+  int count_;
+};
+
+// A num x dim row-major matrix of float or half values, after a 32 byte
+// header: the magic "CAFFEFEA", the uint32 version (1) and size of a value
+// (4 or 2), then the uint64 num and dim, in native byte order. The values
+// are aligned, so the file can be mapped and used as is.
+class RawFeatureSink : public FeatureSink {
+ public:
+  RawFeatureSink(const string& name, bool fp16)
+      : name_(name), fp16_(fp16), num_(0), dim_(0) {
+    file_ = fopen(name.c_str(), "wb");
+    CHECK(file_) << "Failed to open " << name;
+    WriteHeader();
+  }
+  virtual void Write(const float* data, int num, int dim) {
+    CHECK(num_ == 0 || static_cast<uint64_t>(dim) == dim_) << "Features of different sizes";
+    dim_ = dim;
+    num_ += num;
+    const size_t count = static_cast<size_t>(num) * dim;
+    size_t written;
+    if (fp16_) {
+      half_.resize(count);
+      for (size_t i = 0; i < count; ++i) {
+        half_[i] = FloatToHalf(data[i]);
+      }
+      written = fwrite(&half_[0], sizeof(uint16_t), count, file_);
+    } else {
+      written = fwrite(data, sizeof(float), count, file_);
+    }
+    CHECK_EQ(written, count) << "Failed to write " << name_;
+  }
+  virtual void Close() {
+    CHECK_EQ(fseek(file_, 0, SEEK_SET), 0);
+    WriteHeader();
+    CHECK_EQ(fclose(file_), 0) << "Failed to write " << name_;
+    file_ = NULL;
+  }
+
+ private:
+  void WriteHeader() {
+    char header[32];
+    const uint32_t version = 1;
+    const uint32_t value_size = fp16_ ? sizeof(uint16_t) : sizeof(float);
+    memcpy(header, "CAFFEFEA", 8);
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 12, &value_size, 4);
+    memcpy(header + 16, &num_, 8);
+    memcpy(header + 24, &dim_, 8);
+    CHECK_EQ(fwrite(header, 1, sizeof(header), file_), sizeof(header))
+        << "Failed to write " << name_;
+  }
+
+  const string name_;
+  const bool fp16_;
+  FILE* file_;
+  uint64_t num_;
+  uint64_t dim_;
+  vector<uint16_t> half_;
+};
+
+// The features of a batch, copied out of the net.
+struct FeatureBatch {
+  vector<vector<float> > features;
+  vector<int> nums;
+};
+
+// Writes the batches to the sinks while the net computes the next ones.
+class FeatureWriter : public caffe::InternalThread {
+ public:
+  FeatureWriter(const vector<boost::shared_ptr<FeatureSink> >& sinks,
+      int num_batches, int pool_size)
+      : sinks_(sinks), num_batches_(num_batches), pool_(pool_size) {
+    for (int i = 0; i < pool_size; ++i) {
+      pool_[i].features.resize(sinks.size());
+      pool_[i].nums.resize(sinks.size());
+      free_.push(i);
+    }
+  }
+  virtual ~FeatureWriter() {
+    StopInternalThread();
+  }
+
+  FeatureBatch* batch(int slot) { return &pool_[slot]; }
+  int pool_size() const { return pool_.size(); }
+
+  // Slots of the pool, as BlockingQueue is only instantiated for a few
+  // types.
+  BlockingQueue<int> free_;
+  BlockingQueue<int> full_;
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      for (int b = 0; b < num_batches_ && !must_stop(); ++b) {
+        const int slot = full_.pop();
+        const FeatureBatch& batch = pool_[slot];
+        for (int i = 0; i < sinks_.size(); ++i) {
+          const int num = batch.nums[i];
+          sinks_[i]->Write(num ? &batch.features[i][0] : NULL, num,
+              num ? batch.features[i].size() / num : 0);
+        }
+        free_.push(slot);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  const vector<boost::shared_ptr<FeatureSink> >& sinks_;
+  const int num_batches_;
+  vector<FeatureBatch> pool_;
+};
+
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
 
@@ -42,7 +248,10 @@ int feature_extraction_pipeline(int argc, char** argv) {
     "Note: you can extract multiple features in one pass by specifying"
     " multiple feature blob names and dataset names separated by ','."
     " The names cannot contain white space characters and the number of blobs"
-    " and datasets must be equal.";
+    " and datasets must be equal.\n"
+    "db_type is leveldb, lmdb or record for a Datum per image, or raw or"
+    " raw_fp16 for a file holding a num x dim matrix of float or half"
+    " values, after a 32 byte header.";
     return 1;
   }
   int arg_pos = num_required_args;
@@ -118,65 +327,69 @@ int feature_extraction_pipeline(int argc, char** argv) {
 
   int num_mini_batches = atoi(argv[++arg_pos]);
 
-  std::vector<boost::shared_ptr<db::DB> > feature_dbs;
-  std::vector<boost::shared_ptr<db::Transaction> > txns;
-  const char* db_type = argv[++arg_pos];
+  std::vector<boost::shared_ptr<FeatureSink> > sinks;
+  const string db_type = argv[++arg_pos];
   for (size_t i = 0; i < num_features; ++i) {
     LOG(INFO)<< "Opening dataset " << dataset_names[i];
-    boost::shared_ptr<db::DB> db(db::GetDB(db_type));
-    db->Open(dataset_names.at(i), db::NEW);
-    feature_dbs.push_back(db);
-    boost::shared_ptr<db::Transaction> txn(db->NewTransaction());
-    txns.push_back(txn);
+    if (db_type == "raw" || db_type == "raw_fp16") {
+      sinks.push_back(boost::shared_ptr<FeatureSink>(
+          new RawFeatureSink(dataset_names[i], db_type == "raw_fp16")));
+    } else {
+      const Blob<Dtype>& blob =
+          *feature_extraction_net->blob_by_name(blob_names[i]);
+      sinks.push_back(boost::shared_ptr<FeatureSink>(new DBFeatureSink(
+          dataset_names[i], db_type, blob.channels(), blob.height(),
+          blob.width())));
+    }
   }
 
   LOG(ERROR)<< "Extracting Features";
 
-  Datum datum;
-  std::vector<int> image_indices(num_features, 0);
+  // The features of a batch are copied out of the net, and written by
+  // the writer while the next batches are computed.
+  FeatureWriter writer(sinks, num_mini_batches, 4);
+  writer.StartInternalThread();
+  // Reading a timer stops it, so the rate of each ten batches is timed
+  // apart from the total, which is read once at the end.
+  caffe::CPUTimer timer, interval_timer;
+  timer.Start();
+  interval_timer.Start();
+  int num_images = 0, interval_start = 0;
   for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
     feature_extraction_net->Forward();
+    const int slot = writer.free_.pop();
+    FeatureBatch* batch = writer.batch(slot);
     for (int i = 0; i < num_features; ++i) {
       const boost::shared_ptr<Blob<Dtype> > feature_blob =
         feature_extraction_net->blob_by_name(blob_names[i]);
-      int batch_size = feature_blob->num();
-      int dim_features = feature_blob->count() / batch_size;
-      const Dtype* feature_blob_data;
-      for (int n = 0; n < batch_size; ++n) {
-        datum.set_height(feature_blob->height());
-        datum.set_width(feature_blob->width());
-        datum.set_channels(feature_blob->channels());
-        datum.clear_data();
-        datum.clear_float_data();
-        feature_blob_data = feature_blob->cpu_data() +
-            feature_blob->offset(n);
-        for (int d = 0; d < dim_features; ++d) {
-          datum.add_float_data(feature_blob_data[d]);
-        }
-        string key_str = caffe::format_int(image_indices[i], 10);
-
-        string out;
-        CHECK(datum.SerializeToString(&out));
-        txns.at(i)->Put(key_str, out);
-        ++image_indices[i];
-        if (image_indices[i] % 1000 == 0) {
-          txns.at(i)->Commit();
-          txns.at(i).reset(feature_dbs.at(i)->NewTransaction());
-          LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-              " query images for feature blob " << blob_names[i];
-        }
-      }  // for (int n = 0; n < batch_size; ++n)
-    }  // for (int i = 0; i < num_features; ++i)
+      const Dtype* feature_blob_data = feature_blob->cpu_data();
+      batch->features[i].assign(feature_blob_data,
+          feature_blob_data + feature_blob->count());
+      batch->nums[i] = feature_blob->num();
+    }
+    num_images += batch->nums[0];
+    writer.full_.push(slot);
+    if ((batch_index + 1) % 10 == 0) {
+      LOG(ERROR)<< "Extracted features of " << num_images
+          << " query images, " << (num_images - interval_start) * 1e6 /
+          interval_timer.MicroSeconds() << " images/sec";
+      interval_start = num_images;
+      interval_timer.Start();
+    }
   }  // for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index)
-  // write the last batch
+  // Once every slot is back, the writer is done.
+  for (int i = 0; i < writer.pool_size(); ++i) {
+    writer.free_.pop();
+  }
+  const double seconds = timer.MilliSeconds() / 1000.;
+  writer.StopInternalThread();
   for (int i = 0; i < num_features; ++i) {
-    if (image_indices[i] % 1000 != 0) {
-      txns.at(i)->Commit();
-    }
-    LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
+    sinks[i]->Close();
+    LOG(ERROR)<< "Extracted features of " << num_images <<
         " query images for feature blob " << blob_names[i];
-    feature_dbs.at(i)->Close();
   }
+  LOG(ERROR)<< "Extracted " << num_images << " images in " << seconds
+      << " s, " << num_images / seconds << " images/sec";
 
   LOG(ERROR)<< "Successfully extracted the features!";
   return 0;
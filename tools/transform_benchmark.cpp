@@ -0,0 +1,100 @@
+// Times the conversion of cropped 8-bit HWC images to the CHW float input of
+// a net, as done by DataTransformer, with the per-pixel loop it used to run
+// and with the single-pass TransformHWCToCHW kernel.
+// Usage:
+//    transform_benchmark [FLAGS]
+
+#include <stdint.h>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/pixel_transform.hpp"
+
+using caffe::CPUTimer;
+using std::vector;
+
+DEFINE_int32(height, 300, "Height of the crop.");
+DEFINE_int32(width, 300, "Width of the crop.");
+DEFINE_int32(channels, 3, "Number of channels.");
+DEFINE_int32(border, 16, "Extra pixels around the crop in the source image.");
+DEFINE_int32(iterations, 500, "Number of images to transform per run.");
+DEFINE_bool(mirror, true, "Mirror the images.");
+
+// The per-pixel loop of DataTransformer::Transform(const cv::Mat&, ...).
+static void ReferenceTransform(const uint8_t* src, int src_step, int height,
+    int width, int channels, bool mirror, const float* mean, float scale,
+    float* dst) {
+  for (int h = 0; h < height; ++h) {
+    const uint8_t* ptr = src + h * src_step;
+    int img_index = 0;
+    for (int w = 0; w < width; ++w) {
+      const int w_idx = mirror ? (width - 1 - w) : w;
+      for (int c = 0; c < channels; ++c) {
+        const int top_index = (c * height + h) * width + w_idx;
+        const float pixel = static_cast<float>(ptr[img_index++]);
+        if (mean) {
+          dst[top_index] = (pixel - mean[c]) * scale;
+        } else {
+          dst[top_index] = pixel * scale;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::SetUsageMessage("Benchmark the uint8 HWC to float CHW transform\n"
+        "Usage:\n"
+        "    transform_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  const int height = FLAGS_height;
+  const int width = FLAGS_width;
+  const int channels = FLAGS_channels;
+  const int step = (width + 2 * FLAGS_border) * channels;
+  vector<uint8_t> img((height + 2 * FLAGS_border) * step);
+  for (int i = 0; i < img.size(); ++i) {
+    img[i] = static_cast<uint8_t>(i * 2654435761U >> 24);
+  }
+  const uint8_t* src = &img[FLAGS_border * step + FLAGS_border * channels];
+  vector<float> mean(channels);
+  for (int c = 0; c < channels; ++c) {
+    mean[c] = 104 + 13 * c;
+  }
+  const float scale = 0.017;
+  vector<float> expected(channels * height * width);
+  vector<float> out(expected.size());
+
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    ReferenceTransform(src, step, height, width, channels, FLAGS_mirror,
+        &mean[0], scale, &expected[0]);
+  }
+  const double reference_ms = timer.MilliSeconds();
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    caffe::TransformHWCToCHW(src, step, height, width, channels, FLAGS_mirror,
+        &mean[0], scale, &out[0]);
+  }
+  const double fused_ms = timer.MilliSeconds();
+  CHECK(out == expected) << "The kernels disagree";
+
+  LOG(INFO) << "Transforming " << FLAGS_iterations << " images of "
+      << channels << "x" << height << "x" << width;
+  LOG(INFO) << "Per-pixel loop: " << FLAGS_iterations * 1000. / reference_ms
+      << " items/sec.";
+  LOG(INFO) << "Single pass:    " << FLAGS_iterations * 1000. / fused_ms
+      << " items/sec.";
+  LOG(INFO) << "Speedup: " << reference_ms / fused_ms << "x";
+  return 0;
+}